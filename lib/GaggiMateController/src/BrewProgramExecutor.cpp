@@ -0,0 +1,188 @@
+#include "BrewProgramExecutor.h"
+
+BrewProgramExecutor::BrewProgramExecutor(DimmedPump *pump, SimpleRelay *valve, const brew_program_phase_callback_t &phaseCallback)
+    : pump(pump), valve(valve), phaseCallback(phaseCallback) {}
+
+void BrewProgramExecutor::setPhase(uint8_t index, uint8_t count, const BrewProgramPhase &phase) {
+    if (running) {
+        ESP_LOGW(LOG_TAG, "Ignoring program upload while a program is running");
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    if (pending.size() != count || index == 0) {
+        pending.assign(count, BrewProgramPhase{});
+        pendingMask = 0;
+    }
+    pending[index] = phase;
+    pendingMask |= 1u << index;
+}
+
+void BrewProgramExecutor::start(uint8_t count) { requestedStart = count; }
+
+void BrewProgramExecutor::advance(uint8_t fromIndex) { requestedAdvance = fromIndex; }
+
+void BrewProgramExecutor::stop() { requestedStop = true; }
+
+void BrewProgramExecutor::abort() {
+    std::lock_guard<std::mutex> lock(loopMutex);
+    // Commands queued before the stop must not restart the program
+    requestedStart = 0;
+    requestedAdvance = -1;
+    requestedStop = false;
+    if (!running) {
+        return;
+    }
+    running = false;
+    pump->setPower(0.0f);
+    pump->setValveState(false);
+    valve->set(false);
+    ESP_LOGW(LOG_TAG, "Program aborted at phase %d", phaseIndex);
+}
+
+void BrewProgramExecutor::loop() {
+    std::lock_guard<std::mutex> loopLock(loopMutex);
+    unsigned long now = millis();
+    if (requestedStop.exchange(false) && running) {
+        // The display takes back control of the outputs, so we leave them untouched
+        running = false;
+        ESP_LOGI(LOG_TAG, "Program stopped at phase %d", phaseIndex);
+    }
+
+    uint8_t count = requestedStart.exchange(0);
+    if (count > 0) {
+        std::unique_lock<std::mutex> lock(pendingMutex);
+        if (count != pending.size() || pendingMask != (1u << count) - 1) {
+            ESP_LOGE(LOG_TAG, "Can't start incomplete program (%d phases requested, %d uploaded)", count, pending.size());
+        } else {
+            program = pending;
+            lock.unlock();
+            requestedAdvance = -1;
+            waterPumped = 0.0f;
+            targetPressure = 0.0f;
+            targetFlow = 0.0f;
+            lastLoop = now;
+            running = true;
+            enterPhase(0, now);
+        }
+    }
+
+    if (!running) {
+        return;
+    }
+
+    waterPumped += pump->getPumpFlow() * static_cast<float>(now - lastLoop) / 1000.0f;
+    lastLoop = now;
+
+    int advanceFrom = requestedAdvance.exchange(-1);
+    while (running && (advanceFrom == phaseIndex || isPhaseFinished(now))) {
+        advanceFrom = -1;
+        if (phaseIndex + 1 < program.size()) {
+            enterPhase(phaseIndex + 1, now);
+        } else {
+            finish();
+        }
+    }
+
+    if (running) {
+        applyOutputs(now);
+    }
+}
+
+void BrewProgramExecutor::enterPhase(uint8_t index, unsigned long now) {
+    const BrewProgramPhase &phase = program[index];
+    phaseIndex = index;
+    phaseStarted = now;
+    waterPumped = 0.0f;
+
+    // Same semantics as BrewProcess: adaptive transitions start from the measured values,
+    // otherwise from the previous target, and -1 targets hold the value at phase start.
+    phaseStartPressure = phase.adaptive ? pump->getPressure() : targetPressure;
+    phaseStartFlow = phase.adaptive ? pump->getPumpFlow() : targetFlow;
+    if (phase.pumpMode == BrewProgramPumpMode::POWER) {
+        effectivePressure = 0.0f;
+        effectiveFlow = 0.0f;
+    } else {
+        effectivePressure = phase.pressure == -1.0f ? phaseStartPressure : phase.pressure;
+        effectiveFlow = phase.flow == -1.0f ? phaseStartFlow : phase.flow;
+        if (phase.pumpMode == BrewProgramPumpMode::FLOW) {
+            phaseStartPressure = effectivePressure;
+        } else {
+            phaseStartFlow = effectiveFlow;
+        }
+    }
+    ESP_LOGI(LOG_TAG, "Entering phase %d", index);
+    phaseCallback(index, false);
+}
+
+bool BrewProgramExecutor::isPhaseFinished(unsigned long now) const {
+    const BrewProgramPhase &phase = program[phaseIndex];
+    unsigned long timeInPhase = now - phaseStarted;
+    if (timeInPhase > BREW_PROGRAM_SAFETY_DURATION_MS) {
+        return true;
+    }
+    for (uint8_t i = 0; i < phase.targetCount; i++) {
+        const BrewProgramTarget &target = phase.targets[i];
+        float value = 0.0f;
+        switch (target.type) {
+        case BrewProgramTargetType::PRESSURE:
+            value = pump->getPressure();
+            break;
+        case BrewProgramTargetType::FLOW:
+            value = pump->getPumpFlow();
+            break;
+        case BrewProgramTargetType::PUMPED:
+            value = waterPumped;
+            break;
+        }
+        if (target.isReached(value)) {
+            return true;
+        }
+    }
+    return phase.timeExit && static_cast<float>(timeInPhase) / 1000.0f > phase.duration;
+}
+
+void BrewProgramExecutor::applyOutputs(unsigned long now) {
+    const BrewProgramPhase &phase = program[phaseIndex];
+    if (valve->getState() != phase.valve) {
+        valve->set(phase.valve);
+    }
+    pump->setValveState(phase.valve);
+
+    if (phase.pumpMode == BrewProgramPumpMode::POWER) {
+        targetPressure = 0.0f;
+        targetFlow = 0.0f;
+        pump->setPower(phase.power);
+        return;
+    }
+
+    const float alpha = transitionAlpha(now);
+    targetPressure = phaseStartPressure + (effectivePressure - phaseStartPressure) * alpha;
+    targetFlow = phaseStartFlow + (effectiveFlow - phaseStartFlow) * alpha;
+    if (phase.pumpMode == BrewProgramPumpMode::PRESSURE) {
+        pump->setPressureTarget(targetPressure, targetFlow);
+    } else {
+        pump->setFlowTarget(targetFlow, targetPressure);
+    }
+}
+
+float BrewProgramExecutor::transitionAlpha(unsigned long now) const {
+    const BrewProgramPhase &phase = program[phaseIndex];
+    float duration = phase.transitionDuration;
+    if (duration <= 0.0f) {
+        duration = phase.duration; // If the transition has no duration, use the phase duration
+    }
+    if (phase.transition == BrewProgramTransition::INSTANT || duration <= 0.0f) {
+        return 1.0f;
+    }
+    float t = static_cast<float>(now - phaseStarted) / (duration * 1000.0f);
+    return applyBrewProgramEasing(t, phase.transition);
+}
+
+void BrewProgramExecutor::finish() {
+    running = false;
+    pump->setPower(0.0f);
+    pump->setValveState(false);
+    valve->set(false);
+    ESP_LOGI(LOG_TAG, "Program finished");
+    phaseCallback(phaseIndex, true);
+}
@@ -0,0 +1,64 @@
+#ifndef BREWPROGRAMEXECUTOR_H
+#define BREWPROGRAMEXECUTOR_H
+
+#include "BrewProgram.h"
+#include <atomic>
+#include <mutex>
+#include <peripherals/DimmedPump.h>
+#include <peripherals/SimpleRelay.h>
+#include <vector>
+
+// Runs a brew program uploaded by the display against the local pressure loop.
+// Commands arrive from the BLE task and are only applied from loop(), which is called
+// by the pump stage of the control loop right before the pressure controller updates.
+class BrewProgramExecutor {
+  public:
+    BrewProgramExecutor(DimmedPump *pump, SimpleRelay *valve, const brew_program_phase_callback_t &phaseCallback);
+
+    void setPhase(uint8_t index, uint8_t count, const BrewProgramPhase &phase);
+    void start(uint8_t count);
+    void advance(uint8_t fromIndex);
+    void stop();
+    // Safety stop from any task, returns once the program no longer drives the outputs and they are off
+    void abort();
+    void loop();
+
+    bool isRunning() const { return running; }
+
+  private:
+    void enterPhase(uint8_t index, unsigned long now);
+    bool isPhaseFinished(unsigned long now) const;
+    void applyOutputs(unsigned long now);
+    float transitionAlpha(unsigned long now) const;
+    void finish();
+
+    DimmedPump *pump;
+    SimpleRelay *valve;
+    brew_program_phase_callback_t phaseCallback;
+
+    std::mutex loopMutex;    // held by loop() and abort(), a safety stop can't interleave with applyOutputs()
+    std::mutex pendingMutex; // pending is written by the BLE task and copied by loop()
+    std::vector<BrewProgramPhase> pending;
+    uint32_t pendingMask = 0;
+    std::vector<BrewProgramPhase> program;
+
+    std::atomic<bool> running{false};
+    std::atomic<uint8_t> requestedStart{0};
+    std::atomic<int> requestedAdvance{-1};
+    std::atomic<bool> requestedStop{false};
+
+    uint8_t phaseIndex = 0;
+    unsigned long phaseStarted = 0;
+    unsigned long lastLoop = 0;
+    float waterPumped = 0.0f;
+    float phaseStartPressure = 0.0f;
+    float phaseStartFlow = 0.0f;
+    float effectivePressure = 0.0f;
+    float effectiveFlow = 0.0f;
+    float targetPressure = 0.0f;
+    float targetFlow = 0.0f;
+
+    const char *LOG_TAG = "BrewProgramExecutor";
+};
+
+#endif // BREWPROGRAMEXECUTOR_H
@@ -0,0 +1,73 @@
+#include "ControlScheduler.h"
+#include <algorithm>
+
+void ControlScheduler::addStage(const char *name, uint32_t periodMs, const control_stage_t &stage) {
+    if (periodMs % CONTROL_TICK_MS != 0) {
+        ESP_LOGW(LOG_TAG, "Period of stage %s is not a multiple of %d ms", name, CONTROL_TICK_MS);
+    }
+    stages.push_back(Stage{.name = name, .periodTicks = std::max<uint32_t>(periodMs / CONTROL_TICK_MS, 1), .run = stage});
+}
+
+void ControlScheduler::setup() {
+    lastReport = millis();
+    xTaskCreate(loopTask, "ControlScheduler::loop", CONTROL_TASK_STACK_SIZE, this, CONTROL_TASK_PRIORITY, &taskHandle);
+    ESP_LOGI(LOG_TAG, "Running %d control stages every %d ms", stages.size(), CONTROL_TICK_MS);
+}
+
+void ControlScheduler::loop() {
+    const uint32_t tickStart = micros();
+    for (auto &stage : stages) {
+        if (tick % stage.periodTicks != 0) {
+            continue;
+        }
+        const uint32_t start = micros();
+        stage.run();
+        const uint32_t elapsed = micros() - start;
+        stage.lastUs = elapsed;
+        stage.maxUs = std::max(stage.maxUs, elapsed);
+        stage.totalUs += elapsed;
+        stage.runs++;
+    }
+    tick++;
+    lastTickUs = micros() - tickStart;
+    maxTickUs = std::max(maxTickUs, lastTickUs);
+
+    if (millis() - lastReport >= CONTROL_REPORT_INTERVAL_MS) {
+        lastReport = millis();
+        report();
+    }
+}
+
+void ControlScheduler::report() {
+    ESP_LOGI(LOG_TAG, "Control loop: %u overruns, max tick %u us, %u bytes of stack unused", overruns, maxTickUs,
+             uxTaskGetStackHighWaterMark(taskHandle));
+    for (auto &stage : stages) {
+        ESP_LOGI(LOG_TAG, "  %-14s every %4u ms: last %5u us, avg %5u us, max %5u us", stage.name,
+                 stage.periodTicks * CONTROL_TICK_MS, stage.lastUs,
+                 stage.runs > 0 ? static_cast<uint32_t>(stage.totalUs / stage.runs) : 0, stage.maxUs);
+        stage.maxUs = 0;
+    }
+    maxTickUs = 0;
+    reportedOverruns = overruns;
+}
+
+void ControlScheduler::onOverrun() {
+    overruns++;
+    // Only log the first overrun of each report interval, the report contains the total
+    if (overruns == reportedOverruns + 1) {
+        ESP_LOGW(LOG_TAG, "Control tick %u missed its deadline (%u us)", tick, lastTickUs);
+    }
+}
+
+[[noreturn]] void ControlScheduler::loopTask(void *arg) {
+    auto *scheduler = static_cast<ControlScheduler *>(arg);
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        scheduler->loop();
+        // Returns pdFALSE if the next release time already passed, either because the stages took
+        // too long or because the task was preempted for too long
+        if (xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CONTROL_TICK_MS)) == pdFALSE) {
+            scheduler->onOverrun();
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CONTROLSCHEDULER_H
+#define CONTROLSCHEDULER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <functional>
+#include <vector>
+
+constexpr uint32_t CONTROL_TICK_MS = 10;
+constexpr uint32_t CONTROL_REPORT_INTERVAL_MS = 60000;
+constexpr uint32_t CONTROL_TASK_STACK_SIZE = configMINIMAL_STACK_SIZE * 8;
+constexpr UBaseType_t CONTROL_TASK_PRIORITY = 2;
+
+using control_stage_t = std::function<void()>;
+
+// Single task running all periodic control work of the board. Stages run in the order they were
+// added (sensor read, filter, controller, actuator) on every tick that is a multiple of their period,
+// so stages with the same period always see the data of the current tick.
+class ControlScheduler {
+  public:
+    void addStage(const char *name, uint32_t periodMs, const control_stage_t &stage);
+    void setup();
+    void loop();
+    void report();
+
+    uint32_t getOverruns() const { return overruns; }
+
+  private:
+    struct Stage {
+        const char *name;
+        uint32_t periodTicks;
+        control_stage_t run;
+        uint32_t lastUs = 0;
+        uint32_t maxUs = 0;
+        uint64_t totalUs = 0;
+        uint32_t runs = 0;
+    };
+
+    void onOverrun();
+
+    std::vector<Stage> stages;
+    xTaskHandle taskHandle = nullptr;
+    uint32_t tick = 0;
+    uint32_t lastTickUs = 0;
+    uint32_t maxTickUs = 0;
+    uint32_t overruns = 0;
+    uint32_t reportedOverruns = 0;
+    unsigned long lastReport = 0;
+
+    const char *LOG_TAG = "ControlScheduler";
+    static void loopTask(void *arg);
+};
+
+#endif // CONTROLSCHEDULER_H
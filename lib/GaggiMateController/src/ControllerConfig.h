@@ -28,6 +28,7 @@ struct ControllerConfig {
 
     uint8_t pressureScl = 0;
     uint8_t pressureSda = 0;
+    uint8_t pressureAlert = 0; // ADS1115 ALERT/RDY, 0 if not connected
 
     uint8_t maxSckPin;
     uint8_t maxCsPin;
@@ -23,14 +23,23 @@ void GaggiMateController::setup() {
         [this]() { thermalRunawayShutdown(); });
     this->heater = new Heater(
         this->thermocouple, _config.heaterPin, [this]() { thermalRunawayShutdown(); },
-        [this](float Kp, float Ki, float Kd) { _ble.sendAutotuneResult(Kp, Ki, Kd); });
+        [this](float Kp, float Ki, float Kd) { _ble.sendAutotuneResult(Kp, Ki, Kd); },
+        [this](int progress) { _ble.sendAutotuneProgress(progress); });
+    this->heater->setTrace(&trace);
     this->valve = new SimpleRelay(_config.valvePin, _config.valveOn);
     this->alt = new SimpleRelay(_config.altPin, _config.altOn);
     if (_config.capabilites.pressure) {
-        pressureSensor = new PressureSensor(_config.pressureSda, _config.pressureScl, [this](float pressure) { /* noop */ });
+        pressureSensor = new PressureSensor(_config.pressureSda, _config.pressureScl, _config.pressureAlert,
+                                            [this](float pressure) { /* noop */ });
     }
     if (_config.capabilites.dimming) {
-        pump = new DimmedPump(_config.pumpPin, _config.pumpSensePin, pressureSensor);
+        auto dimmedPump = new DimmedPump(_config.pumpPin, _config.pumpSensePin, pressureSensor);
+        brewProgramExecutor = new BrewProgramExecutor(dimmedPump, valve, [this](uint8_t phaseIndex, bool finished) {
+            _ble.sendBrewProgramState(phaseIndex, finished);
+        });
+        dimmedPump->setControlCallback([this]() { brewProgramExecutor->loop(); });
+        dimmedPump->setTrace(&trace);
+        pump = dimmedPump;
     } else {
         pump = new SimplePump(_config.pumpPin, _config.pumpOn, _config.capabilites.ssrPump ? 1000.0f : 5000.0f);
     }
@@ -68,14 +77,18 @@ void GaggiMateController::setup() {
     if (_config.capabilites.tof) {
         this->distanceSensor->setup();
     }
+    setupControlLoop();
 
     // Initialize last ping time
     lastPingTime = millis();
 
     _ble.registerOutputControlCallback([this](bool valve, float pumpSetpoint, float heaterSetpoint) {
+        this->heater->setSetpoint(heaterSetpoint);
+        if (isBrewProgramRunning()) {
+            return;
+        }
         this->pump->setPower(pumpSetpoint);
         this->valve->set(valve);
-        this->heater->setSetpoint(heaterSetpoint);
         if (!_config.capabilites.dimming) {
             return;
         }
@@ -84,8 +97,11 @@ void GaggiMateController::setup() {
     });
     _ble.registerAdvancedOutputControlCallback(
         [this](bool valve, float heaterSetpoint, bool pressureTarget, float pressure, float flow) {
-            this->valve->set(valve);
             this->heater->setSetpoint(heaterSetpoint);
+            if (isBrewProgramRunning()) {
+                return;
+            }
+            this->valve->set(valve);
             if (!_config.capabilites.dimming) {
                 return;
             }
@@ -114,7 +130,12 @@ void GaggiMateController::setup() {
         lastPingTime = millis();
         ESP_LOGV(LOG_TAG, "Ping received, system is alive");
     });
-    _ble.registerAutotuneCallback([this](int goal, int windowSize) { this->heater->autotune(goal, windowSize); });
+    _ble.registerControlTraceCallback([this](int mode) { requestedTraceMode = mode; });
+    _ble.registerAutotuneCallback([this](int goal, int windowSize, int method) {
+        auto autotuneMethod = method == AUTOTUNE_METHOD_RELAY ? Autotune::Method::RELAY : Autotune::Method::STEP_RESPONSE;
+        this->heater->autotune(goal, windowSize, autotuneMethod);
+    });
+    _ble.registerAutotuneAbortCallback([this]() { this->heater->abortAutotune(); });
     _ble.registerTareCallback([this]() {
         if (!_config.capabilites.dimming) {
             return;
@@ -122,6 +143,24 @@ void GaggiMateController::setup() {
         auto dimmedPump = static_cast<DimmedPump *>(pump);
         dimmedPump->tare();
     });
+    if (brewProgramExecutor != nullptr) {
+        _ble.registerBrewProgramUploadCallback([this](uint8_t index, uint8_t count, const BrewProgramPhase &phase) {
+            brewProgramExecutor->setPhase(index, count, phase);
+        });
+        _ble.registerBrewProgramControlCallback([this](BrewProgramCommand command, uint8_t value) {
+            switch (command) {
+            case BrewProgramCommand::START:
+                brewProgramExecutor->start(value);
+                break;
+            case BrewProgramCommand::ADVANCE:
+                brewProgramExecutor->advance(value);
+                break;
+            case BrewProgramCommand::STOP:
+                brewProgramExecutor->stop();
+                break;
+            }
+        });
+    }
     ESP_LOGI(LOG_TAG, "Initialization done");
 }
 
@@ -131,6 +170,8 @@ void GaggiMateController::loop() {
         handlePingTimeout();
     }
     sendSensorData();
+    drainControlTrace();
+    heater->savePreferences();
     delay(250);
 }
 
@@ -162,7 +203,11 @@ void GaggiMateController::detectAddon() {
 
 void GaggiMateController::handlePingTimeout() {
     ESP_LOGE(LOG_TAG, "Ping timeout detected. Turning off heater and pump for safety.\n");
+    if (brewProgramExecutor != nullptr) {
+        brewProgramExecutor->abort();
+    }
     // Turn off the heater and pump as a safety measure
+    this->heater->abortAutotune();
     this->heater->setSetpoint(0);
     this->pump->setPower(0);
     this->valve->set(false);
@@ -171,7 +216,11 @@ void GaggiMateController::handlePingTimeout() {
 
 void GaggiMateController::thermalRunawayShutdown() {
     ESP_LOGE(LOG_TAG, "Thermal runaway detected! Turning off heater and pump!\n");
+    if (brewProgramExecutor != nullptr) {
+        brewProgramExecutor->abort();
+    }
     // Turn off the heater and pump immediately
+    this->heater->abortAutotune();
     this->heater->setSetpoint(0);
     this->pump->setPower(0);
     this->valve->set(false);
@@ -179,13 +228,69 @@ void GaggiMateController::thermalRunawayShutdown() {
     _ble.sendError(ERROR_CODE_RUNAWAY);
 }
 
+void GaggiMateController::setupControlLoop() {
+    // Stages run in this order on every tick: sensor reads, then filters and controllers, then actuators
+    if (_config.capabilites.pressure) {
+        scheduler.addStage("pressure", PRESSURE_READ_INTERVAL_MS, [this]() { pressureSensor->loop(); });
+    }
+    scheduler.addStage("pump", _config.capabilites.dimming ? DIMMED_PUMP_UPDATE_INTERVAL_MS : SIMPLE_PUMP_UPDATE_INTERVAL_MS,
+                       [this]() { pump->loop(); });
+    scheduler.addStage("thermocouple", MAX31855_UPDATE_INTERVAL, [this]() { thermocouple->loop(); });
+    scheduler.addStage("heater", HEATER_UPDATE_INTERVAL_MS, [this]() {
+        if (_config.capabilites.dimming) {
+            heater->setPumpFlow(static_cast<DimmedPump *>(pump)->getPumpFlow());
+        }
+        heater->loop();
+    });
+    scheduler.addStage("brew button", INPUT_CHECK_INTERVAL_MS, [this]() { brewBtn->loop(); });
+    scheduler.addStage("steam button", INPUT_CHECK_INTERVAL_MS, [this]() { steamBtn->loop(); });
+    if (_config.capabilites.tof) {
+        scheduler.addStage("distance", DISTANCE_READ_INTERVAL_MS, [this]() { distanceSensor->loop(); });
+    }
+    scheduler.setup();
+}
+
+void GaggiMateController::drainControlTrace() {
+    // Mode changes are applied here since enabling the trace has to happen on the reading side
+    const int mode = requestedTraceMode;
+    if (mode != traceMode) {
+        traceMode = mode;
+        trace.setEnabled(mode != CONTROL_TRACE_MODE_OFF);
+        ESP_LOGI(LOG_TAG, "Control trace mode set to %d", mode);
+    }
+    if (traceMode == CONTROL_TRACE_MODE_OFF) {
+        return;
+    }
+    ControlTraceRecord records[CONTROL_TRACE_BATCH_SIZE];
+    size_t count;
+    while ((count = trace.read(records, CONTROL_TRACE_BATCH_SIZE)) > 0) {
+        const auto *data = reinterpret_cast<const uint8_t *>(records);
+        const size_t length = count * sizeof(ControlTraceRecord);
+        if (traceMode == CONTROL_TRACE_MODE_SERIAL) {
+            // Frame the records so they can be told apart from log output
+            Serial.write(CONTROL_TRACE_SERIAL_MAGIC, sizeof(CONTROL_TRACE_SERIAL_MAGIC));
+            Serial.write(static_cast<uint8_t>(count));
+            Serial.write(data, length);
+        } else {
+            _ble.sendControlTrace(data, length);
+        }
+    }
+    if (trace.getDropped() > 0) {
+        ESP_LOGV(LOG_TAG, "Control trace dropped %u records", trace.getDropped());
+    }
+}
+
+bool GaggiMateController::isBrewProgramRunning() const {
+    return brewProgramExecutor != nullptr && brewProgramExecutor->isRunning();
+}
+
 void GaggiMateController::sendSensorData() {
     if (_config.capabilites.pressure) {
         auto dimmedPump = static_cast<DimmedPump *>(pump);
         _ble.sendSensorData(this->thermocouple->read(), this->pressureSensor->getPressure(), dimmedPump->getPuckFlow(),
-                            dimmedPump->getPumpFlow());
+                            dimmedPump->getPumpFlow(), dimmedPump->getPower());
         _ble.sendVolumetricMeasurement(dimmedPump->getCoffeeVolume());
     } else {
-        _ble.sendSensorData(this->thermocouple->read(), 0.0f, 0.0f, 0.0f);
+        _ble.sendSensorData(this->thermocouple->read(), 0.0f, 0.0f, 0.0f, 0.0f);
     }
 }
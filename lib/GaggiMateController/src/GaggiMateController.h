@@ -1,5 +1,7 @@
 #ifndef GAGGIMATECONTROLLER_H
 #define GAGGIMATECONTROLLER_H
+#include "BrewProgramExecutor.h"
+#include "ControlScheduler.h"
 #include "ControllerConfig.h"
 #include "NimBLEServerController.h"
 #include <peripherals/DigitalInput.h>
@@ -13,6 +15,8 @@
 #include <vector>
 
 constexpr double PING_TIMEOUT_SECONDS = 20.0;
+constexpr size_t CONTROL_TRACE_BATCH_SIZE = 3; // Records per notification, fits the 128 byte MTU
+constexpr uint8_t CONTROL_TRACE_SERIAL_MAGIC[] = {'G', 'T'};
 
 constexpr int DETECT_EN_PIN = 40;
 constexpr int DETECT_VALUE_PIN = 11;
@@ -33,9 +37,14 @@ class GaggiMateController {
     void startPidAutotune(void);
     void stopPidAutotune(void);
     void sendSensorData(void);
+    void setupControlLoop(void);
+    void drainControlTrace(void);
+    bool isBrewProgramRunning() const;
 
     ControllerConfig _config = ControllerConfig{};
     NimBLEServerController _ble;
+    ControlScheduler scheduler;
+    ControlTrace trace;
 
     Max31855Thermocouple *thermocouple = nullptr;
     Heater *heater = nullptr;
@@ -47,10 +56,13 @@ class GaggiMateController {
     PressureSensor *pressureSensor = nullptr;
     LedController *ledController = nullptr;
     DistanceSensor *distanceSensor = nullptr;
+    BrewProgramExecutor *brewProgramExecutor = nullptr;
 
     std::vector<ControllerConfig> configs;
 
     unsigned long lastPingTime = 0;
+    volatile int requestedTraceMode = CONTROL_TRACE_MODE_OFF;
+    int traceMode = CONTROL_TRACE_MODE_OFF;
 
     const char *LOG_TAG = "GaggiMateController";
 };
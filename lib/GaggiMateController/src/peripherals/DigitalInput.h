@@ -16,11 +16,9 @@ class DigitalInput {
   private:
     uint8_t _pin;
     uint8_t _last_state = HIGH;
-    xTaskHandle taskHandle;
     input_callback_t _callback;
 
     const char *LOG_TAG = "Heater";
-    static void loopTask(void *arg);
 };
 
 #endif // DIGITALINPUT_H
@@ -1,10 +1,12 @@
 #include "DimmedPump.h"
 
 #include <GaggiMateController.h>
+#include <algorithm>
 
 DimmedPump::DimmedPump(uint8_t ssr_pin, uint8_t sense_pin, PressureSensor *pressure_sensor)
     : _ssr_pin(ssr_pin), _sense_pin(sense_pin), _psm(_sense_pin, _ssr_pin, 100, FALLING, 2, 4), _pressureSensor(pressure_sensor),
-      _pressureController(0.03f, &_ctrlPressure, &_ctrlFlow, &_currentPressure, &_controllerPower, &_valveStatus) {
+      _pressureController(DIMMED_PUMP_UPDATE_INTERVAL_MS / 1000.0f, &_ctrlPressure, &_ctrlFlow, &_currentPressure,
+                          &_controllerPower, &_valveStatus) {
     _psm.set(0);
 }
 
@@ -13,11 +15,14 @@ void DimmedPump::setup() {
     if (_cps > 70) {
         _cps = _cps / 2;
     }
-    xTaskCreate(loopTask, "DimmedPump::loop", configMINIMAL_STACK_SIZE * 4, this, 1, &taskHandle);
 }
 
 void DimmedPump::loop() {
     _currentPressure = _pressureSensor->getRawPressure();
+    updateDt();
+    if (_controlCallback != nullptr) {
+        _controlCallback();
+    }
     updatePower();
     _currentFlow = 0.1f * (_pressureController.getPumFlowRate() * 1000000.0f) + 0.9f * _currentFlow;
 }
@@ -40,18 +45,24 @@ float DimmedPump::getPumpFlow() { return _currentFlow; }
 
 float DimmedPump::getPuckFlow() { return _pressureController.getCoffeeFlowRate(); }
 
+float DimmedPump::getPressure() { return _pressureController.getFilteredPressure(); }
+
 void DimmedPump::tare() {
     _pressureController.tare();
     _pressureController.reset();
 }
 
-void DimmedPump::loopTask(void *arg) {
-    auto *pump = static_cast<DimmedPump *>(arg);
-    TickType_t lastWake = xTaskGetTickCount();
-    while (true) {
-        pump->loop();
-        xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(30));
+void DimmedPump::updateDt() {
+    // The controller integrates and differentiates over the time between the samples it sees. The ADC decimation
+    // doesn't line up with the update interval, now and then a sample is skipped or the sensor stalls.
+    const float nominal = DIMMED_PUMP_UPDATE_INTERVAL_MS / 1000.0f;
+    const uint32_t sampleTime = _pressureSensor->getSampleTime();
+    float dt = nominal;
+    if (_lastSampleTime != 0 && sampleTime != _lastSampleTime) {
+        dt = std::clamp(static_cast<float>(sampleTime - _lastSampleTime) / 1e6f, MIN_DT_RATIO * nominal, MAX_DT_RATIO * nominal);
     }
+    _lastSampleTime = sampleTime;
+    _pressureController.setDt(dt);
 }
 
 void DimmedPump::updatePower() {
@@ -78,6 +89,8 @@ void DimmedPump::setPressureTarget(float targetPressure, float flowLimit) {
 
 void DimmedPump::setValveState(bool open) { _valveStatus = open; }
 
+void DimmedPump::setTrace(ControlTrace *trace) { _pressureController.setTrace(trace); }
+
 void DimmedPump::setPumpFlowCoeff(float oneBarFlow, float nineBarFlow) {
     _pressureController.setPumpFlowCoeff(oneBarFlow, nineBarFlow);
 }
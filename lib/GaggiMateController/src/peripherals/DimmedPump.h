@@ -5,6 +5,11 @@
 #include "PressureSensor.h"
 #include "Pump.h"
 #include <Arduino.h>
+#include <functional>
+
+constexpr int DIMMED_PUMP_UPDATE_INTERVAL_MS = 30;
+
+using pump_control_callback_t = std::function<void()>;
 
 class DimmedPump : public Pump {
   public:
@@ -20,6 +25,8 @@ class DimmedPump : public Pump {
     float getCoffeeVolume();
     float getPumpFlow();
     float getPuckFlow();
+    float getPressure();
+    float getPower() const { return _power; }
     void tare();
 
     void setFlowTarget(float targetFlow, float pressureLimit);
@@ -29,6 +36,9 @@ class DimmedPump : public Pump {
     void stop();
     void fullPower();
     void setValveState(bool open);
+    void setTrace(ControlTrace *trace);
+    // Called every cycle right before the pressure controller updates
+    void setControlCallback(const pump_control_callback_t &callback) { _controlCallback = callback; }
 
   private:
     uint8_t _ssr_pin;
@@ -36,7 +46,7 @@ class DimmedPump : public Pump {
     PSM _psm;
     PressureSensor *_pressureSensor;
     PressureController _pressureController;
-    xTaskHandle taskHandle;
+    pump_control_callback_t _controlCallback = nullptr;
 
     ControlMode _mode = ControlMode::POWER;
     float _power = 0.0f;
@@ -46,6 +56,7 @@ class DimmedPump : public Pump {
     float _currentPressure = 0.0f;
     float _currentFlow = 0.0f;
     float _lastPressure = 0.0f;
+    uint32_t _lastSampleTime = 0;
     int _valveStatus = 0;
     int _cps = MAX_FREQ;
 
@@ -54,12 +65,15 @@ class DimmedPump : public Pump {
     static constexpr float BASE_FLOW_RATE = 0.25f;
     static constexpr float MAX_PRESSURE = 15.0f;
     static constexpr float MAX_FREQ = 60.0f;
+    // Bounds of a measured sample interval, relative to the nominal update interval
+    static constexpr float MIN_DT_RATIO = 0.5f;
+    static constexpr float MAX_DT_RATIO = 2.0f;
 
     void updatePower();
+    void updateDt();
     void onPressureUpdate(float pressure);
 
     const char *LOG_TAG = "DimmedPump";
-    static void loopTask(void *arg);
 };
 
 #endif // DIMMEDPUMP_H
@@ -10,7 +10,6 @@ void DistanceSensor::setup() {
     tof->setTimingBudget(100000);
     tof->startMeasurement();
     tof->startNextMeasurement();
-    xTaskCreate(loopTask, "DistanceSensor::loop", configMINIMAL_STACK_SIZE * 4, this, 1, &taskHandle);
 }
 
 void DistanceSensor::loop() {
@@ -35,12 +34,3 @@ void DistanceSensor::loop() {
         tof->startNextMeasurement();
     }
 }
-
-void DistanceSensor::loopTask(void *arg) {
-    auto *sensor = static_cast<DistanceSensor *>(arg);
-    TickType_t lastWake = xTaskGetTickCount();
-    while (true) {
-        sensor->loop();
-        xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(50));
-    }
-}
@@ -5,25 +5,25 @@
 #include <PWFusion_VL53L3C.h>
 #include <Wire.h>
 
+constexpr int DISTANCE_READ_INTERVAL_MS = 50;
+
 using distance_callback_t = std::function<void(int)>;
 
 class DistanceSensor {
   public:
     DistanceSensor(TwoWire *wire, distance_callback_t callback);
     void setup();
+    void loop();
 
   private:
-    void loop();
 
     TwoWire *i2c;
     VL53L3C *tof;
-    xTaskHandle taskHandle;
     distance_callback_t _callback;
     int measurements = 0;
     int currentMillis = 0;
 
     const char *LOG_TAG = "DistanceSensor";
-    static void loopTask(void *arg);
 };
 
 #endif // DISTANCESENSOR_H
@@ -1,10 +1,14 @@
 #include "Heater.h"
 #include <Arduino.h>
+#include <Clock/Clock.h>
 #include <algorithm>
 
+Heater *Heater::instance = nullptr;
+
 Heater::Heater(TemperatureSensor *sensor, uint8_t heaterPin, const heater_error_callback_t &error_callback,
-               const pid_result_callback_t &pid_callback)
-    : sensor(sensor), heaterPin(heaterPin), taskHandle(nullptr), error_callback(error_callback), pid_callback(pid_callback) {
+               const pid_result_callback_t &pid_callback, const autotune_progress_callback_t &progress_callback)
+    : sensor(sensor), heaterPin(heaterPin), error_callback(error_callback), pid_callback(pid_callback),
+      progress_callback(progress_callback) {
 
     simplePid = new SimplePID(&output, &temperature, &setpoint);
     autotuner = new Autotune();
@@ -12,8 +16,15 @@ Heater::Heater(TemperatureSensor *sensor, uint8_t heaterPin, const heater_error_
 
 void Heater::setup() {
     pinMode(heaterPin, OUTPUT);
+    preferences.begin("heater", false);
+    flowFeedForward.setGain(preferences.getFloat("ffGain", FLOW_FF_DEFAULT_GAIN));
+    ESP_LOGI(LOG_TAG, "Flow feedforward gain: %.3f", flowFeedForward.getGain());
     setupPid();
-    xTaskCreate(loopTask, "Heater::loop", configMINIMAL_STACK_SIZE * 4, this, 1, &taskHandle);
+    instance = this;
+    timer = timerBegin(HEATER_TIMER_NUM, 80, true); // 1 MHz
+    timerAttachInterrupt(timer, &Heater::onTimer, true);
+    timerAlarmWrite(timer, HEATER_TICK_US, true);
+    timerAlarmEnable(timer);
 }
 
 void Heater::setupPid() {
@@ -24,24 +35,49 @@ void Heater::setupPid() {
     simplePid->reset();
 }
 
-void Heater::setupAutotune(int goal, int windowSize) {
+void Heater::setupAutotune(int goal, int windowSize, Autotune::Method method) {
+    autotuner->setMethod(method);
     autotuner->setWindowsize(windowSize);
     autotuner->setEpsilon(0.1f);
     autotuner->setRequiredConfirmations(3);
+    autotuner->setRelay(AUTOTUNE_RELAY_TARGET, AUTOTUNE_RELAY_HYSTERESIS, AUTOTUNE_RELAY_CYCLES);
     autotuner->setTuningGoal(goal);
     autotuner->reset();
 }
 
 void Heater::loop() {
-    if (!sensor->isErrorState() && autotuning) {
-        loopAutotune();
-        return;
+    if (autotuneAbortRequested) {
+        autotuneAbortRequested = false;
+        autotuneRequested = false;
+        if (autotuning) {
+            ESP_LOGI(LOG_TAG, "Autotuning aborted");
+            stopAutotune();
+        }
+    }
+    if (autotuneRequested) {
+        autotuneRequested = false;
+        if (!autotuning && !sensor->isErrorState()) {
+            setupAutotune(requestedGoal, requestedWindowSize, requestedMethod);
+            simplePid->setMode(SimplePID::Control::manual);
+            autotuning = true;
+            lastAutotuneSample = 0;
+            lastAutotuneProgress = 0;
+            progress_callback(0);
+        }
+    }
+    if (autotuning) {
+        if (sensor->isErrorState()) {
+            ESP_LOGE(LOG_TAG, "Autotuning aborted due to a sensor error");
+            stopAutotune();
+        } else {
+            loopAutotune();
+            return;
+        }
     }
 
     if (sensor->isErrorState() || setpoint <= 0.0f) {
         simplePid->setMode(SimplePID::Control::manual);
-        digitalWrite(heaterPin, LOW);
-        relayStatus = false;
+        duty = 0;
         temperature = sensor->read();
         return;
     }
@@ -52,6 +88,10 @@ void Heater::loop() {
 
 void Heater::setSetpoint(float setpoint) {
     if (this->setpoint != setpoint) {
+        if (autotuning && setpoint > 0.0f) {
+            // A new target means the user wants to use the machine, the tuning result would be meaningless
+            abortAutotune();
+        }
         this->setpoint = setpoint;
         ESP_LOGV(LOG_TAG, "Set setpoint %f°C", setpoint);
     }
@@ -65,48 +105,74 @@ void Heater::setTunings(float Kp, float Ki, float Kd) {
     }
 }
 
-void Heater::autotune(int goal, int windowSize) {
-    setupAutotune(goal, windowSize);
-    autotuning = true;
+void Heater::setTrace(ControlTrace *trace) { simplePid->setTrace(trace, ControlTraceSource::HEATER_PID); }
+
+void Heater::autotune(int goal, int windowSize, Autotune::Method method) {
+    requestedGoal = goal;
+    requestedWindowSize = windowSize;
+    requestedMethod = method;
+    autotuneRequested = true;
 }
 
+void Heater::abortAutotune() { autotuneAbortRequested = true; }
+
 void Heater::loopPid() {
-    softPwm(TUNER_OUTPUT_SPAN);
     temperature = sensor->read();
+    updateFlowFeedForward();
+    learnFlowFeedForward();
     if (simplePid->update()) {
+        updateDuty();
         plot(output, 1.0f, 1);
     }
 }
 
 void Heater::loopAutotune() {
-    simplePid->setMode(SimplePID::Control::manual);
-    autotuner->reset();
-    long microseconds;
-    long loopInterval = (static_cast<long>(TUNER_OUTPUT_SPAN) - 1L) * 1000L;
-    while (!autotuner->isFinished()) {
-        microseconds = micros();
-        temperature = sensor->read();
-        output = 0.0f;
-        if (autotuner->maxPowerOn) {
-            output = TUNER_OUTPUT_SPAN;
-        }
-        ESP_LOGI(LOG_TAG, "Autotuner Cycle: Temperature=%.2f", temperature);
-        autotuner->update(temperature, millis() / 1000.0f);
-        while (micros() - microseconds < loopInterval) {
-            softPwm(TUNER_OUTPUT_SPAN);
-            vTaskDelay(1 / portTICK_PERIOD_MS);
-        }
-        if (temperature > MAX_AUTOTUNE_TEMP) {
-            output = 0.0f;
-            autotuning = false;
-            softPwm(TUNER_OUTPUT_SPAN);
-            pid_callback(0, 0, 0);
-            return;
-        }
+    // The autotuner expects one sample per output span, the heater loop runs faster than that
+    const unsigned long now = Clock::get().millis();
+    if (lastAutotuneSample != 0 && now - lastAutotuneSample < static_cast<unsigned long>(TUNER_OUTPUT_SPAN)) {
+        return;
+    }
+    lastAutotuneSample = now;
+
+    temperature = sensor->read();
+    if (temperature > MAX_AUTOTUNE_TEMP) {
+        ESP_LOGE(LOG_TAG, "Autotuning aborted, temperature %.2f exceeds the limit", temperature);
+        stopAutotune();
+        return;
+    }
+    ESP_LOGI(LOG_TAG, "Autotuner Cycle: Temperature=%.2f", temperature);
+    autotuner->update(temperature, now / 1000.0f);
+    if (autotuner->isFinished()) {
+        finishAutotune();
+        return;
+    }
+    output = autotuner->getOutput() * TUNER_OUTPUT_SPAN;
+    updateDuty();
+
+    const int progress = autotuner->getProgress();
+    if (progress != lastAutotuneProgress) {
+        lastAutotuneProgress = progress;
+        progress_callback(progress);
     }
+}
+
+void Heater::stopAutotune() {
     output = 0.0f;
     autotuning = false;
-    softPwm(TUNER_OUTPUT_SPAN);
+    updateDuty();
+    progress_callback(AUTOTUNE_PROGRESS_FAILED);
+}
+
+void Heater::finishAutotune() {
+    if (autotuner->hasFailed()) {
+        ESP_LOGE(LOG_TAG, "Autotuning failed to identify the system");
+        stopAutotune();
+        return;
+    }
+    output = 0.0f;
+    autotuning = false;
+    updateDuty();
+    progress_callback(100);
 
     pid_callback(autotuner->getKp() * 1000.0f, autotuner->getKi() * 1000.0f, autotuner->getKd() * 1000.0f);
 
@@ -118,29 +184,48 @@ void Heater::loopAutotune() {
              autotuner->getSystemGain(), autotuner->getCrossoverFreq() / 2);
 }
 
-float Heater::softPwm(uint32_t windowSize) {
-    // software PWM timer
-    unsigned long msNow = millis();
-    if (msNow - windowStartTime >= windowSize) {
-        windowStartTime = msNow;
+void Heater::updateFlowFeedForward() {
+    simplePid->setDisturbanceFeedForward(flowFeedForward.getOutput(pumpFlow, setpoint) * TUNER_OUTPUT_SPAN);
+}
+
+void Heater::learnFlowFeedForward() {
+    if (!flowFeedForward.learn(pumpFlow, setpoint, temperature, Clock::get().millis())) {
+        return;
     }
-    float optimumOutput = output;
+    flowFeedForwardChanged = true;
+    ESP_LOGI(LOG_TAG, "Shot mean temperature error %.2f°C, flow feedforward gain is now %.3f",
+             flowFeedForward.getLastShotError(), flowFeedForward.getGain());
+}
 
-    // PWM relay output
-    if (!relayStatus && static_cast<unsigned long>(optimumOutput) > (msNow - windowStartTime)) {
-        if (msNow > nextSwitchTime) {
-            nextSwitchTime = msNow;
-            relayStatus = true;
-            digitalWrite(heaterPin, HIGH);
-        }
-    } else if (relayStatus && static_cast<unsigned long>(optimumOutput) < (msNow - windowStartTime)) {
-        if (msNow > nextSwitchTime) {
-            nextSwitchTime = msNow;
-            relayStatus = false;
-            digitalWrite(heaterPin, LOW);
-        }
+void Heater::savePreferences() {
+    if (!flowFeedForwardChanged) {
+        return;
+    }
+    flowFeedForwardChanged = false;
+    preferences.putFloat("ffGain", flowFeedForward.getGain());
+}
+
+void Heater::updateDuty() {
+    float ratio = std::clamp(output / TUNER_OUTPUT_SPAN, 0.0f, 1.0f);
+    duty = static_cast<uint32_t>(ratio * static_cast<float>(HEATER_DUTY_RESOLUTION));
+}
+
+void IRAM_ATTR Heater::onTimer() {
+    Heater *heater = instance;
+    if (heater == nullptr) {
+        return;
+    }
+    // Burst fire: a first order sigma-delta spreads the on half-cycles evenly instead of switching
+    // once per output window. Integer only since the FPU can't be used from an ISR.
+    heater->dutyAccumulator += heater->duty;
+    const bool on = heater->dutyAccumulator >= HEATER_DUTY_RESOLUTION;
+    if (on) {
+        heater->dutyAccumulator -= HEATER_DUTY_RESOLUTION;
+    }
+    if (on != heater->relayStatus) {
+        heater->relayStatus = on;
+        digitalWrite(heater->heaterPin, on ? HIGH : LOW);
     }
-    return optimumOutput;
 }
 
 void Heater::plot(float optimumOutput, float outputScale, uint8_t everyNth) {
@@ -151,11 +236,3 @@ void Heater::plot(float optimumOutput, float outputScale, uint8_t everyNth) {
         plotCount++;
 }
 
-void Heater::loopTask(void *arg) {
-    TickType_t lastWake = xTaskGetTickCount();
-    auto *heater = static_cast<Heater *>(arg);
-    while (true) {
-        heater->loop();
-        xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(10));
-    }
-}
@@ -1,8 +1,12 @@
 #ifndef HEATER_H
 #define HEATER_H
 #include "Autotune/Autotune.h"
+#include "FlowFeedForward/FlowFeedForward.h"
 #include "Max31855Thermocouple.h"
+#include "NimBLEComm.h"
 #include "TemperatureSensor.h"
+#include <Arduino.h>
+#include <Preferences.h>
 #include <SimplePID/SimplePID.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -11,37 +15,60 @@ enum class PIDLibrary { Legacy, Nimrod };
 
 constexpr float MAX_AUTOTUNE_TEMP = 125.0f;
 constexpr float TUNER_OUTPUT_SPAN = 1000.0f;
+constexpr int HEATER_UPDATE_INTERVAL_MS = 250;
+// The SSR is driven from a hardware timer, one tick per mains half-cycle at 50 Hz
+constexpr uint8_t HEATER_TIMER_NUM = 3;
+constexpr uint64_t HEATER_TICK_US = 10000;
+constexpr uint32_t HEATER_DUTY_RESOLUTION = 10000;
+// Relay feedback autotuning oscillates around a typical brew temperature
+constexpr float AUTOTUNE_RELAY_TARGET = 93.0f;
+constexpr float AUTOTUNE_RELAY_HYSTERESIS = 0.5f;
+constexpr unsigned int AUTOTUNE_RELAY_CYCLES = 4;
 
 using heater_error_callback_t = std::function<void()>;
 using pid_result_callback_t = std::function<void(float Kp, float Ki, float Kd)>;
+using autotune_progress_callback_t = std::function<void(int progress)>;
 
 class Heater {
   public:
     Heater(TemperatureSensor *sensor, uint8_t heaterPin, const heater_error_callback_t &error_callback,
-           const pid_result_callback_t &pid_callback);
+           const pid_result_callback_t &pid_callback, const autotune_progress_callback_t &progress_callback);
     void setup();
     void loop();
 
     void setSetpoint(float setpoint);
     void setTunings(float Kp, float Ki, float Kd);
-    void autotune(int goal, int windowSize);
+    void autotune(int goal, int windowSize, Autotune::Method method);
+    void abortAutotune();
+    bool isAutotuning() const { return autotuning; }
+    void setTrace(ControlTrace *trace);
+    void setPumpFlow(float flow) { pumpFlow = flow; }
+    float getFlowFeedForwardGain() const { return flowFeedForward.getGain(); }
+    // Writes a learned gain to NVS, called from the main loop since a flash write stalls the control loop
+    void savePreferences();
 
   private:
     void setupPid();
-    void setupAutotune(int goal, int windowSize);
+    void setupAutotune(int goal, int windowSize, Autotune::Method method);
     void loopPid();
     void loopAutotune();
-    float softPwm(uint32_t windowSize);
+    void finishAutotune();
+    void stopAutotune();
+    void updateDuty();
+    void updateFlowFeedForward();
+    void learnFlowFeedForward();
     void plot(float optimumOutput, float outputScale, uint8_t everyNth);
     void setTuningGoal(float percent);
     TemperatureSensor *sensor;
     uint8_t heaterPin;
-    xTaskHandle taskHandle;
+    hw_timer_t *timer = nullptr;
     SimplePID *simplePid = nullptr;
     Autotune *autotuner = nullptr;
+    Preferences preferences;
 
     heater_error_callback_t error_callback;
     pid_result_callback_t pid_callback;
+    autotune_progress_callback_t progress_callback;
 
     float temperature = 0.0f;
     float output = 0.0f;
@@ -51,16 +78,31 @@ class Heater {
     float Kd = 10;
     int plotCount = 0;
 
+    // Flow feedforward, the gain is adapted after every shot from the mean temperature error
+    float pumpFlow = 0.0f;
+    FlowFeedForward flowFeedForward;
+    volatile bool flowFeedForwardChanged = false;
+
+    // Shared with the timer ISR
+    volatile uint32_t duty = 0;
+    uint32_t dutyAccumulator = 0;
     bool relayStatus = false;
-    unsigned long windowStartTime = 0;
-    unsigned long nextSwitchTime = 0;
 
     // Autotune variables
     bool startup = true;
     bool autotuning = false;
+    unsigned long lastAutotuneSample = 0;
+    int lastAutotuneProgress = 0;
+    // Requests arrive from the bluetooth task and are picked up by the control loop
+    volatile bool autotuneRequested = false;
+    volatile bool autotuneAbortRequested = false;
+    int requestedGoal = 0;
+    int requestedWindowSize = 0;
+    Autotune::Method requestedMethod = Autotune::Method::STEP_RESPONSE;
 
     const char *LOG_TAG = "Heater";
-    static void loopTask(void *arg);
+    static void onTimer();
+    static Heater *instance;
 };
 
 #endif // HEATER_H
@@ -6,7 +6,7 @@
 Max31855Thermocouple::Max31855Thermocouple(const int csPin, const int misoPin, const int sckPin,
                                            const temperature_callback_t &callback,
                                            const temperature_error_callback_t &error_callback)
-    : taskHandle(nullptr), csPin(csPin), misoPin(misoPin), sckPin(sckPin) {
+    : csPin(csPin), misoPin(misoPin), sckPin(sckPin) {
     max31855 = new MAX31855(csPin, misoPin, sckPin);
     this->callback = callback;
     this->error_callback = error_callback;
@@ -22,8 +22,6 @@ void Max31855Thermocouple::setup() {
     digitalWrite(csPin, HIGH);
     max31855->begin();
     max31855->setSPIspeed(1000000);
-
-    xTaskCreate(monitorTask, "Max31855Thermocouple::monitor", configMINIMAL_STACK_SIZE * 4, this, 1, &taskHandle);
 }
 
 void Max31855Thermocouple::loop() {
@@ -50,12 +48,3 @@ void Max31855Thermocouple::loop() {
     ESP_LOGV(LOG_TAG, "Updated temperature: %2f\n", temperature);
     callback(temperature);
 }
-
-[[noreturn]] void Max31855Thermocouple::monitorTask(void *arg) {
-    TickType_t lastWake = xTaskGetTickCount();
-    auto *thermocouple = static_cast<Max31855Thermocouple *>(arg);
-    while (true) {
-        thermocouple->loop();
-        xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(MAX31855_UPDATE_INTERVAL));
-    }
-}
@@ -25,7 +25,6 @@ class Max31855Thermocouple : public TemperatureSensor {
 
   private:
     MAX31855 *max31855;
-    xTaskHandle taskHandle;
 
     float errors = .0f;
     float temperature = .0f;
@@ -38,7 +37,6 @@ class Max31855Thermocouple : public TemperatureSensor {
     temperature_error_callback_t error_callback;
 
     const char *LOG_TAG = "Max31855Thermocouple";
-    static void monitorTask(void *arg);
 };
 
 #endif // MAX31855THERMOCOUPLE_H
@@ -1,9 +1,9 @@
 #include "PressureSensor.h"
 #include "Wire.h"
 
-PressureSensor::PressureSensor(uint8_t sda_pin, uint8_t scl_pin, const pressure_callback_t &callback, float pressure_scale,
-                               float voltage_floor, float voltage_ceil)
-    : _sda_pin(sda_pin), _scl_pin(scl_pin), _pressure_scale(pressure_scale), _callback(callback), taskHandle(nullptr) {
+PressureSensor::PressureSensor(uint8_t sda_pin, uint8_t scl_pin, uint8_t alert_pin, const pressure_callback_t &callback,
+                               float pressure_scale, float voltage_floor, float voltage_ceil)
+    : _sda_pin(sda_pin), _scl_pin(scl_pin), _alert_pin(alert_pin), _pressure_scale(pressure_scale), _callback(callback) {
     _adc_floor = static_cast<int16_t>(voltage_floor / ADC_STEP);
     _pressure_adc_range = (voltage_ceil - voltage_floor) / ADC_STEP;
     _pressure_step = pressure_scale / _pressure_adc_range;
@@ -18,25 +18,45 @@ void PressureSensor::setup() {
         ESP_LOGE(LOG_TAG, "Failed to initialize ADS1115");
     }
     ads->setGain(0);
-    ads->setDataRate(4);
-    ads->setMode(0);
-    ads->readADC(0);
-    xTaskCreate(loopTask, "Heater::loop", configMINIMAL_STACK_SIZE * 4, this, 1, &taskHandle);
+    ads->setDataRate(PRESSURE_ADC_DATA_RATE);
+    ads->setMode(0); // Continuous conversion, results are fetched with getValue() without waiting
+    if (_alert_pin != 0) {
+        // Conversion ready mode: ALERT/RDY pulses low after every conversion
+        ads->setComparatorThresholdHigh(0x8000);
+        ads->setComparatorThresholdLow(0x0000);
+        ads->setComparatorQueConvert(0);
+    }
+    ads->requestADC(0);
+
+    xTaskCreate(samplerTask, "PressureSensor::sample", PRESSURE_SAMPLER_STACK_SIZE, this, PRESSURE_SAMPLER_PRIORITY,
+                &_sampler_task);
+    if (_alert_pin != 0) {
+        pinMode(_alert_pin, INPUT_PULLUP);
+        attachInterruptArg(digitalPinToInterrupt(_alert_pin), &PressureSensor::onDataReady, this, FALLING);
+    }
 }
 
 void PressureSensor::loop() {
-    if (ads->isConnected()) {
-        int16_t reading = ads->readADC();
-        reading = reading - _adc_floor;
-        float pressure = reading * _pressure_step;
-        _raw_pressure = pressure;
-        _pressure = 0.05f * pressure + 0.95f * _pressure;
-        _raw_pressure = std::clamp(_raw_pressure, 0.0f, _pressure_scale);
-        _pressure = std::clamp(_pressure, 0.0f, _pressure_scale);
-        ESP_LOGV(LOG_TAG, "ADC Reading: %d, Pressure Reading: %f, Pressure Step: %f, Floor: %d", reading, _pressure,
-                 _pressure_step, _adc_floor);
-        _callback(_pressure);
+    portENTER_CRITICAL(&_sample_lock);
+    const uint32_t count = _sample_count;
+    const float value = _sample_value;
+    const uint32_t timestamp = _sample_timestamp;
+    portEXIT_CRITICAL(&_sample_lock);
+    if (count == _consumed_count) {
+        return; // No new sample since the last run
     }
+    _consumed_count = count;
+    _sample_time = timestamp;
+
+    float reading = value - static_cast<float>(_adc_floor);
+    float pressure = reading * _pressure_step;
+    _raw_pressure = pressure;
+    _pressure = 0.05f * pressure + 0.95f * _pressure;
+    _raw_pressure = std::clamp(_raw_pressure, 0.0f, _pressure_scale);
+    _pressure = std::clamp(_pressure, 0.0f, _pressure_scale);
+    ESP_LOGV(LOG_TAG, "ADC Reading: %.1f, Pressure Reading: %f, Pressure Step: %f, Floor: %d", reading, _pressure,
+             _pressure_step, _adc_floor);
+    _callback(_pressure);
 }
 
 void PressureSensor::setScale(float pressure_scale) {
@@ -44,11 +64,55 @@ void PressureSensor::setScale(float pressure_scale) {
     _pressure_step = pressure_scale / _pressure_adc_range;
 }
 
-[[noreturn]] void PressureSensor::loopTask(void *arg) {
-    TickType_t lastWake = xTaskGetTickCount();
+void PressureSensor::addConversion(int16_t value, uint32_t timestamp) {
+    if (_decimation_count == 0) {
+        _decimation_start = timestamp;
+    }
+    _decimation_sum += value;
+    _decimation_count++;
+    if (_decimation_count < PRESSURE_DECIMATION) {
+        return;
+    }
+    // Boxcar average, stamped with the center of the averaged window
+    portENTER_CRITICAL(&_sample_lock);
+    _sample_value = static_cast<float>(_decimation_sum) / PRESSURE_DECIMATION;
+    _sample_timestamp = _decimation_start + (timestamp - _decimation_start) / 2;
+    _sample_count++;
+    portEXIT_CRITICAL(&_sample_lock);
+    _decimation_sum = 0;
+    _decimation_count = 0;
+}
+
+void PressureSensor::samplerTask(void *arg) {
     auto *sensor = static_cast<PressureSensor *>(arg);
+    TickType_t lastWake = xTaskGetTickCount();
     while (true) {
-        sensor->loop();
-        xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(PRESSURE_READ_INTERVAL_MS));
+        uint32_t timestamp;
+        if (sensor->_alert_pin != 0) {
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PRESSURE_ALERT_TIMEOUT_MS)) == 0) {
+                ESP_LOGW(sensor->LOG_TAG, "No conversion ready signal from the ADS1115");
+                continue;
+            }
+            timestamp = sensor->_ready_time;
+        } else {
+            // Without ALERT/RDY the task is paced to the conversion rate instead
+            xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(PRESSURE_ADC_SAMPLE_PERIOD_MS));
+            timestamp = micros();
+        }
+        // Check the connection once per decimation window instead of on every conversion
+        if (sensor->_decimation_count == 0 && !sensor->ads->isConnected()) {
+            continue;
+        }
+        sensor->addConversion(sensor->ads->getValue(), timestamp);
+    }
+}
+
+void IRAM_ATTR PressureSensor::onDataReady(void *arg) {
+    auto *sensor = static_cast<PressureSensor *>(arg);
+    sensor->_ready_time = micros();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(sensor->_sampler_task, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
     }
 }
@@ -3,39 +3,72 @@
 
 #include <ADS1X15.h>
 #include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 constexpr int PRESSURE_READ_INTERVAL_MS = 30;
 constexpr float ADC_STEP = 6.144f / 32767.0f;
+// The ADC converts continuously at 250 SPS. As many conversions as fit into one read interval are averaged into
+// a sample (7, every 28 ms), so each pressure stage tick finds a sample it hasn't seen yet.
+constexpr uint8_t PRESSURE_ADC_DATA_RATE = 5;
+constexpr int PRESSURE_ADC_SAMPLE_PERIOD_MS = 4;
+constexpr uint8_t PRESSURE_DECIMATION = PRESSURE_READ_INTERVAL_MS / PRESSURE_ADC_SAMPLE_PERIOD_MS;
+constexpr int PRESSURE_ALERT_TIMEOUT_MS = 100;
+constexpr uint32_t PRESSURE_SAMPLER_STACK_SIZE = configMINIMAL_STACK_SIZE * 4;
+constexpr UBaseType_t PRESSURE_SAMPLER_PRIORITY = 3;
 
 using pressure_callback_t = std::function<void(float)>;
 
 class PressureSensor {
   public:
-    PressureSensor(uint8_t sda_pin, uint8_t scl_pin, const pressure_callback_t &callback, float pressure_scale = 16.0f,
-                   float voltage_floor = 0.5, float voltage_ceil = 4.5);
+    // alert_pin is the ADS1115 ALERT/RDY pin, 0 if it isn't connected
+    PressureSensor(uint8_t sda_pin, uint8_t scl_pin, uint8_t alert_pin, const pressure_callback_t &callback,
+                   float pressure_scale = 16.0f, float voltage_floor = 0.5, float voltage_ceil = 4.5);
     ~PressureSensor() = default;
 
     void setup();
     void loop();
     inline float getPressure() const { return _pressure; };
     inline float getRawPressure() const { return _raw_pressure; };
+    // Time in micros of the center of the conversions averaged into the current pressure, DimmedPump steps the pressure
+    // controller by the difference between consecutive samples
+    inline uint32_t getSampleTime() const { return _sample_time; };
     void setScale(float pressure_scale);
 
   private:
+    void addConversion(int16_t value, uint32_t timestamp);
+
     uint8_t _sda_pin;
     uint8_t _scl_pin;
+    uint8_t _alert_pin;
     float _pressure = 0.0f;
     float _raw_pressure = 0.0f;
+    uint32_t _sample_time = 0;
     float _pressure_adc_range;
     float _pressure_scale;
     float _pressure_step;
     int16_t _adc_floor;
     ADS1115 *ads = nullptr;
     pressure_callback_t _callback;
-    xTaskHandle taskHandle;
+
+    // Owned by the sampler task
+    TaskHandle_t _sampler_task = nullptr;
+    volatile uint32_t _ready_time = 0;
+    int32_t _decimation_sum = 0;
+    uint8_t _decimation_count = 0;
+    uint32_t _decimation_start = 0;
+
+    // Latest decimated sample, handed over to the control loop
+    portMUX_TYPE _sample_lock = portMUX_INITIALIZER_UNLOCKED;
+    float _sample_value = 0.0f;
+    uint32_t _sample_timestamp = 0;
+    uint32_t _sample_count = 0;
+    uint32_t _consumed_count = 0;
 
     const char *LOG_TAG = "PressureSensor";
-    static void loopTask(void *arg);
+
+    static void samplerTask(void *arg);
+    static void onDataReady(void *arg);
 };
 
 #endif // PRESSURESENSOR_H
@@ -1,12 +1,11 @@
 #include "SimplePump.h"
 
 SimplePump::SimplePump(int pin, uint8_t pumpOn, float windowSize)
-    : _pin(pin), _pumpOn(pumpOn), _windowSize(windowSize), taskHandle(nullptr) {}
+    : _pin(pin), _pumpOn(pumpOn), _windowSize(windowSize) {}
 
 void SimplePump::setup() {
     pinMode(_pin, OUTPUT);
     digitalWrite(_pin, !_pumpOn);
-    xTaskCreate(loopTask, "SimplePump::loop", configMINIMAL_STACK_SIZE * 8, this, 1, &taskHandle);
 }
 
 void SimplePump::loop() {
@@ -57,11 +56,3 @@ void SimplePump::setPower(float setpoint) {
         relayStatus = true;
     }
 }
-
-void SimplePump::loopTask(void *arg) {
-    auto *pump = static_cast<SimplePump *>(arg);
-    while (true) {
-        pump->loop();
-        vTaskDelay(25 / portTICK_PERIOD_MS);
-    }
-}
@@ -4,6 +4,8 @@
 #include "Pump.h"
 #include <Arduino.h>
 
+constexpr int SIMPLE_PUMP_UPDATE_INTERVAL_MS = 20;
+
 class SimplePump : public Pump {
   public:
     SimplePump(int pin, uint8_t pumpOn, float windowSize = 5000.0f);
@@ -21,10 +23,8 @@ class SimplePump : public Pump {
     float _windowSize = 5000.0f;
     unsigned long windowStartTime = 0;
     unsigned long nextSwitchTime = 0;
-    xTaskHandle taskHandle;
 
     const char *LOG_TAG = "SimplePump";
-    static void loopTask(void *arg);
 };
 
 #endif // SIMPLEPUMP_H
@@ -13,6 +13,7 @@ inline String make_system_info(ControllerConfig config) {
     capabilities["dm"] = config.capabilites.dimming;
     capabilities["led"] = config.capabilites.ledControls;
     capabilities["tof"] = config.capabilites.tof;
+    capabilities["bp"] = config.capabilites.dimming;
     doc["cp"] = capabilities;
     return doc.as<String>();
 }
@@ -0,0 +1,28 @@
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+// Minimal subset of the Arduino core used by the control library, so it can be built and profiled on the host
+// (see the native environment in platformio.ini). Never included on the target.
+// Deterministic runs install a VirtualClock (Clock/Clock.h) instead of relying on this wall clock.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#ifndef constrain
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#endif
+
+inline unsigned long micros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return static_cast<unsigned long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+inline unsigned long millis() { return micros() / 1000UL; }
+
+#endif // ARDUINO_STUB_H
@@ -1,5 +1,9 @@
 #include "Autotune.h"
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <ArduinoStub.h>
+#endif
 #include <algorithm>
 #include <cmath>
 #include <cstring>
@@ -18,12 +22,59 @@ void Autotune::reset() {
     finished = false;
     initialSlope = 0.0f;
     maxPowerOn = false;
+    failed = false;
+    startPowerOnTime = -1.0f;
+    relayOn = false;
+    relayStartTime = -1.0f;
+    lastSwitchOnTime = -1.0f;
+    cycleMax = -INFINITY;
+    cycleMin = INFINITY;
+    completedCycles = 0;
+    amplitudeSum = 0.0f;
+    periodSum = 0.0f;
 }
 
 void Autotune::update(float temperature, float currentTime) {
     // Check if the autotune process is finished
     if (finished)
         return;
+    lastTemperature = temperature;
+    if (method == Method::RELAY) {
+        updateRelay(temperature, currentTime);
+    } else {
+        updateStepResponse(temperature, currentTime);
+    }
+}
+
+float Autotune::getOutput() const {
+    if (finished) {
+        return 0.0f;
+    }
+    if (method == Method::RELAY) {
+        return relayOn ? 1.0f : 0.0f;
+    }
+    return maxPowerOn ? 1.0f : 0.0f;
+}
+
+int Autotune::getProgress() const {
+    if (finished) {
+        return 100;
+    }
+    if (method == Method::RELAY) {
+        return static_cast<int>(completedCycles * 100 / (relayCycles + 2));
+    }
+    if (!maxPowerOn) {
+        return 0;
+    }
+    if (!reactionDetected) {
+        return 10;
+    }
+    // The maximum slope is only accepted once the temperature rose by 10°C
+    float rise = std::clamp((lastTemperature - initialTemp) / 10.0f, 0.0f, 1.0f);
+    return 20 + static_cast<int>(rise * 70.0f);
+}
+
+void Autotune::updateStepResponse(float temperature, float currentTime) {
     if (values.empty())
         initialTemp = temperature;
 
@@ -45,8 +96,10 @@ void Autotune::update(float temperature, float currentTime) {
             } else {
                 // Waiting for the reaction to be detected
                 currentConfirmations = 0;
-                if (currentTime - startPowerOnTime > maxTimeOut_s)
+                if (currentTime - startPowerOnTime > maxTimeOut_s) {
+                    failed = true;
                     finished = true;
+                }
             }
         } else {
             slopes.push_back(slope);
@@ -84,6 +137,71 @@ void Autotune::update(float temperature, float currentTime) {
     }
 }
 
+void Autotune::updateRelay(float temperature, float currentTime) {
+    if (relayStartTime < 0.0f) {
+        relayStartTime = currentTime;
+        relayOn = temperature < relayTarget;
+    }
+    if (currentTime - relayStartTime > maxRelayDuration_s) {
+        failed = true;
+        finished = true;
+        return;
+    }
+    cycleMax = std::max(cycleMax, temperature);
+    cycleMin = std::min(cycleMin, temperature);
+
+    if (relayOn && temperature > relayTarget + relayHysteresis) {
+        relayOn = false;
+    } else if (!relayOn && temperature < relayTarget - relayHysteresis) {
+        relayOn = true;
+        // A full oscillation lies between two switch-on events
+        if (lastSwitchOnTime >= 0.0f) {
+            completedCycles++;
+            // The first cycle still contains the heat-up from the starting temperature
+            if (completedCycles > 1) {
+                amplitudeSum += (cycleMax - cycleMin) / 2.0f;
+                periodSum += currentTime - lastSwitchOnTime;
+            }
+        }
+        lastSwitchOnTime = currentTime;
+        cycleMax = temperature;
+        cycleMin = temperature;
+
+        if (completedCycles > relayCycles) {
+            computeRelayGains(amplitudeSum / relayCycles, periodSum / relayCycles);
+            finished = true;
+        }
+    }
+}
+
+void Autotune::computeRelayGains(float amplitude, float period) {
+    // Describing function of a relay with hysteresis, the output swings between 0 and 1 (d = 0.5)
+    const float d = 0.5f;
+    const float a = amplitude > relayHysteresis ? std::sqrt(amplitude * amplitude - relayHysteresis * relayHysteresis)
+                                                 : amplitude;
+    if (a <= 0.0f || period <= 0.0f) {
+        failed = true;
+        return;
+    }
+    const float ku = 4.0f * d / (M_PI * a);
+    const float tu = period;
+
+    // Ziegler-Nichols rules, blended from the classic PID (aggressive) to the no overshoot rule (conservative)
+    const float conservative = tuningPercentage / 100.0f;
+    const float kp = ku * (0.6f - 0.4f * conservative);
+    const float ti = tu / 2.0f;
+    const float td = tu / 8.0f;
+
+    Kp = kp;
+    Ki = kp / ti;
+    Kd = kp * td * 0.35f; // Same derivative reduction as the step response method
+    Kff = 0.0f;
+
+    system_gain = ku;
+    cross_freq = 1.0f / tu;
+    system_pure_delay = 0.0f;
+}
+
 void Autotune::computeControllerGains(float delay, float gain) {
     // Compute the controller gains based on the system delay and gain
     // This is a simple implementation of the Ziegler-Nichols method for PID tuning
@@ -157,6 +275,12 @@ void Autotune::setRequiredConfirmations(unsigned int confirmations) { requiredCo
 
 void Autotune::setTimeOut(float timeOut) { maxTimeOut_s = timeOut; }
 
+void Autotune::setRelay(float target, float hysteresis, unsigned int cycles) {
+    relayTarget = target;
+    relayHysteresis = hysteresis;
+    relayCycles = std::max(cycles, 1u);
+}
+
 bool Autotune::isFinished() const { return finished; }
 float Autotune::getKp() const { return Kp; }
 float Autotune::getKi() const { return Ki; }
@@ -1,16 +1,25 @@
 #pragma once
 
+#include <cmath>
 #include <deque>
 #include <functional>
 
 class Autotune {
   public:
+    // STEP_RESPONSE identifies delay and slope of a full power step,
+    // RELAY runs an Åström–Hägglund relay experiment around the relay target
+    enum class Method { STEP_RESPONSE, RELAY };
+
     Autotune();
 
     void reset();
+    // Call once per sample, the output requested for the next sample is available from getOutput()
     void update(float temperature, float currentTime);
 
     bool isFinished() const;
+    bool hasFailed() const { return failed; }
+    float getOutput() const; // 0 = off, 1 = full power
+    int getProgress() const; // 0-100
 
     float getKp() const;
     float getKi() const;
@@ -22,6 +31,9 @@ class Autotune {
     void setRequiredConfirmations(unsigned int confirmations);
     void setTimeOut(float timeOut);
     void setTuningGoal(float percentage);
+    void setMethod(Method method) { this->method = method; }
+    void setRelay(float target, float hysteresis, unsigned int cycles);
+    void setRelayTimeOut(float timeOut) { maxRelayDuration_s = timeOut; }
     bool maxPowerOn = false; // Flag to indicate if system should be turned on with maximum power
 
     float getSystemDelay() const { return system_pure_delay; }
@@ -31,6 +43,12 @@ class Autotune {
   private:
     float computeSlope(const std::deque<float> &x, const std::deque<float> &y);
     void computeControllerGains(float system_pure_delay, float system_gain);
+    void updateStepResponse(float temperature, float currentTime);
+    void updateRelay(float temperature, float currentTime);
+    void computeRelayGains(float amplitude, float period);
+
+    Method method = Method::STEP_RESPONSE;
+    bool failed = false;
 
     unsigned int N = 4;   // Size of the moving window to compute the derivative of temperature
     float epsilon = 0.4f; // Temperature variation threshold to detect the reaction
@@ -48,6 +66,21 @@ class Autotune {
     float initialSlope;
     float maxTimeOut_s = 20; // (s) Maximum time to wait for the reaction to be detected before giving up
 
+    // Relay experiment
+    float relayTarget = 95.0f;
+    float relayHysteresis = 0.5f;
+    unsigned int relayCycles = 4;      // Cycles used for the estimate, the first cycle after heat-up is discarded
+    float maxRelayDuration_s = 1800;   // (s) Give up if the oscillation doesn't settle in time
+    bool relayOn = false;
+    float relayStartTime = -1.0f;
+    float lastSwitchOnTime = -1.0f;
+    float cycleMax = -INFINITY;
+    float cycleMin = INFINITY;
+    unsigned int completedCycles = 0;  // Including the discarded one
+    float amplitudeSum = 0.0f;
+    float periodSum = 0.0f;
+    float lastTemperature = 0.0f;
+
     float system_pure_delay = 0.0f;
     float system_gain = 0.0f;
     float cross_freq = 0.0f;
@@ -0,0 +1,82 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <ArduinoStub.h>
+#endif
+#include <cstdint>
+
+// Time source of the control and process code. The firmware runs on the real clock, simulations and replays install
+// a VirtualClock they advance themselves, or an AcceleratedClock to run faster than real time.
+// Like millis() and micros(), readings wrap around and must only be compared by difference.
+class Clock {
+  public:
+    virtual ~Clock() = default;
+
+    virtual unsigned long millis() const = 0;
+    virtual unsigned long micros() const = 0;
+
+    // The installed clock, the real one unless another one was set
+    static Clock &get() { return *current(); }
+    // The clock must outlive its use, nullptr restores the real clock
+    static void set(Clock *clock);
+
+  private:
+    static Clock &realClock();
+    static Clock *&current();
+};
+
+class RealClock : public Clock {
+  public:
+    unsigned long millis() const override { return ::millis(); }
+    unsigned long micros() const override { return ::micros(); }
+};
+
+// Only moves when advanced, runs are deterministic and as fast as the code under test
+class VirtualClock : public Clock {
+  public:
+    explicit VirtualClock(uint64_t startMicros = 0) : now(startMicros) {}
+
+    unsigned long millis() const override { return static_cast<unsigned long>(now / 1000ULL); }
+    unsigned long micros() const override { return static_cast<unsigned long>(now); }
+    void advanceMicros(uint64_t us) { now += us; }
+    void advanceMillis(uint64_t ms) { now += ms * 1000ULL; }
+    void setMillis(uint64_t ms) { now = ms * 1000ULL; }
+
+  private:
+    uint64_t now;
+};
+
+// Real time scaled by a factor from the moment it is created
+class AcceleratedClock : public Clock {
+  public:
+    explicit AcceleratedClock(double factor) : factor(factor), startMillis(::millis()), startMicros(::micros()) {}
+
+    unsigned long millis() const override {
+        return startMillis + static_cast<unsigned long>(static_cast<double>(::millis() - startMillis) * factor);
+    }
+    unsigned long micros() const override {
+        return startMicros + static_cast<unsigned long>(static_cast<double>(::micros() - startMicros) * factor);
+    }
+
+  private:
+    double factor;
+    unsigned long startMillis;
+    unsigned long startMicros;
+};
+
+inline Clock &Clock::realClock() {
+    static RealClock clock;
+    return clock;
+}
+
+inline Clock *&Clock::current() {
+    static Clock *clock = &realClock();
+    return clock;
+}
+
+inline void Clock::set(Clock *clock) { current() = clock != nullptr ? clock : &realClock(); }
+
+#endif // CLOCK_H
@@ -0,0 +1,46 @@
+#include "ControlTrace.h"
+#include "Clock/Clock.h"
+
+void ControlTrace::setEnabled(bool enabled) {
+    if (enabled && !this->enabled.load(std::memory_order_relaxed)) {
+        // Start with an empty buffer, only the reader may move the tail
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+        dropped.store(0, std::memory_order_relaxed);
+    }
+    this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void ControlTrace::record(ControlTraceSource source, float setpoint, float measurement, float p, float i, float d, float ff,
+                          float output) {
+    if (!isEnabled()) {
+        return;
+    }
+    const uint32_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead - tail.load(std::memory_order_acquire) >= CONTROL_TRACE_CAPACITY) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ControlTraceRecord &record = records[currentHead & (CONTROL_TRACE_CAPACITY - 1)];
+    record.timestamp = Clock::get().micros();
+    record.source = static_cast<uint8_t>(source);
+    record.setpoint = setpoint;
+    record.measurement = measurement;
+    record.p = p;
+    record.i = i;
+    record.d = d;
+    record.ff = ff;
+    record.output = output;
+    head.store(currentHead + 1, std::memory_order_release);
+}
+
+size_t ControlTrace::read(ControlTraceRecord *out, size_t maxRecords) {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    const uint32_t currentHead = head.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (currentTail != currentHead && count < maxRecords) {
+        out[count++] = records[currentTail & (CONTROL_TRACE_CAPACITY - 1)];
+        currentTail++;
+    }
+    tail.store(currentTail, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef CONTROL_TRACE_H
+#define CONTROL_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t CONTROL_TRACE_CAPACITY = 256; // Must be a power of two
+
+enum class ControlTraceSource : uint8_t { HEATER_PID, PRESSURE_CONTROLLER, HYDRAULIC_ESTIMATOR };
+
+// One control step, sent as is over the wire (little endian, 36 bytes).
+// Field meaning per source:
+//  HEATER_PID:          filtered setpoint, temperature, P, I, D, feedforward, output
+//  PRESSURE_CONTROLLER: filtered setpoint, filtered pressure, sliding term, integral term, error derivative,
+//                       setpoint derivative, pump power
+//  HYDRAULIC_ESTIMATOR: pump flow (ml/s), measured pressure, estimated pressure, puck conductance,
+//                       conductance covariance, innovation, converged (0/1)
+struct __attribute__((packed)) ControlTraceRecord {
+    uint32_t timestamp; // micros
+    uint8_t source;
+    uint8_t reserved[3];
+    float setpoint;
+    float measurement;
+    float p;
+    float i;
+    float d;
+    float ff;
+    float output;
+};
+
+// Lock-free single producer / single consumer ring buffer. The control loop is the only producer,
+// records are dropped while the buffer is full so the producer never waits on the reader.
+// Recording costs a single relaxed load while tracing is disabled.
+class ControlTrace {
+  public:
+    // Must be called from the reading side since enabling discards unread records
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void record(ControlTraceSource source, float setpoint, float measurement, float p, float i, float d, float ff,
+                float output);
+    size_t read(ControlTraceRecord *out, size_t maxRecords);
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+  private:
+    ControlTraceRecord records[CONTROL_TRACE_CAPACITY]{};
+    std::atomic<uint32_t> head{0}; // written by the producer
+    std::atomic<uint32_t> tail{0}; // written by the consumer
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<bool> enabled{false};
+};
+
+#endif // CONTROL_TRACE_H
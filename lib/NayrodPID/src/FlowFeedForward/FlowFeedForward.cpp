@@ -0,0 +1,41 @@
+#include "FlowFeedForward.h"
+#include <algorithm>
+
+float FlowFeedForward::getOutput(float pumpFlow, float setpoint) const {
+    // Power needed to bring the water pumped into the boiler up to the setpoint
+    const float heatLoad = pumpFlow * WATER_HEAT_CAPACITY * std::max(setpoint - INLET_WATER_TEMP, 0.0f);
+    return gain * heatLoad / HEATER_NOMINAL_POWER_W;
+}
+
+bool FlowFeedForward::learn(float pumpFlow, float setpoint, float temperature, unsigned long now) {
+    if (pumpFlow > FLOW_FF_FLOW_THRESHOLD) {
+        if (!shotActive) {
+            shotActive = true;
+            shotValid = true;
+            shotStart = now;
+            shotSetpoint = setpoint;
+            shotErrorSum = 0.0f;
+            shotSamples = 0;
+        }
+        // Profiles changing the temperature mid-shot would skew the error
+        if (setpoint != shotSetpoint) {
+            shotValid = false;
+        }
+        shotErrorSum += setpoint - temperature;
+        shotSamples++;
+        return false;
+    }
+    if (!shotActive) {
+        return false;
+    }
+    shotActive = false;
+    if (!shotValid || shotSamples == 0 || now - shotStart < FLOW_FF_MIN_SHOT_MS) {
+        return false;
+    }
+    // A remaining sag means the heat load was under-compensated, an overshoot means it was over-compensated
+    lastShotError = shotErrorSum / static_cast<float>(shotSamples);
+    setGain(gain + FLOW_FF_LEARNING_RATE * lastShotError);
+    return true;
+}
+
+void FlowFeedForward::setGain(float gain) { this->gain = std::clamp(gain, FLOW_FF_MIN_GAIN, FLOW_FF_MAX_GAIN); }
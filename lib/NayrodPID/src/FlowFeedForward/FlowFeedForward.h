@@ -0,0 +1,42 @@
+#ifndef FLOWFEEDFORWARD_H
+#define FLOWFEEDFORWARD_H
+
+// Feedforward for the heat drawn by the cold inlet water while the pump is running
+constexpr float HEATER_NOMINAL_POWER_W = 1200.0f;
+constexpr float WATER_HEAT_CAPACITY = 4.186f; // J/(g*K)
+constexpr float INLET_WATER_TEMP = 25.0f;
+constexpr float FLOW_FF_DEFAULT_GAIN = 1.0f; // Fraction of the theoretical heat load that is compensated
+constexpr float FLOW_FF_MIN_GAIN = 0.0f;
+constexpr float FLOW_FF_MAX_GAIN = 2.0f;
+constexpr float FLOW_FF_LEARNING_RATE = 0.05f; // Gain change per °C of mean temperature sag during a shot
+constexpr float FLOW_FF_FLOW_THRESHOLD = 0.5f; // ml/s
+constexpr unsigned long FLOW_FF_MIN_SHOT_MS = 10000;
+
+// Heat load of the pumped water as a fraction of the nominal heater power, with a gain adapted after every shot
+// from the mean temperature error. Has no clock or storage of its own so it runs the same on the host.
+class FlowFeedForward {
+  public:
+    explicit FlowFeedForward(float gain = FLOW_FF_DEFAULT_GAIN) { setGain(gain); }
+
+    // Fraction of the nominal heater power, flow in ml/s
+    float getOutput(float pumpFlow, float setpoint) const;
+    // Call once per heater update, returns true when a finished shot changed the gain
+    bool learn(float pumpFlow, float setpoint, float temperature, unsigned long now);
+
+    float getGain() const { return gain; }
+    void setGain(float gain);
+    // Mean setpoint minus temperature of the last shot that was learned from
+    float getLastShotError() const { return lastShotError; }
+
+  private:
+    float gain = FLOW_FF_DEFAULT_GAIN;
+    bool shotActive = false;
+    bool shotValid = false;
+    unsigned long shotStart = 0;
+    float shotSetpoint = 0.0f;
+    float shotErrorSum = 0.0f;
+    unsigned int shotSamples = 0;
+    float lastShotError = 0.0f;
+};
+
+#endif // FLOWFEEDFORWARD_H
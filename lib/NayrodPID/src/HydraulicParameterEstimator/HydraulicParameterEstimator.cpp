@@ -14,6 +14,7 @@ HydraulicParameterEstimator::HydraulicParameterEstimator(float dt_)
 
 void HydraulicParameterEstimator::reset() {
     counter = 0;
+    pressureFilter.reset();
     K_est = K_est_init;
     X_state[0] = 1e-4f; // P
     X_state[1] = K_est; // k
@@ -30,35 +31,21 @@ bool HydraulicParameterEstimator::hasConverged() {
 }
 
 bool HydraulicParameterEstimator::updateFilteredPressure(float P_raw) {
-    static std::deque<float> buffer;
-
-    constexpr int N = 5;
-    constexpr float smooth_coeffs[N] = {-3, 12, 17, 12, -3};
-    constexpr float deriv_coeffs[N] = {-2, -1, 0, 1, 2};
-
-    buffer.push_back(P_raw);
-    if (buffer.size() < N)
+    if (!pressureFilter.push(P_raw))
         return false;
-    if (buffer.size() > N)
-        buffer.pop_front();
-
-    float smooth = 0.0f, deriv = 0.0f;
-    for (int i = 0; i < N; ++i) {
-        smooth += smooth_coeffs[i] * buffer[i];
-        deriv += deriv_coeffs[i] * buffer[i];
-    }
 
-    P_filtered = smooth / 35.0f;
-    dPdt_filtered = deriv / (10.0f * dt);
+    P_filtered = pressureFilter.getValue();
+    dPdt_filtered = pressureFilter.getDerivative(dt);
     return true;
 }
 
 bool HydraulicParameterEstimator::update(float Q_in, float P_raw) {
     counter++;
-    // if (!updateFilteredPressure(P_raw)) return false;
+    // The EKF already accounts for measurement noise and the filter lags by half a window, so it runs on the raw
+    // pressure. The smoothed pressure and its derivative are kept up to date alongside.
+    updateFilteredPressure(P_raw);
 
-    P_filtered = P_raw;
-    float P_meas = P_filtered;
+    float P_meas = P_raw;
     if (P_meas < 0.3f)
         return false;
 
@@ -118,5 +105,10 @@ bool HydraulicParameterEstimator::update(float Q_in, float P_raw) {
     K_est = std::max(X_state[1], 0.0f);
     // Serial.printf("%.2e\n",K_est);
 
+    if (trace != nullptr) {
+        trace->record(ControlTraceSource::HYDRAULIC_ESTIMATOR, Q_in * 1e6f, P_meas, X_state[0], K_est, P_cov[1][1], y_residual,
+                      hasConverged() ? 1.0f : 0.0f);
+    }
+
     return true;
 }
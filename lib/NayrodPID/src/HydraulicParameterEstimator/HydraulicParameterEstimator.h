@@ -1,9 +1,12 @@
 #ifndef HYDRAULICPARAMETERESTIMATOR_H
 #define HYDRAULICPARAMETERESTIMATOR_H
 
-#include <deque>
+#include "ControlTrace/ControlTrace.h"
+#include "SavGolFilter/SavGolFilter.h"
 #include <math.h>
 
+constexpr size_t HYDRAULIC_PRESSURE_FILTER_WINDOW = 5;
+
 class HydraulicParameterEstimator {
   public:
     HydraulicParameterEstimator(float dt_ = 0.03f);
@@ -14,14 +17,16 @@ class HydraulicParameterEstimator {
     bool hasConverged();
     float getResistance() { return K_est; };
     float getCovariance() { return P_cov[1][1]; };
+    void setTrace(ControlTrace *trace) { this->trace = trace; };
+    void setDt(float dt_) { dt = dt_; };
 
     float C_fixed;
     float K_est_init;
     float K_est;
 
     // Valeurs filtrées
-    float P_filtered;
-    float dPdt_filtered;
+    float P_filtered = 0.0f;
+    float dPdt_filtered = 0.0f;
     float R_filtered;
     float dRdt_filtered;
 
@@ -38,6 +43,8 @@ class HydraulicParameterEstimator {
     float dt;
     float epsilon = 1e-12f;
     int counter;
+    SavGolFilter<HYDRAULIC_PRESSURE_FILTER_WINDOW> pressureFilter;
+    ControlTrace *trace = nullptr;
 
     bool isValid(float x) { return fabs(x) < 1e30f; }
 };
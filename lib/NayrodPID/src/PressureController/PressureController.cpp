@@ -16,7 +16,6 @@ PressureController::PressureController(float dt, float *rawPressureSetpoint, flo
     this->_dt = dt;
 
     this->pressureKF = new SimpleKalmanFilter(0.1f, 10.0f, powf(4 * _dt, 2));
-    this->_P_previous = *sensorOutput;
     this->R_estimator = new HydraulicParameterEstimator(dt);
 }
 
@@ -45,7 +44,10 @@ void PressureController::setupSetpointFilter(float freq, float damping) {
     _filtxi = damping;
 }
 
-void PressureController::filterSensor() { _filteredPressureSensor = this->pressureKF->updateEstimate(*_rawPressure); }
+void PressureController::filterSensor() {
+    _filteredPressureSensor = this->pressureKF->updateEstimate(*_rawPressure);
+    _pressureDerivativeFilter.push(*_rawPressure);
+}
 
 void PressureController::tare() { coffeeOutput = 0.0; }
 
@@ -71,6 +73,16 @@ void PressureController::update(ControlMode mode) {
         *_ctrlOutput = getPumpDutyCycleForPressure();
     }
     virtualScale();
+
+    if (trace != nullptr) {
+        trace->record(ControlTraceSource::PRESSURE_CONTROLLER, _r, _filteredPressureSensor, _slidingTerm, _integralTerm,
+                      _errorDot, _dr, *_ctrlOutput);
+    }
+}
+
+void PressureController::setTrace(ControlTrace *trace) {
+    this->trace = trace;
+    R_estimator->setTrace(trace);
 }
 
 float PressureController::computeAdustedCoffeeFlowRate(float pressure) const {
@@ -164,8 +176,6 @@ float PressureController::getPumpDutyCycleForPressure() {
         initSetpointFilter();
         _errorInteg = 0.0f;
         *_ctrlOutput = 0.0f;
-        _P_previous = 0.0f;
-        _dP_previous = 0.0f;
         return 0.0f;
     }
 
@@ -176,12 +186,9 @@ float PressureController::getPumpDutyCycleForPressure() {
     float dP_ref = _dr;
 
     float error = P - P_ref;
-    float dP_actual = 0.3f * _dP_previous + 0.7f * (P - _P_previous) / _dt;
-    _dP_previous = dP_actual;
+    float dP_actual = _pressureDerivativeFilter.isReady() ? _pressureDerivativeFilter.getEndDerivative(_dt) : 0.0f;
     float error_dot = dP_actual - dP_ref;
 
-    _P_previous = P;
-
     // Switching surface
     _epsilon = 0.15f * _r;
     deadband = 0.1f * _r;
@@ -213,6 +220,9 @@ float PressureController::getPumpDutyCycleForPressure() {
     }
 
     alpha = _Co / Qa * (-_lambda * error - K * sat_s) - iterm;
+    _slidingTerm = _Co / Qa * (-_lambda * error - K * sat_s) * 100.0f;
+    _integralTerm = -iterm * 100.0f;
+    _errorDot = error_dot;
     return constrain(alpha * 100.0f, 0.0f, 100.0f);
 }
 
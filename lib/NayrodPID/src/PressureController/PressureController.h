@@ -5,9 +5,14 @@
 static constexpr float M_PI = 3.14159265358979323846f;
 #endif
 
+#include "ControlTrace/ControlTrace.h"
 #include "HydraulicParameterEstimator/HydraulicParameterEstimator.h"
+#include "SavGolFilter/SavGolFilter.h"
 #include "SimpleKalmanFilter/SimpleKalmanFilter.h"
 #include <algorithm>
+
+constexpr size_t PRESSURE_DERIVATIVE_FILTER_WINDOW = 5;
+
 class PressureController {
   public:
     enum class ControlMode { POWER, PRESSURE, FLOW };
@@ -18,6 +23,11 @@ class PressureController {
     void setupSetpointFilter(float freq, float damping);
 
     void setFlowLimit(float lim) { _flowLimit = lim; };
+    // Time since the previous update in seconds, for sensors that don't deliver exactly one sample per nominal period
+    void setDt(float dt) {
+        _dt = dt;
+        R_estimator->setDt(dt);
+    };
     void setPressureLimit(float lim) { _pressureLimit = lim; };
 
     float getFilteredSetpoint() const { return _r; };
@@ -36,6 +46,7 @@ class PressureController {
     float getPuckResistance() { return R_estimator->getResistance(); }
     float getEstimatorCovariance() { return R_estimator->getCovariance(); };
     float getPumpDutyCycleForFlowRate() const;
+    void setTrace(ControlTrace *trace);
 
   private:
     float getPumpDutyCycleForPressure();
@@ -77,10 +88,13 @@ class PressureController {
     float _Ki = 0.05f;     // dt/tau
     float _integLimit = 0.8f;
     // === Controller states ===
-    float _P_previous = 0.0f;
-    float _dP_previous = 0.0f;
+    SavGolFilter<PRESSURE_DERIVATIVE_FILTER_WINDOW> _pressureDerivativeFilter; // Raw sensor, slope at the newest sample
     float _errorInteg = 0.0f;
     float alpha = 0.0f;
+    // Terms of the last pressure step, only kept for tracing
+    float _slidingTerm = 0.0f;
+    float _integralTerm = 0.0f;
+    float _errorDot = 0.0f;
 
     // === Flow estimation  ===
     float flowPerSecond = 0.0f;
@@ -93,6 +107,7 @@ class PressureController {
 
     SimpleKalmanFilter *pressureKF;
     HydraulicParameterEstimator *R_estimator;
+    ControlTrace *trace = nullptr;
 };
 
 #endif // PRESSURE_CONTROLLER_H
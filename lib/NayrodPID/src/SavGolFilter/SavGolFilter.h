@@ -0,0 +1,89 @@
+#ifndef SAVGOLFILTER_H
+#define SAVGOLFILTER_H
+
+#include <array>
+#include <cstddef>
+
+// Savitzky-Golay filter over a sliding window of N equally spaced samples (N odd).
+// Fits a quadratic to the window. getValue() and getDerivative() evaluate it at the centre sample and lag the input by
+// (N - 1) / 2 samples, getEndDerivative() evaluates the slope at the newest sample without that lag but with more noise.
+// Coefficients are computed at compile time and samples live in a fixed ring buffer, pushing never allocates.
+template <size_t N> class SavGolFilter {
+    static_assert(N >= 3 && N % 2 == 1, "SavGolFilter window must be odd and at least 3 samples");
+
+  public:
+    static constexpr int HALF_WINDOW = static_cast<int>(N / 2);
+
+    // Smoothing weight of the sample at offset i from the centre, i in [-HALF_WINDOW, HALF_WINDOW]
+    static constexpr float smoothingCoefficient(int i) {
+        const float m = HALF_WINDOW;
+        return (3.0f * (3.0f * m * m + 3.0f * m - 1.0f) - 15.0f * static_cast<float>(i * i)) /
+               ((2.0f * m - 1.0f) * (2.0f * m + 1.0f) * (2.0f * m + 3.0f));
+    }
+
+    // First derivative weight of the sample at offset i from the centre, per sample interval
+    static constexpr float derivativeCoefficient(int i) {
+        const float m = HALF_WINDOW;
+        return 3.0f * static_cast<float>(i) / (m * (m + 1.0f) * (2.0f * m + 1.0f));
+    }
+
+    // First derivative weight at the newest sample, the centre slope plus 2 * HALF_WINDOW times the curvature weight
+    static constexpr float endDerivativeCoefficient(int i) {
+        const float m = HALF_WINDOW;
+        const float curvature = 45.0f * (static_cast<float>(i * i) - m * (m + 1.0f) / 3.0f) /
+                                (m * (m + 1.0f) * (2.0f * m + 1.0f) * (2.0f * m - 1.0f) * (2.0f * m + 3.0f));
+        return derivativeCoefficient(i) + 2.0f * m * curvature;
+    }
+
+    void reset() {
+        count = 0;
+        head = 0;
+    }
+
+    // Returns true once the window is full and the outputs are valid
+    bool push(float sample) {
+        samples[head] = sample;
+        head = (head + 1) % N;
+        if (count < N)
+            count++;
+        return isReady();
+    }
+
+    bool isReady() const { return count == N; }
+
+    float getValue() const { return apply(SMOOTHING); }
+
+    float getDerivative(float dt) const { return apply(DERIVATIVE) / dt; }
+
+    float getEndDerivative(float dt) const { return apply(END_DERIVATIVE) / dt; }
+
+  private:
+    static constexpr std::array<float, N> makeCoefficients(float (*coefficient)(int)) {
+        std::array<float, N> coefficients{};
+        for (size_t k = 0; k < N; k++) {
+            coefficients[k] = coefficient(static_cast<int>(k) - HALF_WINDOW);
+        }
+        return coefficients;
+    }
+
+    static constexpr std::array<float, N> SMOOTHING = makeCoefficients(smoothingCoefficient);
+    static constexpr std::array<float, N> DERIVATIVE = makeCoefficients(derivativeCoefficient);
+    static constexpr std::array<float, N> END_DERIVATIVE = makeCoefficients(endDerivativeCoefficient);
+
+    float apply(const std::array<float, N> &coefficients) const {
+        // head points at the oldest sample once the window is full
+        float sum = 0.0f;
+        size_t index = head;
+        for (size_t k = 0; k < N; k++) {
+            sum += coefficients[k] * samples[index];
+            index = (index + 1 == N) ? 0 : index + 1;
+        }
+        return sum;
+    }
+
+    std::array<float, N> samples{};
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif // SAVGOLFILTER_H
@@ -1,5 +1,10 @@
 #include "SimplePID.h"
+#include "Clock/Clock.h"
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <ArduinoStub.h>
+#endif
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
@@ -16,7 +21,7 @@ bool SimplePID::update() {
     if (mode == Control::manual) {
         return false;
     }
-    uint32_t now = millis();
+    uint32_t now = Clock::get().millis();
     uint32_t timeChange = (now - lastTime);
     if (timeChange < ctrl_freq_sampling * 1000) {
         return false;
@@ -41,7 +46,7 @@ bool SimplePID::update() {
 
     if (isFeedForwardActive)
         FFOut = setpointDerivative * gainFF;
-    Serial.printf("%.2f\t %.2f\t %.2f\t %.2f\n", *setpointTarget, setpointFiltered, setpointDerivative, *sensorOutput);
+    FFOut += disturbanceFF;
 
     float deltaTime = 1.0f / ctrl_freq_sampling; // Time step in seconds
 
@@ -82,6 +87,10 @@ bool SimplePID::update() {
 
     *controlerOutput = sumPIDsat;
 
+    if (trace != nullptr) {
+        trace->record(traceSource, setpointFiltered, *sensorOutput, Pout, Iout, Dout, FFOut, sumPIDsat);
+    }
+
     return true;
 }
 
@@ -1,5 +1,6 @@
 #ifndef SIMPLE_PID_H
 #define SIMPLE_PID_H
+#include "ControlTrace/ControlTrace.h"
 #include <cmath>
 #include <deque>
 #include <vector>
@@ -26,6 +27,8 @@ class SimplePID {
     void setManualOutput(float output = 0.0f);
     void computeSetpointDelay(float systemDelay);
     void activateFeedForward(bool flag);
+    // Output added to the next update to compensate a measured disturbance, in output units
+    void setDisturbanceFeedForward(float value) { disturbanceFF = value; };
 
     enum class Control : uint8_t { manual, automatic }; // controller mode
     void setMode(Control mode);
@@ -43,6 +46,10 @@ class SimplePID {
     void setKi(float val) { gainKi = val; };
     void setKd(float val) { gainKd = val; };
     void setKFF(float val) { gainFF = val; };
+    void setTrace(ControlTrace *trace, ControlTraceSource source) {
+        this->trace = trace;
+        traceSource = source;
+    };
 
   private:
     // setpoint filtering
@@ -57,6 +64,7 @@ class SimplePID {
     float setpointFilterFreq = 0.005f;            // Setpoint filter frequency
     float setpointRatelimits[2] = {-INFINITY, 2}; // Setpoint rate limits {lower, upper}
     bool isFeedForwardActive = false;             // Flag to activate/deactivate the feedforward control
+    float disturbanceFF = 0.0f;                   // Measured disturbance feedforward output
 
     // feedback controler
     float ctrlOutputLimits[2] = {-INFINITY, INFINITY}; // Control output limits {lower, upper}
@@ -76,6 +84,9 @@ class SimplePID {
     float *controlerOutput = nullptr; // Pointer to the control output variable
     float *sensorOutput = nullptr;    // Pointer to the sensor output variable
     float *setpointTarget = nullptr;  // System current target setpoint;
+
+    ControlTrace *trace = nullptr;
+    ControlTraceSource traceSource = ControlTraceSource::HEATER_PID;
 };
 
 #endif
@@ -0,0 +1,110 @@
+#ifndef BREWPROGRAM_H
+#define BREWPROGRAM_H
+
+#include "NimBLEComm.h"
+#include <algorithm>
+#include <vector>
+
+// Compiled representation of a brew profile that can be executed by the controller board.
+// Only the exit conditions the controller can evaluate locally are part of the program,
+// volumetric targets stay on the display which sends an advance command once they are reached.
+
+constexpr size_t BREW_PROGRAM_MAX_PHASES = 16;
+constexpr size_t BREW_PROGRAM_MAX_TARGETS = 3;
+constexpr unsigned long BREW_PROGRAM_SAFETY_DURATION_MS = 300000;
+
+enum class BrewProgramCommand : uint8_t { STOP, START, ADVANCE };
+enum class BrewProgramPumpMode : uint8_t { POWER, PRESSURE, FLOW };
+enum class BrewProgramTargetType : uint8_t { PRESSURE, FLOW, PUMPED };
+// Matches the order of TransitionType on the display
+enum class BrewProgramTransition : uint8_t { INSTANT, LINEAR, EASE_IN, EASE_OUT, EASE_IN_OUT };
+
+struct BrewProgramTarget {
+    BrewProgramTargetType type;
+    bool gte;
+    float value;
+
+    bool isReached(float input) const { return gte ? input >= value : input <= value; }
+};
+
+struct BrewProgramPhase {
+    bool valve = false;
+    float duration = 0.0f; // seconds
+    bool timeExit = true;  // standard profiles with a volumetric target ignore the phase duration
+    BrewProgramPumpMode pumpMode = BrewProgramPumpMode::POWER;
+    float power = 0.0f; // used in POWER mode, 0-100
+    float pressure = 0.0f;
+    float flow = 0.0f;
+    BrewProgramTransition transition = BrewProgramTransition::INSTANT;
+    float transitionDuration = 0.0f;
+    bool adaptive = false;
+    uint8_t targetCount = 0;
+    BrewProgramTarget targets[BREW_PROGRAM_MAX_TARGETS]{};
+};
+
+using brew_program_upload_callback_t = std::function<void(uint8_t index, uint8_t count, const BrewProgramPhase &phase)>;
+// value holds the phase count for START and the phase being left for ADVANCE
+using brew_program_control_callback_t = std::function<void(BrewProgramCommand command, uint8_t value)>;
+
+inline float applyBrewProgramEasing(float t, BrewProgramTransition type) {
+    if (t <= 0.0f)
+        return 0.0f;
+    if (t >= 1.0f)
+        return 1.0f;
+    switch (type) {
+    case BrewProgramTransition::LINEAR:
+        return t;
+    case BrewProgramTransition::EASE_IN:
+        return t * t;
+    case BrewProgramTransition::EASE_OUT:
+        return 1.0f - (1.0f - t) * (1.0f - t);
+    case BrewProgramTransition::EASE_IN_OUT:
+        return (t < 0.5f) ? 2.0f * t * t : 1.0f - 2.0f * (1.0f - t) * (1.0f - t);
+    case BrewProgramTransition::INSTANT:
+    default:
+        return 1.0f;
+    }
+}
+
+// One phase is sent per write so a program never exceeds the MTU:
+// index,count,valve,duration,timeExit,pumpMode,power,pressure,flow,transition,transitionDuration,adaptive,targetCount,
+// followed by type,gte,value for each target
+inline String encodeBrewProgramPhase(uint8_t index, uint8_t count, const BrewProgramPhase &phase) {
+    char str[128];
+    int len = snprintf(str, sizeof(str), "%d,%d,%d,%.1f,%d,%d,%.1f,%.2f,%.2f,%d,%.1f,%d,%d", index, count, phase.valve ? 1 : 0,
+                       phase.duration, phase.timeExit ? 1 : 0, static_cast<int>(phase.pumpMode), phase.power, phase.pressure,
+                       phase.flow, static_cast<int>(phase.transition), phase.transitionDuration, phase.adaptive ? 1 : 0,
+                       phase.targetCount);
+    for (uint8_t i = 0; i < phase.targetCount && len < static_cast<int>(sizeof(str)); i++) {
+        len += snprintf(str + len, sizeof(str) - len, ",%d,%d,%.2f", static_cast<int>(phase.targets[i].type),
+                        phase.targets[i].gte ? 1 : 0, phase.targets[i].value);
+    }
+    return String(str);
+}
+
+inline bool decodeBrewProgramPhase(const String &data, uint8_t &index, uint8_t &count, BrewProgramPhase &phase) {
+    index = get_token(data, 0, ',').toInt();
+    count = get_token(data, 1, ',').toInt();
+    if (count == 0 || count > BREW_PROGRAM_MAX_PHASES || index >= count) {
+        return false;
+    }
+    phase.valve = get_token(data, 2, ',').toInt() == 1;
+    phase.duration = get_token(data, 3, ',').toFloat();
+    phase.timeExit = get_token(data, 4, ',').toInt() == 1;
+    phase.pumpMode = static_cast<BrewProgramPumpMode>(get_token(data, 5, ',').toInt());
+    phase.power = get_token(data, 6, ',').toFloat();
+    phase.pressure = get_token(data, 7, ',').toFloat();
+    phase.flow = get_token(data, 8, ',').toFloat();
+    phase.transition = static_cast<BrewProgramTransition>(get_token(data, 9, ',').toInt());
+    phase.transitionDuration = get_token(data, 10, ',').toFloat();
+    phase.adaptive = get_token(data, 11, ',').toInt() == 1;
+    phase.targetCount = std::min(static_cast<size_t>(get_token(data, 12, ',').toInt()), BREW_PROGRAM_MAX_TARGETS);
+    for (uint8_t i = 0; i < phase.targetCount; i++) {
+        phase.targets[i].type = static_cast<BrewProgramTargetType>(get_token(data, 13 + i * 3, ',').toInt());
+        phase.targets[i].gte = get_token(data, 14 + i * 3, ',').toInt() == 1;
+        phase.targets[i].value = get_token(data, 15 + i * 3, ',').toFloat();
+    }
+    return true;
+}
+
+#endif // BREWPROGRAM_H
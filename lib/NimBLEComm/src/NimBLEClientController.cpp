@@ -1,7 +1,10 @@
 #include "NimBLEClientController.h"
 
 constexpr size_t MAX_CONNECT_RETRIES = 3;
+constexpr unsigned int MAX_DISCOVERY_FAILURES = 2; // then the cached address is dropped and we scan again
 constexpr size_t BLE_SCAN_DURATION_SECONDS = 10;
+constexpr uint8_t BLE_CONNECT_TIMEOUT_SECONDS = 1;
+constexpr char BLE_PREFERENCES_NAMESPACE[] = "ble-client";
 
 NimBLEClientController::NimBLEClientController() : client(nullptr) {}
 
@@ -10,9 +13,23 @@ void NimBLEClientController::initClient() {
     NimBLEDevice::setPower(ESP_PWR_LVL_P9); // Set to maximum power
     NimBLEDevice::setMTU(128);
     client = NimBLEDevice::createClient();
-    client->setClientCallbacks(this);
-    if (client == nullptr)
+    if (client == nullptr) {
         ESP_LOGE(LOG_TAG, "Failed to create BLE client");
+        return;
+    }
+    client->setClientCallbacks(this);
+    // Request the fast connection parameters up front instead of renegotiating after connecting
+    client->setConnectionParams(6, 8, 0, 400);
+    client->setConnectTimeout(BLE_CONNECT_TIMEOUT_SECONDS);
+
+    connectStarted = millis();
+    loadServerAddress();
+    if (hasServerAddress) {
+        // Connect directly to the last known controller, we only fall back to scanning if that fails
+        ESP_LOGI(LOG_TAG, "Using cached controller address %s", serverAddress.toString().c_str());
+        readyForConnection = true;
+        return;
+    }
 
     // Scan for BLE Server
     scan();
@@ -44,48 +61,92 @@ void NimBLEClientController::registerAutotuneResultCallback(const pid_control_ca
     autotuneResultCallback = callback;
 }
 
+void NimBLEClientController::registerAutotuneProgressCallback(const int_callback_t &callback) {
+    autotuneProgressCallback = callback;
+}
+
 void NimBLEClientController::registerVolumetricMeasurementCallback(const float_callback_t &callback) {
     volumetricMeasurementCallback = callback;
 }
 
 void NimBLEClientController::registerTofMeasurementCallback(const int_callback_t &callback) { tofMeasurementCallback = callback; }
 
-std::string NimBLEClientController::readInfo() const {
-    if (infoChar != nullptr && infoChar->canRead()) {
-        return infoChar->readValue();
-    }
-    return "";
+void NimBLEClientController::registerBrewProgramPhaseCallback(const brew_program_phase_callback_t &callback) {
+    brewProgramPhaseCallback = callback;
+}
+
+void NimBLEClientController::registerControlTraceCallback(const control_trace_callback_t &callback) {
+    controlTraceCallback = callback;
 }
 
+std::string NimBLEClientController::readInfo() const { return info; }
+
 bool NimBLEClientController::connectToServer() {
-    ESP_LOGI(LOG_TAG, "Connecting to advertised device");
+    ESP_LOGI(LOG_TAG, "Connecting to %s", serverAddress.toString().c_str());
+    readyForConnection = false;
 
     unsigned int tries = 0;
-    while (!client->isConnected()) {
-        if (!client->connect(NimBLEAddress(serverDevice->getAddress()))) {
-            ESP_LOGE(LOG_TAG, "Failed connecting to BLE server. Retrying...");
-        }
-
+    // Keep the discovered attributes around so a reconnect to the same controller skips service discovery
+    while (!client->connect(serverAddress, false)) {
         tries++;
-
         if (tries >= MAX_CONNECT_RETRIES) {
             ESP_LOGE(LOG_TAG, "Connection timeout! Unable to connect to BLE server.");
             scan();
             return false; // Exit the connection attempt if timed out
         }
-
-        delay(500); // Add a small delay to avoid busy-waiting
+        ESP_LOGE(LOG_TAG, "Failed connecting to BLE server. Retrying...");
     }
-    client->updateConnParams(6, 8, 0, 400);
 
     ESP_LOGI(LOG_TAG, "Successfully connected to BLE server");
 
+    if (!discoverAttributes(false)) {
+        discoveryFailures++;
+        if (discoveryFailures >= MAX_DISCOVERY_FAILURES) {
+            // The device at this address no longer offers our service, e.g. a swapped or reflashed board
+            ESP_LOGW(LOG_TAG, "Discovery failed %u times, forgetting %s", discoveryFailures,
+                     serverAddress.toString().c_str());
+            clearServerAddress();
+        }
+        // onDisconnect reconnects to the cached address or scans once it has been dropped
+        client->disconnect();
+        return false;
+    }
+    discoveryFailures = 0;
+    storeServerAddress();
+
+    lastConnectDuration = millis() - connectStarted;
+    ESP_LOGI(LOG_TAG, "Controller link established in %lu ms", lastConnectDuration);
+    return true;
+}
+
+bool NimBLEClientController::discoverAttributes(bool refresh) {
+    if (refresh) {
+        client->deleteServices();
+    }
+    const bool cached = !client->getServices(false)->empty();
+
     // Obtain the remote service we wish to connect to
     NimBLERemoteService *pRemoteService = client->getService(NimBLEUUID(SERVICE_UUID));
     if (pRemoteService == nullptr) {
         ESP_LOGE(LOG_TAG, "Error getting remote service");
         return false;
     }
+    // Discover all characteristics in a single procedure instead of one round trip per UUID
+    if (pRemoteService->getCharacteristics(false)->empty()) {
+        pRemoteService->getCharacteristics(true);
+    }
+
+    infoChar = pRemoteService->getCharacteristic(NimBLEUUID(INFO_UUID));
+    std::string currentInfo;
+    if (infoChar != nullptr && infoChar->canRead()) {
+        currentInfo = infoChar->readValue();
+    }
+    if (cached && currentInfo != info) {
+        // The controller firmware changed since the attributes were discovered, their handles may be stale
+        ESP_LOGI(LOG_TAG, "Controller info changed, rediscovering attributes");
+        return discoverAttributes(true);
+    }
+    info = currentInfo;
 
     // Obtain the remote write characteristics
     outputControlChar = pRemoteService->getCharacteristic(NimBLEUUID(OUTPUT_CONTROL_UUID));
@@ -94,60 +155,78 @@ bool NimBLEClientController::connectToServer() {
     pingChar = pRemoteService->getCharacteristic(NimBLEUUID(PING_CHAR_UUID));
     pidControlChar = pRemoteService->getCharacteristic(NimBLEUUID(PID_CONTROL_CHAR_UUID));
     pumpModelCoeffsChar = pRemoteService->getCharacteristic(NimBLEUUID(PUMP_MODEL_COEFFS_CHAR_UUID));
-    infoChar = pRemoteService->getCharacteristic(NimBLEUUID(INFO_UUID));
     pressureScaleChar = pRemoteService->getCharacteristic(NimBLEUUID(PRESSURE_SCALE_UUID));
     volumetricTareChar = pRemoteService->getCharacteristic(NimBLEUUID(VOLUMETRIC_TARE_UUID));
     ledControlChar = pRemoteService->getCharacteristic(NimBLEUUID(LED_CONTROL_UUID));
+    brewProgramChar = pRemoteService->getCharacteristic(NimBLEUUID(BREW_PROGRAM_UUID));
+    brewProgramControlChar = pRemoteService->getCharacteristic(NimBLEUUID(BREW_PROGRAM_CONTROL_UUID));
 
-    // Obtain the remote notify characteristic and subscribe to it
-
+    // Obtain the remote notify characteristics and subscribe to them
     errorChar = pRemoteService->getCharacteristic(NimBLEUUID(ERROR_CHAR_UUID));
-    if (errorChar->canNotify()) {
-        errorChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                             std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    }
-
     brewBtnChar = pRemoteService->getCharacteristic(NimBLEUUID(BREW_BTN_UUID));
-    if (brewBtnChar != nullptr && brewBtnChar->canNotify()) {
-        brewBtnChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                               std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    }
-
     steamBtnChar = pRemoteService->getCharacteristic(NimBLEUUID(STEAM_BTN_UUID));
-    if (steamBtnChar != nullptr && steamBtnChar->canNotify()) {
-        steamBtnChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                                std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    }
-
     autotuneResultChar = pRemoteService->getCharacteristic(NimBLEUUID(AUTOTUNE_RESULT_UUID));
-    if (autotuneResultChar != nullptr && autotuneResultChar->canNotify()) {
-        autotuneResultChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                                      std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    }
-
+    autotuneProgressChar = pRemoteService->getCharacteristic(NimBLEUUID(AUTOTUNE_PROGRESS_UUID));
     sensorChar = pRemoteService->getCharacteristic(NimBLEUUID(SENSOR_DATA_UUID));
-    if (sensorChar != nullptr && sensorChar->canNotify()) {
-        sensorChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                              std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    }
-
     volumetricMeasurementChar = pRemoteService->getCharacteristic(NimBLEUUID(VOLUMETRIC_MEASUREMENT_UUID));
-    if (volumetricMeasurementChar != nullptr && volumetricMeasurementChar->canNotify()) {
-        volumetricMeasurementChar->subscribe(true,
-                                             std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                                       std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+    tofMeasurementChar = pRemoteService->getCharacteristic(NimBLEUUID(TOF_MEASUREMENT_UUID));
+    brewProgramStateChar = pRemoteService->getCharacteristic(NimBLEUUID(BREW_PROGRAM_STATE_UUID));
+    controlTraceChar = pRemoteService->getCharacteristic(NimBLEUUID(CONTROL_TRACE_UUID));
+
+    subscribe(errorChar);
+    subscribe(brewBtnChar);
+    subscribe(steamBtnChar);
+    subscribe(autotuneResultChar);
+    subscribe(autotuneProgressChar);
+    subscribe(sensorChar);
+    subscribe(volumetricMeasurementChar);
+    subscribe(tofMeasurementChar);
+    subscribe(brewProgramStateChar);
+    subscribe(controlTraceChar);
+    return true;
+}
+
+void NimBLEClientController::subscribe(NimBLERemoteCharacteristic *characteristic) {
+    if (characteristic == nullptr || !characteristic->canNotify()) {
+        return;
     }
+    // Write the CCCD without response so all subscriptions are pipelined instead of waiting for each ack
+    characteristic->subscribe(true,
+                              std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
+                                        std::placeholders::_2, std::placeholders::_3, std::placeholders::_4),
+                              false);
+}
 
-    tofMeasurementChar = pRemoteService->getCharacteristic(NimBLEUUID(TOF_MEASUREMENT_UUID));
-    if (tofMeasurementChar != nullptr && tofMeasurementChar->canNotify()) {
-        tofMeasurementChar->subscribe(true, std::bind(&NimBLEClientController::notifyCallback, this, std::placeholders::_1,
-                                                      std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+void NimBLEClientController::loadServerAddress() {
+    preferences.begin(BLE_PREFERENCES_NAMESPACE, true);
+    String address = preferences.getString("addr", "");
+    uint8_t type = preferences.getUChar("type", BLE_ADDR_PUBLIC);
+    preferences.end();
+    if (address.isEmpty()) {
+        return;
     }
+    serverAddress = NimBLEAddress(std::string(address.c_str()), type);
+    hasServerAddress = true;
+}
 
-    delay(500);
+void NimBLEClientController::clearServerAddress() {
+    hasServerAddress = false;
+    discoveryFailures = 0;
+    client->deleteServices();
+    preferences.begin(BLE_PREFERENCES_NAMESPACE, false);
+    preferences.clear();
+    preferences.end();
+}
 
-    readyForConnection = false;
-    return true;
+void NimBLEClientController::storeServerAddress() {
+    preferences.begin(BLE_PREFERENCES_NAMESPACE, false);
+    String address = serverAddress.toString().c_str();
+    if (preferences.getString("addr", "") != address ||
+        preferences.getUChar("type", BLE_ADDR_PUBLIC) != serverAddress.getType()) {
+        preferences.putString("addr", address);
+        preferences.putUChar("type", serverAddress.getType());
+    }
+    preferences.end();
 }
 
 void NimBLEClientController::sendAdvancedOutputControl(bool valve, float boilerSetpoint, bool pressureTarget, float pressure,
@@ -194,6 +273,35 @@ void NimBLEClientController::sendLedControl(uint8_t channel, uint8_t brightness)
     }
 }
 
+bool NimBLEClientController::sendBrewProgram(const std::vector<BrewProgramPhase> &phases) {
+    if (brewProgramChar == nullptr || !client->isConnected() || phases.empty() || phases.size() > BREW_PROGRAM_MAX_PHASES) {
+        return false;
+    }
+    const auto count = static_cast<uint8_t>(phases.size());
+    for (uint8_t i = 0; i < count; i++) {
+        // Write with response so the program is complete before it gets started
+        if (!brewProgramChar->writeValue(encodeBrewProgramPhase(i, count, phases[i]), true)) {
+            ESP_LOGE(LOG_TAG, "Failed to upload brew program phase %d", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void NimBLEClientController::sendBrewProgramCommand(BrewProgramCommand command, uint8_t value) {
+    if (brewProgramControlChar != nullptr && client->isConnected()) {
+        char str[8];
+        snprintf(str, sizeof(str), "%d,%d", static_cast<int>(command), value);
+        brewProgramControlChar->writeValue(str, true);
+    }
+}
+
+void NimBLEClientController::setControlTraceMode(int mode) {
+    if (controlTraceChar != nullptr && client->isConnected()) {
+        controlTraceChar->writeValue(String(mode), true);
+    }
+}
+
 void NimBLEClientController::sendAltControl(bool pinState) {
     if (altControlChar != nullptr && client->isConnected()) {
         altControlChar->writeValue(pinState ? "1" : "0");
@@ -206,14 +314,20 @@ void NimBLEClientController::sendPing() {
     }
 }
 
-void NimBLEClientController::sendAutotune(int testTime, int samples) {
+void NimBLEClientController::sendAutotune(int testTime, int samples, int method) {
     if (autotuneChar != nullptr && client->isConnected()) {
-        char autotuneStr[20];
-        snprintf(autotuneStr, sizeof(autotuneStr), "%d,%d", testTime, samples);
+        char autotuneStr[24];
+        snprintf(autotuneStr, sizeof(autotuneStr), "%d,%d,%d", testTime, samples, method);
         autotuneChar->writeValue(autotuneStr);
     }
 }
 
+void NimBLEClientController::sendAutotuneAbort() {
+    if (autotuneChar != nullptr && client->isConnected()) {
+        autotuneChar->writeValue(AUTOTUNE_ABORT_COMMAND);
+    }
+}
+
 bool NimBLEClientController::isReadyForConnection() const { return readyForConnection; }
 
 bool NimBLEClientController::isConnected() { return client->isConnected(); }
@@ -228,7 +342,8 @@ void NimBLEClientController::onResult(NimBLEAdvertisedDevice *advertisedDevice)
         if (advertisedDevice->isAdvertisingService(NimBLEUUID(SERVICE_UUID))) {
             ESP_LOGI(LOG_TAG, "Found target BLE device. Connecting...");
             NimBLEDevice::getScan()->stop(); // Stop scanning once we find the correct device
-            serverDevice = advertisedDevice;
+            serverAddress = advertisedDevice->getAddress();
+            hasServerAddress = true;
             readyForConnection = true;
         }
     }
@@ -236,6 +351,12 @@ void NimBLEClientController::onResult(NimBLEAdvertisedDevice *advertisedDevice)
 
 void NimBLEClientController::onDisconnect(NimBLEClient *pServer) {
     ESP_LOGI(LOG_TAG, "Disconnected from server, trying to reconnect...");
+    connectStarted = millis();
+    if (hasServerAddress) {
+        // Reconnect directly, the controller restarts advertising as soon as the link drops
+        readyForConnection = true;
+        return;
+    }
     scan();
 }
 
@@ -269,11 +390,13 @@ void NimBLEClientController::notifyCallback(NimBLERemoteCharacteristic *pRemoteC
         float pressure = get_token(data, 1, ',').toFloat();
         float puckFlow = get_token(data, 2, ',').toFloat();
         float pumpFlow = get_token(data, 3, ',').toFloat();
+        float pumpPower = get_token(data, 4, ',', "0").toFloat();
 
-        ESP_LOGV(LOG_TAG, "Received sensor data: temperature=%.1f, pressure=%.1f, puck_flow=%.1f, pump_flow=%.1f", temperature,
-                 pressure, puckFlow, pumpFlow);
+        ESP_LOGV(LOG_TAG,
+                 "Received sensor data: temperature=%.1f, pressure=%.1f, puck_flow=%.1f, pump_flow=%.1f, pump_power=%.1f",
+                 temperature, pressure, puckFlow, pumpFlow, pumpPower);
         if (sensorCallback != nullptr) {
-            sensorCallback(temperature, pressure, puckFlow, pumpFlow);
+            sensorCallback(temperature, pressure, puckFlow, pumpFlow, pumpPower);
         }
     }
     if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(AUTOTUNE_RESULT_UUID))) {
@@ -286,6 +409,13 @@ void NimBLEClientController::notifyCallback(NimBLERemoteCharacteristic *pRemoteC
             autotuneResultCallback(Kp, Ki, Kd);
         }
     }
+    if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(AUTOTUNE_PROGRESS_UUID))) {
+        int progress = atoi((char *)pData);
+        ESP_LOGV(LOG_TAG, "autotune progress: %d", progress);
+        if (autotuneProgressCallback != nullptr) {
+            autotuneProgressCallback(progress);
+        }
+    }
     if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(VOLUMETRIC_MEASUREMENT_UUID))) {
         float value = atof((char *)pData);
         ESP_LOGV(LOG_TAG, "Volumetric measurement: %.2f", value);
@@ -293,6 +423,21 @@ void NimBLEClientController::notifyCallback(NimBLERemoteCharacteristic *pRemoteC
             volumetricMeasurementCallback(value);
         }
     }
+    if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(BREW_PROGRAM_STATE_UUID))) {
+        String data = String((char *)pData);
+        uint8_t phaseIndex = get_token(data, 0, ',').toInt();
+        bool finished = get_token(data, 1, ',').toInt() == 1;
+        ESP_LOGV(LOG_TAG, "Brew program phase: %d, finished=%d", phaseIndex, finished);
+        if (brewProgramPhaseCallback != nullptr) {
+            brewProgramPhaseCallback(phaseIndex, finished);
+        }
+    }
+    if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(CONTROL_TRACE_UUID))) {
+        // Binary ControlTraceRecord structs, see ControlTrace.h in the controller library
+        if (controlTraceCallback != nullptr) {
+            controlTraceCallback(pData, length);
+        }
+    }
     if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID(TOF_MEASUREMENT_UUID))) {
         int value = atoi((char *)pData);
         ESP_LOGV(LOG_TAG, "ToF measurement: %.2f", value);
@@ -1,8 +1,10 @@
 #ifndef NIMBLECLIENTCONTROLLER_H
 #define NIMBLECLIENTCONTROLLER_H
 
+#include "BrewProgram.h"
 #include "NimBLEComm.h"
 #include "cstring"
+#include <Preferences.h>
 
 class NimBLEClientController : public NimBLEAdvertisedDeviceCallbacks, NimBLEClientCallbacks {
   public:
@@ -15,11 +17,15 @@ class NimBLEClientController : public NimBLEAdvertisedDeviceCallbacks, NimBLECli
     void sendOutputControl(bool valve, float pumpSetpoint, float boilerSetpoint);
     void sendAltControl(bool pinState);
     void sendPing();
-    void sendAutotune(int testTime, int samples);
+    void sendAutotune(int testTime, int samples, int method);
+    void sendAutotuneAbort();
     void sendPidSettings(const String &pid);
     void sendPumpModelCoeffs(const String &pumpModelCoeffs);
     void setPressureScale(float scale);
     void sendLedControl(uint8_t channel, uint8_t brightness);
+    bool sendBrewProgram(const std::vector<BrewProgramPhase> &phases);
+    void sendBrewProgramCommand(BrewProgramCommand command, uint8_t value = 0);
+    void setControlTraceMode(int mode);
     bool isReadyForConnection() const;
     bool isConnected();
     void scan();
@@ -29,13 +35,24 @@ class NimBLEClientController : public NimBLEAdvertisedDeviceCallbacks, NimBLECli
     void registerSteamBtnCallback(const steam_callback_t &callback);
     void registerSensorCallback(const sensor_read_callback_t &callback);
     void registerAutotuneResultCallback(const pid_control_callback_t &callback);
+    void registerAutotuneProgressCallback(const int_callback_t &callback);
     void registerVolumetricMeasurementCallback(const float_callback_t &callback);
     void registerTofMeasurementCallback(const int_callback_t &callback);
+    void registerBrewProgramPhaseCallback(const brew_program_phase_callback_t &callback);
+    void registerControlTraceCallback(const control_trace_callback_t &callback);
     std::string readInfo() const;
     NimBLEClient *getClient() const { return client; };
+    unsigned long getLastConnectDuration() const { return lastConnectDuration; };
 
   private:
+    bool discoverAttributes(bool refresh);
+    void subscribe(NimBLERemoteCharacteristic *characteristic);
+    void loadServerAddress();
+    void clearServerAddress();
+    void storeServerAddress();
+
     NimBLEClient *client;
+    Preferences preferences;
 
     NimBLERemoteCharacteristic *tempControlChar = nullptr;
     NimBLERemoteCharacteristic *pumpControlChar = nullptr;
@@ -48,6 +65,7 @@ class NimBLEClientController : public NimBLEAdvertisedDeviceCallbacks, NimBLECli
     NimBLERemoteCharacteristic *errorChar = nullptr;
     NimBLERemoteCharacteristic *autotuneChar = nullptr;
     NimBLERemoteCharacteristic *autotuneResultChar = nullptr;
+    NimBLERemoteCharacteristic *autotuneProgressChar = nullptr;
     NimBLERemoteCharacteristic *brewBtnChar = nullptr;
     NimBLERemoteCharacteristic *steamBtnChar = nullptr;
     NimBLERemoteCharacteristic *infoChar = nullptr;
@@ -58,16 +76,28 @@ class NimBLEClientController : public NimBLEAdvertisedDeviceCallbacks, NimBLECli
     NimBLERemoteCharacteristic *volumetricTareChar = nullptr;
     NimBLERemoteCharacteristic *ledControlChar = nullptr;
     NimBLERemoteCharacteristic *tofMeasurementChar = nullptr;
-    NimBLEAdvertisedDevice *serverDevice = nullptr;
+    NimBLERemoteCharacteristic *brewProgramChar = nullptr;
+    NimBLERemoteCharacteristic *brewProgramControlChar = nullptr;
+    NimBLERemoteCharacteristic *brewProgramStateChar = nullptr;
+    NimBLERemoteCharacteristic *controlTraceChar = nullptr;
+    NimBLEAddress serverAddress;
+    bool hasServerAddress = false;
+    unsigned int discoveryFailures = 0;
     bool readyForConnection = false;
+    std::string info = "";
+    unsigned long connectStarted = 0;
+    unsigned long lastConnectDuration = 0;
 
     remote_err_callback_t remoteErrorCallback = nullptr;
     brew_callback_t brewBtnCallback = nullptr;
     steam_callback_t steamBtnCallback = nullptr;
     pid_control_callback_t autotuneResultCallback = nullptr;
+    int_callback_t autotuneProgressCallback = nullptr;
     sensor_read_callback_t sensorCallback = nullptr;
     float_callback_t volumetricMeasurementCallback = nullptr;
     int_callback_t tofMeasurementCallback = nullptr;
+    brew_program_phase_callback_t brewProgramPhaseCallback = nullptr;
+    control_trace_callback_t controlTraceCallback = nullptr;
 
     String _lastOutputControl = "";
 
@@ -24,6 +24,11 @@
 #define VOLUMETRIC_TARE_UUID "a8bd52e0-77c3-412c-847c-4e802c3982f9"
 #define TOF_MEASUREMENT_UUID "7282c525-21a0-416a-880d-21fe98602533"
 #define LED_CONTROL_UUID "37804a2b-49ab-4500-8582-db4279fc8573"
+#define BREW_PROGRAM_UUID "5b1d3b2e-8f3a-4c55-9a7e-2f6c1d0b9a41"
+#define BREW_PROGRAM_CONTROL_UUID "5b1d3b2e-8f3a-4c55-9a7e-2f6c1d0b9a42"
+#define BREW_PROGRAM_STATE_UUID "5b1d3b2e-8f3a-4c55-9a7e-2f6c1d0b9a43"
+#define CONTROL_TRACE_UUID "5b1d3b2e-8f3a-4c55-9a7e-2f6c1d0b9a44"
+#define AUTOTUNE_PROGRESS_UUID "5b1d3b2e-8f3a-4c55-9a7e-2f6c1d0b9a45"
 
 constexpr size_t ERROR_CODE_COMM_SEND = 1;
 constexpr size_t ERROR_CODE_COMM_RCV = 2;
@@ -31,12 +36,23 @@ constexpr size_t ERROR_CODE_PROTO_ERR = 3;
 constexpr size_t ERROR_CODE_RUNAWAY = 4;
 constexpr size_t ERROR_CODE_TIMEOUT = 5;
 
+constexpr int CONTROL_TRACE_MODE_OFF = 0;
+constexpr int CONTROL_TRACE_MODE_BLE = 1;
+constexpr int CONTROL_TRACE_MODE_SERIAL = 2;
+
+constexpr int AUTOTUNE_METHOD_STEP = 0;
+constexpr int AUTOTUNE_METHOD_RELAY = 1;
+// Written to the autotune characteristic instead of the parameters to cancel a running autotune
+constexpr const char *AUTOTUNE_ABORT_COMMAND = "abort";
+// Notified as autotune progress when a run was aborted or did not produce a result
+constexpr int AUTOTUNE_PROGRESS_FAILED = -1;
+
 using pin_control_callback_t = std::function<void(bool isActive)>;
 using pid_control_callback_t = std::function<void(float Kp, float Ki, float Kd)>;
 using pump_model_coeffs_callback_t = std::function<void(float a, float b, float c, float d)>;
 using ping_callback_t = std::function<void()>;
 using remote_err_callback_t = std::function<void(int errorCode)>;
-using autotune_callback_t = std::function<void(int testTime, int samples)>;
+using autotune_callback_t = std::function<void(int testTime, int samples, int method)>;
 using brew_callback_t = std::function<void(bool brewButtonStatus)>;
 using steam_callback_t = std::function<void(bool steamButtonStatus)>;
 using void_callback_t = std::function<void()>;
@@ -47,14 +63,18 @@ using int_callback_t = std::function<void(int val)>;
 using simple_output_callback_t = std::function<void(bool valve, float pumpSetpoint, float boilerSetpoint)>;
 using advanced_output_callback_t =
     std::function<void(bool valve, float boilerSetpoint, bool pressureTarget, float pumpPressure, float pumpFlow)>;
-using sensor_read_callback_t = std::function<void(float temperature, float pressure, float puckFlow, float pumpFlow)>;
+using sensor_read_callback_t =
+    std::function<void(float temperature, float pressure, float puckFlow, float pumpFlow, float pumpPower)>;
 using led_control_callback_t = std::function<void(uint8_t channel, uint8_t brightness)>;
+using brew_program_phase_callback_t = std::function<void(uint8_t phaseIndex, bool finished)>;
+using control_trace_callback_t = std::function<void(const uint8_t *data, size_t length)>;
 
 struct SystemCapabilities {
     bool dimming;
     bool pressure;
     bool ledControl;
     bool tof;
+    bool brewProgram;
 };
 
 struct SystemInfo {
@@ -42,6 +42,7 @@ void NimBLEServerController::initServer(const String infoString) {
     autotuneChar = pService->createCharacteristic(AUTOTUNE_CHAR_UUID, NIMBLE_PROPERTY::WRITE);
     autotuneChar->setCallbacks(this); // Use this class as the callback handler
     autotuneResultChar = pService->createCharacteristic(AUTOTUNE_RESULT_UUID, NIMBLE_PROPERTY::NOTIFY);
+    autotuneProgressChar = pService->createCharacteristic(AUTOTUNE_PROGRESS_UUID, NIMBLE_PROPERTY::NOTIFY);
 
     // Brew button Characteristic (Server notifies client of brew button)
     brewBtnChar = pService->createCharacteristic(BREW_BTN_UUID, NIMBLE_PROPERTY::NOTIFY);
@@ -67,6 +68,17 @@ void NimBLEServerController::initServer(const String infoString) {
     ledControlChar = pService->createCharacteristic(LED_CONTROL_UUID, NIMBLE_PROPERTY::WRITE);
     ledControlChar->setCallbacks(this);
 
+    // Brew program characteristics (Client uploads a compiled profile and controls its execution, Server notifies phases)
+    brewProgramChar = pService->createCharacteristic(BREW_PROGRAM_UUID, NIMBLE_PROPERTY::WRITE);
+    brewProgramChar->setCallbacks(this);
+    brewProgramControlChar = pService->createCharacteristic(BREW_PROGRAM_CONTROL_UUID, NIMBLE_PROPERTY::WRITE);
+    brewProgramControlChar->setCallbacks(this);
+    brewProgramStateChar = pService->createCharacteristic(BREW_PROGRAM_STATE_UUID, NIMBLE_PROPERTY::NOTIFY);
+
+    // Control trace Characteristic (Client writes the trace mode, Server notifies binary trace records)
+    controlTraceChar = pService->createCharacteristic(CONTROL_TRACE_UUID, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY);
+    controlTraceChar->setCallbacks(this);
+
     pService->start();
 
     ota_dfu_ble.configure_OTA(pServer);
@@ -79,10 +91,10 @@ void NimBLEServerController::initServer(const String infoString) {
     ESP_LOGI(LOG_TAG, "BLE Server started, advertising...\n");
 }
 
-void NimBLEServerController::sendSensorData(float temperature, float pressure, float puckFlow, float pumpFlow) {
+void NimBLEServerController::sendSensorData(float temperature, float pressure, float puckFlow, float pumpFlow, float pumpPower) {
     if (deviceConnected && sensorChar != nullptr) {
-        char str[30];
-        snprintf(str, sizeof(str), "%.3f,%.3f,%.3f,%.3f", temperature, pressure, puckFlow, pumpFlow);
+        char str[40];
+        snprintf(str, sizeof(str), "%.3f,%.3f,%.3f,%.3f,%.1f", temperature, pressure, puckFlow, pumpFlow, pumpPower);
         sensorChar->setValue(str);
         sensorChar->notify();
     }
@@ -127,6 +139,15 @@ void NimBLEServerController::sendAutotuneResult(float Kp, float Ki, float Kd) {
     }
 }
 
+void NimBLEServerController::sendAutotuneProgress(int progress) {
+    if (deviceConnected) {
+        char progressStr[8];
+        snprintf(progressStr, sizeof(progressStr), "%d", progress);
+        autotuneProgressChar->setValue(progressStr);
+        autotuneProgressChar->notify();
+    }
+}
+
 void NimBLEServerController::sendVolumetricMeasurement(float value) {
     if (deviceConnected) {
         char data[8];
@@ -145,6 +166,22 @@ void NimBLEServerController::sendTofMeasurement(int value) {
     }
 }
 
+void NimBLEServerController::sendBrewProgramState(uint8_t phaseIndex, bool finished) {
+    if (deviceConnected) {
+        char data[8];
+        snprintf(data, sizeof(data), "%d,%d", phaseIndex, finished ? 1 : 0);
+        brewProgramStateChar->setValue(data);
+        brewProgramStateChar->notify();
+    }
+}
+
+void NimBLEServerController::sendControlTrace(const uint8_t *data, size_t length) {
+    if (deviceConnected) {
+        controlTraceChar->setValue(data, length);
+        controlTraceChar->notify();
+    }
+}
+
 void NimBLEServerController::registerOutputControlCallback(const simple_output_callback_t &callback) {
     outputControlCallback = callback;
 }
@@ -156,12 +193,23 @@ void NimBLEServerController::registerAdvancedOutputControlCallback(const advance
 void NimBLEServerController::registerAltControlCallback(const pin_control_callback_t &callback) { altControlCallback = callback; }
 void NimBLEServerController::registerPingCallback(const ping_callback_t &callback) { pingCallback = callback; }
 void NimBLEServerController::registerAutotuneCallback(const autotune_callback_t &callback) { autotuneCallback = callback; }
+void NimBLEServerController::registerAutotuneAbortCallback(const void_callback_t &callback) { autotuneAbortCallback = callback; }
 void NimBLEServerController::registerPressureScaleCallback(const float_callback_t &callback) { pressureScaleCallback = callback; }
 
 void NimBLEServerController::registerTareCallback(const void_callback_t &callback) { tareCallback = callback; }
 
 void NimBLEServerController::registerLedControlCallback(const led_control_callback_t &callback) { ledControlCallback = callback; }
 
+void NimBLEServerController::registerBrewProgramUploadCallback(const brew_program_upload_callback_t &callback) {
+    brewProgramUploadCallback = callback;
+}
+
+void NimBLEServerController::registerBrewProgramControlCallback(const brew_program_control_callback_t &callback) {
+    brewProgramControlCallback = callback;
+}
+
+void NimBLEServerController::registerControlTraceCallback(const int_callback_t &callback) { controlTraceCallback = callback; }
+
 void NimBLEServerController::setInfo(const String infoString) {
     this->infoString = infoString;
     infoChar->setValue(infoString);
@@ -224,11 +272,16 @@ void NimBLEServerController::onWrite(NimBLECharacteristic *pCharacteristic) {
         }
     } else if (pCharacteristic->getUUID().equals(NimBLEUUID(AUTOTUNE_CHAR_UUID))) {
         ESP_LOGV(LOG_TAG, "Received autotune");
-        if (autotuneCallback != nullptr) {
-            auto autotune = String(pCharacteristic->getValue().c_str());
+        auto autotune = String(pCharacteristic->getValue().c_str());
+        if (autotune == AUTOTUNE_ABORT_COMMAND) {
+            if (autotuneAbortCallback != nullptr) {
+                autotuneAbortCallback();
+            }
+        } else if (autotuneCallback != nullptr) {
             int testTime = get_token(autotune, 0, ',').toInt();
             int samples = get_token(autotune, 1, ',').toInt();
-            autotuneCallback(testTime, samples);
+            int method = get_token(autotune, 2, ',', "0").toInt();
+            autotuneCallback(testTime, samples, method);
         }
     } else if (pCharacteristic->getUUID().equals(NimBLEUUID(PID_CONTROL_CHAR_UUID))) {
         auto pid = String(pCharacteristic->getValue().c_str());
@@ -270,5 +323,32 @@ void NimBLEServerController::onWrite(NimBLECharacteristic *pCharacteristic) {
             ledControlCallback(channel, brightness);
             ESP_LOGV(LOG_TAG, "Received led control, %d: %d", channel, brightness);
         }
+    } else if (pCharacteristic->getUUID().equals(NimBLEUUID(BREW_PROGRAM_UUID))) {
+        auto msg = String(pCharacteristic->getValue().c_str());
+        uint8_t index;
+        uint8_t count;
+        BrewProgramPhase phase;
+        if (!decodeBrewProgramPhase(msg, index, count, phase)) {
+            ESP_LOGE(LOG_TAG, "Received invalid brew program phase: %s", msg.c_str());
+            return;
+        }
+        ESP_LOGV(LOG_TAG, "Received brew program phase %d/%d", index + 1, count);
+        if (brewProgramUploadCallback != nullptr) {
+            brewProgramUploadCallback(index, count, phase);
+        }
+    } else if (pCharacteristic->getUUID().equals(NimBLEUUID(BREW_PROGRAM_CONTROL_UUID))) {
+        auto msg = String(pCharacteristic->getValue().c_str());
+        auto command = static_cast<BrewProgramCommand>(get_token(msg, 0, ',').toInt());
+        uint8_t value = get_token(msg, 1, ',', "0").toInt();
+        ESP_LOGV(LOG_TAG, "Received brew program command %d (%d)", static_cast<int>(command), value);
+        if (brewProgramControlCallback != nullptr) {
+            brewProgramControlCallback(command, value);
+        }
+    } else if (pCharacteristic->getUUID().equals(NimBLEUUID(CONTROL_TRACE_UUID))) {
+        int mode = atoi(pCharacteristic->getValue().c_str());
+        ESP_LOGV(LOG_TAG, "Received control trace mode %d", mode);
+        if (controlTraceCallback != nullptr) {
+            controlTraceCallback(mode);
+        }
     }
 }
@@ -1,6 +1,7 @@
 #ifndef NIMBLESERVERCONTROLLER_H
 #define NIMBLESERVERCONTROLLER_H
 
+#include "BrewProgram.h"
 #include "NimBLEComm.h"
 #include "cstring"
 #include <ble_ota_dfu.hpp>
@@ -9,13 +10,16 @@ class NimBLEServerController : public NimBLEServerCallbacks, public NimBLECharac
   public:
     NimBLEServerController();
     void initServer(String infoString);
-    void sendSensorData(float temperature, float pressure, float puckFlow, float pumpFlow);
+    void sendSensorData(float temperature, float pressure, float puckFlow, float pumpFlow, float pumpPower);
     void sendError(int errorCode);
     void sendBrewBtnState(bool brewButtonStatus);
     void sendSteamBtnState(bool steamButtonStatus);
     void sendAutotuneResult(float Kp, float Ki, float Kd);
+    void sendAutotuneProgress(int progress);
     void sendVolumetricMeasurement(float value);
     void sendTofMeasurement(int value);
+    void sendBrewProgramState(uint8_t phaseIndex, bool finished);
+    void sendControlTrace(const uint8_t *data, size_t length);
     void registerOutputControlCallback(const simple_output_callback_t &callback);
     void registerAdvancedOutputControlCallback(const advanced_output_callback_t &callback);
     void registerAltControlCallback(const pin_control_callback_t &callback);
@@ -23,9 +27,13 @@ class NimBLEServerController : public NimBLEServerCallbacks, public NimBLECharac
     void registerPumpModelCoeffsCallback(const pump_model_coeffs_callback_t &callback);
     void registerPingCallback(const ping_callback_t &callback);
     void registerAutotuneCallback(const autotune_callback_t &callback);
+    void registerAutotuneAbortCallback(const void_callback_t &callback);
     void registerPressureScaleCallback(const float_callback_t &callback);
     void registerTareCallback(const void_callback_t &callback);
     void registerLedControlCallback(const led_control_callback_t &callback);
+    void registerBrewProgramUploadCallback(const brew_program_upload_callback_t &callback);
+    void registerBrewProgramControlCallback(const brew_program_control_callback_t &callback);
+    void registerControlTraceCallback(const int_callback_t &callback);
     void setInfo(String infoString);
 
   private:
@@ -40,6 +48,7 @@ class NimBLEServerController : public NimBLEServerCallbacks, public NimBLECharac
     NimBLECharacteristic *errorChar = nullptr;
     NimBLECharacteristic *autotuneChar = nullptr;
     NimBLECharacteristic *autotuneResultChar = nullptr;
+    NimBLECharacteristic *autotuneProgressChar = nullptr;
     NimBLECharacteristic *brewBtnChar = nullptr;
     NimBLECharacteristic *steamBtnChar = nullptr;
     NimBLECharacteristic *infoChar = nullptr;
@@ -48,6 +57,10 @@ class NimBLEServerController : public NimBLEServerCallbacks, public NimBLECharac
     NimBLECharacteristic *volumetricTareChar = nullptr;
     NimBLECharacteristic *tofMeasurementChar = nullptr;
     NimBLECharacteristic *ledControlChar = nullptr;
+    NimBLECharacteristic *brewProgramChar = nullptr;
+    NimBLECharacteristic *brewProgramControlChar = nullptr;
+    NimBLECharacteristic *brewProgramStateChar = nullptr;
+    NimBLECharacteristic *controlTraceChar = nullptr;
 
     simple_output_callback_t outputControlCallback = nullptr;
     advanced_output_callback_t advancedControlCallback = nullptr;
@@ -56,9 +69,13 @@ class NimBLEServerController : public NimBLEServerCallbacks, public NimBLECharac
     pump_model_coeffs_callback_t pumpModelCoeffsCallback = nullptr;
     ping_callback_t pingCallback = nullptr;
     autotune_callback_t autotuneCallback = nullptr;
+    void_callback_t autotuneAbortCallback = nullptr;
     float_callback_t pressureScaleCallback = nullptr;
     void_callback_t tareCallback = nullptr;
     led_control_callback_t ledControlCallback = nullptr;
+    brew_program_upload_callback_t brewProgramUploadCallback = nullptr;
+    brew_program_control_callback_t brewProgramControlCallback = nullptr;
+    int_callback_t controlTraceCallback = nullptr;
 
     // BLEServerCallbacks overrides
     void onConnect(NimBLEServer *pServer) override;
@@ -1,10 +1,15 @@
 #include "ControllerOTA.h"
-#include <HTTPClient.h>
+#include "common.h"
 #include <SPIFFS.h>
+#include <image_decoder.hpp>
+#include <mbedtls/sha256.h>
 
 void ControllerOTA::init(NimBLEClient *client, const ctr_progress_callback_t &progress_callback) {
     this->client = client;
     progressCallback = progress_callback;
+    if (windowedMessages == nullptr) {
+        windowedMessages = xQueueCreate(WINDOWED_MESSAGE_QUEUE_SIZE, sizeof(WindowedMessage));
+    }
     NimBLERemoteService *pRemoteService = client->getService(NimBLEUUID(SERVICE_OTA_BLE_UUID));
     rxChar = pRemoteService->getCharacteristic(NimBLEUUID(CHARACTERISTIC_OTA_BL_UUID_RX));
     txChar = pRemoteService->getCharacteristic(NimBLEUUID(CHARACTERISTIC_OTA_BL_UUID_TX));
@@ -14,24 +19,74 @@ void ControllerOTA::init(NimBLEClient *client, const ctr_progress_callback_t &pr
     }
 }
 
-void ControllerOTA::update(WiFiClientSecure &wifi_client, const String &release_url) {
+void ControllerOTA::update(WiFiClientSecure &wifi_client, const String &release_url, const String &current_version) {
+    if (negotiate()) {
+        // Smallest image first, the controller rejects a delta on its first part when it runs another firmware
+        String urls[3];
+        size_t count = 0;
+        if ((capabilities & DFU_CAPABILITY_DELTA) && current_version.length() > 0) {
+            urls[count++] = compressed_image_url(release_url, current_version);
+        }
+        if (capabilities & DFU_CAPABILITY_COMPRESSED) {
+            urls[count++] = compressed_image_url(release_url);
+        }
+        urls[count++] = release_url;
+
+        bool negotiated = true;
+        for (size_t i = 0; i < count && client->isConnected(); i++) {
+            // Starting again discards what a rejected image left on the controller
+            if (!negotiated && !negotiate()) {
+                break;
+            }
+            HTTPClient http;
+            const int len = openFirmware(http, wifi_client, urls[i]);
+            if (len <= 0) {
+                ESP_LOGW("ControllerOTA", "No firmware image at %s", urls[i].c_str());
+                http.end();
+                continue;
+            }
+            // Streamed from the download to the controller, nothing is staged in SPIFFS
+            progressOffset = 0;
+            negotiated = false;
+            const bool finished = runWindowedUpdate(*http.getStreamPtr(), len);
+            http.end();
+            if (finished) {
+                return;
+            }
+        }
+        ESP_LOGE("ControllerOTA", "Controller update failed");
+        return;
+    }
+
+    HTTPClient http;
+    const int len = openFirmware(http, wifi_client, release_url);
+    if (len <= 0) {
+        ESP_LOGE("ControllerOTA", "Download of firmware file failed");
+        http.end();
+        return;
+    }
+    // The slow mode takes minutes, too long to keep the download open
     if (SPIFFS.exists("/board-firmware.bin")) {
         ESP_LOGI("ControllerOTA", "Removing previous update file");
         SPIFFS.remove("/board-firmware.bin");
     }
-    if (!downloadFile(wifi_client, release_url)) {
+    const bool downloaded = downloadFile(*http.getStreamPtr(), len);
+    http.end();
+    if (!downloaded) {
         ESP_LOGE("ControllerOTA", "Download of firmware file failed");
+        return;
     }
+    progressOffset = 50;
     File file = SPIFFS.open("/board-firmware.bin", FILE_READ);
+    announce(file.size(), MTU);
     runUpdate(file, file.size());
     file.close();
 }
 
-bool ControllerOTA::downloadFile(WiFiClientSecure &wifi_client, const String &release_url) {
-    HTTPClient http;
+int ControllerOTA::openFirmware(HTTPClient &http, WiFiClientSecure &wifi_client, const String &release_url) {
     if (!http.begin(wifi_client, release_url)) {
         ESP_LOGE("ControllerOTA", "Failed to start http client");
-        return false;
+        return 0;
     }
 
     http.useHTTP10(true);
@@ -44,32 +99,33 @@ bool ControllerOTA::downloadFile(WiFiClientSecure &wifi_client, const String &re
 
     if (code != HTTP_CODE_OK) {
         ESP_LOGE("ControllerOTA", "HTTP error: %d", code);
-        http.end();
-        return false;
+        return 0;
     }
 
-    if (len == 0) {
+    if (len <= 0) {
         ESP_LOGE("ControllerOTA", "Could not fetch firmware");
-        http.end();
-        return false;
+        return 0;
     }
 
     WiFiClient *tcp = http.getStreamPtr();
     delay(100);
 
-    if (tcp->peek() != 0xE9) {
+    const int magic = tcp->peek();
+    if (magic != IMAGE_PLAIN_MAGIC && magic != IMAGE_MAGIC[0]) {
         ESP_LOGE("ControllerOTA", "Magic header does not start with 0xE9");
-        http.end();
-        return false;
+        return 0;
     }
+    return len;
+}
 
+bool ControllerOTA::downloadFile(Stream &in, int len) {
     File file = SPIFFS.open("/board-firmware.bin", FILE_WRITE, true);
 
     int written = 0;
     while (written < len) {
         int bufferSize = min(1024, len - written);
         uint8_t buffer[bufferSize];
-        fillBuffer(*tcp, buffer, bufferSize);
+        fillBuffer(in, buffer, bufferSize);
         file.write(buffer, bufferSize);
         written += bufferSize;
         double progress = (static_cast<double>(written) / static_cast<double>(len)) * 50.0;
@@ -77,11 +133,32 @@ bool ControllerOTA::downloadFile(WiFiClientSecure &wifi_client, const String &re
     }
     ESP_LOGI("ControllerOTA", "Downloaded firmware file with %d bytes to /board-firmware.bin", len);
     file.close();
-    http.end();
     return true;
 }
 
-void ControllerOTA::runUpdate(Stream &in, uint32_t size) {
+bool ControllerOTA::negotiate() {
+    transferMode = 0x00;
+    capabilities = 0x00;
+    lastSignal = 0x00;
+    xQueueReset(windowedMessages);
+    uint8_t updateStart[] = {0xFD};
+    sendData(updateStart, 1);
+    ESP_LOGI("ControllerOTA", "Waiting for signal from controller");
+
+    const unsigned long modeRequested = millis();
+    while (client->isConnected() && lastSignal != 0xAA && millis() - modeRequested < MODE_TIMEOUT_MS) {
+        delay(10);
+    }
+    // The controller also accepts slow mode packets, which still fit when the MTU is too small for windowed ones
+    if (lastSignal == 0xAA && transferMode == DFU_MODE_WINDOWED &&
+        client->getMTU() >= 3 + DFU_WINDOWED_DATA_HEADER + DFU_WINDOWED_MIN_PAYLOAD) {
+        lastSignal = 0x00;
+        return true;
+    }
+    return false;
+}
+
+void ControllerOTA::announce(uint32_t size, uint16_t packetSize) {
     ESP_LOGI("ControllerOTA", "Sending update instructions over BLE. File Size: %d", size);
     fileParts = (size + PART_SIZE - 1) / PART_SIZE;
     currentPart = 0;
@@ -94,18 +171,18 @@ void ControllerOTA::runUpdate(Stream &in, uint32_t size) {
         static_cast<uint8_t>(size & 0xFF),
     };
     sendData(fileLengthBytes, 5);
-    uint8_t partsAndMTU[] = {
+    // The windowed transfer indexes the packets of a part by their size
+    uint8_t partsAndPacketSize[] = {
         0xFF,
         static_cast<uint8_t>(fileParts / 256),
         static_cast<uint8_t>(fileParts % 256),
-        static_cast<uint8_t>(MTU / 256),
-        static_cast<uint8_t>(MTU % 256),
+        static_cast<uint8_t>(packetSize / 256),
+        static_cast<uint8_t>(packetSize % 256),
     };
-    sendData(partsAndMTU, 5);
-    uint8_t updateStart[] = {0xFD};
-    sendData(updateStart, 1);
-    ESP_LOGI("ControllerOTA", "Waiting for signal from controller");
+    sendData(partsAndPacketSize, 5);
+}
 
+void ControllerOTA::runUpdate(File &in, uint32_t size) {
     while (client->isConnected()) {
         uint8_t signal = lastSignal;
         lastSignal = 0x00;
@@ -123,6 +200,72 @@ void ControllerOTA::runUpdate(Stream &in, uint32_t size) {
     ESP_LOGI("ControllerOTA", "Controller update finished");
 }
 
+bool ControllerOTA::runWindowedUpdate(Stream &in, uint32_t size) {
+    const uint16_t payload = std::min<uint16_t>(client->getMTU() - 3 - DFU_WINDOWED_DATA_HEADER, OTA_WINDOWED_MAX_PAYLOAD);
+    announce(size, payload);
+    ESP_LOGI("ControllerOTA", "Starting windowed transfer with %d byte packets", payload);
+
+    // Every byte passes the buffer once and in order, so it is hashed as it arrives
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    WindowedStreamBuffer firmware(size, PART_SIZE, OTA_STREAM_BUFFERED_PARTS, [&in, &sha](uint8_t *buffer, size_t length) {
+        const int available = in.available();
+        if (available <= 0) {
+            return static_cast<size_t>(0);
+        }
+        const size_t read = in.readBytes(buffer, std::min<size_t>(length, available));
+        mbedtls_sha256_update_ret(&sha, buffer, read);
+        return read;
+    });
+
+    WindowedTransferSender sender(
+        size, PART_SIZE, payload,
+        [&firmware](uint32_t offset, uint8_t *buffer, uint16_t length) {
+            // A part is read when it enters the window, wait if the download has not reached it yet
+            unsigned long progressed = millis();
+            while (!firmware.read(offset, buffer, length)) {
+                if (firmware.load() > 0) {
+                    progressed = millis();
+                } else if (millis() - progressed > STREAM_TIMEOUT_MS) {
+                    ESP_LOGE("ControllerOTA", "Download stalled at offset %u", offset);
+                    return false;
+                } else {
+                    delay(1);
+                }
+            }
+            return true;
+        },
+        [this](const uint8_t *data, uint16_t length) { return rxChar->writeValue(data, length, false); },
+        [&sha](uint8_t *digest) { mbedtls_sha256_finish_ret(&sha, digest); });
+    const unsigned long started = millis();
+    WindowedTransferSender::State state = WindowedTransferSender::State::RUNNING;
+    while (client->isConnected() && state == WindowedTransferSender::State::RUNNING) {
+        WindowedMessage message;
+        while (xQueueReceive(windowedMessages, &message, 0) == pdTRUE) {
+            sender.onMessage(message.data, message.length, millis());
+        }
+        // Acknowledged parts free their slot for the download to continue
+        firmware.release(sender.getAcknowledgedParts());
+        firmware.load();
+        state = sender.poll(millis());
+        if (currentPart != sender.getAcknowledgedParts()) {
+            currentPart = sender.getAcknowledgedParts();
+            notifyUpdate();
+        }
+        // Yield so the stack can drain its buffers, writes fail until it has room again
+        delay(1);
+    }
+    if (state == WindowedTransferSender::State::FINISHED) {
+        ESP_LOGI("ControllerOTA", "Windowed transfer finished in %lu ms, %u packets sent again", millis() - started,
+                 sender.getRetransmissions());
+    } else {
+        ESP_LOGE("ControllerOTA", "Windowed transfer failed at part %d / %d", sender.getAcknowledgedParts() + 1, fileParts);
+    }
+    mbedtls_sha256_free(&sha);
+    return state == WindowedTransferSender::State::FINISHED;
+}
+
 void ControllerOTA::sendData(uint8_t *data, uint16_t len) const {
     if (rxChar == nullptr) {
         ESP_LOGI("ControllerOTA", "RX Char uninitialized");
@@ -158,7 +301,8 @@ void ControllerOTA::fillBuffer(Stream &in, uint8_t *buffer, uint16_t len) const
 }
 
 void ControllerOTA::notifyUpdate() const {
-    double progress = (static_cast<double>(currentPart) / static_cast<double>(fileParts)) * 50.0 + 50.0;
+    double progress =
+        (static_cast<double>(currentPart) / static_cast<double>(fileParts)) * (100.0 - progressOffset) + progressOffset;
     progressCallback(static_cast<int>(progress));
 }
 
@@ -201,11 +345,28 @@ void ControllerOTA::sendPart(Stream &in, uint32_t totalSize) const {
 }
 
 void ControllerOTA::onReceive(NimBLERemoteCharacteristic *pRemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify) {
+    if (length == 0) {
+        return;
+    }
+    if (pData[0] == DFU_WINDOWED_ACK || pData[0] == DFU_WINDOWED_NAK || pData[0] == DFU_WINDOWED_REJECTED ||
+        (pData[0] == DFU_WINDOWED_INSTALLING && transferMode == DFU_MODE_WINDOWED)) {
+        // Handled by the transfer loop, acknowledgements arrive too often to log
+        WindowedMessage message{};
+        message.length = std::min(length, OTA_WINDOWED_MAX_MESSAGE);
+        memcpy(message.data, pData, message.length);
+        xQueueSend(windowedMessages, &message, 0);
+        return;
+    }
+    if (pData[0] == 0xAA) {
+        // Set before the signal, the update loop reads the mode as soon as it sees 0xAA
+        transferMode = length > 1 ? pData[1] : 0x00;
+        capabilities = length > 2 ? pData[2] : 0x00;
+    }
     lastSignal = pData[0];
     ESP_LOGI("ControllerOTA", "Received signal 0x%x", lastSignal);
     switch (lastSignal) {
     case 0xAA:
-        ESP_LOGI("ControllerOTA", "Starting transfer, only slow mode supported as of yet");
+        ESP_LOGI("ControllerOTA", "Starting transfer, %s mode", transferMode == DFU_MODE_WINDOWED ? "windowed" : "slow");
         break;
     case 0xF1:
         ESP_LOGI("ControllerOTA", "Next part requested");
@@ -1,7 +1,10 @@
 #ifndef CONTROLLEROTA_H
 #define CONTROLLEROTA_H
 
+#include "WindowedTransfer.h"
 #include <Arduino.h>
+#include <FS.h>
+#include <HTTPClient.h>
 #include <NimBLEDevice.h>
 #include <WiFiClientSecure.h>
 
@@ -11,6 +14,9 @@ constexpr char CHARACTERISTIC_OTA_BL_UUID_TX[] = "fe590003-54ae-4a28-9f74-dfccb2
 
 constexpr uint16_t MTU = 120;
 constexpr uint16_t PART_SIZE = 19000;
+constexpr unsigned long MODE_TIMEOUT_MS = 5000;
+constexpr unsigned long STREAM_TIMEOUT_MS = 30000; // without download progress the windowed transfer gives up
+constexpr uint8_t WINDOWED_MESSAGE_QUEUE_SIZE = 8;
 
 using ctr_progress_callback_t = std::function<void(int progress)>;
 
@@ -20,11 +26,16 @@ class ControllerOTA {
     ~ControllerOTA() = default;
     void init(NimBLEClient *client, const ctr_progress_callback_t &progress_callback);
 
-    void update(WiFiClientSecure &wifi_client, const String &release_url);
+    // current_version is the controller firmware a delta image may apply to, empty if unknown
+    void update(WiFiClientSecure &wifi_client, const String &release_url, const String &current_version = "");
 
   private:
-    bool downloadFile(WiFiClientSecure &wifi_client, const String &release_url);
-    void runUpdate(Stream &in, uint32_t size);
+    int openFirmware(HTTPClient &http, WiFiClientSecure &wifi_client, const String &release_url);
+    bool downloadFile(Stream &in, int len);
+    bool negotiate();
+    void announce(uint32_t size, uint16_t packetSize);
+    void runUpdate(File &in, uint32_t size);
+    bool runWindowedUpdate(Stream &in, uint32_t size);
     void sendPart(Stream &in, uint32_t totalSize) const;
     void sendData(uint8_t *data, uint16_t len) const;
     void fillBuffer(Stream &in, uint8_t *buffer, uint16_t len) const;
@@ -37,10 +48,19 @@ class ControllerOTA {
 
     ctr_progress_callback_t progressCallback = nullptr;
 
+    struct WindowedMessage {
+        uint8_t length;
+        uint8_t data[OTA_WINDOWED_MAX_MESSAGE];
+    };
+    QueueHandle_t windowedMessages = nullptr;
+
     bool interrupted = false;
     uint8_t lastSignal = 0x00;
+    volatile uint8_t transferMode = 0x00;
+    volatile uint8_t capabilities = 0x00;
     uint32_t currentPart = 0;
     uint32_t fileParts = 0;
+    int progressOffset = 50; // share of the progress taken by staging the download in SPIFFS
 };
 
 #endif // CONTROLLEROTA_H
@@ -6,6 +6,8 @@
 #include <HTTPUpdate.h>
 #include <Update.h>
 #include <WiFiClientSecure.h>
+#include <image_decoder.hpp>
+#include <running_firmware.hpp>
 
 GitHubOTA::GitHubOTA(const String &display_version, const String &controller_version, const String &release_url,
                      const phase_callback_t &phase_callback, const progress_callback_t &progress_callback,
@@ -15,6 +17,8 @@ GitHubOTA::GitHubOTA(const String &display_version, const String &controller_ver
 
     _version = from_string(display_version.substring(1).c_str());
     _controller_version = from_string(controller_version.substring(1).c_str());
+    _version_string = display_version;
+    _controller_version_string = controller_version;
     _release_url = release_url;
     _firmware_name = firmware_name;
     _filesystem_name = filesystem_name;
@@ -40,32 +44,56 @@ void GitHubOTA::init(NimBLEClient *client) {
     _controller_ota.init(client, [this](int progress) { _progress_callback(PHASE_CONTROLLER_FW, progress); });
 }
 
-void GitHubOTA::checkForUpdates() {
+bool GitHubOTA::checkForUpdates() {
     const char *TAG = "checkForUpdates";
+    std::lock_guard<std::mutex> client_lock(_client_mutex);
+    String release_url;
+    {
+        std::lock_guard<std::mutex> lock(_state_mutex);
+        release_url = _release_url;
+    }
 
-    _latest_url = get_updated_base_url_via_redirect(_wifi_client, _release_url);
-    if (_latest_url != "") {
-        ESP_LOGI(TAG, "base_url %s\n", _latest_url.c_str());
+    String version;
+    String latest_url = get_updated_base_url_via_redirect(_wifi_client, release_url);
+    if (latest_url != "") {
+        ESP_LOGI(TAG, "base_url %s\n", latest_url.c_str());
 
-        auto last_slash = _latest_url.lastIndexOf('/', _latest_url.length() - 2);
-        auto semver_str = _latest_url.substring(last_slash + 2);
-        semver_str.replace("/", "");
-        ESP_LOGI(TAG, "semver_str %s\n", semver_str.c_str());
-        _latest_version_string = semver_str;
-        _latest_version = from_string(semver_str.c_str());
+        auto last_slash = latest_url.lastIndexOf('/', latest_url.length() - 2);
+        version = latest_url.substring(last_slash + 2);
+        version.replace("/", "");
+        ESP_LOGI(TAG, "semver_str %s\n", version.c_str());
     } else {
-        _latest_url = _release_url + "/";
-        _latest_url.replace("tag", "download");
-        String version = get_updated_version_via_txt_file(_wifi_client, _latest_url);
-        version = version.substring(1);
-        _latest_version_string = version;
-        _latest_version = from_string(version.c_str());
+        latest_url = release_url + "/";
+        latest_url.replace("tag", "download");
+        // The cached version.txt is only valid for the channel it was fetched from
+        if (latest_url != _version_txt_url) {
+            _version_txt = "";
+            _version_txt_etag = "";
+            _version_txt_url = latest_url;
+        }
+        if (!get_updated_version_via_txt_file(_wifi_client, latest_url, _version_txt, _version_txt_etag)) {
+            return false;
+        }
+        version = _version_txt.substring(1);
+    }
+    if (version.length() == 0) {
+        return false;
     }
+
+    std::lock_guard<std::mutex> lock(_state_mutex);
+    _latest_url = latest_url;
+    _latest_version_string = version;
+    _latest_version = from_string(version.c_str());
+    return true;
 }
 
-String GitHubOTA::getCurrentVersion() const { return _latest_version_string; }
+String GitHubOTA::getCurrentVersion() const {
+    std::lock_guard<std::mutex> lock(_state_mutex);
+    return _latest_version_string;
+}
 
 bool GitHubOTA::isUpdateAvailable(bool controller) const {
+    std::lock_guard<std::mutex> lock(_state_mutex);
     if (controller) {
         return update_required(_latest_version, _controller_version);
     }
@@ -74,12 +102,14 @@ bool GitHubOTA::isUpdateAvailable(bool controller) const {
 
 void GitHubOTA::update(bool controller, bool display) {
     const char *TAG = "update";
+    // Waits for a running check, the client cannot serve both
+    std::lock_guard<std::mutex> client_lock(_client_mutex);
 
     if (controller && update_required(_latest_version, _controller_version)) {
         ESP_LOGI(TAG, "Controller update is required, running firmware update.");
         this->phase = PHASE_CONTROLLER_FW;
         this->_phase_callback(PHASE_CONTROLLER_FW);
-        _controller_ota.update(_wifi_client, _latest_url + _controller_firmware_name);
+        _controller_ota.update(_wifi_client, _latest_url + _controller_firmware_name, _controller_version_string);
         ESP_LOGI(TAG, "Controller update successful. Restarting...\n");
     }
 
@@ -90,7 +120,7 @@ void GitHubOTA::update(bool controller, bool display) {
         auto result = update_firmware(_latest_url + _firmware_name);
 
         if (result != HTTP_UPDATE_OK) {
-            ESP_LOGI(TAG, "Update failed: %s\n", Updater.getLastErrorString().c_str());
+            ESP_LOGI(TAG, "Update failed, an interrupted download continues with the next update\n");
             return;
         }
 
@@ -115,27 +145,113 @@ void GitHubOTA::update(bool controller, bool display) {
     ESP_LOGI(TAG, "No updates found\n");
 }
 
-void GitHubOTA::setReleaseUrl(const String &release_url) { this->_release_url = release_url; }
+void GitHubOTA::setReleaseUrl(const String &release_url) {
+    std::lock_guard<std::mutex> lock(_state_mutex);
+    this->_release_url = release_url;
+}
 
 HTTPUpdateResult GitHubOTA::update_firmware(const String &url) {
     const char *TAG = "update_firmware";
     ESP_LOGI(TAG, "Download URL: %s\n", url.c_str());
 
-    auto result = Updater.update(_wifi_client, url);
-
-    print_update_result(Updater, result, TAG);
-    return result;
+    // The delta from the running release is the smallest download, the plain image is the fallback. An interrupted
+    // download of the plain image is continued instead, the compressed ones cannot be resumed.
+    if (!_resumable_update.isPending(url) &&
+        (update_image(compressed_image_url(url, _version_string), U_FLASH, _version_string) ||
+         update_image(compressed_image_url(url), U_FLASH))) {
+        return HTTP_UPDATE_OK;
+    }
+    update_started();
+    const bool updated =
+        _resumable_update.update(_wifi_client, url, [this](int progress) { _progress_callback(phase, progress); });
+    if (!updated) {
+        ESP_LOGI(TAG, "Firmware download failed\n");
+        return HTTP_UPDATE_FAILED;
+    }
+    update_finished();
+    return HTTP_UPDATE_OK;
 }
 
 HTTPUpdateResult GitHubOTA::update_filesystem(const String &url) {
     const char *TAG = "update_filesystem";
     ESP_LOGI(TAG, "Download URL: %s\n", url.c_str());
 
+    // Filesystem images are only published compressed, there is no running filesystem image to apply a delta to
+    if (update_image(compressed_image_url(url), U_SPIFFS)) {
+        return HTTP_UPDATE_OK;
+    }
     auto result = Updater.updateSpiffs(_wifi_client, url);
     print_update_result(Updater, result, TAG);
     return result;
 }
 
 void GitHubOTA::setControllerVersion(const String &controller_version) {
+    std::lock_guard<std::mutex> lock(_state_mutex);
     _controller_version = from_string(controller_version.substring(1).c_str());
+    _controller_version_string = controller_version;
+}
+
+bool GitHubOTA::update_image(const String &url, int command, const String &base_version) {
+    const char *TAG = "update_image";
+    HTTPClient http;
+    if (!http.begin(_wifi_client, url)) {
+        return false;
+    }
+    http.useHTTP10(true);
+    http.setTimeout(1800);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    http.setUserAgent("ESP32-http-Update");
+    const int code = http.GET();
+    const int len = http.getSize();
+    if (code != HTTP_CODE_OK || len <= 0) {
+        ESP_LOGI(TAG, "No image at %s (%d), falling back\n", url.c_str(), code);
+        http.end();
+        return false;
+    }
+    ESP_LOGI(TAG, "Download URL: %s\n", url.c_str());
+
+    image_decoder decoder(
+        [command, &base_version, TAG](const image_header &header) {
+            if (header.format == IMAGE_FORMAT_DELTA &&
+                (command != U_FLASH || base_version.length() == 0 ||
+                 !running_firmware_matches(header.base_size, header.base_sha256))) {
+                ESP_LOGW(TAG, "Delta image does not apply to the running firmware\n");
+                return false;
+            }
+            return Update.begin(header.output_size, command);
+        },
+        [](const uint8_t *data, size_t length) { return Update.write(const_cast<uint8_t *>(data), length) == length; },
+        [](uint32_t offset, uint8_t *buffer, size_t length) { return read_running_firmware(offset, buffer, length); });
+    decoder.reset(len);
+    update_started();
+
+    WiFiClient *stream = http.getStreamPtr();
+    uint8_t buffer[1024];
+    int received = 0;
+    int progress = -1;
+    unsigned long progressed = millis();
+    while (received < len && !decoder.failed() && millis() - progressed < STREAM_TIMEOUT_MS) {
+        const int available = stream->available();
+        if (available <= 0) {
+            delay(1);
+            continue;
+        }
+        const size_t read = stream->readBytes(buffer, std::min<size_t>(sizeof(buffer), available));
+        decoder.feed(buffer, read);
+        received += read;
+        progressed = millis();
+        if (100 * received / len != progress) {
+            progress = 100 * received / len;
+            _progress_callback(phase, progress);
+        }
+    }
+    http.end();
+
+    if (received == len && decoder.finish() && Update.end()) {
+        update_finished();
+        return true;
+    }
+    ESP_LOGE(TAG, "Image update failed after %d / %d bytes, error %d\n", received, len, Update.getError());
+    Update.abort();
+    return false;
 }
@@ -2,8 +2,10 @@
 #define ESP_GITHUB_OTA_H
 
 #include "ControllerOTA.h"
+#include "ResumableUpdate.h"
 #include <HTTPUpdate.h>
 #include <WiFiClientSecure.h>
+#include <mutex>
 
 #include "semver.h"
 
@@ -26,7 +28,8 @@ class GitHubOTA {
               const String &controller_firmware_name = "controller.bin");
 
     void init(NimBLEClient *client);
-    void checkForUpdates();
+    // Blocks for the requests to GitHub, safe to call from a background task. False if the check failed.
+    bool checkForUpdates();
     bool isUpdateAvailable(bool controller = false) const;
     String getCurrentVersion() const;
     void update(bool controller = true, bool display = true);
@@ -38,21 +41,31 @@ class GitHubOTA {
 
     HTTPUpdateResult update_filesystem(const String &url);
     HTTPUpdateResult update_firmware(const String &url);
+    bool update_image(const String &url, int command, const String &base_version = "");
 
     uint8_t phase = PHASE_IDLE;
     semver_t _version;
     semver_t _controller_version;
+    String _version_string;
+    String _controller_version_string;
     String _latest_version_string;
     semver_t _latest_version = {0, 0, 0, nullptr, nullptr};
     String _release_url;
     String _latest_url;
+    String _version_txt;
+    String _version_txt_url;
+    String _version_txt_etag;
     String _firmware_name;
     String _filesystem_name;
     String _controller_firmware_name;
     WiFiClientSecure _wifi_client;
     ControllerOTA _controller_ota;
+    ResumableUpdate _resumable_update;
     phase_callback_t _phase_callback = nullptr;
     progress_callback_t _progress_callback = nullptr;
+    // The client is used by one check or update at a time, the state is read by other tasks meanwhile
+    std::mutex _client_mutex;
+    mutable std::mutex _state_mutex;
 };
 
 #endif
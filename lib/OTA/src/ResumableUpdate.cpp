@@ -0,0 +1,180 @@
+#include "ResumableUpdate.h"
+#include <HTTPClient.h>
+#include <esp_image_format.h>
+#include <esp_ota_ops.h>
+#include <memory>
+
+bool ResumableUpdate::isPending(const String &url) {
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(nullptr);
+    const State state = load();
+    return partition != nullptr && state.url == url && state.address == partition->address && state.etag.length() > 0 &&
+           state.written > 0 && state.written < state.size;
+}
+
+bool ResumableUpdate::update(WiFiClientSecure &wifi_client, const String &url,
+                             const resumable_progress_callback_t &progress_callback) {
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(nullptr);
+    if (partition == nullptr) {
+        ESP_LOGE("ResumableUpdate", "No OTA partition to update");
+        return false;
+    }
+    const bool resume = isPending(url);
+    State state = resume ? load() : State();
+    state.url = url;
+    state.address = partition->address;
+
+    HTTPClient http;
+    if (!http.begin(wifi_client, url)) {
+        ESP_LOGE("ResumableUpdate", "Failed to start http client");
+        return false;
+    }
+    http.useHTTP10(true);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    http.setUserAgent("ESP32-http-Update");
+    const char *headers[] = {"ETag"};
+    http.collectHeaders(headers, 1);
+    if (resume) {
+        http.addHeader("Range", "bytes=" + String(state.written) + "-");
+        // A changed image is sent whole instead of the range
+        http.addHeader("If-Range", state.etag);
+    }
+    const int code = http.GET();
+    const int len = http.getSize();
+    if (code == HTTP_CODE_PARTIAL_CONTENT && resume && len > 0 && state.written + len == state.size) {
+        ESP_LOGI("ResumableUpdate", "Resuming download at %u / %u bytes", state.written, state.size);
+    } else if (code == HTTP_CODE_OK && len > 0 && static_cast<uint32_t>(len) <= partition->size) {
+        state.etag = http.header("ETag");
+        state.size = len;
+        state.written = 0;
+    } else {
+        ESP_LOGE("ResumableUpdate", "HTTP error: %d, %d bytes", code, len);
+        if (resume && code > 0) {
+            // A resume the server answered but won't serve fails the same way every time, the next attempt starts
+            // over. Connection errors keep the progress.
+            clear();
+        }
+        http.end();
+        return false;
+    }
+    // Without an ETag a resumed download could mix two images, it starts over every time
+    const bool resumable = state.etag.length() > 0;
+    if (resumable) {
+        save(state);
+    } else {
+        clear();
+    }
+
+    std::unique_ptr<uint8_t[]> sector(new (std::nothrow) uint8_t[RESUMABLE_UPDATE_SECTOR]);
+    if (!sector) {
+        ESP_LOGE("ResumableUpdate", "Not enough memory for the download buffer");
+        http.end();
+        return false;
+    }
+    WiFiClient *stream = http.getStreamPtr();
+    size_t filled = 0;
+    uint32_t checkpoint = state.written;
+    unsigned long progressed = millis();
+    int progress = -1;
+    bool failed = false;
+    while (!failed && state.written < state.size) {
+        const int available = stream->available();
+        if (available <= 0) {
+            if (!stream->connected() || millis() - progressed > RESUMABLE_UPDATE_TIMEOUT_MS) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        const size_t wanted = std::min<size_t>(RESUMABLE_UPDATE_SECTOR - filled, state.size - state.written - filled);
+        filled += stream->readBytes(sector.get() + filled, std::min<size_t>(wanted, available));
+        progressed = millis();
+        if (filled < RESUMABLE_UPDATE_SECTOR && state.written + filled < state.size) {
+            continue;
+        }
+        if (state.written == 0 && sector[0] != 0xE9) {
+            ESP_LOGE("ResumableUpdate", "Magic header does not start with 0xE9");
+            clear();
+            http.end();
+            return false;
+        }
+        failed = !writeSector(partition, state.written, sector.get(), filled);
+        if (!failed) {
+            state.written += filled;
+            filled = 0;
+        }
+        if (resumable && state.written - checkpoint >= RESUMABLE_UPDATE_CHECKPOINT) {
+            save(state);
+            checkpoint = state.written;
+        }
+        if (static_cast<int>(100ULL * state.written / state.size) != progress) {
+            progress = static_cast<int>(100ULL * state.written / state.size);
+            progress_callback(progress);
+        }
+    }
+    http.end();
+
+    if (state.written < state.size) {
+        if (resumable) {
+            save(state);
+        }
+        ESP_LOGW("ResumableUpdate", "Download interrupted at %u / %u bytes", state.written, state.size);
+        return false;
+    }
+    // Complete, a corrupt image has to be downloaded again anyway
+    clear();
+    return finish(partition);
+}
+
+ResumableUpdate::State ResumableUpdate::load() {
+    State state;
+    preferences.begin(RESUMABLE_UPDATE_PREFERENCES, true);
+    state.url = preferences.getString("url", "");
+    state.etag = preferences.getString("etag", "");
+    state.address = preferences.getUInt("addr", 0);
+    state.size = preferences.getUInt("size", 0);
+    state.written = preferences.getUInt("written", 0);
+    preferences.end();
+    return state;
+}
+
+void ResumableUpdate::save(const State &state) {
+    preferences.begin(RESUMABLE_UPDATE_PREFERENCES, false);
+    preferences.putString("url", state.url);
+    preferences.putString("etag", state.etag);
+    preferences.putUInt("addr", state.address);
+    preferences.putUInt("size", state.size);
+    preferences.putUInt("written", state.written);
+    preferences.end();
+}
+
+void ResumableUpdate::clear() {
+    preferences.begin(RESUMABLE_UPDATE_PREFERENCES, false);
+    preferences.clear();
+    preferences.end();
+}
+
+bool ResumableUpdate::writeSector(const esp_partition_t *partition, uint32_t offset, const uint8_t *data, size_t length) {
+    // Offsets are whole sectors, only the last one is partly filled
+    if (esp_partition_erase_range(partition, offset, RESUMABLE_UPDATE_SECTOR) != ESP_OK ||
+        esp_partition_write(partition, offset, data, length) != ESP_OK) {
+        ESP_LOGE("ResumableUpdate", "Flash write failed at offset %u", offset);
+        return false;
+    }
+    return true;
+}
+
+bool ResumableUpdate::finish(const esp_partition_t *partition) {
+    // Checks the segments and the SHA-256 the build appends, the same check the bootloader does
+    const esp_partition_pos_t position = {partition->address, partition->size};
+    esp_image_metadata_t metadata;
+    if (esp_image_verify(ESP_IMAGE_VERIFY, &position, &metadata) != ESP_OK) {
+        ESP_LOGE("ResumableUpdate", "Downloaded image does not verify, discarding it");
+        return false;
+    }
+    if (esp_ota_set_boot_partition(partition) != ESP_OK) {
+        ESP_LOGE("ResumableUpdate", "Failed to set boot partition %s", partition->label);
+        return false;
+    }
+    ESP_LOGI("ResumableUpdate", "Verified %u byte image, booting from %s next", metadata.image_len, partition->label);
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef RESUMABLEUPDATE_H
+#define RESUMABLEUPDATE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFiClientSecure.h>
+#include <esp_partition.h>
+
+constexpr char RESUMABLE_UPDATE_PREFERENCES[] = "ota-resume";
+constexpr size_t RESUMABLE_UPDATE_SECTOR = 4096;             // flash erase unit, the download is written per sector
+constexpr uint32_t RESUMABLE_UPDATE_CHECKPOINT = 64 * 1024;  // progress saved to NVS every this many bytes
+constexpr unsigned long RESUMABLE_UPDATE_TIMEOUT_MS = 30000; // without data the download is paused
+
+using resumable_progress_callback_t = std::function<void(int progress)>;
+
+// Downloads a plain firmware image into the inactive OTA partition. What was written is kept in NVS together with
+// the ETag of the image, so after a dropped connection or a reboot the next attempt continues with a range request
+// instead of starting over. The boot partition is only switched once the whole image verifies.
+class ResumableUpdate {
+  public:
+    ResumableUpdate() = default;
+    ~ResumableUpdate() = default;
+
+    // True if an interrupted download of url can be continued
+    bool isPending(const String &url);
+    // True once the image is complete, verified and set as the boot partition
+    bool update(WiFiClientSecure &wifi_client, const String &url, const resumable_progress_callback_t &progress_callback);
+
+  private:
+    struct State {
+        String url;
+        String etag;
+        uint32_t address = 0;
+        uint32_t size = 0;
+        uint32_t written = 0;
+    };
+
+    State load();
+    void save(const State &state);
+    void clear();
+    bool writeSector(const esp_partition_t *partition, uint32_t offset, const uint8_t *data, size_t length);
+    bool finish(const esp_partition_t *partition);
+
+    Preferences preferences;
+};
+
+#endif // RESUMABLEUPDATE_H
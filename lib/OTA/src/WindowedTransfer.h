@@ -0,0 +1,286 @@
+#ifndef WINDOWEDTRANSFER_H
+#define WINDOWEDTRANSFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <windowed_transfer.hpp>
+
+// Fast controller update, used when the controller answers the start command (0xFD) with DFU_MODE_WINDOWED.
+// Packets are written without response and carry their part and offset. Every part ends with its length and CRC32,
+// the controller then acknowledges the part or lists the packets it is missing so only those are sent again.
+// Two parts are in flight at a time, the controller double buffers them. Once all parts are acknowledged the SHA-256
+// of the firmware is sent and the controller installs the update only if it matches. The message types are shared
+// with the receiver in windowed_transfer.hpp of ble_ota_dfu.
+constexpr uint16_t OTA_WINDOWED_MAX_PAYLOAD = 240;
+constexpr size_t OTA_WINDOWED_MAX_MESSAGE = 64;
+constexpr uint16_t OTA_WINDOWED_PARTS_IN_FLIGHT = 2;
+constexpr unsigned long OTA_WINDOWED_RETRY_MS = 1000; // no answer for this long asks for the part status again
+constexpr uint8_t OTA_WINDOWED_MAX_RETRIES = 10;
+constexpr uint16_t OTA_STREAM_BUFFERED_PARTS = OTA_WINDOWED_PARTS_IN_FLIGHT + 1; // one more downloads meanwhile
+
+class WindowedTransferSender {
+  public:
+    // Reads length bytes of the firmware at offset
+    using read_callback_t = std::function<bool(uint32_t offset, uint8_t *buffer, uint16_t length)>;
+    // Writes a packet without response, false when the stack has no buffer left and the packet must be retried
+    using write_callback_t = std::function<bool(const uint8_t *data, uint16_t length)>;
+    // Fills the SHA-256 of the firmware, called once after every part has been read
+    using digest_callback_t = std::function<void(uint8_t *digest)>;
+
+    enum class State { RUNNING, FINISHED, FAILED };
+
+    WindowedTransferSender(uint32_t size, uint16_t partSize, uint16_t payloadSize, read_callback_t read,
+                           write_callback_t write, digest_callback_t digest)
+        : size(size), partSize(partSize), payloadSize(payloadSize), parts((size + partSize - 1) / partSize),
+          read(std::move(read)), write(std::move(write)), digest(std::move(digest)) {}
+
+    uint16_t getParts() const { return parts; }
+    uint16_t getAcknowledgedParts() const { return base; }
+    uint32_t getRetransmissions() const { return retransmissions; }
+
+    void onMessage(const uint8_t *data, size_t length, unsigned long now) {
+        if (length > 0 && (data[0] == DFU_WINDOWED_INSTALLING || data[0] == DFU_WINDOWED_REJECTED)) {
+            state = data[0] == DFU_WINDOWED_INSTALLING ? State::FINISHED : State::FAILED;
+            return;
+        }
+        if (length < 3) {
+            return;
+        }
+        const uint16_t part = (data[1] << 8) | data[2];
+        switch (data[0]) {
+        case DFU_WINDOWED_ACK:
+            // Parts are committed in order, an acknowledgement covers all earlier ones
+            if (part >= base && part < next) {
+                base = part + 1;
+                lastAnswer = now;
+                retries = 0;
+            }
+            break;
+        case DFU_WINDOWED_NAK:
+            if (length < 4 || part < base || part >= next) {
+                break;
+            }
+            lastAnswer = now;
+            if (data[3] == 0) {
+                queuePart(part);
+                retransmissions += packetCount(part);
+            } else {
+                for (size_t i = 0; i < data[3] && 5 + 2 * i < length; i++) {
+                    queue.push_back({part, static_cast<uint16_t>((data[4 + 2 * i] << 8) | data[5 + 2 * i])});
+                    retransmissions++;
+                }
+                queue.push_back({part, END});
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    State poll(unsigned long now) {
+        if (state != State::RUNNING) {
+            return state;
+        }
+        if (lastAnswer == 0) {
+            lastAnswer = now;
+        }
+        while (next < parts && next < base + OTA_WINDOWED_PARTS_IN_FLIGHT) {
+            queuePart(next++);
+        }
+        if (base == parts && !digestQueued) {
+            queue.push_back({END, DIGEST});
+            digestQueued = true;
+            lastAnswer = now;
+        }
+        while (!queue.empty() && state == State::RUNNING) {
+            if (!send(queue.front())) {
+                return state;
+            }
+            queue.pop_front();
+        }
+        if ((base < next || base == parts) && now - lastAnswer > OTA_WINDOWED_RETRY_MS) {
+            // Lost track of the oldest part, its end marker makes the controller report what it still needs. Once
+            // every part is acknowledged it is the digest that went unanswered.
+            if (++retries > OTA_WINDOWED_MAX_RETRIES) {
+                state = State::FAILED;
+                return state;
+            }
+            lastAnswer = now;
+            queue.push_back(base == parts ? Packet{END, DIGEST} : Packet{base, END});
+        }
+        return state;
+    }
+
+  private:
+    static constexpr uint16_t END = 0xFFFF;
+    static constexpr uint16_t DIGEST = 0xFFFE;
+
+    struct Packet {
+        uint16_t part;
+        uint16_t index; // END for the end marker, DIGEST for the digest of the whole firmware
+    };
+
+    uint16_t partLength(uint16_t part) const {
+        const uint32_t offset = static_cast<uint32_t>(part) * partSize;
+        return static_cast<uint16_t>(std::min<uint32_t>(partSize, size - offset));
+    }
+
+    uint16_t packetCount(uint16_t part) const { return (partLength(part) + payloadSize - 1) / payloadSize; }
+
+    void queuePart(uint16_t part) {
+        if (part == crcs.size()) {
+            crcs.push_back(partCrc(part));
+        }
+        const uint16_t count = packetCount(part);
+        for (uint16_t index = 0; index < count; index++) {
+            queue.push_back({part, index});
+        }
+        queue.push_back({part, END});
+    }
+
+    uint32_t partCrc(uint16_t part) {
+        const uint32_t start = static_cast<uint32_t>(part) * partSize;
+        const uint16_t length = partLength(part);
+        uint8_t chunk[256];
+        uint32_t crc = 0;
+        for (uint16_t offset = 0; offset < length; offset += sizeof(chunk)) {
+            const uint16_t chunkLength = std::min<uint16_t>(sizeof(chunk), length - offset);
+            if (!read(start + offset, chunk, chunkLength)) {
+                state = State::FAILED;
+                return 0;
+            }
+            crc = windowed_crc32(chunk, chunkLength, crc);
+        }
+        return crc;
+    }
+
+    bool send(const Packet &packet) {
+        if (packet.index == DIGEST) {
+            uint8_t message[1 + DFU_WINDOWED_DIGEST_SIZE] = {DFU_WINDOWED_DIGEST};
+            if (!digestReady) {
+                digest(sha256);
+                digestReady = true;
+            }
+            memcpy(message + 1, sha256, DFU_WINDOWED_DIGEST_SIZE);
+            return write(message, sizeof(message));
+        }
+        const uint16_t length = partLength(packet.part);
+        if (packet.index == END) {
+            const uint32_t crc = crcs[packet.part];
+            const uint8_t end[] = {DFU_WINDOWED_END,
+                                   static_cast<uint8_t>(packet.part >> 8),
+                                   static_cast<uint8_t>(packet.part & 0xFF),
+                                   static_cast<uint8_t>(length >> 8),
+                                   static_cast<uint8_t>(length & 0xFF),
+                                   static_cast<uint8_t>(crc >> 24),
+                                   static_cast<uint8_t>((crc >> 16) & 0xFF),
+                                   static_cast<uint8_t>((crc >> 8) & 0xFF),
+                                   static_cast<uint8_t>(crc & 0xFF)};
+            return write(end, sizeof(end));
+        }
+        const uint16_t offset = packet.index * payloadSize;
+        if (offset >= length) {
+            return true;
+        }
+        const uint16_t payload = std::min<uint16_t>(payloadSize, length - offset);
+        buffer.resize(DFU_WINDOWED_DATA_HEADER + payloadSize);
+        buffer[0] = DFU_WINDOWED_DATA;
+        buffer[1] = packet.part >> 8;
+        buffer[2] = packet.part & 0xFF;
+        buffer[3] = offset >> 8;
+        buffer[4] = offset & 0xFF;
+        if (!read(static_cast<uint32_t>(packet.part) * partSize + offset, buffer.data() + DFU_WINDOWED_DATA_HEADER,
+                  payload)) {
+            state = State::FAILED;
+            return false;
+        }
+        return write(buffer.data(), DFU_WINDOWED_DATA_HEADER + payload);
+    }
+
+    const uint32_t size;
+    const uint16_t partSize;
+    const uint16_t payloadSize;
+    const uint16_t parts;
+    read_callback_t read;
+    write_callback_t write;
+    digest_callback_t digest;
+
+    State state = State::RUNNING;
+    uint16_t base = 0; // oldest part not acknowledged yet
+    uint16_t next = 0; // next part to send
+    std::deque<Packet> queue;
+    std::vector<uint8_t> buffer;
+    std::vector<uint32_t> crcs;
+    uint8_t sha256[DFU_WINDOWED_DIGEST_SIZE] = {};
+    bool digestQueued = false;
+    bool digestReady = false;
+    unsigned long lastAnswer = 0;
+    uint8_t retries = 0;
+    uint32_t retransmissions = 0;
+};
+
+// The parts around the window of a firmware that can only be read once, e.g. while it downloads. Parts are loaded in
+// order into a ring of slots and a slot is reused once its part has been acknowledged, so the download runs ahead of
+// the transfer by at most the number of slots.
+class WindowedStreamBuffer {
+  public:
+    // Reads up to length bytes following the previous ones, returns 0 when none are available yet
+    using fill_callback_t = std::function<size_t(uint8_t *buffer, size_t length)>;
+
+    WindowedStreamBuffer(uint32_t size, uint16_t partSize, uint16_t slots, fill_callback_t fill)
+        : size(size), partSize(partSize), slots(slots), storage(static_cast<size_t>(partSize) * slots),
+          fill(std::move(fill)) {}
+
+    // Loads what the stream has for the free slots without waiting, returns the number of bytes loaded
+    size_t load() {
+        size_t total = 0;
+        while (loaded < size) {
+            const uint32_t part = loaded / partSize;
+            if (part >= static_cast<uint32_t>(released) + slots) {
+                break;
+            }
+            const uint32_t partStart = part * partSize;
+            const uint32_t partEnd = std::min<uint32_t>(partStart + partSize, size);
+            const size_t count = fill(slot(part) + (loaded - partStart), partEnd - loaded);
+            if (count == 0) {
+                break;
+            }
+            loaded += count;
+            total += count;
+        }
+        return total;
+    }
+
+    // Parts before acknowledgedParts will not be read again
+    void release(uint16_t acknowledgedParts) { released = std::max(released, acknowledgedParts); }
+
+    // Copies a range within one part, false while it is not loaded yet
+    bool read(uint32_t offset, uint8_t *buffer, uint16_t length) {
+        const uint32_t part = offset / partSize;
+        const uint32_t partOffset = offset - part * partSize;
+        if (part < released || offset + length > loaded || partOffset + length > partSize) {
+            return false;
+        }
+        memcpy(buffer, slot(part) + partOffset, length);
+        return true;
+    }
+
+  private:
+    uint8_t *slot(uint32_t part) { return storage.data() + static_cast<size_t>(part % slots) * partSize; }
+
+    const uint32_t size;
+    const uint16_t partSize;
+    const uint16_t slots;
+    std::vector<uint8_t> storage;
+    fill_callback_t fill;
+
+    uint32_t loaded = 0;
+    uint16_t released = 0;
+};
+
+#endif // WINDOWEDTRANSFER_H
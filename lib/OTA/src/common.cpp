@@ -38,7 +38,8 @@ String get_redirect_location(WiFiClientSecure &wifi_client, String &initial_url)
         return "";
     }
 
-    int httpCode = https.GET();
+    // Only the location is needed, a release page without redirect is a lot of HTML
+    int httpCode = https.sendRequest("HEAD");
     if (httpCode != HTTP_CODE_FOUND) {
         ESP_LOGE(TAG, "[HTTPS] GET... failed, No redirect\n");
         char errorText[128];
@@ -53,7 +54,7 @@ String get_redirect_location(WiFiClientSecure &wifi_client, String &initial_url)
     return redirect_url;
 }
 
-String get_updated_version_via_txt_file(WiFiClientSecure &wifi_client, String &_release_url) {
+bool get_updated_version_via_txt_file(WiFiClientSecure &wifi_client, String &_release_url, String &version, String &etag) {
     const char *TAG = "get_updated_version_via_txt_file";
     HTTPClient https;
     https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
@@ -62,20 +63,33 @@ String get_updated_version_via_txt_file(WiFiClientSecure &wifi_client, String &_
     ESP_LOGI(TAG, "url: %s\n", url.c_str());
     if (!https.begin(wifi_client, url)) {
         ESP_LOGE(TAG, "[HTTPS] Unable to connect\n");
-        return "";
+        return false;
     }
 
+    const char *headers[] = {"ETag"};
+    https.collectHeaders(headers, 1);
+    if (etag.length() > 0 && version.length() > 0) {
+        https.addHeader("If-None-Match", etag);
+    }
     int httpCode = https.GET();
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        https.end();
+        ESP_LOGI(TAG, "not modified: %s\n", version.c_str());
+        return true;
+    }
     if (httpCode != HTTP_CODE_OK) {
         ESP_LOGE(TAG, "[HTTPS] GET... failed\n");
         char errorText[128];
         int errCode = wifi_client.lastError(errorText, sizeof(errorText));
         ESP_LOGV(TAG, "httpCode: %d, errorCode %d: %s\n", httpCode, errCode, errorText);
+        https.end();
+        return false;
     }
-    String version = https.getString();
+    version = https.getString();
+    etag = https.header("ETag");
     https.end();
     ESP_LOGI(TAG, "returns: %s\n", version.c_str());
-    return version;
+    return version.length() > 0;
 }
 
 void print_update_result(Updater updater, HTTPUpdateResult result, const char *TAG) {
@@ -98,6 +112,14 @@ bool update_required(semver_t _new_version, semver_t _current_version) {
     return _new_version > _current_version;
 }
 
+String compressed_image_url(const String &url, const String &base_version) {
+    String base = url.endsWith(".bin") ? url.substring(0, url.length() - 4) : url;
+    if (base_version.length() > 0) {
+        return base + "-from-" + base_version + ".gmz";
+    }
+    return base + ".gmz";
+}
+
 void update_started() { ESP_LOGI("update_started", "HTTP update process started\n"); }
 
 void update_finished() { ESP_LOGI("update_finished", "HTTP update process finished\n"); }
@@ -11,12 +11,16 @@ using Updater = HTTPUpdate;
 
 String get_updated_base_url_via_redirect(WiFiClientSecure &wifi_client, String &release_url);
 String get_redirect_location(WiFiClientSecure &wifi_client, String &initial_url);
-String get_updated_version_via_txt_file(WiFiClientSecure &wifi_client, String &_release_url);
+// Leaves version as it is when etag still matches, false if no version could be fetched
+bool get_updated_version_via_txt_file(WiFiClientSecure &wifi_client, String &_release_url, String &version, String &etag);
 
 void print_update_result(Updater updater, HTTPUpdateResult result, const char *TAG);
 
 bool update_required(semver_t _new_version, semver_t _current_version);
 
+// Compressed image published next to a .bin release file, or the delta from base_version when one is given
+String compressed_image_url(const String &url, const String &base_version = "");
+
 void update_started();
 void update_finished();
 void update_error(int err);
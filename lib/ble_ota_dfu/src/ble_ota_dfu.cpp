@@ -4,6 +4,24 @@
 QueueHandle_t start_update_queue;
 QueueHandle_t update_uploading_queue;
 
+static void send_result_and_restart(BLE_OTA_DFU *OTA_DFU_BLE, const String &result) {
+    if (OTA_DFU_BLE->connected()) {
+        // Return the result to the client (tells the client if the update was a
+        // successfull or not)
+        ESP_LOGI(TAG, "Sending result to client");
+        OTA_DFU_BLE->send_OTA_DFU(result);
+        // OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->setValue(result);
+        // OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->notify();
+        ESP_LOGE(TAG, "%s", result.c_str());
+        ESP_LOGI(TAG, "Result sent to client");
+        delay(5000);
+    }
+
+    ESP_LOGE(TAG, "Rebooting ESP32: complete OTA update");
+    delay(5000);
+    ESP.restart();
+}
+
 void task_install_update(void *parameters) {
     FS file_system = FLASH;
     const char path[] = "/update.bin";
@@ -22,6 +40,19 @@ void task_install_update(void *parameters) {
 
     ESP_LOGE(TAG, "Starting OTA update");
 
+    // The windowed transfer already wrote the update to the OTA partition and checked its digest
+    if (Update.isRunning()) {
+        String result = (String) static_cast<char>(0x0F);
+        if (Update.end()) {
+            ESP_LOGI(TAG, "Update successfully completed. Rebooting...");
+            result += "OTA Done: Success!\n";
+        } else {
+            ESP_LOGE(TAG, "Error Occurred. Error #: %d", Update.getError());
+            result += "Error #: " + String(Update.getError());
+        }
+        send_result_and_restart(OTA_DFU_BLE, result);
+    }
+
     // Open update.bin file.
     File update_binary = FLASH.open(path);
 
@@ -89,21 +120,7 @@ void task_install_update(void *parameters) {
     ESP_LOGI(TAG, "Removing update file");
     FLASH.remove(path);
 
-    if (OTA_DFU_BLE->connected()) {
-        // Return the result to the client (tells the client if the update was a
-        // successfull or not)
-        ESP_LOGI(TAG, "Sending result to client");
-        OTA_DFU_BLE->send_OTA_DFU(result);
-        // OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->setValue(result);
-        // OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->notify();
-        ESP_LOGE(TAG, "%s", result.c_str());
-        ESP_LOGI(TAG, "Result sent to client");
-        delay(5000);
-    }
-
-    ESP_LOGE(TAG, "Rebooting ESP32: complete OTA update");
-    delay(5000);
-    ESP.restart();
+    send_result_and_restart(OTA_DFU_BLE, result);
 
     // ESP_LOGI(TAG, "Installation is complete");
     vTaskDelete(NULL);
@@ -254,16 +271,26 @@ void BLEOverTheAirDeviceFirmwareUpdate::onWrite(BLECharacteristic *pCharacterist
                     }
 
                 } else {
-                    ESP_LOGI(TAG, "Installing update");
-
-                    // Start the installation
-                    write_binary(&FLASH, "/update.bin", nullptr, 0, false);
-                    bool start_update = true;
-                    xQueueOverwrite(start_update_queue, &start_update);
+                    install_update();
                 }
             }
         } break;
 
+            // Windowed transfer, packets carry their part and offset
+        case DFU_WINDOWED_DATA:
+            windowed.on_data(pData, len);
+            break;
+
+            // Windowed transfer, end of a part with its length and CRC
+        case DFU_WINDOWED_END:
+            windowed.on_end(pData, len);
+            break;
+
+            // Windowed transfer, digest of the whole firmware once all parts are written
+        case DFU_WINDOWED_DIGEST:
+            windowed.on_digest(pData, len);
+            break;
+
             // Remove previous file and send transfer mode
         case 0xFD: {
             // Remove previous (failed?) update
@@ -271,10 +298,19 @@ void BLEOverTheAirDeviceFirmwareUpdate::onWrite(BLECharacteristic *pCharacterist
                 ESP_LOGI(TAG, "Removing previous update");
                 FLASH.remove("/update.bin");
             }
+            if (Update.isRunning()) {
+                ESP_LOGI(TAG, "Aborting previous windowed update");
+                Update.abort();
+            }
+            if (digest_started) {
+                mbedtls_sha256_free(&update_digest);
+                digest_started = false;
+            }
 
-            // Send mode ("fast" or "slow")
-            uint8_t mode[] = {0xAA, FASTMODE};
-            OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->setValue(mode, 2);
+            // Send mode, displays that know the windowed transfer switch to it, older ones keep sending parts slowly.
+            // The capabilities tell which images the display may send instead of the plain one.
+            uint8_t mode[] = {0xAA, DFU_MODE_WINDOWED, DFU_CAPABILITY_COMPRESSED | DFU_CAPABILITY_DELTA};
+            OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->setValue(mode, sizeof(mode));
             OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->notify();
             delay(10);
         } break;
@@ -291,6 +327,8 @@ void BLEOverTheAirDeviceFirmwareUpdate::onWrite(BLECharacteristic *pCharacterist
         case 0xFF:
             parts = (pData[1] * 256) + pData[2];
             MTU = (pData[3] * 256) + pData[4];
+            windowed.begin(parts, MTU);
+            decoder.reset(expected_file_size);
             break;
 
         default:
@@ -302,6 +340,76 @@ void BLEOverTheAirDeviceFirmwareUpdate::onWrite(BLECharacteristic *pCharacterist
     delay(1);
 }
 
+bool BLEOverTheAirDeviceFirmwareUpdate::begin_image(const image_header &header) {
+    if (header.format == IMAGE_FORMAT_DELTA && !running_firmware_matches(header.base_size, header.base_sha256)) {
+        ESP_LOGE(TAG, "Delta update does not apply to the running firmware");
+        return false;
+    }
+    if (!Update.begin(header.output_size)) {
+        ESP_LOGE(TAG, "Not enough space to begin BLE OTA DFU");
+        return false;
+    }
+    ESP_LOGI(TAG, "Receiving %s image of %d bytes",
+             header.format == IMAGE_FORMAT_PLAIN ? "plain" : header.format == IMAGE_FORMAT_DELTA ? "delta" : "compressed",
+             header.output_size);
+    return true;
+}
+
+bool BLEOverTheAirDeviceFirmwareUpdate::commit_part(const uint8_t *data, uint16_t length) {
+    if (!digest_started) {
+        mbedtls_sha256_init(&update_digest);
+        mbedtls_sha256_starts_ret(&update_digest, 0);
+        digest_started = true;
+    }
+    mbedtls_sha256_update_ret(&update_digest, data, length);
+    received_file_size += length;
+    ESP_LOGI(TAG, "Upload progress: %d/%d", received_file_size, expected_file_size);
+    // Compressed and delta images expand while they are written, the image header starts the update
+    return decoder.feed(data, length);
+}
+
+bool BLEOverTheAirDeviceFirmwareUpdate::verify_update(const uint8_t *digest) {
+    uint8_t written_digest[DFU_WINDOWED_DIGEST_SIZE] = {};
+    if (digest_started) {
+        mbedtls_sha256_finish_ret(&update_digest, written_digest);
+        mbedtls_sha256_free(&update_digest);
+        digest_started = false;
+    }
+    if (received_file_size != expected_file_size) {
+        ESP_LOGE(TAG, "Unexpected size:\n Expected: %d\nReceived: %d", expected_file_size, received_file_size);
+        Update.abort();
+        return false;
+    }
+    if (memcmp(digest, written_digest, DFU_WINDOWED_DIGEST_SIZE) != 0) {
+        ESP_LOGE(TAG, "SHA-256 of the update does not match, discarding it");
+        Update.abort();
+        return false;
+    }
+    if (!decoder.finish()) {
+        ESP_LOGE(TAG, "Update image is incomplete, discarding it");
+        Update.abort();
+        return false;
+    }
+    // The installation task finishes the update that is already in the OTA partition
+    bool start_update = true;
+    xQueueOverwrite(start_update_queue, &start_update);
+    return true;
+}
+
+void BLEOverTheAirDeviceFirmwareUpdate::notify_windowed(const uint8_t *data, size_t length) {
+    OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->setValue(data, length);
+    OTA_DFU_BLE->pCharacteristic_BLE_OTA_DFU_TX->notify();
+}
+
+void BLEOverTheAirDeviceFirmwareUpdate::install_update() {
+    ESP_LOGI(TAG, "Installing update");
+
+    // Start the installation
+    write_binary(&FLASH, "/update.bin", nullptr, 0, false);
+    bool start_update = true;
+    xQueueOverwrite(start_update_queue, &start_update);
+}
+
 bool BLE_OTA_DFU::configure_OTA(NimBLEServer *pServer) {
     // Init FLASH
 #ifdef USE_SPIFFS
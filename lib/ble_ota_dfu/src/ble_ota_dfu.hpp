@@ -5,10 +5,14 @@
 #define SRC_BLE_OTA_DFU_HPP_
 
 #include "./freertos_utils.hpp"
+#include "./image_decoder.hpp"
+#include "./running_firmware.hpp"
+#include "./windowed_transfer.hpp"
 #include <Arduino.h>
 #include <FS.h>
 #include <NimBLEDevice.h>
 #include <Update.h>
+#include <mbedtls/sha256.h>
 #include <string>
 
 // comment to use FFat
@@ -49,6 +53,24 @@ private:
   uint16_t current_progression = 0;
   uint32_t received_file_size = 0;
   uint32_t expected_file_size = 0;
+  // The windowed transfer decodes straight to the OTA partition, hashing the image as it was sent
+  mbedtls_sha256_context update_digest{};
+  bool digest_started = false;
+  image_decoder decoder{
+      [this](const image_header &header) { return begin_image(header); },
+      [](const uint8_t *data, size_t length) { return Update.write(const_cast<uint8_t *>(data), length) == length; },
+      [](uint32_t offset, uint8_t *buffer, size_t length) { return read_running_firmware(offset, buffer, length); }};
+  WindowedTransferReceiver<UPDATER_SIZE> windowed{
+      updater[0], updater[1],
+      [this](const uint8_t *data, uint16_t length) { return commit_part(data, length); },
+      [this](const uint8_t *data, size_t length) { notify_windowed(data, length); },
+      [this](const uint8_t *digest) { return verify_update(digest); }};
+
+  bool begin_image(const image_header &header);
+  bool commit_part(const uint8_t *data, uint16_t length);
+  bool verify_update(const uint8_t *digest);
+  void notify_windowed(const uint8_t *data, size_t length);
+  void install_update();
 
 public:
   friend class BLE_OTA_DFU;
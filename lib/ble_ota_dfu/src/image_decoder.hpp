@@ -0,0 +1,324 @@
+#pragma once
+#ifndef SRC_IMAGE_DECODER_HPP_
+#define SRC_IMAGE_DECODER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// Firmware images are published plain (an ESP image starting with 0xE9), compressed, or as a delta against the image
+// of a previous release, see scripts/ota/compress_image.py. Compressed and delta images start with a header followed
+// by a heatshrink style LZSS stream. For a delta the stream holds copy and add operations against the base image.
+constexpr uint8_t IMAGE_MAGIC[4] = {'G', 'M', 'Z', 1};
+constexpr uint8_t IMAGE_PLAIN_MAGIC = 0xE9;
+// magic (4), format, window bits, lookahead bits, reserved, output size (4), base size (4), base sha256 (32)
+constexpr size_t IMAGE_HEADER_SIZE = 48;
+constexpr size_t IMAGE_SHA256_SIZE = 32;
+constexpr uint8_t IMAGE_FORMAT_PLAIN = 0;
+constexpr uint8_t IMAGE_FORMAT_COMPRESSED = 1;
+constexpr uint8_t IMAGE_FORMAT_DELTA = 2;
+constexpr uint8_t IMAGE_MIN_WINDOW_BITS = 8;
+constexpr uint8_t IMAGE_MAX_WINDOW_BITS = 13; // 8 KB of history, allocated while decoding
+constexpr uint8_t IMAGE_MAX_LOOKAHEAD_BITS = 8;
+constexpr uint8_t IMAGE_DELTA_COPY = 0x01; // base offset after the previous copy (zigzag varint), length (varint)
+constexpr uint8_t IMAGE_DELTA_ADD = 0x02;  // length (varint), bytes
+
+struct image_header {
+    uint8_t format = IMAGE_FORMAT_PLAIN;
+    uint8_t window_bits = 0;
+    uint8_t lookahead_bits = 0;
+    uint32_t output_size = 0;
+    uint32_t base_size = 0;
+    uint8_t base_sha256[IMAGE_SHA256_SIZE] = {};
+};
+
+// Decodes an image of any format as it streams in, without holding more than the LZSS window
+class image_decoder {
+  public:
+    // Prepares the destination for output_size bytes, for a delta also checks that the base is the running firmware
+    using begin_callback_t = std::function<bool(const image_header &header)>;
+    using write_callback_t = std::function<bool(const uint8_t *data, size_t length)>;
+    using read_base_callback_t = std::function<bool(uint32_t offset, uint8_t *buffer, size_t length)>;
+
+    image_decoder(begin_callback_t begin, write_callback_t write, read_base_callback_t read_base)
+        : begin(std::move(begin)), write(std::move(write)), read_base(std::move(read_base)) {}
+
+    // Starts a new image, stream_size is only used when it turns out to be a plain one
+    void reset(uint32_t stream_size) {
+        this->stream_size = stream_size;
+        header = image_header();
+        stage = Stage::HEADER;
+        header_length = 0;
+        produced = 0;
+        out_length = 0;
+        bits = 0;
+        bit_count = 0;
+        lz_state = LzState::TAG;
+        window.clear();
+        window_position = 0;
+        delta_state = DeltaState::OPERATION;
+        varint_shift = 0;
+        base_cursor = 0;
+    }
+
+    // Returns false once the image turned out invalid or a callback failed
+    bool feed(const uint8_t *data, size_t length) {
+        for (size_t i = 0; i < length && stage != Stage::FAILED; i++) {
+            switch (stage) {
+            case Stage::HEADER:
+                read_header(data[i]);
+                break;
+            case Stage::PLAIN:
+                output(data[i]);
+                break;
+            case Stage::BODY:
+                decompress(data[i]);
+                break;
+            case Stage::FAILED:
+                break;
+            }
+        }
+        return stage != Stage::FAILED;
+    }
+
+    // Writes what is left, true if the whole image was decoded
+    bool finish() {
+        if (stage == Stage::FAILED || stage == Stage::HEADER || !flush()) {
+            return false;
+        }
+        const bool operation_complete = header.format != IMAGE_FORMAT_DELTA || delta_state == DeltaState::OPERATION;
+        return produced == header.output_size && operation_complete;
+    }
+
+    bool failed() const { return stage == Stage::FAILED; }
+    const image_header &get_header() const { return header; }
+
+  private:
+    enum class Stage { HEADER, PLAIN, BODY, FAILED };
+    enum class LzState { TAG, LITERAL, INDEX, COUNT };
+    enum class DeltaState { OPERATION, COPY_OFFSET, COPY_LENGTH, ADD_LENGTH, ADD_BYTES };
+
+    void fail() { stage = Stage::FAILED; }
+
+    void read_header(uint8_t byte) {
+        if (header_length == 0 && byte == IMAGE_PLAIN_MAGIC) {
+            header.output_size = stream_size;
+            if (!begin(header)) {
+                fail();
+                return;
+            }
+            stage = Stage::PLAIN;
+            output(byte);
+            return;
+        }
+        header_bytes[header_length++] = byte;
+        if (header_length <= sizeof(IMAGE_MAGIC) && byte != IMAGE_MAGIC[header_length - 1]) {
+            fail();
+            return;
+        }
+        if (header_length < IMAGE_HEADER_SIZE) {
+            return;
+        }
+        header.format = header_bytes[4];
+        header.window_bits = header_bytes[5];
+        header.lookahead_bits = header_bytes[6];
+        header.output_size = read_le32(header_bytes + 8);
+        header.base_size = read_le32(header_bytes + 12);
+        memcpy(header.base_sha256, header_bytes + 16, IMAGE_SHA256_SIZE);
+        if ((header.format != IMAGE_FORMAT_COMPRESSED && header.format != IMAGE_FORMAT_DELTA) ||
+            header.window_bits < IMAGE_MIN_WINDOW_BITS || header.window_bits > IMAGE_MAX_WINDOW_BITS ||
+            header.lookahead_bits < 1 || header.lookahead_bits > IMAGE_MAX_LOOKAHEAD_BITS || !begin(header)) {
+            fail();
+            return;
+        }
+        window.assign(static_cast<size_t>(1) << header.window_bits, 0);
+        stage = Stage::BODY;
+    }
+
+    // Tag bit 1 is a literal byte, 0 a back reference of window_bits distance - 1 and lookahead_bits count - 1
+    void decompress(uint8_t byte) {
+        bits = (bits << 8) | byte;
+        bit_count += 8;
+        while (stage == Stage::BODY) {
+            const uint8_t needed = lz_state == LzState::TAG       ? 1
+                                   : lz_state == LzState::LITERAL ? 8
+                                   : lz_state == LzState::INDEX   ? header.window_bits
+                                                                  : header.lookahead_bits;
+            if (bit_count < needed) {
+                return;
+            }
+            bit_count -= needed;
+            const uint32_t value = (bits >> bit_count) & ((1u << needed) - 1);
+            switch (lz_state) {
+            case LzState::TAG:
+                lz_state = value ? LzState::LITERAL : LzState::INDEX;
+                break;
+            case LzState::LITERAL:
+                emit(static_cast<uint8_t>(value));
+                lz_state = LzState::TAG;
+                break;
+            case LzState::INDEX:
+                distance = value + 1;
+                lz_state = LzState::COUNT;
+                break;
+            case LzState::COUNT:
+                if (distance > window_position) {
+                    fail();
+                    return;
+                }
+                for (uint32_t i = 0; i <= value && stage == Stage::BODY; i++) {
+                    emit(window[(window_position - distance) & (window.size() - 1)]);
+                }
+                lz_state = LzState::TAG;
+                break;
+            }
+        }
+    }
+
+    // A decompressed byte, the image itself or a delta operation
+    void emit(uint8_t byte) {
+        window[window_position & (window.size() - 1)] = byte;
+        window_position++;
+        if (header.format == IMAGE_FORMAT_COMPRESSED) {
+            output(byte);
+        } else {
+            apply_delta(byte);
+        }
+    }
+
+    void apply_delta(uint8_t byte) {
+        switch (delta_state) {
+        case DeltaState::OPERATION:
+            if (byte == IMAGE_DELTA_COPY) {
+                delta_state = DeltaState::COPY_OFFSET;
+            } else if (byte == IMAGE_DELTA_ADD) {
+                delta_state = DeltaState::ADD_LENGTH;
+            } else {
+                fail();
+            }
+            break;
+        case DeltaState::COPY_OFFSET:
+            if (read_varint(byte)) {
+                // Zigzag, small jumps back and forth stay short
+                const int64_t offset = static_cast<int64_t>(varint >> 1) ^ -static_cast<int64_t>(varint & 1);
+                copy_offset = static_cast<int64_t>(base_cursor) + offset;
+                delta_state = DeltaState::COPY_LENGTH;
+            }
+            break;
+        case DeltaState::COPY_LENGTH:
+            if (read_varint(byte)) {
+                copy(varint);
+                delta_state = DeltaState::OPERATION;
+            }
+            break;
+        case DeltaState::ADD_LENGTH:
+            if (read_varint(byte)) {
+                add_remaining = varint;
+                delta_state = add_remaining > 0 ? DeltaState::ADD_BYTES : DeltaState::OPERATION;
+            }
+            break;
+        case DeltaState::ADD_BYTES:
+            output(byte);
+            if (--add_remaining == 0) {
+                delta_state = DeltaState::OPERATION;
+            }
+            break;
+        }
+    }
+
+    // Returns true once the last byte was read, the value is then in varint until the next one starts
+    bool read_varint(uint8_t byte) {
+        if (varint_shift == 0) {
+            varint = 0;
+        }
+        if (varint_shift > 28) {
+            fail();
+            return false;
+        }
+        varint |= static_cast<uint64_t>(byte & 0x7F) << varint_shift;
+        varint_shift += 7;
+        if (byte & 0x80) {
+            return false;
+        }
+        varint_shift = 0;
+        return true;
+    }
+
+    void copy(uint64_t length) {
+        if (copy_offset < 0 || static_cast<uint64_t>(copy_offset) + length > header.base_size) {
+            fail();
+            return;
+        }
+        uint8_t chunk[128];
+        uint32_t offset = static_cast<uint32_t>(copy_offset);
+        while (length > 0 && stage != Stage::FAILED) {
+            const size_t count = length < sizeof(chunk) ? static_cast<size_t>(length) : sizeof(chunk);
+            if (!read_base(offset, chunk, count)) {
+                fail();
+                return;
+            }
+            for (size_t i = 0; i < count; i++) {
+                output(chunk[i]);
+            }
+            offset += count;
+            length -= count;
+        }
+        base_cursor = offset;
+    }
+
+    void output(uint8_t byte) {
+        if (produced >= header.output_size) {
+            fail();
+            return;
+        }
+        out[out_length++] = byte;
+        produced++;
+        if (out_length == sizeof(out) && !flush()) {
+            fail();
+        }
+    }
+
+    bool flush() {
+        if (out_length > 0 && !write(out, out_length)) {
+            return false;
+        }
+        out_length = 0;
+        return true;
+    }
+
+    static uint32_t read_le32(const uint8_t *data) {
+        return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+               (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    begin_callback_t begin;
+    write_callback_t write;
+    read_base_callback_t read_base;
+
+    uint32_t stream_size = 0;
+    image_header header;
+    Stage stage = Stage::HEADER;
+    uint8_t header_bytes[IMAGE_HEADER_SIZE] = {};
+    size_t header_length = 0;
+    uint32_t produced = 0;
+    uint8_t out[256] = {};
+    size_t out_length = 0;
+
+    uint32_t bits = 0;
+    uint8_t bit_count = 0;
+    LzState lz_state = LzState::TAG;
+    uint32_t distance = 0;
+    std::vector<uint8_t> window;
+    uint32_t window_position = 0;
+
+    DeltaState delta_state = DeltaState::OPERATION;
+    uint64_t varint = 0;
+    uint8_t varint_shift = 0;
+    int64_t copy_offset = 0;
+    uint64_t add_remaining = 0;
+    uint32_t base_cursor = 0;
+};
+
+#endif /* SRC_IMAGE_DECODER_HPP_ */
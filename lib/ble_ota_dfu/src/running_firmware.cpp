@@ -0,0 +1,37 @@
+#include "running_firmware.hpp"
+#include <cstring>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+bool running_firmware_matches(uint32_t size, const uint8_t *sha256) {
+    const esp_partition_t *partition = esp_ota_get_running_partition();
+    if (partition == nullptr || size > partition->size) {
+        ESP_LOGE("running_firmware", "Running partition cannot hold a %u byte base", size);
+        return false;
+    }
+    mbedtls_sha256_context context;
+    mbedtls_sha256_init(&context);
+    mbedtls_sha256_starts_ret(&context, 0);
+    uint8_t chunk[512];
+    bool read = true;
+    for (uint32_t offset = 0; offset < size && read; offset += sizeof(chunk)) {
+        const size_t length = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+        read = esp_partition_read(partition, offset, chunk, length) == ESP_OK;
+        mbedtls_sha256_update_ret(&context, chunk, length);
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish_ret(&context, digest);
+    mbedtls_sha256_free(&context);
+    if (!read || memcmp(digest, sha256, sizeof(digest)) != 0) {
+        ESP_LOGW("running_firmware", "Running firmware is not the base of the delta image");
+        return false;
+    }
+    return true;
+}
+
+bool read_running_firmware(uint32_t offset, uint8_t *buffer, size_t length) {
+    const esp_partition_t *partition = esp_ota_get_running_partition();
+    return partition != nullptr && esp_partition_read(partition, offset, buffer, length) == ESP_OK;
+}
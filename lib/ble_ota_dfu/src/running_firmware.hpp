@@ -0,0 +1,13 @@
+#pragma once
+#ifndef SRC_RUNNING_FIRMWARE_HPP_
+#define SRC_RUNNING_FIRMWARE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// The image in the running app partition, the base a delta image is applied to. A board flashed over USB may carry
+// a patched header and then never matches a release, it falls back to the compressed image.
+bool running_firmware_matches(uint32_t size, const uint8_t *sha256);
+bool read_running_firmware(uint32_t offset, uint8_t *buffer, size_t length);
+
+#endif /* SRC_RUNNING_FIRMWARE_HPP_ */
@@ -0,0 +1,206 @@
+#pragma once
+#ifndef SRC_WINDOWED_TRANSFER_HPP_
+#define SRC_WINDOWED_TRANSFER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+// Receiving side of the windowed transfer, the display switches to it when the start command (0xFD) is answered with
+// DFU_MODE_WINDOWED. The sender in WindowedTransfer.h of the OTA library uses these constants and the CRC as well.
+constexpr uint8_t DFU_MODE_WINDOWED = 0x02;
+constexpr uint8_t DFU_CAPABILITY_COMPRESSED = 0x01; // third byte of the mode answer
+constexpr uint8_t DFU_CAPABILITY_DELTA = 0x02;
+constexpr uint8_t DFU_WINDOWED_DATA = 0xFA; // part (2), offset (2), payload
+constexpr uint8_t DFU_WINDOWED_END = 0xF9;  // part (2), length (2), crc32 (4)
+constexpr uint8_t DFU_WINDOWED_ACK = 0xF3;  // part (2)
+constexpr uint8_t DFU_WINDOWED_NAK = 0xF4;  // part (2), count, packet indices (2 each), count 0 resends the whole part
+constexpr uint8_t DFU_WINDOWED_DIGEST = 0xF8; // sha256 (32), sent once every part is acknowledged
+constexpr uint8_t DFU_WINDOWED_INSTALLING = 0xF2;
+constexpr uint8_t DFU_WINDOWED_REJECTED = 0xF5; // part (2), the update was discarded
+constexpr uint16_t DFU_WINDOWED_DATA_HEADER = 5;
+constexpr uint16_t DFU_WINDOWED_MIN_PAYLOAD = 20;
+constexpr uint8_t DFU_WINDOWED_MAX_MISSING = 24; // packet indices per NAK, keeps it within one notification
+constexpr size_t DFU_WINDOWED_DIGEST_SIZE = 32;
+
+inline uint32_t windowed_crc32(const uint8_t *data, size_t length, uint32_t crc = 0) {
+    static constexpr uint32_t table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                           0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                           0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+// Collects the parts in two buffers, part n goes to buffer n % 2. A part is committed once all its packets arrived and
+// its CRC matches, always in order, so the sender may run one part ahead. The digest of the whole firmware decides
+// whether it is installed.
+template <size_t BUFFER_SIZE> class WindowedTransferReceiver {
+  public:
+    // Appends a verified part to the update file, returns false if it could not be written
+    using commit_callback_t = std::function<bool(const uint8_t *data, uint16_t length)>;
+    using notify_callback_t = std::function<void(const uint8_t *data, size_t length)>;
+    // Checks the SHA-256 of all committed parts and starts the installation, false discards the update
+    using verify_callback_t = std::function<bool(const uint8_t *digest)>;
+
+    WindowedTransferReceiver(uint8_t *first_buffer, uint8_t *second_buffer, commit_callback_t commit,
+                             notify_callback_t notify, verify_callback_t verify)
+        : commit(std::move(commit)), notify(std::move(notify)), verify(std::move(verify)) {
+        slots[0].buffer = first_buffer;
+        slots[1].buffer = second_buffer;
+    }
+
+    void begin(uint16_t parts, uint16_t payload_size) {
+        total_parts = parts;
+        payload = payload_size < DFU_WINDOWED_MIN_PAYLOAD ? DFU_WINDOWED_MIN_PAYLOAD : payload_size;
+        next_part = 0;
+        digest_checked = false;
+        for (auto &slot : slots) {
+            slot.reset(NO_PART);
+        }
+    }
+
+    bool is_complete() const { return total_parts > 0 && next_part == total_parts; }
+
+    void on_data(const uint8_t *data, size_t length) {
+        if (length <= DFU_WINDOWED_DATA_HEADER) {
+            return;
+        }
+        const uint16_t part = (data[1] << 8) | data[2];
+        const uint16_t offset = (data[3] << 8) | data[4];
+        const size_t payload_length = length - DFU_WINDOWED_DATA_HEADER;
+        Slot *slot = slot_for(part);
+        if (slot == nullptr || offset % payload != 0 || offset + payload_length > BUFFER_SIZE) {
+            return;
+        }
+        memcpy(slot->buffer + offset, data + DFU_WINDOWED_DATA_HEADER, payload_length);
+        const uint16_t index = offset / payload;
+        slot->received[index / 8] |= 1 << (index % 8);
+    }
+
+    void on_end(const uint8_t *data, size_t length) {
+        if (length < 9) {
+            return;
+        }
+        const uint16_t part = (data[1] << 8) | data[2];
+        if (part < next_part) {
+            // Already written, the acknowledgement got lost
+            send_part_message(DFU_WINDOWED_ACK, part);
+            return;
+        }
+        Slot *slot = slot_for(part);
+        if (slot == nullptr) {
+            return;
+        }
+        slot->length = (data[3] << 8) | data[4];
+        slot->crc = (static_cast<uint32_t>(data[5]) << 24) | (static_cast<uint32_t>(data[6]) << 16) |
+                    (static_cast<uint32_t>(data[7]) << 8) | data[8];
+        if (slot->length > BUFFER_SIZE) {
+            return;
+        }
+
+        uint8_t nak[5 + 2 * DFU_WINDOWED_MAX_MISSING] = {DFU_WINDOWED_NAK, static_cast<uint8_t>(part >> 8),
+                                                          static_cast<uint8_t>(part & 0xFF), 0};
+        const uint16_t packets = (slot->length + payload - 1) / payload;
+        for (uint16_t index = 0; index < packets && nak[3] < DFU_WINDOWED_MAX_MISSING; index++) {
+            if (!(slot->received[index / 8] & (1 << (index % 8)))) {
+                nak[4 + 2 * nak[3]] = index >> 8;
+                nak[5 + 2 * nak[3]] = index & 0xFF;
+                nak[3]++;
+            }
+        }
+        if (nak[3] > 0) {
+            notify(nak, 4 + 2 * nak[3]);
+            return;
+        }
+        if (windowed_crc32(slot->buffer, slot->length) != slot->crc) {
+            // Count 0 asks for the whole part again
+            slot->reset(part);
+            notify(nak, 4);
+            return;
+        }
+        slot->verified = true;
+
+        // Commit in order, the following part may have been verified while waiting for this one
+        while (next_part < total_parts) {
+            Slot &ready = slots[next_part % 2];
+            if (ready.part != next_part || !ready.verified) {
+                break;
+            }
+            if (!commit(ready.buffer, ready.length)) {
+                // Nothing the sender can resend fixes this, e.g. a delta image for another firmware
+                send_part_message(DFU_WINDOWED_REJECTED, next_part);
+                return;
+            }
+            send_part_message(DFU_WINDOWED_ACK, next_part);
+            ready.reset(NO_PART);
+            next_part++;
+        }
+    }
+
+    void on_digest(const uint8_t *data, size_t length) {
+        if (length < 1 + DFU_WINDOWED_DIGEST_SIZE || !is_complete()) {
+            return;
+        }
+        // A repeated digest means the answer got lost, the update is verified only once
+        if (!digest_checked) {
+            digest_accepted = verify(data + 1);
+            digest_checked = true;
+        }
+        send_part_message(digest_accepted ? DFU_WINDOWED_INSTALLING : DFU_WINDOWED_REJECTED, total_parts);
+    }
+
+  private:
+    static constexpr uint16_t NO_PART = 0xFFFF;
+    static constexpr size_t BITMAP_SIZE = (BUFFER_SIZE / DFU_WINDOWED_MIN_PAYLOAD + 8) / 8;
+
+    struct Slot {
+        uint8_t *buffer = nullptr;
+        uint16_t part = NO_PART;
+        uint16_t length = 0;
+        uint32_t crc = 0;
+        bool verified = false;
+        uint8_t received[BITMAP_SIZE] = {};
+
+        void reset(uint16_t new_part) {
+            part = new_part;
+            length = 0;
+            crc = 0;
+            verified = false;
+            memset(received, 0, sizeof(received));
+        }
+    };
+
+    // The slot of a part within the window, a new part takes over the slot of the one committed two parts before
+    Slot *slot_for(uint16_t part) {
+        if (part < next_part || part >= next_part + 2 || part >= total_parts) {
+            return nullptr;
+        }
+        Slot &slot = slots[part % 2];
+        if (slot.part != part) {
+            slot.reset(part);
+        }
+        return &slot;
+    }
+
+    void send_part_message(uint8_t type, uint16_t part) {
+        const uint8_t message[] = {type, static_cast<uint8_t>(part >> 8), static_cast<uint8_t>(part & 0xFF)};
+        notify(message, sizeof(message));
+    }
+
+    commit_callback_t commit;
+    notify_callback_t notify;
+    verify_callback_t verify;
+    Slot slots[2];
+    uint16_t total_parts = 0;
+    uint16_t payload = DFU_WINDOWED_MIN_PAYLOAD;
+    uint16_t next_part = 0;
+    bool digest_checked = false;
+    bool digest_accepted = false;
+};
+
+#endif /* SRC_WINDOWED_TRANSFER_HPP_ */
@@ -0,0 +1,304 @@
+#!/usr/bin/env python3
+"""
+Builds the compressed and delta firmware images the boards can update from.
+
+A compressed image is the firmware packed with heatshrink style LZSS. A delta image describes the firmware as copy
+and add operations against the image of an earlier release (--base), packed the same way. Both start with a header
+the devices check before writing anything, see lib/ble_ota_dfu/src/image_decoder.hpp. The plain .bin images are
+always published as well, devices fall back to them when no smaller image applies.
+
+Every image is decoded again after writing it and compared to the input.
+
+Usage: python3 scripts/ota/compress_image.py firmware.bin firmware.gmz [--base previous-firmware.bin]
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+# Keep in sync with image_decoder.hpp
+MAGIC = b'GMZ\x01'
+FORMAT_COMPRESSED = 1
+FORMAT_DELTA = 2
+MIN_WINDOW_BITS = 8
+MAX_WINDOW_BITS = 13
+MAX_LOOKAHEAD_BITS = 8
+DELTA_COPY = 0x01
+DELTA_ADD = 0x02
+
+HASH_LENGTH = 3
+MAX_CHAIN = 16
+DELTA_BLOCK = 16
+DELTA_STEP = 4
+DELTA_MIN_COPY = 12
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count:
+            self.out.append((self.acc << (8 - self.count)) & 0xFF)
+        return bytes(self.out)
+
+
+def match_length(a, i, b, j, limit):
+    """Length of the common prefix of a[i:] and b[j:], at most limit."""
+    limit = min(limit, len(a) - i, len(b) - j)
+    # Gallop to a mismatching length first, long matches are only compared about twice
+    low, high = 0, min(limit, 32)
+    while high < limit and a[i:i + high] == b[j:j + high]:
+        low, high = high, min(limit, high * 2)
+    while low < high:
+        middle = (low + high + 1) // 2
+        if a[i:i + middle] == b[j:j + middle]:
+            low = middle
+        else:
+            high = middle - 1
+    return low
+
+
+def lzss_compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_length = 1 << lookahead_bits
+    # A back reference has to be shorter than the literals it replaces
+    min_length = (1 + window_bits + lookahead_bits) // 9 + 1
+    chains = {}
+    writer = BitWriter()
+
+    def insert(position):
+        key = data[position:position + HASH_LENGTH]
+        chain = chains.setdefault(key, [])
+        chain.append(position)
+        if len(chain) > MAX_CHAIN:
+            del chain[0]
+
+    position = 0
+    while position < len(data):
+        best_length, best_distance = 0, 0
+        for candidate in reversed(chains.get(data[position:position + HASH_LENGTH], ())):
+            distance = position - candidate
+            if distance > window:
+                break
+            if best_length and data[candidate + best_length:candidate + best_length + 1] != \
+                    data[position + best_length:position + best_length + 1]:
+                continue
+            length = match_length(data, candidate, data, position, max_length)
+            if length > best_length:
+                best_length, best_distance = length, distance
+                if length == max_length:
+                    break
+        if best_length >= min_length:
+            writer.write(0, 1)
+            writer.write(best_distance - 1, window_bits)
+            writer.write(best_length - 1, lookahead_bits)
+        else:
+            best_length = 1
+            writer.write(1, 1)
+            writer.write(data[position], 8)
+        for covered in range(position, position + best_length):
+            insert(covered)
+        position += best_length
+    return writer.finish()
+
+
+def lzss_decompress(data, window_bits, lookahead_bits):
+    """Decodes until the bits run out, the padding of the last byte is too short for another token."""
+    out = bytearray()
+    acc = 0
+    count = 0
+    position = 0
+
+    def read(bits):
+        nonlocal acc, count, position
+        while count < bits:
+            if position == len(data):
+                return None
+            acc = ((acc << 8) | data[position]) & 0xFFFFFFFF
+            count += 8
+            position += 1
+        count -= bits
+        return (acc >> count) & ((1 << bits) - 1)
+
+    while True:
+        tag = read(1)
+        if tag is None:
+            break
+        if tag:
+            literal = read(8)
+            if literal is None:
+                break
+            out.append(literal)
+        else:
+            index = read(window_bits)
+            length = read(lookahead_bits) if index is not None else None
+            if length is None:
+                break
+            start = len(out) - index - 1
+            for offset in range(length + 1):
+                out.append(out[start + offset])
+    return bytes(out)
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return out
+
+
+def zigzag(value):
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def delta_operations(base, new):
+    index = {}
+    for position in range(0, len(base) - DELTA_BLOCK + 1, DELTA_STEP):
+        index.setdefault(base[position:position + DELTA_BLOCK], position)
+
+    ops = bytearray()
+    cursor = 0
+    add_start = 0
+    position = 0
+
+    def add(end):
+        if end > add_start:
+            ops.append(DELTA_ADD)
+            ops.extend(varint(end - add_start))
+            ops.extend(new[add_start:end])
+
+    while position <= len(new) - DELTA_BLOCK:
+        block = new[position:position + DELTA_BLOCK]
+        # Code that only moved keeps its distance to the previous copy, try that before the index
+        predicted = cursor + position - add_start
+        if base[predicted:predicted + DELTA_BLOCK] == block:
+            source = predicted
+        else:
+            source = index.get(block)
+        if source is None:
+            position += 1
+            continue
+        length = match_length(base, source, new, position, len(new))
+        back = 0
+        while back < position - add_start and back < source and base[source - back - 1] == new[position - back - 1]:
+            back += 1
+        if length + back < DELTA_MIN_COPY:
+            position += 1
+            continue
+        add(position - back)
+        ops.append(DELTA_COPY)
+        ops.extend(varint(zigzag(source - back - cursor)))
+        ops.extend(varint(length + back))
+        cursor = source + length
+        position += length
+        add_start = position
+    add(len(new))
+    return bytes(ops)
+
+
+def apply_delta(base, ops):
+    out = bytearray()
+    cursor = 0
+    position = 0
+
+    def read_varint():
+        nonlocal position
+        value, shift = 0, 0
+        while True:
+            byte = ops[position]
+            position += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while position < len(ops):
+        op = ops[position]
+        position += 1
+        if op == DELTA_COPY:
+            offset = read_varint()
+            source = cursor + ((offset >> 1) ^ -(offset & 1))
+            length = read_varint()
+            out.extend(base[source:source + length])
+            cursor = source + length
+        elif op == DELTA_ADD:
+            length = read_varint()
+            out.extend(ops[position:position + length])
+            position += length
+        else:
+            raise ValueError(f'unknown delta operation {op:#x}')
+    return bytes(out)
+
+
+def build_image(data, base, window_bits, lookahead_bits):
+    if base is None:
+        image_format, stream, base_size, base_hash = FORMAT_COMPRESSED, data, 0, bytes(32)
+    else:
+        image_format = FORMAT_DELTA
+        stream = delta_operations(base, data)
+        base_size, base_hash = len(base), hashlib.sha256(base).digest()
+    header = MAGIC + struct.pack('<BBBxII', image_format, window_bits, lookahead_bits, len(data), base_size) + base_hash
+    return header + lzss_compress(stream, window_bits, lookahead_bits), len(stream)
+
+
+def decode_image(image, base):
+    image_format, window_bits, lookahead_bits, size, base_size = struct.unpack('<BBBxII', image[4:16])
+    if image[:4] != MAGIC:
+        raise ValueError('not a compressed image')
+    stream = lzss_decompress(image[48:], window_bits, lookahead_bits)
+    if image_format == FORMAT_COMPRESSED:
+        return stream[:size]
+    if base is None or len(base) != base_size or hashlib.sha256(base).digest() != image[16:48]:
+        raise ValueError('delta image does not apply to the given base')
+    return apply_delta(base, stream)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a compressed or delta firmware image')
+    parser.add_argument('input', help='plain firmware image')
+    parser.add_argument('output', help='image to write')
+    parser.add_argument('--base', help='image of the release the delta applies to')
+    parser.add_argument('--window-bits', type=int, default=13)
+    parser.add_argument('--lookahead-bits', type=int, default=5)
+    args = parser.parse_args()
+
+    if not MIN_WINDOW_BITS <= args.window_bits <= MAX_WINDOW_BITS or not 1 <= args.lookahead_bits <= MAX_LOOKAHEAD_BITS:
+        parser.error('window or lookahead bits out of range')
+    with open(args.input, 'rb') as f:
+        data = f.read()
+    base = None
+    if args.base:
+        with open(args.base, 'rb') as f:
+            base = f.read()
+
+    image, stream_size = build_image(data, base, args.window_bits, args.lookahead_bits)
+    if decode_image(image, base) != data:
+        print(f'{args.output}: image does not decode to {args.input}', file=sys.stderr)
+        return 1
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    kind = 'delta' if base is not None else 'compressed'
+    print(f'{args.output}: {kind}, {len(data)} -> {len(image)} bytes ({100.0 * len(image) / len(data):.1f}%)'
+          + (f', {stream_size} bytes of operations' if base is not None else ''))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,5 +1,6 @@
 #include "Controller.h"
 #include "ArduinoJson.h"
+#include <Clock/Clock.h>
 #include <SPIFFS.h>
 #include <ctime>
 #include <display/config.h>
@@ -15,6 +16,7 @@
 #include <display/plugins/HomekitPlugin.h>
 #include <display/plugins/LedControlPlugin.h>
 #include <display/plugins/MQTTPlugin.h>
+#include <display/plugins/PumpCalibrationPlugin.h>
 #include <display/plugins/ShotHistoryPlugin.h>
 #include <display/plugins/SmartGrindPlugin.h>
 #include <display/plugins/WebUIPlugin.h>
@@ -52,6 +54,7 @@ void Controller::setup() {
     pluginManager->registerPlugin(&ShotHistory);
     pluginManager->registerPlugin(&BLEScales);
     pluginManager->registerPlugin(new LedControlPlugin());
+    pluginManager->registerPlugin(new PumpCalibrationPlugin());
     pluginManager->setup(this);
 
     pluginManager->on("profiles:profile:save", [this](Event const &event) {
@@ -62,6 +65,8 @@ void Controller::setup() {
     });
 
     pluginManager->on("profiles:profile:select", [this](Event const &event) { this->handleProfileUpdate(); });
+    pluginManager->on(SETTINGS_EVENT_TEMPERATURE, [this](Event const &) { this->setTargetTemp(this->getTargetTemp()); });
+    pluginManager->on(SETTINGS_EVENT_PUMP, [this](Event const &) { this->setPumpModelCoeffs(); });
 
 #ifndef GAGGIMATE_HEADLESS
     ui->init();
@@ -79,7 +84,7 @@ void Controller::onTargetChange(ProcessTarget target) { settings.setVolumetricTa
 void Controller::connect() {
     if (initialized)
         return;
-    lastPing = millis();
+    lastPing = Clock::get().millis();
     pluginManager->trigger("controller:startup");
 
     setupWifi();
@@ -94,7 +99,7 @@ void Controller::connect() {
 void Controller::setupBluetooth() {
     clientController.initClient();
     clientController.registerSensorCallback(
-        [this](const float temp, const float pressure, const float puckFlow, const float pumpFlow) {
+        [this](const float temp, const float pressure, const float puckFlow, const float pumpFlow, const float pumpPower) {
             onTempRead(temp);
             this->pressure = pressure;
             this->currentPuckFlow = puckFlow;
@@ -102,6 +107,7 @@ void Controller::setupBluetooth() {
             pluginManager->trigger("boiler:pressure:change", "value", pressure);
             pluginManager->trigger("pump:puck-flow:change", "value", puckFlow);
             pluginManager->trigger("pump:flow:change", "value", pumpFlow);
+            pluginManager->trigger("pump:power:change", "value", pumpPower);
         });
     clientController.registerBrewBtnCallback([this](const int brewButtonStatus) { handleBrewButton(brewButtonStatus); });
     clientController.registerSteamBtnCallback([this](const int steamButtonStatus) { handleSteamButton(steamButtonStatus); });
@@ -122,6 +128,18 @@ void Controller::setupBluetooth() {
         pluginManager->trigger("controller:autotune:result");
         autotuning = false;
     });
+    clientController.registerAutotuneProgressCallback([this](const int progress) {
+        if (!autotuning) {
+            return;
+        }
+        if (progress == AUTOTUNE_PROGRESS_FAILED) {
+            ESP_LOGW(LOG_TAG, "Autotune was aborted by the controller");
+            autotuning = false;
+            pluginManager->trigger("controller:autotune:abort");
+            return;
+        }
+        pluginManager->trigger("controller:autotune:progress", "value", progress);
+    });
     clientController.registerVolumetricMeasurementCallback(
         [this](const float value) { onVolumetricMeasurement(value, VolumetricMeasurementSource::FLOW_ESTIMATION); });
     clientController.registerTofMeasurementCallback([this](const int value) {
@@ -129,6 +147,13 @@ void Controller::setupBluetooth() {
         ESP_LOGV(LOG_TAG, "Received new TOF distance: %d", value);
         pluginManager->trigger("controller:tof:change", "value", value);
     });
+    clientController.registerBrewProgramPhaseCallback([this](const uint8_t phaseIndex, const bool finished) {
+        ESP_LOGV(LOG_TAG, "Brew program phase %d, finished: %d", phaseIndex, finished);
+        if (finished) {
+            remoteProgramFinished = true;
+        }
+        remoteProgramPhase = phaseIndex;
+    });
     pluginManager->trigger("controller:bluetooth:init");
 }
 
@@ -149,6 +174,7 @@ void Controller::setupInfos() {
                                     .pressure = doc["cp"]["ps"].as<bool>(),
                                     .ledControl = doc["cp"]["led"].as<bool>(),
                                     .tof = doc["cp"]["tof"].as<bool>(),
+                                    .brewProgram = doc["cp"]["bp"].as<bool>(),
                                 }};
     }
 }
@@ -206,10 +232,14 @@ void Controller::loop() {
         connect();
     }
 
-    if (clientController.isReadyForConnection()) {
-        clientController.connectToServer();
+    if (clientController.isReadyForConnection() && clientController.connectToServer()) {
         setupInfos();
-        pluginManager->trigger("controller:bluetooth:connect");
+        pluginManager->trigger("controller:bluetooth:connect", "duration",
+                               static_cast<int>(clientController.getLastConnectDuration()));
+        if (systemInfo.capabilities.brewProgram) {
+            // A program may still be running from before the connection dropped, the brew continued locally
+            clientController.sendBrewProgramCommand(BrewProgramCommand::STOP);
+        }
         if (!loaded) {
             loaded = true;
             if (settings.getStartupMode() == MODE_STANDBY)
@@ -224,7 +254,7 @@ void Controller::loop() {
         }
     }
 
-    unsigned long now = millis();
+    unsigned long now = Clock::get().millis();
     if (now - lastPing > PING_INTERVAL) {
         lastPing = now;
         clientController.sendPing();
@@ -247,8 +277,21 @@ void Controller::loop() {
                 auto brewProcess = static_cast<BrewProcess *>(currentProcess);
                 brewProcess->updatePressure(pressure);
                 brewProcess->updateFlow(currentPumpFlow);
+                weightEstimator.addReferenceFlow(currentPuckFlow);
+                if (brewProcess->isRemoteExecution() && !clientController.isConnected()) {
+                    ESP_LOGW(LOG_TAG, "Lost connection during brew program, continuing locally");
+                    brewProcess->setRemoteExecution(false);
+                } else if (brewProcess->isRemoteExecution() && remoteProgramPhase >= 0) {
+                    brewProcess->onRemotePhase(remoteProgramPhase, remoteProgramFinished);
+                }
+                const unsigned int previousPhase = brewProcess->phaseIndex;
+                brewProcess->progress();
+                if (brewProcess->isRemoteExecution() && brewProcess->phaseIndex != previousPhase) {
+                    clientController.sendBrewProgramCommand(BrewProgramCommand::ADVANCE, previousPhase);
+                }
+            } else {
+                currentProcess->progress();
             }
-            currentProcess->progress();
             if (!isActive()) {
                 deactivate();
             }
@@ -301,7 +344,7 @@ bool Controller::isVolumetricAvailable() const {
 #endif
 }
 
-void Controller::autotune(int testTime, int samples) {
+void Controller::autotune(int testTime, int samples, int method) {
     if (isActive() || !isReady()) {
         return;
     }
@@ -309,10 +352,19 @@ void Controller::autotune(int testTime, int samples) {
         activateStandby();
     }
     autotuning = true;
-    clientController.sendAutotune(testTime, samples);
+    clientController.sendAutotune(testTime, samples, method);
     pluginManager->trigger("controller:autotune:start");
 }
 
+void Controller::abortAutotune() {
+    if (!autotuning) {
+        return;
+    }
+    clientController.sendAutotuneAbort();
+    autotuning = false;
+    pluginManager->trigger("controller:autotune:abort");
+}
+
 void Controller::startProcess(Process *process) {
     if (isActive() || !isReady())
         return;
@@ -519,6 +571,7 @@ void Controller::activate() {
                                      settings.isVolumetricTarget() && isVolumetricAvailable() ? ProcessTarget::VOLUMETRIC
                                                                                               : ProcessTarget::TIME,
                                      settings.getBrewDelay()));
+        startBrewProgram();
         break;
     case MODE_STEAM:
         startProcess(new SteamProcess(STEAM_SAFETY_DURATION_MS, settings.getSteamPumpPercentage()));
@@ -529,10 +582,31 @@ void Controller::activate() {
     default:;
     }
     if (currentProcess->getType() == MODE_BREW) {
+        weightEstimator.startShot();
         pluginManager->trigger("controller:brew:start");
     }
 }
 
+void Controller::startBrewProgram() {
+    if (!systemInfo.capabilities.brewProgram || !clientController.isConnected() || currentProcess == nullptr ||
+        currentProcess->getType() != MODE_BREW) {
+        return;
+    }
+    auto *brewProcess = static_cast<BrewProcess *>(currentProcess);
+    const std::vector<BrewProgramPhase> program = brewProcess->compileProgram();
+    if (program.empty() || program.size() > BREW_PROGRAM_MAX_PHASES) {
+        return;
+    }
+    remoteProgramPhase = -1;
+    remoteProgramFinished = false;
+    if (!clientController.sendBrewProgram(program)) {
+        ESP_LOGW(LOG_TAG, "Failed to upload brew program, running profile locally");
+        return;
+    }
+    clientController.sendBrewProgramCommand(BrewProgramCommand::START, program.size());
+    brewProcess->setRemoteExecution(true);
+}
+
 void Controller::deactivate() {
     if (currentProcess == nullptr) {
         return;
@@ -541,6 +615,10 @@ void Controller::deactivate() {
     lastProcess = currentProcess;
     currentProcess = nullptr;
     if (lastProcess->getType() == MODE_BREW) {
+        if (auto *brewProcess = static_cast<BrewProcess *>(lastProcess); brewProcess->isRemoteExecution()) {
+            clientController.sendBrewProgramCommand(BrewProgramCommand::STOP);
+        }
+        weightEstimator.endShot();
         pluginManager->trigger("controller:brew:end");
     } else if (lastProcess->getType() == MODE_GRIND) {
         pluginManager->trigger("controller:grind:end");
@@ -607,7 +685,7 @@ void Controller::onTempRead(float temperature) {
     currentTemp = event.getFloat("value");
 }
 
-void Controller::updateLastAction() { lastAction = millis(); }
+void Controller::updateLastAction() { lastAction = Clock::get().millis(); }
 
 void Controller::onOTAUpdate() {
     activateStandby();
@@ -623,10 +701,17 @@ void Controller::onVolumetricMeasurement(double measurement, VolumetricMeasureme
     if (source == VolumetricMeasurementSource::FLOW_ESTIMATION && volumetricOverride) {
         return;
     }
+    // The scale reading was fed to the weight estimator already, processes get its latency compensated weight
+    const WeightEstimator *estimator = source == VolumetricMeasurementSource::BLUETOOTH ? &weightEstimator : nullptr;
+    if (estimator != nullptr) {
+        measurement = weightEstimator.getWeight();
+    }
     if (currentProcess != nullptr) {
+        currentProcess->setWeightEstimator(estimator);
         currentProcess->updateVolume(measurement);
     }
     if (lastProcess != nullptr) {
+        lastProcess->setWeightEstimator(estimator);
         lastProcess->updateVolume(measurement);
     }
 }
@@ -640,6 +725,11 @@ void Controller::onFlush() {
     pluginManager->trigger("controller:brew:start");
 }
 
+void Controller::tare() {
+    clientController.tare();
+    pluginManager->trigger("controller:tare");
+}
+
 void Controller::handleBrewButton(int brewButtonStatus) {
     printf("current screen %d, brew button %d\n", getMode(), brewButtonStatus);
     if (brewButtonStatus) {
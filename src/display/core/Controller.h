@@ -5,6 +5,7 @@
 #include "NimBLEComm.h"
 #include "PluginManager.h"
 #include "Settings.h"
+#include "WeightEstimator.h"
 #include <WiFi.h>
 #include <display/core/ProfileManager.h>
 #include <display/core/process/Process.h>
@@ -53,12 +54,14 @@ class Controller {
     virtual float getCurrentPuckFlow() const { return currentPuckFlow; }
     virtual float getCurrentPumpFlow() const { return currentPumpFlow; }
 
-    void autotune(int testTime, int samples);
+    void autotune(int testTime, int samples, int method = AUTOTUNE_METHOD_STEP);
+    void abortAutotune();
     void startProcess(Process *process);
     Process *getProcess() const { return currentProcess; }
     Process *getLastProcess() const { return lastProcess; }
     Settings &getSettings() { return settings; }
     ProfileManager *getProfileManager() { return profileManager; }
+    WeightEstimator &getWeightEstimator() { return weightEstimator; }
 #ifndef GAGGIMATE_HEADLESS
     DefaultUI *getUI() const { return ui; }
 #endif
@@ -86,6 +89,7 @@ class Controller {
     void onVolumetricMeasurement(double measurement, VolumetricMeasurementSource source);
     void setVolumetricOverride(bool override) { volumetricOverride = override; }
     void onFlush();
+    void tare();
     int getWaterLevel() const {
         float reversedLevel = static_cast<float>(settings.getEmptyTankDistance()) -
                               static_cast<float>(std::min(settings.getEmptyTankDistance(), tofDistance));
@@ -104,6 +108,7 @@ class Controller {
     void setupBluetooth();
     void setupInfos();
     void setupWifi();
+    void startBrewProgram();
 
     // Functional methods
     void updateControl();
@@ -127,6 +132,7 @@ class Controller {
     Settings settings;
     PluginManager *pluginManager{};
     ProfileManager *profileManager{};
+    WeightEstimator weightEstimator;
 
     int mode = MODE_BREW;
     float currentTemp = 0;
@@ -156,6 +162,9 @@ class Controller {
     bool processCompleted = false;
     bool steamReady = false;
     int error = 0;
+    // Written from the bluetooth callback, applied to the brew process in the main loop
+    volatile int remoteProgramPhase = -1;
+    volatile bool remoteProgramFinished = false;
 
     xTaskHandle taskHandle;
 
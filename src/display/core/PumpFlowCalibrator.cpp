@@ -0,0 +1,79 @@
+#include "PumpFlowCalibrator.h"
+#include <algorithm>
+#include <cmath>
+
+// Prior covariance relative to the noise variance, allows ~0.2 ml/s/bar on c and ~2 ml/s on d
+constexpr float PRIOR_VARIANCE_C = 1.0f;
+constexpr float PRIOR_VARIANCE_D = 100.0f;
+
+void PumpFlowCalibrator::reset(float a, float b, float c, float d) {
+    this->a = a;
+    this->b = b;
+    theta[0] = c;
+    theta[1] = d;
+    P[0][0] = PRIOR_VARIANCE_C;
+    P[0][1] = P[1][0] = 0.0f;
+    P[1][1] = PRIOR_VARIANCE_D;
+    noise = PUMP_CALIBRATION_INITIAL_NOISE;
+    samples = 0;
+}
+
+void PumpFlowCalibrator::update(float pressure, float duty, float flow) {
+    const float phi[2] = {duty * pressure, duty};
+    const float y = flow - duty * (a * pressure * pressure * pressure + b * pressure * pressure);
+    const float error = y - (phi[0] * theta[0] + phi[1] * theta[1]);
+
+    const float Pphi[2] = {P[0][0] * phi[0] + P[0][1] * phi[1], P[1][0] * phi[0] + P[1][1] * phi[1]};
+    const float denominator = PUMP_CALIBRATION_FORGETTING_FACTOR + phi[0] * Pphi[0] + phi[1] * Pphi[1];
+    const float K[2] = {Pphi[0] / denominator, Pphi[1] / denominator};
+
+    theta[0] += K[0] * error;
+    theta[1] += K[1] * error;
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            P[i][j] = (P[i][j] - K[i] * Pphi[j]) / PUMP_CALIBRATION_FORGETTING_FACTOR;
+        }
+    }
+    // Forgetting lets the covariance grow in directions that aren't excited, keep it bounded by the prior
+    P[0][0] = std::min(P[0][0], PRIOR_VARIANCE_C);
+    P[1][1] = std::min(P[1][1], PRIOR_VARIANCE_D);
+    const float maxCovariance = std::sqrt(P[0][0] * P[1][1]);
+    P[0][1] = P[1][0] = std::clamp(0.5f * (P[0][1] + P[1][0]), -maxCovariance, maxCovariance);
+
+    // Starts from the prior, a single residual says nothing about the scale noise
+    noise = 0.98f * noise + 0.02f * error * error;
+    samples++;
+}
+
+float PumpFlowCalibrator::getFlow(float pressure, float duty) const {
+    return duty * (a * pressure * pressure * pressure + b * pressure * pressure + theta[0] * pressure + theta[1]);
+}
+
+float PumpFlowCalibrator::getFlowStdDev(float pressure) const {
+    const float variance = pressure * pressure * P[0][0] + 2.0f * pressure * P[0][1] + P[1][1];
+    return std::sqrt(std::max(variance, 0.0f) * std::max(noise, PUMP_CALIBRATION_INITIAL_NOISE / 4.0f));
+}
+
+float PumpFlowCalibrator::getConfidence() const {
+    if (samples == 0) {
+        return 0.0f;
+    }
+    const float stdDev = getFlowStdDev(PUMP_CALIBRATION_REFERENCE_PRESSURE);
+    return std::clamp(PUMP_CALIBRATION_TARGET_STDDEV / stdDev, 0.0f, 1.0f);
+}
+
+PumpFlowCalibrator::State PumpFlowCalibrator::getState() const {
+    return State{theta[0], theta[1], P[0][0], P[0][1], P[1][1], noise, samples};
+}
+
+void PumpFlowCalibrator::setState(float a, float b, const State &state) {
+    this->a = a;
+    this->b = b;
+    theta[0] = state.c;
+    theta[1] = state.d;
+    P[0][0] = state.p00;
+    P[0][1] = P[1][0] = state.p01;
+    P[1][1] = state.p11;
+    noise = state.noise;
+    samples = state.samples;
+}
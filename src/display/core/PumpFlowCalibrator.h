@@ -0,0 +1,54 @@
+#ifndef PUMPFLOWCALIBRATOR_H
+#define PUMPFLOWCALIBRATOR_H
+
+#include <cstdint>
+
+constexpr float PUMP_CALIBRATION_FORGETTING_FACTOR = 0.998f;
+constexpr float PUMP_CALIBRATION_INITIAL_NOISE = 0.04f;  // (ml/s)^2
+constexpr float PUMP_CALIBRATION_TARGET_STDDEV = 0.2f;   // ml/s at 9 bar for full confidence
+constexpr float PUMP_CALIBRATION_REFERENCE_PRESSURE = 9.0f;
+constexpr float PUMP_CALIBRATION_APPLY_CONFIDENCE = 0.8f;
+
+// Recursive least squares fit of the pump flow model used by the controller:
+//   flow = duty * (a * P^3 + b * P^2 + c * P + d)
+// Only the affine part (c, d) is estimated, a shot doesn't cover enough of the pressure range to identify
+// the higher order terms so a and b are kept from the configured model.
+class PumpFlowCalibrator {
+  public:
+    struct State {
+        float c;
+        float d;
+        float p00;
+        float p01;
+        float p11;
+        float noise;
+        uint32_t samples;
+    };
+
+    void reset(float a, float b, float c, float d);
+    // duty in 0..1, flow measured at the cup in ml/s
+    void update(float pressure, float duty, float flow);
+
+    float getC() const { return theta[0]; }
+    float getD() const { return theta[1]; }
+    float getFlow(float pressure, float duty = 1.0f) const;
+    // Standard deviation of the predicted full power flow at the given pressure
+    float getFlowStdDev(float pressure) const;
+    float getConfidence() const; // 0..1
+    // Confident enough to replace the configured model
+    bool isConfident() const { return getConfidence() >= PUMP_CALIBRATION_APPLY_CONFIDENCE; }
+    uint32_t getSampleCount() const { return samples; }
+
+    State getState() const;
+    void setState(float a, float b, const State &state);
+
+  private:
+    float a = 0.0f;
+    float b = 0.0f;
+    float theta[2] = {0.0f, 0.0f};
+    float P[2][2] = {{1.0f, 0.0f}, {0.0f, 100.0f}};
+    float noise = PUMP_CALIBRATION_INITIAL_NOISE;
+    uint32_t samples = 0;
+};
+
+#endif // PUMPFLOWCALIBRATOR_H
@@ -1,83 +1,359 @@
 #include "Settings.h"
 
 #include <algorithm>
+#include <array>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include <utility>
 
-Settings::Settings() {
-    preferences.begin(PREFERENCES_KEY, true);
-    startupMode = preferences.getInt("sm", MODE_STANDBY);
-    targetBrewTemp = preferences.getInt("tb", 90);
-    targetSteamTemp = preferences.getInt("ts", 145);
-    targetWaterTemp = preferences.getInt("tw", 80);
-    targetDuration = preferences.getInt("td", 25000);
-    targetVolume = preferences.getInt("tv", 36);
-    targetGrindVolume = preferences.getDouble("tgv", 18.0);
-    targetGrindDuration = preferences.getInt("tgd", 25000);
-    brewDelay = preferences.getDouble("del_br", 1000.0);
-    grindDelay = preferences.getDouble("del_gd", 1000.0);
-    delayAdjust = preferences.getBool("del_ad", true);
-    temperatureOffset = preferences.getInt("to", DEFAULT_TEMPERATURE_OFFSET);
-    pressureScaling = preferences.getFloat("ps", DEFAULT_PRESSURE_SCALING);
-    pid = preferences.getString("pid", DEFAULT_PID);
-    pumpModelCoeffs = preferences.getString("pmc", DEFAULT_PUMP_MODEL_COEFFS);
-    wifiSsid = preferences.getString("ws", "");
-    wifiPassword = preferences.getString("wp", "");
-    mdnsName = preferences.getString("mn", DEFAULT_MDNS_NAME);
-    homekit = preferences.getBool("hk", false);
-    volumetricTarget = preferences.getBool("vt", false);
-    otaChannel = preferences.getString("oc", DEFAULT_OTA_CHANNEL);
-    infusePumpTime = preferences.getInt("ipt", 0);
-    infuseBloomTime = preferences.getInt("ibt", 0);
-    pressurizeTime = preferences.getInt("pt", 0);
-    savedScale = preferences.getString("ssc", "");
-    momentaryButtons = preferences.getBool("mb", false);
-    boilerFillActive = preferences.getBool("bf_a", false);
-    startupFillTime = preferences.getInt("bf_su", 5000);
-    steamFillTime = preferences.getInt("bf_st", 5000);
-    smartGrindActive = preferences.getBool("sg_a", false);
-    smartGrindIp = preferences.getString("sg_i", "");
-    smartGrindToggle = preferences.getBool("sg_t", false);
-    smartGrindMode = preferences.getInt("sg_m", smartGrindToggle ? 1 : 0);
-    homeAssistant = preferences.getBool("ha_a", false);
-    homeAssistantIP = preferences.getString("ha_i", "");
-    homeAssistantPort = preferences.getInt("ha_p", 1883);
-    homeAssistantTopic = preferences.getString("ha_t", DEFAULT_HOME_ASSISTANT_TOPIC);
-    homeAssistantUser = preferences.getString("ha_u", "");
-    homeAssistantPassword = preferences.getString("ha_pw", "");
-    standbyTimeout = preferences.getInt("sbt", DEFAULT_STANDBY_TIMEOUT_MS);
-    timezone = preferences.getString("tz", DEFAULT_TIMEZONE);
-    clock24hFormat = preferences.getBool("clk_24h", true);
-    selectedProfile = preferences.getString("sp", "");
-    profilesMigrated = preferences.getBool("pm", false);
-    favoritedProfiles = explode(preferences.getString("fp", ""), ',');
-    profileOrder = explode(preferences.getString("po", ""), ',');
-    steamPumpPercentage = preferences.getFloat("spp", DEFAULT_STEAM_PUMP_PERCENTAGE);
-    steamPumpCutoff = preferences.getFloat("spc", DEFAULT_STEAM_PUMP_CUTOFF);
-    historyIndex = preferences.getInt("hi", 0);
+namespace {
+constexpr const char *STARTUP_MODES[] = {"standby", "brew"}; // indexed by MODE_STANDBY and MODE_BREW
+
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name, int SettingsSnapshot::*field,
+                                    int defaultValue) {
+    return {key, nvsKey, name, SettingType::INT, field, static_cast<double>(defaultValue), "", INT_MIN, INT_MAX};
+}
+
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name, float SettingsSnapshot::*field,
+                                    float defaultValue) {
+    return {key, nvsKey, name, SettingType::FLOAT, field, defaultValue, "", -FLT_MAX, FLT_MAX};
+}
+
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name, double SettingsSnapshot::*field,
+                                    double defaultValue) {
+    return {key, nvsKey, name, SettingType::DOUBLE, field, defaultValue, "", -DBL_MAX, DBL_MAX};
+}
+
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name, bool SettingsSnapshot::*field,
+                                    bool defaultValue) {
+    return {key, nvsKey, name, SettingType::BOOL, field, defaultValue ? 1.0 : 0.0, "", 0, 1};
+}
+
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name, String SettingsSnapshot::*field,
+                                    const char *defaultValue) {
+    return {key, nvsKey, name, SettingType::STRING, field, 0, defaultValue, 0, 0};
+}
+
+// Stored comma separated
+constexpr SettingDescriptor setting(Settings::Key key, const char *nvsKey, const char *name,
+                                    std::vector<String> SettingsSnapshot::*field) {
+    return {key, nvsKey, name, SettingType::LIST, field, 0, "", 0, 0};
+}
+
+void printJsonString(Print &out, const char *value) {
+    out.print('"');
+    for (const char *c = value; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.print('\\');
+            out.print(*c);
+        } else if (static_cast<uint8_t>(*c) < 0x20) {
+            out.printf("\\u%04x", *c);
+        } else {
+            out.print(*c);
+        }
+    }
+    out.print('"');
+}
+
+void printJsonNumber(Print &out, double value, int precision) {
+    if (!std::isfinite(value)) {
+        out.print("null");
+        return;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    out.print(buffer);
+}
+
+bool parseNumber(const String &value, double &number) {
+    char *end = nullptr;
+    number = strtod(value.c_str(), &end);
+    return end != value.c_str() && std::isfinite(number);
+}
+} // namespace
+
+constexpr SettingDescriptor Settings::SCHEMA[KEY_COUNT] = {
+    setting(KEY_STARTUP_MODE, "sm", "startupMode", &SettingsSnapshot::startupMode, MODE_STANDBY).withOptions(STARTUP_MODES),
+    setting(KEY_TARGET_BREW_TEMP, "tb", nullptr, &SettingsSnapshot::targetBrewTemp, 90).withRange(0, MAX_TEMP),
+    setting(KEY_TARGET_STEAM_TEMP, "ts", "targetSteamTemp", &SettingsSnapshot::targetSteamTemp, 145)
+        .withRange(0, MAX_TEMP)
+        .withEvent(SETTINGS_EVENT_TEMPERATURE),
+    setting(KEY_TARGET_WATER_TEMP, "tw", "targetWaterTemp", &SettingsSnapshot::targetWaterTemp, 80)
+        .withRange(0, MAX_TEMP)
+        .withEvent(SETTINGS_EVENT_TEMPERATURE),
+    setting(KEY_TARGET_DURATION, "td", nullptr, &SettingsSnapshot::targetDuration, 25000).withRange(0, INT_MAX),
+    setting(KEY_TARGET_VOLUME, "tv", nullptr, &SettingsSnapshot::targetVolume, 36).withRange(0, INT_MAX),
+    setting(KEY_TARGET_GRIND_VOLUME, "tgv", nullptr, &SettingsSnapshot::targetGrindVolume, 18.0).withRange(0, DBL_MAX),
+    setting(KEY_TARGET_GRIND_DURATION, "tgd", nullptr, &SettingsSnapshot::targetGrindDuration, 25000).withRange(0, INT_MAX),
+    setting(KEY_BREW_DELAY, "del_br", "brewDelay", &SettingsSnapshot::brewDelay, 1000.0).withRange(0, 4000),
+    setting(KEY_GRIND_DELAY, "del_gd", "grindDelay", &SettingsSnapshot::grindDelay, 1000.0).withRange(0, 4000),
+    setting(KEY_DELAY_ADJUST, "del_ad", "delayAdjust", &SettingsSnapshot::delayAdjust, true),
+    setting(KEY_TEMPERATURE_OFFSET, "to", "temperatureOffset", &SettingsSnapshot::temperatureOffset, DEFAULT_TEMPERATURE_OFFSET)
+        .withRange(-MAX_TEMP, MAX_TEMP)
+        .withEvent(SETTINGS_EVENT_TEMPERATURE),
+    setting(KEY_PRESSURE_SCALING, "ps", "pressureScaling", &SettingsSnapshot::pressureScaling, DEFAULT_PRESSURE_SCALING)
+        .withRange(0, FLT_MAX),
+    setting(KEY_PID, "pid", "pid", &SettingsSnapshot::pid, DEFAULT_PID),
+    setting(KEY_PUMP_MODEL_COEFFS, "pmc", "pumpModelCoeffs", &SettingsSnapshot::pumpModelCoeffs, DEFAULT_PUMP_MODEL_COEFFS)
+        .withEvent(SETTINGS_EVENT_PUMP),
+    setting(KEY_WIFI_SSID, "ws", "wifiSsid", &SettingsSnapshot::wifiSsid, ""),
+    setting(KEY_WIFI_PASSWORD, "wp", "wifiPassword", &SettingsSnapshot::wifiPassword, "").withFlags(SETTING_SECRET),
+    setting(KEY_MDNS_NAME, "mn", "mdnsName", &SettingsSnapshot::mdnsName, DEFAULT_MDNS_NAME),
+    setting(KEY_HOMEKIT, "hk", "homekit", &SettingsSnapshot::homekit, false),
+    setting(KEY_VOLUMETRIC_TARGET, "vt", nullptr, &SettingsSnapshot::volumetricTarget, false),
+    setting(KEY_OTA_CHANNEL, "oc", nullptr, &SettingsSnapshot::otaChannel, DEFAULT_OTA_CHANNEL),
+    setting(KEY_INFUSE_PUMP_TIME, "ipt", nullptr, &SettingsSnapshot::infusePumpTime, 0).withRange(0, INT_MAX),
+    setting(KEY_INFUSE_BLOOM_TIME, "ibt", nullptr, &SettingsSnapshot::infuseBloomTime, 0).withRange(0, INT_MAX),
+    setting(KEY_PRESSURIZE_TIME, "pt", nullptr, &SettingsSnapshot::pressurizeTime, 0).withRange(0, INT_MAX),
+    setting(KEY_SAVED_SCALE, "ssc", nullptr, &SettingsSnapshot::savedScale, ""),
+    setting(KEY_BOILER_FILL_ACTIVE, "bf_a", "boilerFillActive", &SettingsSnapshot::boilerFillActive, false),
+    setting(KEY_STARTUP_FILL_TIME, "bf_su", "startupFillTime", &SettingsSnapshot::startupFillTime, 5000)
+        .withRange(0, INT_MAX)
+        .withScale(1000),
+    setting(KEY_STEAM_FILL_TIME, "bf_st", "steamFillTime", &SettingsSnapshot::steamFillTime, 5000)
+        .withRange(0, INT_MAX)
+        .withScale(1000),
+    setting(KEY_SMART_GRIND_ACTIVE, "sg_a", "smartGrindActive", &SettingsSnapshot::smartGrindActive, false),
+    setting(KEY_SMART_GRIND_IP, "sg_i", "smartGrindIp", &SettingsSnapshot::smartGrindIp, ""),
+    setting(KEY_SMART_GRIND_MODE, "sg_m", "smartGrindMode", &SettingsSnapshot::smartGrindMode, 0).withRange(0, INT_MAX),
+    setting(KEY_HOME_ASSISTANT, "ha_a", "homeAssistant", &SettingsSnapshot::homeAssistant, false),
+    setting(KEY_HOME_ASSISTANT_IP, "ha_i", "haIP", &SettingsSnapshot::homeAssistantIP, ""),
+    setting(KEY_HOME_ASSISTANT_PORT, "ha_p", "haPort", &SettingsSnapshot::homeAssistantPort, 1883).withRange(1, 65535),
+    setting(KEY_HOME_ASSISTANT_TOPIC, "ha_t", "haTopic", &SettingsSnapshot::homeAssistantTopic, DEFAULT_HOME_ASSISTANT_TOPIC),
+    setting(KEY_HOME_ASSISTANT_USER, "ha_u", "haUser", &SettingsSnapshot::homeAssistantUser, ""),
+    setting(KEY_HOME_ASSISTANT_PASSWORD, "ha_pw", "haPassword", &SettingsSnapshot::homeAssistantPassword, ""),
+    setting(KEY_TIMEZONE, "tz", "timezone", &SettingsSnapshot::timezone, DEFAULT_TIMEZONE),
+    setting(KEY_CLOCK_24H_FORMAT, "clk_24h", "clock24hFormat", &SettingsSnapshot::clock24hFormat, true),
+    setting(KEY_SELECTED_PROFILE, "sp", nullptr, &SettingsSnapshot::selectedProfile, ""),
+    setting(KEY_STANDBY_TIMEOUT, "sbt", "standbyTimeout", &SettingsSnapshot::standbyTimeout, DEFAULT_STANDBY_TIMEOUT_MS)
+        .withRange(0, INT_MAX)
+        .withScale(1000),
+    setting(KEY_PROFILES_MIGRATED, "pm", nullptr, &SettingsSnapshot::profilesMigrated, false),
+    setting(KEY_MOMENTARY_BUTTONS, "mb", "momentaryButtons", &SettingsSnapshot::momentaryButtons, false),
+    setting(KEY_FAVORITED_PROFILES, "fp", nullptr, &SettingsSnapshot::favoritedProfiles),
+    setting(KEY_PROFILE_ORDER, "po", nullptr, &SettingsSnapshot::profileOrder),
+    setting(KEY_STEAM_PUMP_PERCENTAGE, "spp", "steamPumpPercentage", &SettingsSnapshot::steamPumpPercentage,
+            DEFAULT_STEAM_PUMP_PERCENTAGE)
+        .withRange(0, FLT_MAX),
+    setting(KEY_STEAM_PUMP_CUTOFF, "spc", "steamPumpCutoff", &SettingsSnapshot::steamPumpCutoff, DEFAULT_STEAM_PUMP_CUTOFF)
+        .withRange(0, FLT_MAX),
+    setting(KEY_HISTORY_INDEX, "hi", nullptr, &SettingsSnapshot::historyIndex, 0).withRange(0, INT_MAX),
 
     // Display settings
-    mainBrightness = preferences.getInt("main_b", 16);
-    standbyBrightness = preferences.getInt("standby_b", 8);
-    standbyBrightnessTimeout = preferences.getInt("standby_bt", 60000);
-    wifiApTimeout = preferences.getInt("wifi_apt", DEFAULT_WIFI_AP_TIMEOUT_MS);
-    themeMode = preferences.getInt("theme", 0);
+    setting(KEY_MAIN_BRIGHTNESS, "main_b", "mainBrightness", &SettingsSnapshot::mainBrightness, 16).withRange(0, 16),
+    setting(KEY_STANDBY_BRIGHTNESS, "standby_b", "standbyBrightness", &SettingsSnapshot::standbyBrightness, 8).withRange(0, 16),
+    setting(KEY_STANDBY_BRIGHTNESS_TIMEOUT, "standby_bt", "standbyBrightnessTimeout", &SettingsSnapshot::standbyBrightnessTimeout,
+            60000)
+        .withRange(0, INT_MAX)
+        .withScale(1000),
+    setting(KEY_WIFI_AP_TIMEOUT, "wifi_apt", nullptr, &SettingsSnapshot::wifiApTimeout, DEFAULT_WIFI_AP_TIMEOUT_MS)
+        .withRange(0, INT_MAX),
+    setting(KEY_THEME_MODE, "theme", "themeMode", &SettingsSnapshot::themeMode, 0).withRange(0, INT_MAX),
 
     // Sunrise settings
-    sunriseR = preferences.getInt("sr_r", 0);
-    sunriseG = preferences.getInt("sr_g", 0);
-    sunriseB = preferences.getInt("sr_b", 255);
-    sunriseW = preferences.getInt("sr_w", 50);
-    sunriseExtBrightness = preferences.getInt("sr_exb", 255);
-    emptyTankDistance = preferences.getInt("sr_ed", 200);
-    fullTankDistance = preferences.getInt("sr_fd", 50);
+    setting(KEY_SUNRISE_R, "sr_r", "sunriseR", &SettingsSnapshot::sunriseR, 0).withRange(0, 255),
+    setting(KEY_SUNRISE_G, "sr_g", "sunriseG", &SettingsSnapshot::sunriseG, 0).withRange(0, 255),
+    setting(KEY_SUNRISE_B, "sr_b", "sunriseB", &SettingsSnapshot::sunriseB, 255).withRange(0, 255),
+    setting(KEY_SUNRISE_W, "sr_w", "sunriseW", &SettingsSnapshot::sunriseW, 50).withRange(0, 255),
+    setting(KEY_SUNRISE_EXT_BRIGHTNESS, "sr_exb", "sunriseExtBrightness", &SettingsSnapshot::sunriseExtBrightness, 255)
+        .withRange(0, 255),
+    setting(KEY_EMPTY_TANK_DISTANCE, "sr_ed", "emptyTankDistance", &SettingsSnapshot::emptyTankDistance, 200)
+        .withRange(0, INT_MAX),
+    setting(KEY_FULL_TANK_DISTANCE, "sr_fd", "fullTankDistance", &SettingsSnapshot::fullTankDistance, 50).withRange(0, INT_MAX),
+
+    // MQTT telemetry, 0 turns it off
+    setting(KEY_HOME_ASSISTANT_TELEMETRY_INTERVAL, "ha_ti", "haTelemetryInterval",
+            &SettingsSnapshot::homeAssistantTelemetryInterval, 1000)
+        .withRange(0, 60000),
+};
+
+constexpr bool Settings::schemaMatchesKeys() {
+    for (uint8_t key = 0; key < KEY_COUNT; key++) {
+        if (SCHEMA[key].key != key) {
+            return false;
+        }
+    }
+    return true;
+}
 
+Settings::Settings() {
+    static_assert(schemaMatchesKeys(), "SCHEMA rows have to be in Key order");
+    preferences.begin(PREFERENCES_KEY, true);
+    for (const SettingDescriptor &setting : SCHEMA) {
+        switch (setting.type) {
+        case SettingType::INT:
+            values.*setting.field.i = preferences.getInt(setting.nvsKey, static_cast<int>(setting.defaultNumber));
+            break;
+        case SettingType::FLOAT:
+            values.*setting.field.f = preferences.getFloat(setting.nvsKey, static_cast<float>(setting.defaultNumber));
+            break;
+        case SettingType::DOUBLE:
+            values.*setting.field.d = preferences.getDouble(setting.nvsKey, setting.defaultNumber);
+            break;
+        case SettingType::BOOL:
+            values.*setting.field.b = preferences.getBool(setting.nvsKey, setting.defaultNumber != 0);
+            break;
+        case SettingType::STRING:
+            values.*setting.field.s = preferences.getString(setting.nvsKey, setting.defaultText);
+            break;
+        case SettingType::LIST:
+            values.*setting.field.l = explode(preferences.getString(setting.nvsKey, ""), ',');
+            break;
+        }
+    }
+    // Before the grind mode the smart grind toggle was a bool
+    if (!preferences.isKey("sg_m")) {
+        values.smartGrindMode = preferences.getBool("sg_t", false) ? 1 : 0;
+    }
     preferences.end();
+    current = std::make_shared<const SettingsSnapshot>(values);
 
     xTaskCreate(loopTask, "Settings::loop", configMINIMAL_STACK_SIZE * 6, this, 1, &taskHandle);
 }
 
+const SettingDescriptor *Settings::findSetting(const char *name) {
+    // Names sorted once, the web UI posts every setting on save
+    static const std::array<uint8_t, KEY_COUNT> byName = [] {
+        std::array<uint8_t, KEY_COUNT> keys{};
+        for (uint8_t key = 0; key < KEY_COUNT; key++) {
+            keys[key] = key;
+        }
+        std::sort(keys.begin(), keys.end(), [](uint8_t a, uint8_t b) {
+            const char *nameA = SCHEMA[a].name != nullptr ? SCHEMA[a].name : "";
+            const char *nameB = SCHEMA[b].name != nullptr ? SCHEMA[b].name : "";
+            return strcmp(nameA, nameB) < 0;
+        });
+        return keys;
+    }();
+    auto it = std::lower_bound(byName.begin(), byName.end(), name, [](uint8_t key, const char *value) {
+        return strcmp(SCHEMA[key].name != nullptr ? SCHEMA[key].name : "", value) < 0;
+    });
+    if (it == byName.end() || SCHEMA[*it].name == nullptr || strcmp(SCHEMA[*it].name, name) != 0) {
+        return nullptr;
+    }
+    return &SCHEMA[*it];
+}
+
+bool Settings::update(const SettingDescriptor &setting, const String &value) {
+    if (setting.name == nullptr || ((setting.flags & SETTING_SECRET) && value == SETTING_SECRET_PLACEHOLDER)) {
+        return false;
+    }
+    const Key key = static_cast<Key>(setting.key);
+    double number = 0;
+    switch (setting.type) {
+    case SettingType::INT:
+        if (setting.options != nullptr) {
+            for (uint8_t option = 0; option < setting.optionCount; option++) {
+                if (value == setting.options[option]) {
+                    return set(values.*setting.field.i, static_cast<int>(option), key);
+                }
+            }
+            return false;
+        }
+        if (!parseNumber(value, number)) {
+            return false;
+        }
+        // Clamped before the conversion, an out of range double does not convert
+        number = std::clamp(number * setting.scale, setting.min, setting.max);
+        return set(values.*setting.field.i, static_cast<int>(std::lround(number)), key);
+    case SettingType::FLOAT:
+        if (!parseNumber(value, number)) {
+            return false;
+        }
+        number = std::clamp(number * setting.scale, setting.min, setting.max);
+        return set(values.*setting.field.f, static_cast<float>(number), key);
+    case SettingType::DOUBLE:
+        if (!parseNumber(value, number)) {
+            return false;
+        }
+        return set(values.*setting.field.d, number * setting.scale, key);
+    case SettingType::BOOL:
+        return set(values.*setting.field.b, value != "false" && value != "0" && value != "off", key);
+    case SettingType::STRING:
+        return set(values.*setting.field.s, value, key);
+    case SettingType::LIST:
+        return set(values.*setting.field.l, explode(value, ','), key);
+    }
+    return false;
+}
+
+void Settings::writeJson(Print &out, bool maskSecrets) const {
+    const std::shared_ptr<const SettingsSnapshot> snapshot = this->snapshot();
+    const SettingsSnapshot &view = *snapshot;
+    bool first = true;
+    out.print('{');
+    for (const SettingDescriptor &setting : SCHEMA) {
+        if (setting.name == nullptr) {
+            continue;
+        }
+        if (!first) {
+            out.print(',');
+        }
+        first = false;
+        printJsonString(out, setting.name);
+        out.print(':');
+        if ((setting.flags & SETTING_SECRET) && maskSecrets) {
+            printJsonString(out, SETTING_SECRET_PLACEHOLDER);
+            continue;
+        }
+        switch (setting.type) {
+        case SettingType::INT: {
+            const int value = view.*setting.field.i;
+            if (setting.options != nullptr && value >= 0 && value < setting.optionCount) {
+                printJsonString(out, setting.options[value]);
+            } else {
+                out.print(value / setting.scale);
+            }
+            break;
+        }
+        case SettingType::FLOAT:
+            printJsonNumber(out, view.*setting.field.f / setting.scale, FLT_DIG);
+            break;
+        case SettingType::DOUBLE:
+            printJsonNumber(out, view.*setting.field.d / setting.scale, DBL_DIG);
+            break;
+        case SettingType::BOOL:
+            out.print(view.*setting.field.b ? "true" : "false");
+            break;
+        case SettingType::STRING:
+            printJsonString(out, (view.*setting.field.s).c_str());
+            break;
+        case SettingType::LIST:
+            printJsonString(out, implode(view.*setting.field.l, ",").c_str());
+            break;
+        }
+    }
+    out.print('}');
+}
+
+std::shared_ptr<const SettingsSnapshot> Settings::snapshot() const {
+    // Only the reference count changes under the lock, the settings themselves are never copied for a reader
+    portENTER_CRITICAL(&snapshotLock);
+    std::shared_ptr<const SettingsSnapshot> snapshot = current;
+    portEXIT_CRITICAL(&snapshotLock);
+    return snapshot;
+}
+
+void Settings::publish() {
+    if (batchDepth > 0) {
+        return;
+    }
+    std::shared_ptr<const SettingsSnapshot> next = std::make_shared<const SettingsSnapshot>(values);
+    portENTER_CRITICAL(&snapshotLock);
+    current.swap(next);
+    portEXIT_CRITICAL(&snapshotLock);
+    // The previous snapshot is freed here, or by the last reader still holding it
+}
+
 void Settings::batchUpdate(const SettingsCallback &callback) {
+    std::lock_guard<std::recursive_mutex> lock(writeMutex);
+    // Readers see all changes of the batch at once
+    batchDepth++;
     callback(this);
+    batchDepth--;
+    publish();
     save();
 }
 
@@ -86,235 +362,199 @@ void Settings::save(bool noDelay) {
         doSave();
         return;
     }
-    dirty = true;
+    if (taskHandle != nullptr) {
+        xTaskNotifyGive(taskHandle);
+    }
 }
 
 void Settings::setTargetBrewTemp(const int target_brew_temp) {
-    targetBrewTemp = target_brew_temp;
-    save();
+    set(values.targetBrewTemp, target_brew_temp, KEY_TARGET_BREW_TEMP);
 }
 
 void Settings::setTargetSteamTemp(const int target_steam_temp) {
-    targetSteamTemp = target_steam_temp;
-    save();
+    set(values.targetSteamTemp, target_steam_temp, KEY_TARGET_STEAM_TEMP);
 }
 
 void Settings::setTargetWaterTemp(const int target_water_temp) {
-    targetWaterTemp = target_water_temp;
-    save();
+    set(values.targetWaterTemp, target_water_temp, KEY_TARGET_WATER_TEMP);
 }
 
 void Settings::setTemperatureOffset(const int temperature_offset) {
-    temperatureOffset = temperature_offset;
-    save();
+    set(values.temperatureOffset, temperature_offset, KEY_TEMPERATURE_OFFSET);
 }
 
 void Settings::setPressureScaling(const float pressure_scaling) {
-    pressureScaling = pressure_scaling;
-    save();
+    set(values.pressureScaling, pressure_scaling, KEY_PRESSURE_SCALING);
 }
 
 void Settings::setTargetDuration(const int target_duration) {
-    targetDuration = target_duration;
-    save();
+    set(values.targetDuration, target_duration, KEY_TARGET_DURATION);
 }
 
 void Settings::setTargetVolume(int target_volume) {
-    targetVolume = target_volume;
-    save();
+    set(values.targetVolume, target_volume, KEY_TARGET_VOLUME);
 }
 
 void Settings::setTargetGrindVolume(double target_grind_volume) {
-    targetGrindVolume = target_grind_volume;
-    save();
+    set(values.targetGrindVolume, target_grind_volume, KEY_TARGET_GRIND_VOLUME);
 }
 
 void Settings::setTargetGrindDuration(const int target_duration) {
-    targetGrindDuration = target_duration;
-    save();
+    set(values.targetGrindDuration, target_duration, KEY_TARGET_GRIND_DURATION);
 }
 
 void Settings::setBrewDelay(double brew_Delay) {
-    brewDelay = std::clamp(brew_Delay, 0.0, 4000.0);
-    save();
+    set(values.brewDelay, brew_Delay, KEY_BREW_DELAY);
 }
 
 void Settings::setGrindDelay(double grind_Delay) {
-    grindDelay = std::clamp(grind_Delay, 0.0, 4000.0);
-    save();
+    set(values.grindDelay, grind_Delay, KEY_GRIND_DELAY);
 }
 
 void Settings::setDelayAdjust(bool delay_adjust) {
-    delayAdjust = delay_adjust;
-    save();
+    set(values.delayAdjust, delay_adjust, KEY_DELAY_ADJUST);
 }
 
 void Settings::setStartupMode(const int startup_mode) {
-    startupMode = startup_mode;
-    save();
+    set(values.startupMode, startup_mode, KEY_STARTUP_MODE);
 }
 
 void Settings::setStandbyTimeout(int standby_timeout) {
-    standbyTimeout = standby_timeout;
-    save();
+    set(values.standbyTimeout, standby_timeout, KEY_STANDBY_TIMEOUT);
 }
 
 void Settings::setInfuseBloomTime(int infuse_bloom_time) {
-    infuseBloomTime = infuse_bloom_time;
-    save();
+    set(values.infuseBloomTime, infuse_bloom_time, KEY_INFUSE_BLOOM_TIME);
 }
 
 void Settings::setInfusePumpTime(int infuse_pump_time) {
-    infusePumpTime = infuse_pump_time;
-    save();
+    set(values.infusePumpTime, infuse_pump_time, KEY_INFUSE_PUMP_TIME);
 }
 
 void Settings::setPressurizeTime(int pressurize_time) {
-    pressurizeTime = pressurize_time;
-    save();
+    set(values.pressurizeTime, pressurize_time, KEY_PRESSURIZE_TIME);
 }
 
 void Settings::setPid(const String &pid) {
-    this->pid = pid;
-    save();
+    set(values.pid, pid, KEY_PID);
 }
 
 void Settings::setPumpModelCoeffs(const String &pumpModelCoeffs) {
-    this->pumpModelCoeffs = pumpModelCoeffs;
-    save();
+    set(values.pumpModelCoeffs, pumpModelCoeffs, KEY_PUMP_MODEL_COEFFS);
 }
 
 void Settings::setWifiSsid(const String &wifiSsid) {
-    this->wifiSsid = wifiSsid;
-    save();
+    set(values.wifiSsid, wifiSsid, KEY_WIFI_SSID);
 }
 
 void Settings::setWifiPassword(const String &wifiPassword) {
-    this->wifiPassword = wifiPassword;
-    save();
+    set(values.wifiPassword, wifiPassword, KEY_WIFI_PASSWORD);
 }
 
 void Settings::setMdnsName(const String &mdnsName) {
-    this->mdnsName = mdnsName;
-    save();
+    set(values.mdnsName, mdnsName, KEY_MDNS_NAME);
 }
 
 void Settings::setHomekit(const bool homekit) {
-    this->homekit = homekit;
-    save();
+    set(values.homekit, homekit, KEY_HOMEKIT);
 }
 
 void Settings::setVolumetricTarget(bool volumetric_target) {
-    this->volumetricTarget = volumetric_target;
-    save();
+    set(values.volumetricTarget, volumetric_target, KEY_VOLUMETRIC_TARGET);
 }
 
 void Settings::setOTAChannel(const String &otaChannel) {
-    this->otaChannel = otaChannel;
-    save();
+    set(values.otaChannel, otaChannel, KEY_OTA_CHANNEL);
 }
 
 void Settings::setSavedScale(const String &savedScale) {
-    this->savedScale = savedScale;
-    save();
+    set(values.savedScale, savedScale, KEY_SAVED_SCALE);
 }
 
 void Settings::setBoilerFillActive(bool boiler_fill_active) {
-    boilerFillActive = boiler_fill_active;
-    save();
+    set(values.boilerFillActive, boiler_fill_active, KEY_BOILER_FILL_ACTIVE);
 }
 
 void Settings::setStartupFillTime(int startup_fill_time) {
-    startupFillTime = startup_fill_time;
-    save();
+    set(values.startupFillTime, startup_fill_time, KEY_STARTUP_FILL_TIME);
 }
 
 void Settings::setSteamFillTime(int steam_fill_time) {
-    steamFillTime = steam_fill_time;
-    save();
+    set(values.steamFillTime, steam_fill_time, KEY_STEAM_FILL_TIME);
 }
 
 void Settings::setSmartGrindActive(bool smart_grind_active) {
-    smartGrindActive = smart_grind_active;
-    save();
+    set(values.smartGrindActive, smart_grind_active, KEY_SMART_GRIND_ACTIVE);
 }
 
 void Settings::setSmartGrindIp(String smart_grind_ip) {
-    this->smartGrindIp = std::move(smart_grind_ip);
-    save();
+    set(values.smartGrindIp, std::move(smart_grind_ip), KEY_SMART_GRIND_IP);
 }
 
 void Settings::setSmartGrindMode(int smart_grind_mode) {
-    this->smartGrindMode = smart_grind_mode;
-    save();
+    set(values.smartGrindMode, smart_grind_mode, KEY_SMART_GRIND_MODE);
 }
 
 void Settings::setHomeAssistant(const bool homeAssistant) {
-    this->homeAssistant = homeAssistant;
-    save();
+    set(values.homeAssistant, homeAssistant, KEY_HOME_ASSISTANT);
 }
 
 void Settings::setHomeAssistantIP(const String &homeAssistantIP) {
-    this->homeAssistantIP = homeAssistantIP;
-    save();
+    set(values.homeAssistantIP, homeAssistantIP, KEY_HOME_ASSISTANT_IP);
 }
 
 void Settings::setHomeAssistantPort(const int homeAssistantPort) {
-    this->homeAssistantPort = homeAssistantPort;
-    save();
+    set(values.homeAssistantPort, homeAssistantPort, KEY_HOME_ASSISTANT_PORT);
 }
 void Settings::setHomeAssistantTopic(const String &homeAssistantTopic) {
-    this->homeAssistantTopic = homeAssistantTopic;
-    save();
+    set(values.homeAssistantTopic, homeAssistantTopic, KEY_HOME_ASSISTANT_TOPIC);
+}
+void Settings::setHomeAssistantTelemetryInterval(const int interval) {
+    set(values.homeAssistantTelemetryInterval, interval, KEY_HOME_ASSISTANT_TELEMETRY_INTERVAL);
 }
 void Settings::setHomeAssistantUser(const String &homeAssistantUser) {
-    this->homeAssistantUser = homeAssistantUser;
-    save();
+    set(values.homeAssistantUser, homeAssistantUser, KEY_HOME_ASSISTANT_USER);
 }
 void Settings::setHomeAssistantPassword(const String &homeAssistantPassword) {
-    this->homeAssistantPassword = homeAssistantPassword;
-    save();
+    set(values.homeAssistantPassword, homeAssistantPassword, KEY_HOME_ASSISTANT_PASSWORD);
 }
 
 void Settings::setMomentaryButtons(bool momentary_buttons) {
-    momentaryButtons = momentary_buttons;
-    save();
+    set(values.momentaryButtons, momentary_buttons, KEY_MOMENTARY_BUTTONS);
 }
 
 void Settings::setTimezone(String timezone) {
-    this->timezone = std::move(timezone);
-    save();
+    set(values.timezone, std::move(timezone), KEY_TIMEZONE);
 }
 
 void Settings::setClockFormat(bool clock_24h_format) {
-    this->clock24hFormat = clock_24h_format;
-    save();
+    set(values.clock24hFormat, clock_24h_format, KEY_CLOCK_24H_FORMAT);
 }
 
 void Settings::setSelectedProfile(String selected_profile) {
-    this->selectedProfile = std::move(selected_profile);
-    save();
+    set(values.selectedProfile, std::move(selected_profile), KEY_SELECTED_PROFILE);
 }
 
 void Settings::setProfilesMigrated(bool profiles_migrated) {
-    profilesMigrated = profiles_migrated;
-    save();
+    set(values.profilesMigrated, profiles_migrated, KEY_PROFILES_MIGRATED);
 }
 
 void Settings::setFavoritedProfiles(std::vector<String> favorited_profiles) {
-    favoritedProfiles = std::move(favorited_profiles);
-    save();
+    set(values.favoritedProfiles, std::move(favorited_profiles), KEY_FAVORITED_PROFILES);
 }
 
 void Settings::addFavoritedProfile(String profile) {
-    favoritedProfiles.emplace_back(profile);
-    save();
+    std::lock_guard<std::recursive_mutex> lock(writeMutex);
+    std::vector<String> profiles = values.favoritedProfiles;
+    profiles.emplace_back(std::move(profile));
+    set(values.favoritedProfiles, std::move(profiles), KEY_FAVORITED_PROFILES);
 }
 
 void Settings::removeFavoritedProfile(String profile) {
-    favoritedProfiles.erase(std::remove(favoritedProfiles.begin(), favoritedProfiles.end(), profile), favoritedProfiles.end());
-    favoritedProfiles.shrink_to_fit();
-    save();
+    std::lock_guard<std::recursive_mutex> lock(writeMutex);
+    std::vector<String> profiles = values.favoritedProfiles;
+    profiles.erase(std::remove(profiles.begin(), profiles.end(), profile), profiles.end());
+    set(values.favoritedProfiles, std::move(profiles), KEY_FAVORITED_PROFILES);
 }
 
 void Settings::setProfileOrder(std::vector<String> profile_order) {
@@ -328,165 +568,126 @@ void Settings::setProfileOrder(std::vector<String> profile_order) {
         }
     }
 
-    profileOrder = std::move(cleaned);
-    save();
+    set(values.profileOrder, std::move(cleaned), KEY_PROFILE_ORDER);
 }
 
 void Settings::setMainBrightness(int main_brightness) {
-    mainBrightness = main_brightness;
-    save();
+    set(values.mainBrightness, main_brightness, KEY_MAIN_BRIGHTNESS);
 }
 
 void Settings::setStandbyBrightness(int standby_brightness) {
-    standbyBrightness = standby_brightness;
-    save();
+    set(values.standbyBrightness, standby_brightness, KEY_STANDBY_BRIGHTNESS);
 }
 
 void Settings::setStandbyBrightnessTimeout(int standby_brightness_timeout) {
-    standbyBrightnessTimeout = standby_brightness_timeout;
-    save();
+    set(values.standbyBrightnessTimeout, standby_brightness_timeout, KEY_STANDBY_BRIGHTNESS_TIMEOUT);
 }
 
 void Settings::setWifiApTimeout(int timeout) {
-    wifiApTimeout = timeout;
-    save();
+    set(values.wifiApTimeout, timeout, KEY_WIFI_AP_TIMEOUT);
 }
 
 void Settings::setSteamPumpPercentage(float steam_pump_percentage) {
-    steamPumpPercentage = steam_pump_percentage;
-    save();
+    set(values.steamPumpPercentage, steam_pump_percentage, KEY_STEAM_PUMP_PERCENTAGE);
 }
 
 void Settings::setSteamPumpCutoff(float steam_pump_cutoff) {
-    steamPumpCutoff = steam_pump_cutoff;
-    save();
+    set(values.steamPumpCutoff, steam_pump_cutoff, KEY_STEAM_PUMP_CUTOFF);
 }
 
 void Settings::setThemeMode(int theme_mode) {
-    themeMode = theme_mode;
-    save();
+    set(values.themeMode, theme_mode, KEY_THEME_MODE);
 }
 
 void Settings::setHistoryIndex(int history_index) {
-    historyIndex = history_index;
-    save();
+    set(values.historyIndex, history_index, KEY_HISTORY_INDEX);
 }
 
 void Settings::setSunriseR(int sunrise_r) {
-    sunriseR = sunrise_r;
-    save();
+    set(values.sunriseR, sunrise_r, KEY_SUNRISE_R);
 }
 
 void Settings::setSunriseG(int sunrise_g) {
-    sunriseG = sunrise_g;
-    save();
+    set(values.sunriseG, sunrise_g, KEY_SUNRISE_G);
 }
 
 void Settings::setSunriseB(int sunrise_b) {
-    sunriseB = sunrise_b;
-    save();
+    set(values.sunriseB, sunrise_b, KEY_SUNRISE_B);
 }
 
 void Settings::setSunriseW(int sunrise_w) {
-    sunriseW = sunrise_w;
-    save();
+    set(values.sunriseW, sunrise_w, KEY_SUNRISE_W);
 }
 
 void Settings::setSunriseExtBrightness(int sunrise_ext_brightness) {
-    sunriseExtBrightness = sunrise_ext_brightness;
-    save();
+    set(values.sunriseExtBrightness, sunrise_ext_brightness, KEY_SUNRISE_EXT_BRIGHTNESS);
 }
 
 void Settings::setEmptyTankDistance(int empty_tank_distance) {
-    emptyTankDistance = empty_tank_distance;
-    save();
+    set(values.emptyTankDistance, empty_tank_distance, KEY_EMPTY_TANK_DISTANCE);
 }
 
 void Settings::setFullTankDistance(int full_tank_distance) {
-    fullTankDistance = full_tank_distance;
+    set(values.fullTankDistance, full_tank_distance, KEY_FULL_TANK_DISTANCE);
+}
+
+void Settings::markDirty(Key key) {
+    portENTER_CRITICAL(&dirtyLock);
+    dirtyKeys |= 1ULL << key;
+    portEXIT_CRITICAL(&dirtyLock);
     save();
 }
 
 void Settings::doSave() {
-    if (!dirty) {
+    // Writers wait for the flush, so every written key matches its cleared dirty bit
+    std::lock_guard<std::recursive_mutex> lock(writeMutex);
+    portENTER_CRITICAL(&dirtyLock);
+    const uint64_t keys = dirtyKeys;
+    dirtyKeys = 0;
+    portEXIT_CRITICAL(&dirtyLock);
+    if (keys == 0) {
         return;
     }
-    dirty = false;
-    ESP_LOGI("Settings", "Saving settings");
+    ESP_LOGI("Settings", "Saving %d changed settings", __builtin_popcountll(keys));
     preferences.begin(PREFERENCES_KEY, false);
-    preferences.putInt("sm", startupMode);
-    preferences.putInt("tb", targetBrewTemp);
-    preferences.putInt("ts", targetSteamTemp);
-    preferences.putInt("tw", targetWaterTemp);
-    preferences.putInt("td", targetDuration);
-    preferences.putInt("tv", targetVolume);
-    preferences.putDouble("tgv", targetGrindVolume);
-    preferences.putInt("tgd", targetGrindDuration);
-    preferences.putDouble("del_br", brewDelay);
-    preferences.putDouble("del_gd", grindDelay);
-    preferences.putBool("del_ad", delayAdjust);
-    preferences.putInt("to", temperatureOffset);
-    preferences.putFloat("ps", pressureScaling);
-    preferences.putString("pid", pid);
-    preferences.putString("pmc", pumpModelCoeffs);
-    preferences.putString("ws", wifiSsid);
-    preferences.putString("wp", wifiPassword);
-    preferences.putString("mn", mdnsName);
-    preferences.putBool("hk", homekit);
-    preferences.putBool("vt", volumetricTarget);
-    preferences.putString("oc", otaChannel);
-    preferences.putInt("ipt", infusePumpTime);
-    preferences.putInt("ibt", infuseBloomTime);
-    preferences.putInt("pt", pressurizeTime);
-    preferences.putString("ssc", savedScale);
-    preferences.putBool("bf_a", boilerFillActive);
-    preferences.putInt("bf_su", startupFillTime);
-    preferences.putInt("bf_st", steamFillTime);
-    preferences.putBool("sg_a", smartGrindActive);
-    preferences.putString("sg_i", smartGrindIp);
-    preferences.putBool("sg_t", smartGrindToggle);
-    preferences.putInt("sg_m", smartGrindMode);
-    preferences.putBool("ha_a", homeAssistant);
-    preferences.putString("ha_i", homeAssistantIP);
-    preferences.putInt("ha_p", homeAssistantPort);
-    preferences.putString("ha_t", homeAssistantTopic);
-    preferences.putString("ha_u", homeAssistantUser);
-    preferences.putString("ha_pw", homeAssistantPassword);
-    preferences.putString("tz", timezone);
-    preferences.putBool("clk_24h", clock24hFormat);
-    preferences.putString("sp", selectedProfile);
-    preferences.putInt("sbt", standbyTimeout);
-    preferences.putBool("pm", profilesMigrated);
-    preferences.putBool("mb", momentaryButtons);
-    preferences.putString("fp", implode(favoritedProfiles, ","));
-    preferences.putString("po", implode(profileOrder, ","));
-    preferences.putFloat("spp", steamPumpPercentage);
-    preferences.putFloat("spc", steamPumpCutoff);
-    preferences.putInt("hi", historyIndex);
-
-    // Display settings
-    preferences.putInt("main_b", mainBrightness);
-    preferences.putInt("standby_b", standbyBrightness);
-    preferences.putInt("standby_bt", standbyBrightnessTimeout);
-    preferences.putInt("wifi_apt", wifiApTimeout);
-    preferences.putInt("theme", themeMode);
-
-    // Sunrise Settings
-    preferences.putInt("sr_r", sunriseR);
-    preferences.putInt("sr_g", sunriseG);
-    preferences.putInt("sr_b", sunriseB);
-    preferences.putInt("sr_w", sunriseW);
-    preferences.putInt("sr_exb", sunriseExtBrightness);
-    preferences.putInt("sr_ed", emptyTankDistance);
-    preferences.putInt("sr_fd", fullTankDistance);
-
+    for (uint8_t key = 0; key < KEY_COUNT; key++) {
+        if (keys & (1ULL << key)) {
+            write(static_cast<Key>(key));
+        }
+    }
     preferences.end();
 }
 
+void Settings::write(Key key) {
+    const SettingDescriptor &setting = SCHEMA[key];
+    switch (setting.type) {
+    case SettingType::INT:
+        preferences.putInt(setting.nvsKey, values.*setting.field.i);
+        break;
+    case SettingType::FLOAT:
+        preferences.putFloat(setting.nvsKey, values.*setting.field.f);
+        break;
+    case SettingType::DOUBLE:
+        preferences.putDouble(setting.nvsKey, values.*setting.field.d);
+        break;
+    case SettingType::BOOL:
+        preferences.putBool(setting.nvsKey, values.*setting.field.b);
+        break;
+    case SettingType::STRING:
+        preferences.putString(setting.nvsKey, values.*setting.field.s);
+        break;
+    case SettingType::LIST:
+        preferences.putString(setting.nvsKey, implode(values.*setting.field.l, ","));
+        break;
+    }
+}
+
 void Settings::loopTask(void *arg) {
     auto *settings = static_cast<Settings *>(arg);
     while (true) {
+        // Sleeps until something changed, then gives further changes time to pile up into one write
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(SETTINGS_SAVE_DELAY_MS / portTICK_PERIOD_MS);
         settings->doSave();
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
     }
 }
@@ -4,22 +4,33 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <algorithm>
 #include <display/core/constants.h>
 #include <display/core/utils.h>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 #define PREFERENCES_KEY "controller"
 
+constexpr unsigned long SETTINGS_SAVE_DELAY_MS = 5000;
+
 class Settings;
 using SettingsCallback = std::function<void(Settings *)>;
 
-class Settings {
-  public:
-    Settings();
+enum class SettingType : uint8_t { INT, FLOAT, DOUBLE, BOOL, STRING, LIST };
 
-    void batchUpdate(const SettingsCallback &callback);
-    void save(bool noDelay = false);
+constexpr uint8_t SETTING_SECRET = 0x01; // replaced by SETTING_SECRET_PLACEHOLDER towards the setup access point
+constexpr char SETTING_SECRET_PLACEHOLDER[] = "---unchanged---";
 
-    // Getters and setters
+constexpr char SETTINGS_EVENT_TEMPERATURE[] = "settings:temperature:change";
+constexpr char SETTINGS_EVENT_PUMP[] = "settings:pump:change";
+
+// Immutable copy of all settings. Settings publishes a new one after every change, a reader keeps the one it took
+// for as long as it needs consistent values and is never blocked by a writer.
+class SettingsSnapshot {
+  public:
     int getTargetBrewTemp() const { return targetBrewTemp; }
     int getTargetSteamTemp() const { return targetSteamTemp; }
     int getTargetWaterTemp() const { return targetWaterTemp; }
@@ -58,6 +69,7 @@ class Settings {
     String getHomeAssistantPassword() const { return homeAssistantPassword; }
     int getHomeAssistantPort() const { return homeAssistantPort; }
     String getHomeAssistantTopic() const { return homeAssistantTopic; }
+    int getHomeAssistantTelemetryInterval() const { return homeAssistantTelemetryInterval; }
     bool isMomentaryButtons() const { return momentaryButtons; }
     String getTimezone() const { return timezone; }
     bool isClock24hFormat() const { return clock24hFormat; }
@@ -80,6 +92,298 @@ class Settings {
     int getSunriseExtBrightness() const { return sunriseExtBrightness; }
     int getEmptyTankDistance() const { return emptyTankDistance; }
     int getFullTankDistance() const { return fullTankDistance; }
+
+  private:
+    friend class Settings;
+
+    // Defaults are in Settings::SCHEMA
+    String selectedProfile;
+    bool profilesMigrated;
+    int targetSteamTemp;
+    int targetWaterTemp;
+    int temperatureOffset;
+    float pressureScaling;
+    double targetGrindVolume;
+    int targetGrindDuration;
+    double brewDelay;
+    double grindDelay;
+    bool delayAdjust;
+    int startupMode;
+    int standbyTimeout;
+    String pid;
+    String pumpModelCoeffs;
+    String wifiSsid;
+    String wifiPassword;
+    String mdnsName;
+    String savedScale;
+    bool homekit;
+    bool volumetricTarget;
+    bool boilerFillActive;
+    int startupFillTime;
+    int steamFillTime;
+    bool smartGrindActive;
+    int smartGrindMode;
+    String smartGrindIp;
+    bool homeAssistant;
+    String homeAssistantUser;
+    String homeAssistantPassword;
+    String homeAssistantIP;
+    int homeAssistantPort;
+    String homeAssistantTopic;
+    int homeAssistantTelemetryInterval;
+    bool momentaryButtons;
+    String timezone;
+    bool clock24hFormat;
+    String otaChannel;
+    std::vector<String> favoritedProfiles;
+    std::vector<String> profileOrder; // persisted profile ordering
+    float steamPumpPercentage;
+    float steamPumpCutoff;
+    int historyIndex;
+
+    // Deprecated, use profiles
+    int targetBrewTemp;
+    int targetDuration;
+    int targetVolume;
+    int infuseBloomTime;
+    int infusePumpTime;
+    int pressurizeTime;
+
+    // Display settings
+    int mainBrightness;
+    int standbyBrightness;
+    int standbyBrightnessTimeout;
+    int wifiApTimeout;
+    int themeMode;
+
+    // Sunrise settings
+    int sunriseR;
+    int sunriseG;
+    int sunriseB;
+    int sunriseW;
+    int sunriseExtBrightness;
+    int emptyTankDistance;
+    int fullTankDistance;
+};
+
+// One row of Settings::SCHEMA. Loading, storing, validation and the JSON the web UI reads and posts are all
+// generated from these rows, a setting is added by adding its field, key and row.
+struct SettingDescriptor {
+    union Field {
+        constexpr Field(int SettingsSnapshot::*value) : i(value) {}
+        constexpr Field(float SettingsSnapshot::*value) : f(value) {}
+        constexpr Field(double SettingsSnapshot::*value) : d(value) {}
+        constexpr Field(bool SettingsSnapshot::*value) : b(value) {}
+        constexpr Field(String SettingsSnapshot::*value) : s(value) {}
+        constexpr Field(std::vector<String> SettingsSnapshot::*value) : l(value) {}
+        int SettingsSnapshot::*i;
+        float SettingsSnapshot::*f;
+        double SettingsSnapshot::*d;
+        bool SettingsSnapshot::*b;
+        String SettingsSnapshot::*s;
+        std::vector<String> SettingsSnapshot::*l;
+    };
+
+    constexpr SettingDescriptor(uint8_t key, const char *nvsKey, const char *name, SettingType type, Field field,
+                                double defaultNumber, const char *defaultText, double min, double max)
+        : key(key), nvsKey(nvsKey), name(name), type(type), field(field), defaultNumber(defaultNumber),
+          defaultText(defaultText), min(min), max(max) {}
+
+    constexpr SettingDescriptor withRange(double min, double max) const {
+        SettingDescriptor descriptor = *this;
+        descriptor.min = min;
+        descriptor.max = max;
+        return descriptor;
+    }
+    // Stored value per unit of the web UI, e.g. 1000 for a millisecond setting shown in seconds
+    constexpr SettingDescriptor withScale(int scale) const {
+        SettingDescriptor descriptor = *this;
+        descriptor.scale = scale;
+        return descriptor;
+    }
+    // Names of the values of an int setting, sent instead of the number
+    template <size_t N> constexpr SettingDescriptor withOptions(const char *const (&options)[N]) const {
+        SettingDescriptor descriptor = *this;
+        descriptor.options = options;
+        descriptor.optionCount = N;
+        return descriptor;
+    }
+    // Triggered when the web UI changes the setting
+    constexpr SettingDescriptor withEvent(const char *event) const {
+        SettingDescriptor descriptor = *this;
+        descriptor.event = event;
+        return descriptor;
+    }
+    constexpr SettingDescriptor withFlags(uint8_t flags) const {
+        SettingDescriptor descriptor = *this;
+        descriptor.flags = flags;
+        return descriptor;
+    }
+
+    uint8_t key; // Settings::Key, also the row in Settings::SCHEMA
+    const char *nvsKey;
+    const char *name; // REST and WebSocket name, nullptr for state the web UI does not edit
+    SettingType type;
+    Field field;
+    double defaultNumber;
+    const char *defaultText;
+    double min;
+    double max;
+    int scale = 1;
+    const char *const *options = nullptr;
+    uint8_t optionCount = 0;
+    const char *event = nullptr;
+    uint8_t flags = 0;
+};
+
+class Settings {
+  public:
+    // One per preference key and row of SCHEMA, changed keys are collected in dirtyKeys and written together
+    enum Key : uint8_t {
+        KEY_STARTUP_MODE,
+        KEY_TARGET_BREW_TEMP,
+        KEY_TARGET_STEAM_TEMP,
+        KEY_TARGET_WATER_TEMP,
+        KEY_TARGET_DURATION,
+        KEY_TARGET_VOLUME,
+        KEY_TARGET_GRIND_VOLUME,
+        KEY_TARGET_GRIND_DURATION,
+        KEY_BREW_DELAY,
+        KEY_GRIND_DELAY,
+        KEY_DELAY_ADJUST,
+        KEY_TEMPERATURE_OFFSET,
+        KEY_PRESSURE_SCALING,
+        KEY_PID,
+        KEY_PUMP_MODEL_COEFFS,
+        KEY_WIFI_SSID,
+        KEY_WIFI_PASSWORD,
+        KEY_MDNS_NAME,
+        KEY_HOMEKIT,
+        KEY_VOLUMETRIC_TARGET,
+        KEY_OTA_CHANNEL,
+        KEY_INFUSE_PUMP_TIME,
+        KEY_INFUSE_BLOOM_TIME,
+        KEY_PRESSURIZE_TIME,
+        KEY_SAVED_SCALE,
+        KEY_BOILER_FILL_ACTIVE,
+        KEY_STARTUP_FILL_TIME,
+        KEY_STEAM_FILL_TIME,
+        KEY_SMART_GRIND_ACTIVE,
+        KEY_SMART_GRIND_IP,
+        KEY_SMART_GRIND_MODE,
+        KEY_HOME_ASSISTANT,
+        KEY_HOME_ASSISTANT_IP,
+        KEY_HOME_ASSISTANT_PORT,
+        KEY_HOME_ASSISTANT_TOPIC,
+        KEY_HOME_ASSISTANT_USER,
+        KEY_HOME_ASSISTANT_PASSWORD,
+        KEY_TIMEZONE,
+        KEY_CLOCK_24H_FORMAT,
+        KEY_SELECTED_PROFILE,
+        KEY_STANDBY_TIMEOUT,
+        KEY_PROFILES_MIGRATED,
+        KEY_MOMENTARY_BUTTONS,
+        KEY_FAVORITED_PROFILES,
+        KEY_PROFILE_ORDER,
+        KEY_STEAM_PUMP_PERCENTAGE,
+        KEY_STEAM_PUMP_CUTOFF,
+        KEY_HISTORY_INDEX,
+        KEY_MAIN_BRIGHTNESS,
+        KEY_STANDBY_BRIGHTNESS,
+        KEY_STANDBY_BRIGHTNESS_TIMEOUT,
+        KEY_WIFI_AP_TIMEOUT,
+        KEY_THEME_MODE,
+        KEY_SUNRISE_R,
+        KEY_SUNRISE_G,
+        KEY_SUNRISE_B,
+        KEY_SUNRISE_W,
+        KEY_SUNRISE_EXT_BRIGHTNESS,
+        KEY_EMPTY_TANK_DISTANCE,
+        KEY_FULL_TANK_DISTANCE,
+        KEY_HOME_ASSISTANT_TELEMETRY_INTERVAL,
+        KEY_COUNT
+    };
+    static_assert(KEY_COUNT <= 64, "dirtyKeys has one bit per key");
+
+    static const SettingDescriptor SCHEMA[KEY_COUNT];
+    // Looks up a setting by its REST and WebSocket name
+    static const SettingDescriptor *findSetting(const char *name);
+
+    Settings();
+    Settings(const Settings &) = delete;
+    Settings &operator=(const Settings &) = delete;
+
+    // Consistent view of all settings, cheap to take from any task or core
+    std::shared_ptr<const SettingsSnapshot> snapshot() const;
+    void batchUpdate(const SettingsCallback &callback);
+    void save(bool noDelay = false);
+    // Parses and validates a value as sent by the web UI, true if the setting changed
+    bool update(const SettingDescriptor &setting, const String &value);
+    // Writes all named settings as a JSON object
+    void writeJson(Print &out, bool maskSecrets) const;
+
+    // Getters and setters
+    int getTargetBrewTemp() const { return snapshot()->getTargetBrewTemp(); }
+    int getTargetSteamTemp() const { return snapshot()->getTargetSteamTemp(); }
+    int getTargetWaterTemp() const { return snapshot()->getTargetWaterTemp(); }
+    int getTemperatureOffset() const { return snapshot()->getTemperatureOffset(); }
+    float getPressureScaling() const { return snapshot()->getPressureScaling(); }
+    int getTargetDuration() const { return snapshot()->getTargetDuration(); }
+    int getTargetVolume() const { return snapshot()->getTargetVolume(); }
+    double getTargetGrindVolume() const { return snapshot()->getTargetGrindVolume(); }
+    int getTargetGrindDuration() const { return snapshot()->getTargetGrindDuration(); }
+    int getStartupMode() const { return snapshot()->getStartupMode(); }
+    int getStandbyTimeout() const { return snapshot()->getStandbyTimeout(); }
+    int getInfuseBloomTime() const { return snapshot()->getInfuseBloomTime(); }
+    int getInfusePumpTime() const { return snapshot()->getInfusePumpTime(); }
+    int getPressurizeTime() const { return snapshot()->getPressurizeTime(); }
+    double getBrewDelay() const { return snapshot()->getBrewDelay(); }
+    double getGrindDelay() const { return snapshot()->getGrindDelay(); }
+    bool isDelayAdjust() const { return snapshot()->isDelayAdjust(); }
+    String getPid() const { return snapshot()->getPid(); }
+    String getPumpModelCoeffs() const { return snapshot()->getPumpModelCoeffs(); }
+    String getWifiSsid() const { return snapshot()->getWifiSsid(); }
+    String getWifiPassword() const { return snapshot()->getWifiPassword(); }
+    String getMdnsName() const { return snapshot()->getMdnsName(); }
+    bool isHomekit() const { return snapshot()->isHomekit(); }
+    bool isVolumetricTarget() const { return snapshot()->isVolumetricTarget(); }
+    String getOTAChannel() const { return snapshot()->getOTAChannel(); }
+    String getSavedScale() const { return snapshot()->getSavedScale(); }
+    bool isBoilerFillActive() const { return snapshot()->isBoilerFillActive(); }
+    int getStartupFillTime() const { return snapshot()->getStartupFillTime(); }
+    int getSteamFillTime() const { return snapshot()->getSteamFillTime(); }
+    bool isSmartGrindActive() const { return snapshot()->isSmartGrindActive(); }
+    int getSmartGrindMode() const { return snapshot()->getSmartGrindMode(); }
+    String getSmartGrindIp() const { return snapshot()->getSmartGrindIp(); }
+    bool isHomeAssistant() const { return snapshot()->isHomeAssistant(); }
+    String getHomeAssistantIP() const { return snapshot()->getHomeAssistantIP(); }
+    String getHomeAssistantUser() const { return snapshot()->getHomeAssistantUser(); }
+    String getHomeAssistantPassword() const { return snapshot()->getHomeAssistantPassword(); }
+    int getHomeAssistantPort() const { return snapshot()->getHomeAssistantPort(); }
+    String getHomeAssistantTopic() const { return snapshot()->getHomeAssistantTopic(); }
+    int getHomeAssistantTelemetryInterval() const { return snapshot()->getHomeAssistantTelemetryInterval(); }
+    bool isMomentaryButtons() const { return snapshot()->isMomentaryButtons(); }
+    String getTimezone() const { return snapshot()->getTimezone(); }
+    bool isClock24hFormat() const { return snapshot()->isClock24hFormat(); }
+    String getSelectedProfile() const { return snapshot()->getSelectedProfile(); }
+    bool isProfilesMigrated() const { return snapshot()->isProfilesMigrated(); }
+    std::vector<String> getFavoritedProfiles() const { return snapshot()->getFavoritedProfiles(); }
+    std::vector<String> getProfileOrder() const { return snapshot()->getProfileOrder(); }
+    int getMainBrightness() const { return snapshot()->getMainBrightness(); }
+    int getStandbyBrightness() const { return snapshot()->getStandbyBrightness(); }
+    int getStandbyBrightnessTimeout() const { return snapshot()->getStandbyBrightnessTimeout(); }
+    int getWifiApTimeout() const { return snapshot()->getWifiApTimeout(); }
+    float getSteamPumpPercentage() const { return snapshot()->getSteamPumpPercentage(); }
+    float getSteamPumpCutoff() const { return snapshot()->getSteamPumpCutoff(); }
+    int getThemeMode() const { return snapshot()->getThemeMode(); }
+    int getHistoryIndex() const { return snapshot()->getHistoryIndex(); }
+    int getSunriseR() const { return snapshot()->getSunriseR(); }
+    int getSunriseG() const { return snapshot()->getSunriseG(); }
+    int getSunriseB() const { return snapshot()->getSunriseB(); }
+    int getSunriseW() const { return snapshot()->getSunriseW(); }
+    int getSunriseExtBrightness() const { return snapshot()->getSunriseExtBrightness(); }
+    int getEmptyTankDistance() const { return snapshot()->getEmptyTankDistance(); }
+    int getFullTankDistance() const { return snapshot()->getFullTankDistance(); }
     void setTargetBrewTemp(int target_brew_temp);
     void setTargetSteamTemp(int target_steam_temp);
     void setTargetWaterTemp(int target_water_temp);
@@ -118,6 +422,7 @@ class Settings {
     void setHomeAssistantIP(const String &homeAssistantIP);
     void setHomeAssistantPort(int homeAssistantPort);
     void setHomeAssistantTopic(const String &homeAssistantTopic);
+    void setHomeAssistantTelemetryInterval(int interval);
     void setMomentaryButtons(bool momentary_buttons);
     void setTimezone(String timezone);
     void setClockFormat(bool format_24h);
@@ -145,78 +450,36 @@ class Settings {
 
   private:
     Preferences preferences;
-    bool dirty = false;
-
-    String selectedProfile;
-    bool profilesMigrated = false;
-    int targetSteamTemp = 155;
-    int targetWaterTemp = 80;
-    int temperatureOffset = DEFAULT_TEMPERATURE_OFFSET;
-    float pressureScaling = DEFAULT_PRESSURE_SCALING;
-    double targetGrindVolume = 18;
-    int targetGrindDuration = 25000;
-    double brewDelay = 1000.0;
-    double grindDelay = 1000.0;
-    bool delayAdjust = true;
-    int startupMode = MODE_STANDBY;
-    int standbyTimeout = DEFAULT_STANDBY_TIMEOUT_MS;
-    String pid = DEFAULT_PID;
-    String pumpModelCoeffs = DEFAULT_PUMP_MODEL_COEFFS;
-    String wifiSsid = "";
-    String wifiPassword = "";
-    String mdnsName = DEFAULT_MDNS_NAME;
-    String savedScale = "";
-    bool homekit = false;
-    bool volumetricTarget = false;
-    bool boilerFillActive = false;
-    int startupFillTime = 0;
-    int steamFillTime = 0;
-    bool smartGrindActive = false;
-    bool smartGrindToggle = false;
-    int smartGrindMode = 0;
-    String smartGrindIp = "";
-    bool homeAssistant = false;
-    String homeAssistantUser = "";
-    String homeAssistantPassword = "";
-    String homeAssistantIP = "";
-    int homeAssistantPort = 1883;
-    String homeAssistantTopic = DEFAULT_HOME_ASSISTANT_TOPIC;
-    bool momentaryButtons = false;
-    String timezone = DEFAULT_TIMEZONE;
-    bool clock24hFormat = true;
-    String otaChannel = DEFAULT_OTA_CHANNEL;
-    std::vector<String> favoritedProfiles;
-    std::vector<String> profileOrder; // persisted profile ordering
-    float steamPumpPercentage = DEFAULT_STEAM_PUMP_PERCENTAGE;
-    float steamPumpCutoff = DEFAULT_STEAM_PUMP_CUTOFF;
-    int historyIndex = 0;
+    uint64_t dirtyKeys = 0;
+    portMUX_TYPE dirtyLock = portMUX_INITIALIZER_UNLOCKED;
 
-    // Deprecated, use profiles
-    int targetBrewTemp = 93;
-    int targetDuration = 25000;
-    int targetVolume = 36;
-    int infuseBloomTime = 0;
-    int infusePumpTime = 0;
-    int pressurizeTime = 0;
-
-    // Display settings
-    int mainBrightness = 16;
-    int standbyBrightness = 8;
-    int standbyBrightnessTimeout = 60000; // 60 seconds default
-    int wifiApTimeout = DEFAULT_WIFI_AP_TIMEOUT_MS;
-    int themeMode = 0;
-
-    // Sunrise settings
-    int sunriseR = 0;
-    int sunriseG = 0;
-    int sunriseB = 255;
-    int sunriseW = 50;
-    int sunriseExtBrightness = 255;
-    int emptyTankDistance = 200;
-    int fullTankDistance = 50;
+    // Changed by one writer at a time, readers only see what was published
+    SettingsSnapshot values;
+    std::recursive_mutex writeMutex;
+    int batchDepth = 0;
+    std::shared_ptr<const SettingsSnapshot> current;
+    mutable portMUX_TYPE snapshotLock = portMUX_INITIALIZER_UNLOCKED;
 
+    // Values out of the range in SCHEMA are clamped, true if the value changed
+    template <typename T> bool set(T &field, T value, Key key) {
+        std::lock_guard<std::recursive_mutex> lock(writeMutex);
+        if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) {
+            value = std::clamp(value, static_cast<T>(SCHEMA[key].min), static_cast<T>(SCHEMA[key].max));
+        }
+        if (field == value) {
+            return false;
+        }
+        field = std::move(value);
+        publish();
+        markDirty(key);
+        return true;
+    }
+    static constexpr bool schemaMatchesKeys();
+    void publish();
+    void markDirty(Key key);
     void doSave();
-    xTaskHandle taskHandle;
+    void write(Key key);
+    xTaskHandle taskHandle = nullptr;
     static void loopTask(void *arg);
 };
 
@@ -0,0 +1,230 @@
+#include "WeightEstimator.h"
+#include <Clock/Clock.h>
+#include <algorithm>
+#include <cmath>
+
+void WeightEstimator::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    initialized = false;
+}
+
+void WeightEstimator::addMeasurement(float weight) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const unsigned long now = Clock::get().millis();
+    const unsigned long sampleTime = now - static_cast<unsigned long>(latency);
+    if (recording && shotWeights.size() < WEIGHT_LATENCY_MAX_SAMPLES) {
+        shotWeights.push_back({now, weight});
+    }
+    if (!initialized || now - lastArrival > WEIGHT_STALE_MS) {
+        initialize(weight, sampleTime);
+        lastArrival = now;
+        return;
+    }
+    lastArrival = now;
+
+    const float dt = static_cast<float>(static_cast<long>(sampleTime - stateTime)) / 1000.0f;
+    if (dt > 0.0f) {
+        predict(dt);
+        stateTime = sampleTime;
+    }
+
+    const float innovation = weight - x[0];
+    if (std::fabs(innovation) > WEIGHT_RESET_JUMP) {
+        initialize(weight, sampleTime);
+        return;
+    }
+    const float S = P[0][0] + WEIGHT_MEASUREMENT_VARIANCE;
+    const float K[3] = {P[0][0] / S, P[1][0] / S, P[2][0] / S};
+    const float P0[3] = {P[0][0], P[0][1], P[0][2]};
+    for (int i = 0; i < 3; i++) {
+        x[i] += K[i] * innovation;
+        for (int j = 0; j < 3; j++) {
+            P[i][j] -= K[i] * P0[j];
+        }
+    }
+}
+
+bool WeightEstimator::hasEstimate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return initialized && Clock::get().millis() - lastArrival <= WEIGHT_STALE_MS;
+}
+
+float WeightEstimator::getWeight() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!initialized) {
+        return 0.0f;
+    }
+    const float dt = elapsed(Clock::get().millis());
+    return x[0] + x[1] * dt + 0.5f * x[2] * dt * dt;
+}
+
+float WeightEstimator::getFlow() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!initialized) {
+        return 0.0f;
+    }
+    return x[1] + x[2] * elapsed(Clock::get().millis());
+}
+
+float WeightEstimator::predictWeight(double horizonMs) const {
+    const float flow = std::max(getFlow(), 0.0f);
+    return getWeight() + flow * static_cast<float>(horizonMs / 1000.0);
+}
+
+float WeightEstimator::getLatency() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latency;
+}
+
+void WeightEstimator::setLatency(float latencyMs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    latency = std::clamp(latencyMs, 0.0f, WEIGHT_MAX_LATENCY_MS);
+}
+
+void WeightEstimator::startShot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    shotWeights.clear();
+    shotFlows.clear();
+    shotWeights.reserve(WEIGHT_LATENCY_MAX_SAMPLES);
+    shotFlows.reserve(WEIGHT_LATENCY_MAX_SAMPLES);
+    recording = true;
+}
+
+void WeightEstimator::endShot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    recording = false;
+}
+
+void WeightEstimator::addReferenceFlow(float flow) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording && shotFlows.size() < WEIGHT_LATENCY_MAX_SAMPLES) {
+        shotFlows.push_back({Clock::get().millis(), flow});
+    }
+}
+
+bool WeightEstimator::estimateLatency(float &latencyMs) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shotWeights.size() < WEIGHT_LATENCY_MIN_SAMPLES || shotFlows.size() < 2) {
+        return false;
+    }
+    // Volume that left the puck, the cup weight follows it up to retention and dripping
+    std::vector<float> volume(shotFlows.size(), 0.0f);
+    for (size_t k = 1; k < shotFlows.size(); k++) {
+        const float dt = static_cast<float>(shotFlows[k].time - shotFlows[k - 1].time) / 1000.0f;
+        volume[k] = volume[k - 1] + 0.5f * (shotFlows[k].value + shotFlows[k - 1].value) * dt;
+    }
+
+    // A constant flow fits every lag equally well, so the best lag must also clearly beat the worst one
+    const unsigned long start = shotFlows.front().time;
+    float bestFit = 0.0f;
+    double bestResidual = 0.0;
+    double worstResidual = 0.0;
+    long bestLag = -1;
+    for (long lag = 0; lag <= static_cast<long>(WEIGHT_MAX_LATENCY_MS); lag += WEIGHT_LATENCY_STEP_MS) {
+        size_t n = 0;
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+        for (const auto &sample : shotWeights) {
+            const long time = static_cast<long>(sample.time - start) - lag;
+            if (sample.value < WEIGHT_LATENCY_MIN_WEIGHT || time < 0) {
+                continue;
+            }
+            const double reference = referenceVolumeAt(volume, time);
+            n++;
+            sx += reference;
+            sy += sample.value;
+            sxx += reference * reference;
+            sxy += reference * sample.value;
+            syy += static_cast<double>(sample.value) * sample.value;
+        }
+        if (n < WEIGHT_LATENCY_MIN_SAMPLES) {
+            continue;
+        }
+        const double covariance = sxy - sx * sy / n;
+        const double varianceX = sxx - sx * sx / n;
+        const double varianceY = syy - sy * sy / n;
+        if (covariance <= 0.0 || varianceX <= 0.0 || varianceY <= 0.0) {
+            continue;
+        }
+        const double fit = covariance * covariance / (varianceX * varianceY);
+        const double residual = varianceY * (1.0 - fit) / n;
+        worstResidual = std::max(worstResidual, residual);
+        if (fit > bestFit) {
+            bestFit = static_cast<float>(fit);
+            bestResidual = residual;
+            bestLag = lag;
+        }
+    }
+    if (bestLag < 0 || bestFit < WEIGHT_LATENCY_MIN_FIT || bestResidual > WEIGHT_LATENCY_MIN_CONTRAST * worstResidual) {
+        return false;
+    }
+    latencyMs = static_cast<float>(bestLag);
+    return true;
+}
+
+void WeightEstimator::initialize(float weight, unsigned long time) {
+    initialized = true;
+    stateTime = time;
+    x[0] = weight;
+    x[1] = 0.0f;
+    x[2] = 0.0f;
+    for (auto &row : P) {
+        std::fill(std::begin(row), std::end(row), 0.0f);
+    }
+    P[0][0] = WEIGHT_MEASUREMENT_VARIANCE;
+    P[1][1] = WEIGHT_INITIAL_FLOW_VARIANCE;
+    P[2][2] = WEIGHT_INITIAL_ACCELERATION_VARIANCE;
+}
+
+void WeightEstimator::predict(float dt) {
+    const float dt2 = dt * dt;
+    const float F[3][3] = {{1.0f, dt, 0.5f * dt2}, {0.0f, 1.0f, dt}, {0.0f, 0.0f, 1.0f}};
+    // White jerk noise integrated over the interval
+    const float q = WEIGHT_JERK_DENSITY;
+    const float Q[3][3] = {{q * dt2 * dt2 * dt / 20.0f, q * dt2 * dt2 / 8.0f, q * dt2 * dt / 6.0f},
+                           {q * dt2 * dt2 / 8.0f, q * dt2 * dt / 3.0f, q * dt2 / 2.0f},
+                           {q * dt2 * dt / 6.0f, q * dt2 / 2.0f, q * dt}};
+
+    float predicted[3] = {};
+    float FP[3][3] = {};
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 3; k++) {
+            predicted[i] += F[i][k] * x[k];
+            for (int j = 0; j < 3; j++) {
+                FP[i][j] += F[i][k] * P[k][j];
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        x[i] = predicted[i];
+        for (int j = 0; j < 3; j++) {
+            float value = Q[i][j];
+            for (int k = 0; k < 3; k++) {
+                value += FP[i][k] * F[j][k];
+            }
+            P[i][j] = value;
+        }
+    }
+}
+
+float WeightEstimator::elapsed(unsigned long now) const {
+    const float dt = static_cast<float>(static_cast<long>(now - stateTime)) / 1000.0f;
+    return std::clamp(dt, 0.0f, WEIGHT_MAX_EXTRAPOLATION_S);
+}
+
+float WeightEstimator::referenceVolumeAt(const std::vector<float> &volume, long time) const {
+    const unsigned long start = shotFlows.front().time;
+    const auto it = std::upper_bound(shotFlows.begin(), shotFlows.end(), time, [start](long t, const TimedValue &sample) {
+        return t < static_cast<long>(sample.time - start);
+    });
+    if (it == shotFlows.end()) {
+        return volume.back();
+    }
+    const size_t k = it - shotFlows.begin();
+    if (k == 0) {
+        return volume.front();
+    }
+    const long before = static_cast<long>(shotFlows[k - 1].time - start);
+    const long after = static_cast<long>(shotFlows[k].time - start);
+    const float alpha = static_cast<float>(time - before) / static_cast<float>(after - before);
+    return volume[k - 1] + (volume[k] - volume[k - 1]) * alpha;
+}
@@ -0,0 +1,74 @@
+#ifndef WEIGHTESTIMATOR_H
+#define WEIGHTESTIMATOR_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+constexpr float WEIGHT_MEASUREMENT_VARIANCE = 0.01f; // g^2, scale noise and 0.1 g resolution
+constexpr float WEIGHT_JERK_DENSITY = 2.0f;          // g^2/s^5, how quickly the flow may bend
+constexpr float WEIGHT_INITIAL_FLOW_VARIANCE = 4.0f; // (g/s)^2
+constexpr float WEIGHT_INITIAL_ACCELERATION_VARIANCE = 4.0f;
+constexpr float WEIGHT_RESET_JUMP = 5.0f;          // g, a larger step is a tare or a cup being lifted
+constexpr unsigned long WEIGHT_STALE_MS = 2000;    // notifications older than this restart the estimate
+constexpr float WEIGHT_MAX_EXTRAPOLATION_S = 1.0f; // beyond this only the flow is extrapolated
+
+constexpr float WEIGHT_DEFAULT_LATENCY_MS = 200.0f;
+constexpr float WEIGHT_MAX_LATENCY_MS = 1000.0f;
+constexpr unsigned long WEIGHT_LATENCY_STEP_MS = 50;
+constexpr size_t WEIGHT_LATENCY_MAX_SAMPLES = 600; // one minute of 10 Hz readings
+constexpr size_t WEIGHT_LATENCY_MIN_SAMPLES = 50;
+constexpr float WEIGHT_LATENCY_MIN_WEIGHT = 1.0f;  // g, ignore the preinfusion before the first drops
+constexpr float WEIGHT_LATENCY_MIN_FIT = 0.9f;     // R^2 of the weight against the lagged machine flow
+constexpr float WEIGHT_LATENCY_MIN_CONTRAST = 0.8f; // the best lag must leave at most 80% of the worst residual
+
+// Constant acceleration Kalman filter over the bluetooth scale readings, state is weight, flow and its rate of change.
+// Readings are placed at their arrival time minus the scale latency, so weight and flow are reported for the present
+// instead of the moment the scale sampled them. The latency is learnt per scale by aligning the weight of a shot
+// with the puck flow reported by the machine. Readings arrive on the bluetooth task, all methods are thread safe.
+class WeightEstimator {
+  public:
+    void reset();
+    void addMeasurement(float weight);
+
+    bool hasEstimate() const;
+    float getWeight() const;
+    float getFlow() const; // g/s
+    // Weight expected horizonMs from now, the flow is extrapolated without its rate of change
+    float predictWeight(double horizonMs) const;
+
+    float getLatency() const;
+    void setLatency(float latencyMs);
+
+    // Collects the readings and the machine flow of a shot to estimate the latency afterwards
+    void startShot();
+    void endShot();
+    void addReferenceFlow(float flow);
+    bool estimateLatency(float &latencyMs) const;
+
+  private:
+    struct TimedValue {
+        unsigned long time;
+        float value;
+    };
+
+    void initialize(float weight, unsigned long time);
+    void predict(float dt);
+    // Elapsed seconds between the filter state and now, bounded for the extrapolation
+    float elapsed(unsigned long now) const;
+    float referenceVolumeAt(const std::vector<float> &volume, long time) const;
+
+    mutable std::mutex mutex;
+    bool initialized = false;
+    float x[3] = {0.0f, 0.0f, 0.0f};
+    float P[3][3] = {};
+    unsigned long stateTime = 0; // when the scale sampled the last reading
+    unsigned long lastArrival = 0;
+    float latency = WEIGHT_DEFAULT_LATENCY_MS;
+
+    bool recording = false;
+    std::vector<TimedValue> shotWeights;
+    std::vector<TimedValue> shotFlows;
+};
+
+#endif // WEIGHTESTIMATOR_H
@@ -2,19 +2,29 @@
 #define PREDICTIVE_H
 
 #include <Arduino.h>
+#include <Clock/Clock.h>
+#include <vector>
 
 class VolumetricRateCalculator {
   public:
     explicit VolumetricRateCalculator(double window_duration) : windowDuration(window_duration) {}
 
     void addMeasurement(double volume) {
+        const double now = Clock::get().millis();
         measurements.emplace_back(volume);
-        measurementTimes.emplace_back(millis());
+        measurementTimes.emplace_back(now);
+        // Keep one window, older samples never take part in the fit
+        size_t expired = 0;
+        while (expired < measurementTimes.size() && measurementTimes[expired] < now - windowDuration) {
+            expired++;
+        }
+        measurements.erase(measurements.begin(), measurements.begin() + expired);
+        measurementTimes.erase(measurementTimes.begin(), measurementTimes.begin() + expired);
     }
 
     double getRate(double time = 0) const {
         if (time == 0) {
-            time = millis();
+            time = Clock::get().millis();
         }
         // perform a linear fit through the last PREDICTIVE_TIME (ms) of data time & measurement data and return the slope
         if (measurements.size() < 2)
@@ -22,7 +32,7 @@ class VolumetricRateCalculator {
 
         size_t i = measurementTimes.size();
         double cutoff = time - windowDuration;
-        while (measurementTimes[i - 1] > cutoff) { // check from the most recent time
+        while (i > 0 && measurementTimes[i - 1] > cutoff) { // check from the most recent time
             i--;
         }
         // i is the index of the first entry after the cutoff
@@ -42,9 +52,11 @@ class VolumetricRateCalculator {
         double tdev2 = 0.0;
         double tdev_vdev = 0.0;
         for (size_t j = i; j < measurements.size(); j++) {
-            tdev_vdev += (measurementTimes[i] - t_mean) * (measurements[i] - v_mean);
-            tdev2 += pow(measurementTimes[i] - t_mean, 2.0);
+            tdev_vdev += (measurementTimes[j] - t_mean) * (measurements[j] - v_mean);
+            tdev2 += pow(measurementTimes[j] - t_mean, 2.0);
         }
+        if (tdev2 <= 0.0)
+            return 0.0;
         double volumePerMilliSecond = tdev_vdev / tdev2;              // the slope (volume per millisecond) of the linear best fit
         return volumePerMilliSecond > 0 ? volumePerMilliSecond : 0.0; // return 0 if it is not positive, convert to seconds
     }
@@ -52,8 +64,11 @@ class VolumetricRateCalculator {
     double getOvershootAdjustMillis(double expectedVolume, double actualVolume) {
         if (measurementTimes.size() < 2)
             return 0.0;
+        const double rate = getRate(measurementTimes.back());
+        if (rate <= 0.0)
+            return 0.0;
         double overshoot = actualVolume - expectedVolume;
-        return overshoot / getRate(measurementTimes.back());
+        return overshoot / rate;
     }
 
   private:
@@ -1,7 +1,10 @@
 #ifndef BREWPROCESS_H
 #define BREWPROCESS_H
 
+#include "BrewProgram.h"
+#include <Clock/Clock.h>
 #include <algorithm>
+#include <display/core/WeightEstimator.h>
 #include <display/core/constants.h>
 #include <display/core/predictive.h>
 #include <display/core/process/Process.h>
@@ -28,8 +31,8 @@ class BrewProcess : public Process {
     explicit BrewProcess(Profile profile, ProcessTarget target, double brewDelay = 0.0)
         : profile(profile), target(target), brewDelay(brewDelay) {
         currentPhase = profile.phases.at(phaseIndex);
-        processStarted = millis();
-        currentPhaseStarted = millis();
+        processStarted = Clock::get().millis();
+        currentPhaseStarted = Clock::get().millis();
         phaseStartPressure = currentPhase.transition.adaptive ? currentPressure : 0;
         phaseStartFlow = currentPhase.transition.adaptive ? currentFlow : 0;
         computeEffectiveTargetsForCurrentPhase();
@@ -50,19 +53,88 @@ class BrewProcess : public Process {
 
     unsigned long getPhaseDuration() const { return static_cast<long>(currentPhase.duration) * 1000L; }
 
-    bool isCurrentPhaseFinished() {
-        if (millis() - currentPhaseStarted > BREW_SAFETY_DURATION_MS) {
-            return true;
-        }
+    double getPredictedVolume() {
         double volume = currentVolume;
-        if (volume > 0.0) {
+        if (volume > 0.0 && weightEstimator != nullptr && weightEstimator->hasEstimate()) {
+            volume = weightEstimator->predictWeight(brewDelay);
+        } else if (volume > 0.0) {
             double currentRate = volumetricRateCalculator.getRate();
             const double predictedAddedVolume = currentRate * brewDelay;
             volume = currentVolume + predictedAddedVolume;
         }
-        float timeInPhase = static_cast<float>(millis() - currentPhaseStarted) / 1000.0f;
-        return currentPhase.isFinished(target == ProcessTarget::VOLUMETRIC, volume, timeInPhase, currentFlow, currentPressure,
-                                       waterPumped, profile.type);
+        return volume;
+    }
+
+    bool isCurrentPhaseFinished() {
+        if (Clock::get().millis() - currentPhaseStarted > BREW_SAFETY_DURATION_MS) {
+            return true;
+        }
+        float timeInPhase = static_cast<float>(Clock::get().millis() - currentPhaseStarted) / 1000.0f;
+        return currentPhase.isFinished(target == ProcessTarget::VOLUMETRIC, getPredictedVolume(), timeInPhase, currentFlow,
+                                       currentPressure, waterPumped, profile.type);
+    }
+
+    // In remote execution the controller evaluates all other exits, so only the scale is checked here
+    bool isVolumetricTargetReached() {
+        if (target != ProcessTarget::VOLUMETRIC || !currentPhase.hasVolumetricTarget()) {
+            return false;
+        }
+        return currentPhase.getVolumetricTarget().isReached(getPredictedVolume());
+    }
+
+    // Compiles the profile into a program the controller can run against its own pressure loop
+    std::vector<BrewProgramPhase> compileProgram() const {
+        std::vector<BrewProgramPhase> program;
+        for (const auto &phase : profile.phases) {
+            BrewProgramPhase compiled;
+            compiled.valve = phase.valve == 1;
+            compiled.duration = phase.duration;
+            compiled.pumpMode = phase.pumpIsSimple ? BrewProgramPumpMode::POWER
+                                : phase.pumpAdvanced.target == PumpTarget::PUMP_TARGET_PRESSURE ? BrewProgramPumpMode::PRESSURE
+                                                                                                 : BrewProgramPumpMode::FLOW;
+            compiled.power = static_cast<float>(phase.pumpSimple);
+            compiled.pressure = phase.pumpAdvanced.pressure;
+            compiled.flow = phase.pumpAdvanced.flow;
+            compiled.transition = static_cast<BrewProgramTransition>(phase.transition.type);
+            compiled.transitionDuration = phase.transition.duration;
+            compiled.adaptive = phase.transition.adaptive;
+            for (const auto &phaseTarget : phase.targets) {
+                if (phaseTarget.type == TargetType::TARGET_TYPE_VOLUMETRIC) {
+                    // Standard profiles ignore the phase duration while a volumetric target is active
+                    if (profile.type == "standard" && target == ProcessTarget::VOLUMETRIC) {
+                        compiled.timeExit = false;
+                    }
+                    continue;
+                }
+                if (compiled.targetCount >= BREW_PROGRAM_MAX_TARGETS) {
+                    continue;
+                }
+                BrewProgramTarget &programTarget = compiled.targets[compiled.targetCount++];
+                programTarget.type = phaseTarget.type == TargetType::TARGET_TYPE_PRESSURE ? BrewProgramTargetType::PRESSURE
+                                     : phaseTarget.type == TargetType::TARGET_TYPE_FLOW   ? BrewProgramTargetType::FLOW
+                                                                                          : BrewProgramTargetType::PUMPED;
+                programTarget.gte = phaseTarget.operator_ == TargetOperator::GTE;
+                programTarget.value = phaseTarget.value;
+            }
+            program.push_back(compiled);
+        }
+        return program;
+    }
+
+    void setRemoteExecution(bool remote) { remoteExecution = remote; }
+
+    bool isRemoteExecution() const { return remoteExecution; }
+
+    // Follows the phase reported by the controller while it executes the program
+    void onRemotePhase(unsigned int index, bool programFinished) {
+        while (phaseIndex < index && processPhase == ProcessPhase::RUNNING) {
+            advancePhase();
+        }
+        if (programFinished && processPhase == ProcessPhase::RUNNING) {
+            previousPhaseFinished = Clock::get().millis();
+            processPhase = ProcessPhase::FINISHED;
+            finished = Clock::get().millis();
+        }
     }
 
     double getBrewVolume() const {
@@ -130,21 +202,14 @@ class BrewProcess : public Process {
     void progress() override {
         // Progress should be called around every 100ms, as defined in PROGRESS_INTERVAL, while the Process is active
         waterPumped += currentFlow / 10.0f; // Add current flow divided to 100ms to water pumped counter
-        while (isCurrentPhaseFinished() && processPhase == ProcessPhase::RUNNING) {
-            previousPhaseFinished = millis();
-            if (phaseIndex + 1 < profile.phases.size()) {
-                waterPumped = 0.0f;
-                phaseIndex++;
-                Phase nextPhase = profile.phases.at(phaseIndex);
-                phaseStartPressure = nextPhase.transition.adaptive ? currentPressure : getPumpPressure();
-                phaseStartFlow = nextPhase.transition.adaptive ? currentFlow : getPumpFlow();
-                currentPhase = nextPhase;
-                currentPhaseStarted = millis();
-                computeEffectiveTargetsForCurrentPhase();
-            } else {
-                processPhase = ProcessPhase::FINISHED;
-                finished = millis();
+        if (remoteExecution) {
+            if (processPhase == ProcessPhase::RUNNING && isVolumetricTargetReached()) {
+                advancePhase();
             }
+            return;
+        }
+        while (isCurrentPhaseFinished() && processPhase == ProcessPhase::RUNNING) {
+            advancePhase();
         }
     }
 
@@ -154,12 +219,13 @@ class BrewProcess : public Process {
         if (target == ProcessTarget::TIME) {
             return !isActive();
         }
-        return processPhase == ProcessPhase::FINISHED && millis() - finished > PREDICTIVE_TIME;
+        return processPhase == ProcessPhase::FINISHED && Clock::get().millis() - finished > PREDICTIVE_TIME;
     }
 
     int getType() override { return MODE_BREW; }
 
   private:
+    bool remoteExecution = false;
     float phaseStartPressure = 0.0f;
     float phaseStartFlow = 0.0f;
 
@@ -191,6 +257,23 @@ class BrewProcess : public Process {
         }
     }
 
+    void advancePhase() {
+        previousPhaseFinished = Clock::get().millis();
+        if (phaseIndex + 1 < profile.phases.size()) {
+            waterPumped = 0.0f;
+            phaseIndex++;
+            Phase nextPhase = profile.phases.at(phaseIndex);
+            phaseStartPressure = nextPhase.transition.adaptive ? currentPressure : getPumpPressure();
+            phaseStartFlow = nextPhase.transition.adaptive ? currentFlow : getPumpFlow();
+            currentPhase = nextPhase;
+            currentPhaseStarted = Clock::get().millis();
+            computeEffectiveTargetsForCurrentPhase();
+        } else {
+            processPhase = ProcessPhase::FINISHED;
+            finished = Clock::get().millis();
+        }
+    }
+
     void computeEffectiveTargetsForCurrentPhase() {
         if (currentPhase.pumpIsSimple) {
             effectivePressure = 0.0f;
@@ -217,7 +300,7 @@ class BrewProcess : public Process {
         if (currentPhase.transition.type == TransitionType::INSTANT || dur_s <= 0.0f) {
             return 1.0f;
         }
-        const unsigned long elapsedMs = millis() - currentPhaseStarted;
+        const unsigned long elapsedMs = Clock::get().millis() - currentPhaseStarted;
         float t = float(elapsedMs) / (dur_s * 1000.0f);
         return applyEasing(t, currentPhase.transition.type);
     }
@@ -1,7 +1,9 @@
 #ifndef GRINDPROCESS_H
 #define GRINDPROCESS_H
 
+#include <Clock/Clock.h>
 #include <algorithm>
+#include <display/core/WeightEstimator.h>
 #include <display/core/constants.h>
 #include <display/core/predictive.h>
 #include <display/core/process/Process.h>
@@ -20,7 +22,7 @@ class GrindProcess : public Process {
 
     explicit GrindProcess(ProcessTarget target = ProcessTarget::TIME, int time = 0, double volume = 0, double grindDelay = 0.0)
         : target(target), time(time), grindVolume(volume), grindDelay(grindDelay) {
-        started = millis();
+        started = Clock::get().millis();
     }
 
     void updateVolume(double volume) override {
@@ -39,14 +41,16 @@ class GrindProcess : public Process {
     void progress() override {
         // Progress should be called around every 100ms, as defined in PROGRESS_INTERVAL, while GrindProcess is active
         if (target == ProcessTarget::TIME) {
-            active = millis() - started < time;
+            active = Clock::get().millis() - started < time;
         } else {
-            double currentRate = volumetricRateCalculator.getRate();
-            ESP_LOGI("GrindProcess", "Current rate: %f, Current volume: %f, Expected Offset: %f", currentRate, currentVolume,
-                     currentRate * grindDelay);
-            if (currentVolume + currentRate * grindDelay > grindVolume && active) {
+            double predictedVolume = currentVolume + volumetricRateCalculator.getRate() * grindDelay;
+            if (weightEstimator != nullptr && weightEstimator->hasEstimate()) {
+                predictedVolume = weightEstimator->predictWeight(grindDelay);
+            }
+            ESP_LOGI("GrindProcess", "Current volume: %f, Predicted volume: %f", currentVolume, predictedVolume);
+            if (predictedVolume > grindVolume && active) {
                 active = false;
-                finished = millis();
+                finished = Clock::get().millis();
             }
         }
     }
@@ -61,7 +65,7 @@ class GrindProcess : public Process {
 
     bool isActive() override {
         if (target == ProcessTarget::TIME) {
-            return millis() - started < time;
+            return Clock::get().millis() - started < time;
         }
         return active;
     }
@@ -69,7 +73,7 @@ class GrindProcess : public Process {
     bool isComplete() override {
         if (target == ProcessTarget::TIME)
             return !isActive();
-        return millis() - finished > PREDICTIVE_TIME;
+        return Clock::get().millis() - finished > PREDICTIVE_TIME;
     }
 
     int getType() override { return MODE_GRIND; }
@@ -4,6 +4,8 @@
 constexpr double PREDICTIVE_TIME = 4000.0; // time window for the prediction
 // constexpr double PREDICTIVE_TIME_MS = 1000.0;
 
+class WeightEstimator;
+
 class Process {
   public:
     Process() = default;
@@ -24,6 +26,12 @@ class Process {
     virtual int getType() = 0;
 
     virtual void updateVolume(double volume) = 0;
+
+    // Set while a bluetooth scale provides the volume, the stop prediction then uses its flow estimate
+    void setWeightEstimator(const WeightEstimator *estimator) { weightEstimator = estimator; }
+
+  protected:
+    const WeightEstimator *weightEstimator = nullptr;
 };
 
 enum class ProcessTarget { VOLUMETRIC, TIME };
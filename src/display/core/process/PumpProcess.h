@@ -1,6 +1,7 @@
 #ifndef PUMPPROCESS_H
 #define PUMPPROCESS_H
 
+#include <Clock/Clock.h>
 #include <display/core/constants.h>
 #include <display/core/process/Process.h>
 
@@ -9,7 +10,7 @@ class PumpProcess : public Process {
     int duration;
     unsigned long started;
 
-    explicit PumpProcess(int duration = HOT_WATER_SAFETY_DURATION_MS) : duration(duration) { started = millis(); }
+    explicit PumpProcess(int duration = HOT_WATER_SAFETY_DURATION_MS) : duration(duration) { started = Clock::get().millis(); }
 
     bool isRelayActive() override { return false; };
 
@@ -22,7 +23,7 @@ class PumpProcess : public Process {
     };
 
     bool isActive() override {
-        unsigned long now = millis();
+        unsigned long now = Clock::get().millis();
         return now - started < duration;
     };
 
@@ -1,6 +1,7 @@
 #ifndef STEAMPROCESS_H
 #define STEAMPROCESS_H
 
+#include <Clock/Clock.h>
 #include <display/core/constants.h>
 #include <display/core/process/Process.h>
 
@@ -12,7 +13,7 @@ class SteamProcess : public Process {
 
     explicit SteamProcess(int duration = STEAM_SAFETY_DURATION_MS, float pumpValue = 4.f)
         : pumpValue(pumpValue), duration(duration) {
-        started = millis();
+        started = Clock::get().millis();
     }
 
     bool isRelayActive() override { return false; };
@@ -26,7 +27,7 @@ class SteamProcess : public Process {
     };
 
     bool isActive() override {
-        unsigned long now = millis();
+        unsigned long now = Clock::get().millis();
         return now - started < duration;
     };
 
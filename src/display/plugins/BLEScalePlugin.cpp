@@ -1,6 +1,7 @@
 #include "BLEScalePlugin.h"
 #include "remote_scales.h"
 #include "remote_scales_plugin_registry.h"
+#include <algorithm>
 #include <display/core/Controller.h>
 #include <scales/acaia.h>
 #include <scales/bookoo.h>
@@ -35,6 +36,7 @@ void BLEScalePlugin::setup(Controller *controller, PluginManager *manager) {
     WeighMyBrewScalePlugin::apply();
     myscalePlugin::apply();
     this->scanner = new RemoteScalesScanner();
+    preferences.begin("scales", false);
     manager->on("controller:ready", [this](Event const &) {
         if (this->controller->getMode() != MODE_STANDBY) {
             ESP_LOGI("BLEScalePlugin", "Resuming scanning");
@@ -44,6 +46,8 @@ void BLEScalePlugin::setup(Controller *controller, PluginManager *manager) {
     });
     manager->on("controller:brew:prestart", [this](Event const &) { onProcessStart(); });
     manager->on("controller:grind:start", [this](Event const &) { onProcessStart(); });
+    manager->on("controller:tare", [this](Event const &) { onProcessStart(); });
+    manager->on("controller:brew:end", [this](Event const &) { onBrewEnd(); });
     manager->on("controller:mode:change", [this](Event const &event) {
         if (event.getInt("value") != MODE_STANDBY) {
             ESP_LOGI("BLEScalePlugin", "Resuming scanning");
@@ -141,6 +145,8 @@ void BLEScalePlugin::establishConnection() {
             if (!scale->connect()) {
                 disconnect();
                 this->scanner->initializeAsyncScan();
+            } else {
+                loadLatency();
             }
             break;
         }
@@ -149,8 +155,38 @@ void BLEScalePlugin::establishConnection() {
 
 void BLEScalePlugin::onMeasurement(float value) const {
     if (controller != nullptr) {
+        controller->getWeightEstimator().addMeasurement(value);
         controller->onVolumetricMeasurement(value, VolumetricMeasurementSource::BLUETOOTH);
     }
 }
 
+void BLEScalePlugin::onBrewEnd() {
+    if (!isConnected()) {
+        return;
+    }
+    WeightEstimator &estimator = controller->getWeightEstimator();
+    float latency;
+    if (!estimator.estimateLatency(latency)) {
+        return;
+    }
+    latency = estimator.getLatency() + (latency - estimator.getLatency()) * LATENCY_LEARNING_RATE;
+    ESP_LOGI("BLEScalePlugin", "Learnt latency of %s: %.0f ms", getName().c_str(), latency);
+    estimator.setLatency(latency);
+    preferences.putFloat(latencyKey().c_str(), latency);
+}
+
+void BLEScalePlugin::loadLatency() {
+    const float latency = preferences.getFloat(latencyKey().c_str(), WEIGHT_DEFAULT_LATENCY_MS);
+    ESP_LOGI("BLEScalePlugin", "Using latency of %.0f ms for %s", latency, getName().c_str());
+    controller->getWeightEstimator().setLatency(latency);
+    controller->getWeightEstimator().reset();
+}
+
+std::string BLEScalePlugin::latencyKey() const {
+    // Preference keys are limited to 15 characters, the address without separators fits
+    std::string key = scale->getDeviceAddress();
+    key.erase(std::remove(key.begin(), key.end(), ':'), key.end());
+    return key;
+}
+
 std::vector<DiscoveredDevice> BLEScalePlugin::getDiscoveredScales() const { return scanner->getDiscoveredScales(); }
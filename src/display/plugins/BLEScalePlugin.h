@@ -1,6 +1,7 @@
 #ifndef BLESCALEPLUGIN_H
 #define BLESCALEPLUGIN_H
 #include "../core/Plugin.h"
+#include <Preferences.h>
 #include "remote_scales.h"
 #include "remote_scales_plugin_registry.h"
 
@@ -8,6 +9,7 @@ void on_ble_measurement(float value);
 
 constexpr unsigned long UPDATE_INTERVAL_MS = 1000;
 constexpr unsigned int RECONNECTION_TRIES = 15;
+constexpr float LATENCY_LEARNING_RATE = 0.3f; // weight of a new shot in the stored scale latency
 
 class BLEScalePlugin : public Plugin {
   public:
@@ -30,6 +32,9 @@ class BLEScalePlugin : public Plugin {
   private:
     void update();
     void onProcessStart() const;
+    void onBrewEnd();
+    void loadLatency();
+    std::string latencyKey() const;
 
     void establishConnection();
 
@@ -41,6 +46,7 @@ class BLEScalePlugin : public Plugin {
     unsigned int reconnectionTries = 0;
 
     Controller *controller = nullptr;
+    Preferences preferences;
     RemoteScalesPluginRegistry *pluginRegistry = nullptr;
     RemoteScalesScanner *scanner = nullptr;
     std::unique_ptr<RemoteScales> scale = nullptr;
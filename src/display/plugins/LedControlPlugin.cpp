@@ -18,7 +18,7 @@ void LedControlPlugin::loop() {
 }
 
 void LedControlPlugin::updateControl() {
-    Settings settings = this->controller->getSettings();
+    const std::shared_ptr<const SettingsSnapshot> settings = this->controller->getSettings().snapshot();
     int mode = this->controller->getMode();
     if (mode == MODE_STANDBY) {
         sendControl(0, 0, 0, 0, 0);
@@ -36,8 +36,8 @@ void LedControlPlugin::updateControl() {
         sendControl(255, 0, 0, 20, 255);
         return;
     }
-    sendControl(settings.getSunriseR(), settings.getSunriseG(), settings.getSunriseB(), settings.getSunriseW(),
-                settings.getSunriseExtBrightness());
+    sendControl(settings->getSunriseR(), settings->getSunriseG(), settings->getSunriseB(), settings->getSunriseW(),
+                settings->getSunriseExtBrightness());
 }
 
 void LedControlPlugin::sendControl(uint8_t r, uint8_t g, uint8_t b, uint8_t w, uint8_t ext) {
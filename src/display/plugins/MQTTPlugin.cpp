@@ -1,39 +1,51 @@
 #include "MQTTPlugin.h"
 #include "../core/Controller.h"
 #include <ArduinoJson.h>
+#include <cstdlib>
 #include <ctime>
+#include <display/core/ProfileManager.h>
+#include <display/core/process/BrewProcess.h>
 
-bool MQTTPlugin::connect(Controller *controller) {
-    const Settings settings = controller->getSettings();
-    const String ip = settings.getHomeAssistantIP();
-    const int haPort = settings.getHomeAssistantPort();
-    const String clientId = "GaggiMate";
-    const String haUser = settings.getHomeAssistantUser();
-    const String haPassword = settings.getHomeAssistantPassword();
+namespace {
+const char *const MODE_NAMES[] = {"Standby", "Brew", "Steam", "Water", "Grind"};
+constexpr int MODE_NAME_COUNT = sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]);
+const char *const COMMAND_NAMES[] = {"mode", "temperature", "profile", "brew", "flush", "tare"};
 
-    client.begin(ip.c_str(), haPort, net);
-    client.setKeepAlive(10);
-    printf("Connecting to MQTT");
-    for (int i = 0; i < MQTT_CONNECTION_RETRIES; i++) {
-        if (client.connect(clientId.c_str(), haUser.c_str(), haPassword.c_str())) {
-            printf("\n");
+bool isCommand(const String &name) {
+    for (const char *commandName : COMMAND_NAMES) {
+        if (name == commandName) {
             return true;
         }
-        printf(".");
-        delay(MQTT_CONNECTION_DELAY);
     }
-    printf("\nConnection to MQTT failed.\n");
     return false;
 }
 
-void MQTTPlugin::publishDiscovery(Controller *controller) {
-    if (!client.connected())
-        return;
-    const Settings settings = controller->getSettings();
-    const String haTopic = settings.getHomeAssistantTopic();
-    String mac = WiFi.macAddress();
-    mac.replace(":", "_");
-    const char *cmac = mac.c_str();
+bool parseNumber(const String &value, float &out) {
+    char *end = nullptr;
+    out = std::strtof(value.c_str(), &end);
+    return !value.isEmpty() && *end == '\0';
+}
+
+void addSensor(JsonDocument &components, const char *key, const char *name, const char *deviceClass, const char *unit,
+               const char *valueTemplate, const String &stateTopic) {
+    JsonObject sensor = components[key].to<JsonObject>();
+    sensor["name"] = name;
+    sensor["p"] = "sensor";
+    if (deviceClass != nullptr) {
+        sensor["device_class"] = deviceClass;
+    }
+    if (unit != nullptr) {
+        sensor["unit_of_measurement"] = unit;
+    }
+    sensor["value_template"] = valueTemplate;
+    sensor["unique_id"] = key;
+    sensor["state_topic"] = stateTopic;
+}
+} // namespace
+
+void MQTTPlugin::publishDiscovery() {
+    const String haTopic = controller->getSettings().getHomeAssistantTopic();
+    const char *cmac = deviceId.c_str();
 
     JsonDocument device;
     JsonDocument origin;
@@ -65,7 +77,7 @@ void MQTTPlugin::publishDiscovery(Controller *controller) {
     boilerTemperature["unit_of_measurement"] = "°C";
     boilerTemperature["value_template"] = "{{ value_json.temperature | round(2) }}";
     boilerTemperature["unique_id"] = "boiler0Tmp";
-    boilerTemperature["state_topic"] = "gaggimate/" + String(cmac) + "/boilers/0/temperature";
+    boilerTemperature["state_topic"] = topicPrefix + "boilers/0/temperature";
 
     boilerTargetTemperature["name"] = "Boiler Target Temperature";
     boilerTargetTemperature["p"] = "sensor";
@@ -73,43 +85,306 @@ void MQTTPlugin::publishDiscovery(Controller *controller) {
     boilerTargetTemperature["unit_of_measurement"] = "°C";
     boilerTargetTemperature["value_template"] = "{{ value_json.temperature | round(2) }}";
     boilerTargetTemperature["unique_id"] = "boiler0TargetTmp";
-    boilerTargetTemperature["state_topic"] = "gaggimate/" + String(cmac) + "/boilers/0/targetTemperature";
+    boilerTargetTemperature["state_topic"] = topicPrefix + "boilers/0/targetTemperature";
 
     mode["name"] = "Mode";
     mode["p"] = "text";
     mode["device_class"] = "text";
     mode["value_template"] = "{{ value_json.mode_str }}";
     mode["unique_id"] = "mode";
-    mode["state_topic"] = "gaggimate/" + String(cmac) + "/controller/mode";
+    mode["state_topic"] = topicPrefix + "controller/mode";
 
     cmps["boiler"] = boilerTemperature;
     cmps["boiler_target"] = boilerTargetTemperature;
     cmps["mode"] = mode;
 
+    const String telemetryTopic = topicPrefix + "telemetry";
+    addSensor(cmps, "pressure", "Pressure", "pressure", "bar", "{{ value_json.pressure | round(1) }}", telemetryTopic);
+    addSensor(cmps, "flow", "Flow", nullptr, "ml/s", "{{ value_json.flow | round(1) }}", telemetryTopic);
+    addSensor(cmps, "weight", "Weight", "weight", "g", "{{ value_json.weight | round(1) }}", telemetryTopic);
+    addSensor(cmps, "phase", "Phase", nullptr, nullptr, "{{ value_json.phase }}", telemetryTopic);
+    const String summaryTopic = topicPrefix + "controller/brew/summary";
+    addSensor(cmps, "lastShotWeight", "Last Shot Weight", "weight", "g", "{{ value_json.weight | round(1) }}", summaryTopic);
+    addSensor(cmps, "lastShotDuration", "Last Shot Duration", "duration", "s", "{{ (value_json.duration / 1000) | round(1) }}",
+              summaryTopic);
+
+    // Controls, commands are acknowledged on gaggimate/<id>/ack/<name>
+    const String commandTopic = topicPrefix + "command/";
+    JsonObject modeSelect = cmps["mode_select"].to<JsonObject>();
+    modeSelect["name"] = "Set Mode";
+    modeSelect["p"] = "select";
+    modeSelect["unique_id"] = "modeSelect";
+    modeSelect["command_topic"] = commandTopic + "mode";
+    modeSelect["state_topic"] = topicPrefix + "controller/mode";
+    modeSelect["value_template"] = "{{ value_json.mode_str }}";
+    JsonArray options = modeSelect["options"].to<JsonArray>();
+    for (const char *modeName : MODE_NAMES) {
+        options.add(modeName);
+    }
+
+    JsonObject targetTemperature = cmps["target_temperature"].to<JsonObject>();
+    targetTemperature["name"] = "Target Temperature";
+    targetTemperature["p"] = "number";
+    targetTemperature["device_class"] = "temperature";
+    targetTemperature["unit_of_measurement"] = "°C";
+    targetTemperature["unique_id"] = "boiler0TargetTmpSet";
+    targetTemperature["command_topic"] = commandTopic + "temperature";
+    targetTemperature["state_topic"] = topicPrefix + "boilers/0/targetTemperature";
+    targetTemperature["value_template"] = "{{ value_json.temperature | round(0) }}";
+    targetTemperature["min"] = MIN_TEMP;
+    targetTemperature["max"] = MAX_TEMP;
+    targetTemperature["step"] = 1;
+    targetTemperature["mode"] = "box";
+
+    JsonObject profile = cmps["profile"].to<JsonObject>();
+    profile["name"] = "Profile";
+    profile["p"] = "text";
+    profile["unique_id"] = "profile";
+    profile["command_topic"] = commandTopic + "profile";
+    profile["state_topic"] = topicPrefix + "controller/profile";
+    profile["value_template"] = "{{ value_json.id }}";
+
+    const char *const buttons[][4] = {{"brew_start", "Start Brew", "brew", "start"},
+                                      {"brew_stop", "Stop Brew", "brew", "stop"},
+                                      {"flush", "Flush", "flush", "PRESS"},
+                                      {"tare", "Tare", "tare", "PRESS"}};
+    for (const auto &button : buttons) {
+        JsonObject entity = cmps[button[0]].to<JsonObject>();
+        entity["name"] = button[1];
+        entity["p"] = "button";
+        entity["unique_id"] = button[0];
+        entity["command_topic"] = commandTopic + button[2];
+        entity["payload_press"] = button[3];
+    }
+
     // Prepare the payload for Home Assistant discovery
     JsonDocument payload;
     payload["dev"] = device;
     payload["o"] = origin;
     payload["cmps"] = cmps;
-    payload["state_topic"] = "gaggimate/" + String(cmac) + "/state";
+    payload["state_topic"] = topicPrefix + "state";
     payload["qos"] = 2;
 
-    char publishTopic[80];
-    snprintf(publishTopic, sizeof(publishTopic), "%s/device/%s/config", haTopic.c_str(), cmac);
+    enqueue({haTopic + "/device/" + deviceId + "/config", payload.as<String>(), false});
+}
+
+void MQTTPlugin::publishTelemetry() {
+    JsonDocument doc;
+    doc["pressure"] = controller->getCurrentPressure();
+    doc["flow"] = controller->getCurrentPumpFlow();
+    doc["puck_flow"] = controller->getCurrentPuckFlow();
+    Process *process = controller->getProcess();
+    if (process != nullptr && process->getType() == MODE_BREW) {
+        auto *brew = static_cast<BrewProcess *>(process);
+        doc["weight"] = brew->currentVolume;
+        doc["phase"] = brew->currentPhase.name;
+        doc["elapsed"] = millis() - brew->processStarted;
+    } else {
+        doc["weight"] = 0;
+        doc["phase"] = "idle";
+    }
+    JsonObject commandsDoc = doc["commands"].to<JsonObject>();
+    commandsDoc["handled"] = commandStats.handled;
+    commandsDoc["rejected"] = commandStats.rejected;
+    commandsDoc["avg_latency"] = commandStats.handled > 0 ? commandStats.totalLatency / commandStats.handled : 0;
+    commandsDoc["max_latency"] = commandStats.maxLatency;
+    publish("telemetry", doc.as<String>());
+}
+
+void MQTTPlugin::sampleShot() {
+    Process *process = controller->getProcess();
+    if (process == nullptr || process->getType() != MODE_BREW) {
+        return;
+    }
+    const float pressure = controller->getCurrentPressure();
+    const float flow = controller->getCurrentPumpFlow();
+    std::lock_guard<std::mutex> lock(shotMutex);
+    shot.samples++;
+    shot.pressureSum += pressure;
+    shot.maxPressure = std::max(shot.maxPressure, pressure);
+    shot.flowSum += flow;
+    shot.maxFlow = std::max(shot.maxFlow, flow);
+}
+
+void MQTTPlugin::publishShotSummary() {
+    // Runs in the brew end event, the finished process is still the last one
+    Process *process = controller->getLastProcess();
+    if (process == nullptr || process->getType() != MODE_BREW) {
+        return;
+    }
+    auto *brew = static_cast<BrewProcess *>(process);
+    ShotStats stats;
+    {
+        std::lock_guard<std::mutex> lock(shotMutex);
+        stats = shot;
+    }
+    const unsigned long end = brew->finished > brew->processStarted ? brew->finished : millis();
+    JsonDocument doc;
+    doc["profile"] = brew->profile.label;
+    doc["duration"] = end - brew->processStarted;
+    doc["weight"] = brew->currentVolume;
+    doc["target"] = brew->target == ProcessTarget::VOLUMETRIC ? "volumetric" : "time";
+    doc["water_pumped"] = brew->waterPumped;
+    doc["phases"] = brew->phaseIndex + 1;
+    if (stats.samples > 0) {
+        doc["avg_pressure"] = stats.pressureSum / static_cast<float>(stats.samples);
+        doc["max_pressure"] = stats.maxPressure;
+        doc["avg_flow"] = stats.flowSum / static_cast<float>(stats.samples);
+        doc["max_flow"] = stats.maxFlow;
+    }
+    doc["timestamp"] = std::time(nullptr);
+    // Retained, Home Assistant shows the last shot after a restart
+    publish("controller/brew/summary", doc.as<String>(), true);
+}
+
+void MQTTPlugin::onMessage(const String &topic, const String &payload) {
+    // Called by client.loop() on the worker task, the controller is only touched from its own loop
+    const String prefix = topicPrefix + "command/";
+    if (!topic.startsWith(prefix)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(commandMutex);
+    if (commands.size() >= MQTT_COMMAND_QUEUE_SIZE) {
+        ESP_LOGW("MQTTPlugin", "Command queue full, dropping %s", topic.c_str());
+        return;
+    }
+    commands.push_back({topic.substring(prefix.length()), payload, millis()});
+}
+
+void MQTTPlugin::handleCommands() {
+    std::deque<Command> pending;
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        pending.swap(commands);
+    }
+    for (const Command &command : pending) {
+        // Plain values as sent by Home Assistant, or {"value": ..., "id": ...} to get the id back in the ack
+        String value = command.payload;
+        JsonDocument request;
+        if (command.payload.startsWith("{") && !deserializeJson(request, command.payload)) {
+            value = request["value"].as<String>();
+        }
+
+        JsonDocument ack;
+        ack["command"] = command.name;
+        if (!request["id"].isNull()) {
+            ack["id"] = request["id"];
+        }
+        String error;
+        const auto last = lastCommands.find(command.name);
+        if (!isCommand(command.name)) {
+            // Checked before debouncing, every name seen on command/+ would otherwise stay in lastCommands
+            error = "unknown command";
+        } else if (last != lastCommands.end() && last->second.first == command.payload &&
+                   command.received - last->second.second < MQTT_COMMAND_DEBOUNCE_MS) {
+            error = "debounced";
+        } else {
+            lastCommands[command.name] = {command.payload, command.received};
+            dispatch(command.name, value, error);
+        }
+
+        // Time from the broker handing the message over until the controller acted on it
+        const unsigned long latency = millis() - command.received;
+        if (error.isEmpty()) {
+            commandStats.handled++;
+            commandStats.totalLatency += latency;
+            commandStats.maxLatency = std::max(commandStats.maxLatency, latency);
+        } else {
+            commandStats.rejected++;
+            ack["error"] = error;
+            ESP_LOGW("MQTTPlugin", "Command %s rejected: %s", command.name.c_str(), error.c_str());
+        }
+        ack["ok"] = error.isEmpty();
+        ack["latency"] = latency;
+        publish("ack/" + command.name, ack.as<String>());
+    }
+}
+
+bool MQTTPlugin::dispatch(const String &name, const String &value, String &error) {
+    if (name == "mode") {
+        int mode = -1;
+        for (int i = 0; i < MODE_NAME_COUNT; i++) {
+            if (value.equalsIgnoreCase(MODE_NAMES[i])) {
+                mode = i;
+            }
+        }
+        float number;
+        if (mode < 0 && parseNumber(value, number)) {
+            mode = static_cast<int>(number);
+        }
+        if (mode < MODE_STANDBY || mode > MODE_GRIND) {
+            error = "unknown mode";
+            return false;
+        }
+        controller->deactivate();
+        controller->clear();
+        controller->setMode(mode);
+    } else if (name == "temperature") {
+        float temperature;
+        if (!parseNumber(value, temperature) || temperature < MIN_TEMP || temperature > MAX_TEMP) {
+            error = "temperature out of range";
+            return false;
+        }
+        // Only steam and water keep a target of their own, brew and grind follow the selected profile
+        if (controller->getMode() != MODE_STEAM && controller->getMode() != MODE_WATER) {
+            error = "not in steam or water mode";
+            return false;
+        }
+        controller->setTargetTemp(temperature);
+    } else if (name == "profile") {
+        if (value.isEmpty() || !controller->getProfileManager()->profileExists(value)) {
+            error = "unknown profile";
+            return false;
+        }
+        controller->getProfileManager()->selectProfile(value);
+    } else if (name == "brew") {
+        if (value.equalsIgnoreCase("start")) {
+            if (controller->getMode() != MODE_BREW) {
+                error = "not in brew mode";
+                return false;
+            }
+            if (controller->isActive()) {
+                error = "already brewing";
+                return false;
+            }
+            controller->activate();
+        } else if (value.equalsIgnoreCase("stop")) {
+            controller->deactivate();
+            controller->clear();
+        } else {
+            error = "expected start or stop";
+            return false;
+        }
+    } else if (name == "flush") {
+        if (controller->isActive()) {
+            error = "busy";
+            return false;
+        }
+        controller->onFlush();
+    } else if (name == "tare") {
+        controller->tare();
+    } else {
+        error = "unknown command";
+        return false;
+    }
+    return true;
+}
 
-    client.publish(publishTopic, payload.as<String>());
+void MQTTPlugin::publish(const String &topic, const String &message, bool retained) {
+    enqueue({topicPrefix + topic, message, retained});
 }
 
-void MQTTPlugin::publish(const std::string &topic, const std::string &message) {
-    if (!client.connected())
+void MQTTPlugin::enqueue(Message message) {
+    if (!brokerConnected) {
         return;
-    String mac = WiFi.macAddress();
-    mac.replace(":", "_");
-    const char *cmac = mac.c_str();
-    char publishTopic[80];
-    snprintf(publishTopic, sizeof(publishTopic), "gaggimate/%s/%s", cmac, topic.c_str());
-    client.publish(publishTopic, message.c_str());
+    }
+    std::lock_guard<std::mutex> lock(outboxMutex);
+    if (outbox.size() >= MQTT_OUTBOX_SIZE) {
+        outbox.pop_front();
+    }
+    outbox.push_back(std::move(message));
 }
+
 void MQTTPlugin::publishBrewState(const char *state) {
     char json[100];
     std::time_t now = std::time(nullptr); // Get current timestame
@@ -118,15 +393,19 @@ void MQTTPlugin::publishBrewState(const char *state) {
 }
 
 void MQTTPlugin::setup(Controller *controller, PluginManager *pluginManager) {
-    pluginManager->on("controller:wifi:connect", [this, controller](const Event &) {
-        if (!connect(controller))
-            return;
-        publishDiscovery(controller);
+    this->controller = controller;
+    deviceId = WiFi.macAddress();
+    deviceId.replace(":", "_");
+    topicPrefix = "gaggimate/" + deviceId + "/";
+    client.onMessage([this](String &topic, String &payload) { onMessage(topic, payload); });
+
+    pluginManager->on("controller:wifi:connect", [this](const Event &) {
+        wifiConnected = true;
+        reconnectNow = true;
     });
+    pluginManager->on("controller:wifi:disconnect", [this](const Event &) { wifiConnected = false; });
 
     pluginManager->on("boiler:currentTemperature:change", [this](Event const &event) {
-        if (!client.connected())
-            return;
         char json[50];
         const float temp = event.getFloat("value");
         if (temp != lastTemperature) {
@@ -136,8 +415,6 @@ void MQTTPlugin::setup(Controller *controller, PluginManager *pluginManager) {
         lastTemperature = temp;
     });
     pluginManager->on("boiler:targetTemperature:change", [this](Event const &event) {
-        if (!client.connected())
-            return;
         char json[50];
         const float temp = event.getFloat("value");
         snprintf(json, sizeof(json), R"***({"temperature":%02f})***", temp);
@@ -145,32 +422,123 @@ void MQTTPlugin::setup(Controller *controller, PluginManager *pluginManager) {
     });
     pluginManager->on("controller:mode:change", [this](Event const &event) {
         int newMode = event.getInt("value");
-        const char *modeStr;
-        switch (newMode) {
-        case 0:
-            modeStr = "Standby";
-            break;
-        case 1:
-            modeStr = "Brew";
-            break;
-        case 2:
-            modeStr = "Steam";
-            break;
-        case 3:
-            modeStr = "Water";
-            break;
-        case 4:
-            modeStr = "Grind";
-            break;
-        default:
-            modeStr = "Unknown";
-            break; // Fallback in case of unexpected value
-        }
+        const char *modeStr = newMode >= 0 && newMode < MODE_NAME_COUNT ? MODE_NAMES[newMode] : "Unknown";
         char json[100];
         snprintf(json, sizeof(json), R"({"mode":%d,"mode_str":"%s"})", newMode, modeStr);
         publish("controller/mode", json);
     });
-    pluginManager->on("controller:brew:start", [this](Event const &) { publishBrewState("brewing"); });
+    pluginManager->on("profiles:profile:select", [this](Event const &event) {
+        JsonDocument doc;
+        doc["id"] = event.getString("id");
+        publish("controller/profile", doc.as<String>(), true);
+    });
+    pluginManager->on("controller:brew:start", [this](Event const &) {
+        {
+            std::lock_guard<std::mutex> lock(shotMutex);
+            shot = ShotStats();
+        }
+        publishBrewState("brewing");
+    });
+
+    pluginManager->on("controller:brew:end", [this](Event const &) {
+        publishBrewState("not brewing");
+        publishShotSummary();
+    });
 
-    pluginManager->on("controller:brew:end", [this](Event const &) { publishBrewState("not brewing"); });
+    xTaskCreatePinnedToCore(loopTask, "MQTTPlugin::loop", MQTT_TASK_STACK_SIZE, this, 1, &taskHandle, 0);
+}
+
+void MQTTPlugin::loop() {
+    handleCommands();
+    if (!brokerConnected) {
+        return;
+    }
+    const unsigned long now = millis();
+    if (controller->isActive() && now - lastShotSample >= MQTT_SHOT_SAMPLE_INTERVAL_MS) {
+        lastShotSample = now;
+        sampleShot();
+    }
+    const int interval = controller->getSettings().getHomeAssistantTelemetryInterval();
+    if (interval > 0 && now - lastTelemetry >= static_cast<unsigned long>(interval)) {
+        lastTelemetry = now;
+        publishTelemetry();
+    }
+}
+
+bool MQTTPlugin::connect() {
+    const std::shared_ptr<const SettingsSnapshot> settings = controller->getSettings().snapshot();
+    const String ip = settings->getHomeAssistantIP();
+    const int haPort = settings->getHomeAssistantPort();
+    const String clientId = "GaggiMate";
+    const String haUser = settings->getHomeAssistantUser();
+    const String haPassword = settings->getHomeAssistantPassword();
+
+    client.begin(ip.c_str(), haPort, net);
+    client.setKeepAlive(10);
+    client.setTimeout(MQTT_COMMAND_TIMEOUT_MS);
+    return client.connect(clientId.c_str(), haUser.c_str(), haPassword.c_str());
+}
+
+void MQTTPlugin::work() {
+    if (!wifiConnected) {
+        if (client.connected()) {
+            client.disconnect();
+        }
+        brokerConnected = false;
+        return;
+    }
+    if (!client.connected()) {
+        brokerConnected = false;
+        const unsigned long now = millis();
+        if (!reconnectNow.exchange(false) && now - lastConnectAttempt < reconnectDelay) {
+            return;
+        }
+        lastConnectAttempt = now;
+        if (!connect()) {
+            ESP_LOGW("MQTTPlugin", "Connection to MQTT failed (%d), retrying in %lu s", static_cast<int>(client.lastError()),
+                     reconnectDelay / 1000);
+            reconnectDelay = std::min(reconnectDelay * 2, MQTT_RECONNECT_MAX_DELAY_MS);
+            return;
+        }
+        ESP_LOGI("MQTTPlugin", "Connected to MQTT");
+        reconnectDelay = MQTT_RECONNECT_MIN_DELAY_MS;
+        {
+            // Nothing queued before the connection is still current
+            std::lock_guard<std::mutex> lock(outboxMutex);
+            outbox.clear();
+        }
+        brokerConnected = true;
+        publishDiscovery();
+        JsonDocument profile;
+        profile["id"] = controller->getSettings().getSelectedProfile();
+        publish("controller/profile", profile.as<String>(), true);
+        if (!client.subscribe(topicPrefix + "command/+")) {
+            ESP_LOGW("MQTTPlugin", "Failed to subscribe to commands (%d)", static_cast<int>(client.lastError()));
+        }
+    }
+    client.loop();
+
+    while (client.connected()) {
+        Message message;
+        {
+            std::lock_guard<std::mutex> lock(outboxMutex);
+            if (outbox.empty()) {
+                break;
+            }
+            message = std::move(outbox.front());
+            outbox.pop_front();
+        }
+        if (!client.publish(message.topic, message.payload, message.retained, 0)) {
+            ESP_LOGW("MQTTPlugin", "Failed to publish %s (%d)", message.topic.c_str(),
+                     static_cast<int>(client.lastError()));
+        }
+    }
+}
+
+void MQTTPlugin::loopTask(void *arg) {
+    auto *plugin = static_cast<MQTTPlugin *>(arg);
+    while (true) {
+        plugin->work();
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+    }
 }
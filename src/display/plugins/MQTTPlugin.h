@@ -3,24 +3,100 @@
 #include "../core/Plugin.h"
 #include <MQTT.h>
 #include <WiFi.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
 
-constexpr int MQTT_CONNECTION_RETRIES = 5;
-constexpr int MQTT_CONNECTION_DELAY = 1000;
+constexpr unsigned long MQTT_RECONNECT_MIN_DELAY_MS = 1000;
+constexpr unsigned long MQTT_RECONNECT_MAX_DELAY_MS = 60000;
+constexpr int MQTT_COMMAND_TIMEOUT_MS = 1000;
+constexpr int MQTT_BUFFER_SIZE = 4096;     // the discovery payload is the largest message
+constexpr size_t MQTT_OUTBOX_SIZE = 32;    // the oldest message is dropped while the broker is unreachable
+constexpr unsigned long MQTT_SHOT_SAMPLE_INTERVAL_MS = 250;
+constexpr uint32_t MQTT_TASK_STACK_SIZE = 6144;
+constexpr size_t MQTT_COMMAND_QUEUE_SIZE = 8;
+constexpr unsigned long MQTT_COMMAND_DEBOUNCE_MS = 500; // a repeated command with the same payload is ignored
 
 class MQTTPlugin : public Plugin {
   public:
     void setup(Controller *controller, PluginManager *pluginManager) override;
-    bool connect(Controller *controller);
-    void loop() override {
-        // Event based plugin, no loop needed
-    };
+    void loop() override;
 
   private:
-    void publish(const std::string &topic, const std::string &message);
+    struct Message {
+        String topic;
+        String payload;
+        bool retained;
+    };
+
+    // Pressure and flow over one shot, sampled from the loop
+    struct ShotStats {
+        unsigned int samples = 0;
+        float pressureSum = 0.0f;
+        float maxPressure = 0.0f;
+        float flowSum = 0.0f;
+        float maxFlow = 0.0f;
+    };
+
+    // Received on gaggimate/<deviceId>/command/<name>, run from the controller loop
+    struct Command {
+        String name;
+        String payload;
+        unsigned long received;
+    };
+
+    struct CommandStats {
+        unsigned int handled = 0;
+        unsigned int rejected = 0;
+        unsigned long totalLatency = 0;
+        unsigned long maxLatency = 0;
+    };
+
+    // Messages are queued and sent by the worker task, event handlers never wait for the broker
+    void publish(const String &topic, const String &message, bool retained = false);
+    void enqueue(Message message);
     void publishBrewState(const char *state);
-    void publishDiscovery(Controller *controller);
-    MQTTClient client;
+    void publishDiscovery();
+    void publishTelemetry();
+    void publishShotSummary();
+    void sampleShot();
+
+    void onMessage(const String &topic, const String &payload);
+    void handleCommands();
+    bool dispatch(const String &name, const String &value, String &error);
+
+    // Worker task
+    bool connect();
+    void work();
+    static void loopTask(void *arg);
+
+    Controller *controller = nullptr;
+    MQTTClient client{MQTT_BUFFER_SIZE};
     WiFiClient net;
+    xTaskHandle taskHandle = nullptr;
+
+    String deviceId;    // MAC address with underscores
+    String topicPrefix; // gaggimate/<deviceId>/
+
+    std::mutex outboxMutex;
+    std::deque<Message> outbox;
+
+    std::atomic<bool> wifiConnected{false};
+    std::atomic<bool> brokerConnected{false};
+    std::atomic<bool> reconnectNow{false};
+    unsigned long lastConnectAttempt = 0;
+    unsigned long reconnectDelay = MQTT_RECONNECT_MIN_DELAY_MS;
+
+    unsigned long lastTelemetry = 0;
+    unsigned long lastShotSample = 0;
+    std::mutex shotMutex;
+    ShotStats shot;
+
+    std::mutex commandMutex;
+    std::deque<Command> commands;
+    std::map<String, std::pair<String, unsigned long>> lastCommands; // name to payload and time, for debouncing
+    CommandStats commandStats;
 
     float lastTemperature = 0;
 };
@@ -0,0 +1,194 @@
+#include "PumpCalibrationPlugin.h"
+#include <display/core/Controller.h>
+#include <display/core/Event.h>
+
+void PumpCalibrationPlugin::setup(Controller *controller, PluginManager *pluginManager) {
+    this->controller = controller;
+    this->pluginManager = pluginManager;
+    preferences.begin("pumpcal", false);
+    loadState();
+
+    pluginManager->on("controller:brew:start", [this](Event const &) { onShotStart(); });
+    pluginManager->on("controller:brew:end", [this](Event const &) { shotActive = false; });
+    pluginManager->on("boiler:pressure:change", [this](Event const &event) { pressure = event.getFloat("value"); });
+    pluginManager->on("pump:power:change", [this](Event const &event) { onPumpSample(event.getFloat("value")); });
+    pluginManager->on("controller:volumetric-measurement:bluetooth:change",
+                      [this](Event const &event) { onWeight(event.getFloat("value")); });
+}
+
+void PumpCalibrationPlugin::loop() {
+    if (!applyPending) {
+        return;
+    }
+    applyPending = false;
+    ESP_LOGI("PumpCalibrationPlugin", "Applying calibrated pump model %s", pendingModel.c_str());
+    baseModel = pendingModel;
+    controller->getSettings().setPumpModelCoeffs(pendingModel);
+    controller->setPumpModelCoeffs();
+}
+
+void PumpCalibrationPlugin::onShotStart() {
+    if (!controller->getSystemInfo().capabilities.dimming) {
+        return;
+    }
+    const String coeffs = controller->getSettings().getPumpModelCoeffs();
+    if (coeffs != baseModel) {
+        // The model was changed by hand, start over from it
+        if (!loadModel(coeffs, model)) {
+            return;
+        }
+        baseModel = coeffs;
+        calibrator.reset(model[0], model[1], model[2], model[3]);
+    }
+    shotActive = true;
+}
+
+void PumpCalibrationPlugin::onPumpSample(float power) {
+    if (!shotActive) {
+        if (shotRunning) {
+            finishShot();
+        }
+        return;
+    }
+    const unsigned long now = millis();
+    if (!shotRunning) {
+        shotRunning = true;
+        shotSamples = 0;
+        pumpSamples.clear();
+        weights.clear();
+    }
+    pumpSamples.push_back({now, pressure, power});
+    while (now - pumpSamples.front().time > PUMP_CALIBRATION_WINDOW_MS) {
+        pumpSamples.pop_front();
+    }
+    if (pumpSamples.size() < 4 || weights.empty() || now - weights.back().time > 1000) {
+        return;
+    }
+
+    // Only steady conditions are used, the cup flow lags the pump by the time it takes to drip
+    float minPressure = pumpSamples.front().pressure, maxPressure = minPressure;
+    float minPower = pumpSamples.front().power, maxPower = minPower;
+    float pressureSum = 0.0f, powerSum = 0.0f;
+    for (const auto &sample : pumpSamples) {
+        minPressure = std::min(minPressure, sample.pressure);
+        maxPressure = std::max(maxPressure, sample.pressure);
+        minPower = std::min(minPower, sample.power);
+        maxPower = std::max(maxPower, sample.power);
+        pressureSum += sample.pressure;
+        powerSum += sample.power;
+    }
+    const float meanPower = powerSum / pumpSamples.size();
+    if (maxPressure - minPressure > PUMP_CALIBRATION_MAX_PRESSURE_RANGE || maxPower - minPower > PUMP_CALIBRATION_MAX_POWER_RANGE ||
+        meanPower < PUMP_CALIBRATION_MIN_POWER) {
+        return;
+    }
+    // Coffee is close enough to the density of water to treat g/s as ml/s
+    const float flow = getScaleFlow();
+    if (flow < PUMP_CALIBRATION_MIN_FLOW) {
+        return;
+    }
+    calibrator.update(pressureSum / pumpSamples.size(), meanPower / 100.0f, flow);
+    shotSamples++;
+}
+
+void PumpCalibrationPlugin::onWeight(float weight) {
+    if (!shotRunning) {
+        return;
+    }
+    const unsigned long now = millis();
+    weights.push_back({now, weight});
+    while (now - weights.front().time > PUMP_CALIBRATION_WINDOW_MS) {
+        weights.pop_front();
+    }
+}
+
+void PumpCalibrationPlugin::finishShot() {
+    shotRunning = false;
+    if (shotSamples < PUMP_CALIBRATION_MIN_SHOT_SAMPLES) {
+        return;
+    }
+    const float confidence = calibrator.getConfidence();
+    ESP_LOGI("PumpCalibrationPlugin", "Calibrated pump model c=%.4f d=%.4f from %u samples, confidence %.0f%%",
+             calibrator.getC(), calibrator.getD(), calibrator.getSampleCount(), confidence * 100.0f);
+    if (calibrator.isConfident()) {
+        float calibrated[4] = {model[0], model[1], calibrator.getC(), calibrator.getD()};
+        pendingModel = formatModel(calibrated);
+        applyPending = true;
+    }
+    saveState();
+    pluginManager->trigger("pump:calibration:update", "confidence", static_cast<int>(confidence * 100.0f));
+}
+
+float PumpCalibrationPlugin::getScaleFlow() const {
+    if (weights.size() < 2) {
+        return 0.0f;
+    }
+    // Slope of a linear fit through the weight window
+    float timeMean = 0.0f, weightMean = 0.0f;
+    for (const auto &w : weights) {
+        timeMean += static_cast<float>(w.time - weights.front().time);
+        weightMean += w.value;
+    }
+    timeMean /= weights.size();
+    weightMean /= weights.size();
+    float covariance = 0.0f, variance = 0.0f;
+    for (const auto &w : weights) {
+        const float dt = static_cast<float>(w.time - weights.front().time) - timeMean;
+        covariance += dt * (w.value - weightMean);
+        variance += dt * dt;
+    }
+    return variance > 0.0f ? covariance / variance * 1000.0f : 0.0f;
+}
+
+bool PumpCalibrationPlugin::loadModel(const String &coeffs, float model[4]) const {
+    const String a = get_token(coeffs, 0, ',');
+    const String b = get_token(coeffs, 1, ',');
+    const String c = get_token(coeffs, 2, ',');
+    const String d = get_token(coeffs, 3, ',');
+    if (a.isEmpty() || b.isEmpty()) {
+        return false;
+    }
+    if (c.isEmpty() || d.isEmpty()) {
+        // Flow measured at 1 and 9 bar, same conversion as PressureController::setPumpFlowCoeff
+        const float oneBarFlow = a.toFloat();
+        const float nineBarFlow = b.toFloat();
+        model[0] = 0.0f;
+        model[1] = 0.0f;
+        model[2] = (nineBarFlow - oneBarFlow) / 8.0f;
+        model[3] = oneBarFlow - model[2];
+        return true;
+    }
+    model[0] = a.toFloat();
+    model[1] = b.toFloat();
+    model[2] = c.toFloat();
+    model[3] = d.toFloat();
+    return true;
+}
+
+String PumpCalibrationPlugin::formatModel(const float model[4]) const {
+    char str[64];
+    if (model[0] == 0.0f && model[1] == 0.0f) {
+        // Keep the two point format the settings page edits
+        snprintf(str, sizeof(str), "%.3f,%.3f", model[2] + model[3], 9.0f * model[2] + model[3]);
+    } else {
+        snprintf(str, sizeof(str), "%.6f,%.6f,%.4f,%.4f", model[0], model[1], model[2], model[3]);
+    }
+    return String(str);
+}
+
+void PumpCalibrationPlugin::loadState() {
+    baseModel = preferences.getString("base", "");
+    PumpFlowCalibrator::State state{};
+    if (baseModel.isEmpty() || !loadModel(baseModel, model) ||
+        preferences.getBytes("state", &state, sizeof(state)) != sizeof(state)) {
+        baseModel = "";
+        return;
+    }
+    calibrator.setState(model[0], model[1], state);
+}
+
+void PumpCalibrationPlugin::saveState() {
+    PumpFlowCalibrator::State state = calibrator.getState();
+    preferences.putString("base", applyPending ? pendingModel : baseModel);
+    preferences.putBytes("state", &state, sizeof(state));
+}
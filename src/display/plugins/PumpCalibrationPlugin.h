@@ -0,0 +1,66 @@
+#ifndef PUMPCALIBRATIONPLUGIN_H
+#define PUMPCALIBRATIONPLUGIN_H
+
+#include <Preferences.h>
+#include <deque>
+#include <display/core/Plugin.h>
+#include <display/core/PumpFlowCalibrator.h>
+
+// Window the pump and scale readings are averaged over, long enough to bridge the dripping delay
+constexpr unsigned long PUMP_CALIBRATION_WINDOW_MS = 2000;
+constexpr float PUMP_CALIBRATION_MAX_PRESSURE_RANGE = 0.3f; // bar within the window
+constexpr float PUMP_CALIBRATION_MAX_POWER_RANGE = 10.0f;   // % within the window
+constexpr float PUMP_CALIBRATION_MIN_POWER = 10.0f;
+constexpr float PUMP_CALIBRATION_MIN_FLOW = 0.3f; // g/s at the cup
+constexpr uint32_t PUMP_CALIBRATION_MIN_SHOT_SAMPLES = 20;
+
+// Refines the pump flow model from paired pump and bluetooth scale readings during shots
+class PumpCalibrationPlugin : public Plugin {
+  public:
+    void setup(Controller *controller, PluginManager *pluginManager) override;
+    void loop() override;
+
+  private:
+    struct TimedValue {
+        unsigned long time;
+        float value;
+    };
+    struct PumpSample {
+        unsigned long time;
+        float pressure;
+        float power;
+    };
+
+    void onShotStart();
+    void onPumpSample(float power);
+    void finishShot();
+    void onWeight(float weight);
+    float getScaleFlow() const;
+    bool loadModel(const String &coeffs, float model[4]) const;
+    String formatModel(const float model[4]) const;
+    void loadState();
+    void saveState();
+
+    Controller *controller = nullptr;
+    PluginManager *pluginManager = nullptr;
+    Preferences preferences;
+    PumpFlowCalibrator calibrator;
+
+    // Model the calibrator state belongs to, a manual change of the setting restarts the calibration
+    String baseModel = "";
+    bool twoPointModel = true;
+    float model[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    // Set from the main loop, the samples are processed in the bluetooth task
+    volatile bool shotActive = false;
+    bool shotRunning = false;
+    uint32_t shotSamples = 0;
+    // Handed back to the main loop since settings and controller writes can't happen inside a notification
+    volatile bool applyPending = false;
+    String pendingModel = "";
+    float pressure = 0.0f;
+    std::deque<PumpSample> pumpSamples;
+    std::deque<TimedValue> weights;
+};
+
+#endif // PUMPCALIBRATIONPLUGIN_H
@@ -14,17 +14,10 @@ void ShotHistoryPlugin::setup(Controller *c, PluginManager *pm) {
     pm->on("controller:brew:end", [this](Event const &) { endRecording(); });
     pm->on("controller:volumetric-measurement:estimation:change",
            [this](Event const &event) { currentEstimatedWeight = event.getFloat("value"); });
-    pm->on("controller:volumetric-measurement:bluetooth:change", [this](Event const &event) {
-        const float weight = event.getFloat("value");
-        const unsigned long now = millis();
-        if (lastVolumeSample != 0) {
-            const unsigned long timeDiff = now - lastVolumeSample;
-            const float volumeDiff = weight - currentBluetoothWeight;
-            const float volumeFlow = volumeDiff / static_cast<float>(timeDiff) * 1000.0f;
-            currentBluetoothFlow = currentBluetoothFlow * 0.9f + volumeFlow * 0.1f;
-        }
-        lastVolumeSample = now;
-        currentBluetoothWeight = weight;
+    pm->on("controller:volumetric-measurement:bluetooth:change", [this](Event const &) {
+        const WeightEstimator &estimator = controller->getWeightEstimator();
+        currentBluetoothWeight = estimator.getWeight();
+        currentBluetoothFlow = estimator.getFlow();
     });
     pm->on("boiler:currentTemperature:change", [this](Event const &event) { currentTemperature = event.getFloat("value"); });
     xTaskCreatePinnedToCore(loopTask, "ShotHistoryPlugin::loop", configMINIMAL_STACK_SIZE * 3, this, 1, &taskHandle, 0);
@@ -80,7 +73,6 @@ void ShotHistoryPlugin::startRecording() {
         currentId = "0" + currentId;
     }
     shotStart = millis();
-    lastVolumeSample = 0;
     currentBluetoothWeight = 0.0f;
     currentEstimatedWeight = 0.0f;
     currentBluetoothFlow = 0.0f;
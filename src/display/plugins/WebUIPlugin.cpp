@@ -1,6 +1,7 @@
 #include "WebUIPlugin.h"
 #include <DNSServer.h>
 #include <SPIFFS.h>
+#include <StreamString.h>
 #include <display/core/Controller.h>
 #include <display/core/ProfileManager.h>
 #include <display/core/process/BrewProcess.h>
@@ -42,7 +43,14 @@ void WebUIPlugin::setup(Controller *_controller, PluginManager *_pluginManager)
         ota->init(controller->getClientController()->getClient());
     });
     pluginManager->on("controller:autotune:result", [this](Event const &event) { sendAutotuneResult(); });
+    pluginManager->on("controller:autotune:progress",
+                      [this](Event const &event) { sendAutotuneProgress(event.getInt("value")); });
+    pluginManager->on("controller:autotune:abort", [this](Event const &event) { sendAutotuneAbort(); });
+    pluginManager->on("pump:calibration:update",
+                      [this](Event const &event) { sendPumpCalibration(event.getInt("confidence")); });
     setupServer();
+    xTaskCreatePinnedToCore(updateCheckTask, "WebUIPlugin::updateCheck", UPDATE_CHECK_STACK_SIZE, this, tskIDLE_PRIORITY,
+                            &updateCheckTaskHandle, 0);
 }
 
 void WebUIPlugin::loop() {
@@ -56,10 +64,8 @@ void WebUIPlugin::loop() {
         return;
     }
     const long now = millis();
-    if ((lastUpdateCheck == 0 || now > lastUpdateCheck + UPDATE_CHECK_INTERVAL)) {
-        ota->checkForUpdates();
+    if (updateCheckFinished.exchange(false)) {
         pluginManager->trigger("ota:update:status", "value", ota->isUpdateAvailable());
-        lastUpdateCheck = now;
         updateOTAStatus(ota->getCurrentVersion());
     }
     if (now > lastStatus + STATUS_PERIOD) {
@@ -78,6 +84,7 @@ void WebUIPlugin::loop() {
         doc["bta"] = controller->isVolumetricAvailable() ? 1 : 0;
         doc["bt"] = controller->isVolumetricAvailable() && controller->getSettings().isVolumetricTarget() ? 1 : 0;
         doc["led"] = controller->getSystemInfo().capabilities.ledControl;
+        doc["blc"] = controller->getClientController()->getLastConnectDuration();
 
         Process *process = controller->getProcess();
         if (process == nullptr) {
@@ -179,6 +186,36 @@ void WebUIPlugin::start() {
     serverRunning = true;
 }
 
+void WebUIPlugin::checkForUpdates() {
+    if (!serverRunning || updating) {
+        return;
+    }
+    const unsigned long now = millis();
+    if (!updateCheckRequested.exchange(false) && now - lastUpdateCheck < updateCheckInterval) {
+        return;
+    }
+    lastUpdateCheck = now;
+    if (ota->checkForUpdates()) {
+        updateCheckFailures = 0;
+        updateCheckInterval = UPDATE_CHECK_INTERVAL;
+    } else {
+        // Back off while GitHub or the network is unavailable
+        updateCheckInterval = std::min<unsigned long>(UPDATE_CHECK_RETRY_INTERVAL << std::min(updateCheckFailures, 7),
+                                                      UPDATE_CHECK_MAX_INTERVAL);
+        updateCheckFailures++;
+        ESP_LOGW("WebUIPlugin", "Update check failed, retrying in %lu s", updateCheckInterval / 1000);
+    }
+    updateCheckFinished = true;
+}
+
+void WebUIPlugin::updateCheckTask(void *arg) {
+    auto *plugin = static_cast<WebUIPlugin *>(arg);
+    while (true) {
+        plugin->checkForUpdates();
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+}
+
 void WebUIPlugin::stop() {
     if (!serverRunning)
         return;
@@ -226,6 +263,8 @@ void WebUIPlugin::handleWebSocketData(AsyncWebSocket *server, AsyncWebSocketClie
                     handleOTAStart(client->id(), doc);
                 } else if (msgType == "req:autotune-start") {
                     handleAutotuneStart(client->id(), doc);
+                } else if (msgType == "req:autotune-abort") {
+                    controller->abortAutotune();
                 } else if (msgType == "req:process:activate") {
                     controller->activate();
                 } else if (msgType == "req:process:deactivate") {
@@ -253,6 +292,8 @@ void WebUIPlugin::handleWebSocketData(AsyncWebSocket *server, AsyncWebSocketClie
                     ws.text(client->id(), msg);
                 } else if (msgType == "req:flush:start") {
                     handleFlushStart(client->id(), doc);
+                } else if (msgType == "req:settings") {
+                    handleSettingsRequest(client->id(), doc);
                 }
             }
         }
@@ -266,7 +307,7 @@ void WebUIPlugin::handleOTASettings(uint32_t clientId, JsonDocument &request) {
         if (!request["channel"].isNull()) {
             controller->getSettings().setOTAChannel(request["channel"].as<String>() == "latest" ? "latest" : "nightly");
             ota->setReleaseUrl(RELEASE_URL + (controller->getSettings().getOTAChannel() == "latest" ? "latest" : "tag/nightly"));
-            lastUpdateCheck = 0;
+            updateCheckRequested = true;
         }
     }
     updateOTAStatus("Checking...");
@@ -284,7 +325,8 @@ void WebUIPlugin::handleOTAStart(uint32_t clientId, JsonDocument &request) {
 void WebUIPlugin::handleAutotuneStart(uint32_t clientId, JsonDocument &request) {
     int testTime = request["time"].as<int>();
     int samples = request["samples"].as<int>();
-    controller->autotune(testTime, samples);
+    int method = request["method"] | AUTOTUNE_METHOD_STEP;
+    controller->autotune(testTime, samples, method);
 }
 
 void WebUIPlugin::handleProfileRequest(uint32_t clientId, JsonDocument &request) {
@@ -357,145 +399,78 @@ void WebUIPlugin::handleProfileRequest(uint32_t clientId, JsonDocument &request)
 
 void WebUIPlugin::handleSettings(AsyncWebServerRequest *request) const {
     if (request->method() == HTTP_POST) {
-        controller->getSettings().batchUpdate([request](Settings *settings) {
-            if (request->hasArg("startupMode"))
-                settings->setStartupMode(request->arg("startupMode") == "brew" ? MODE_BREW : MODE_STANDBY);
-            if (request->hasArg("targetSteamTemp"))
-                settings->setTargetSteamTemp(request->arg("targetSteamTemp").toInt());
-            if (request->hasArg("targetWaterTemp"))
-                settings->setTargetWaterTemp(request->arg("targetWaterTemp").toInt());
-            if (request->hasArg("temperatureOffset"))
-                settings->setTemperatureOffset(request->arg("temperatureOffset").toInt());
-            if (request->hasArg("pressureScaling"))
-                settings->setPressureScaling(request->arg("pressureScaling").toFloat());
-            if (request->hasArg("pid"))
-                settings->setPid(request->arg("pid"));
-            if (request->hasArg("pumpModelCoeffs"))
-                settings->setPumpModelCoeffs(request->arg("pumpModelCoeffs"));
-            if (request->hasArg("wifiSsid"))
-                settings->setWifiSsid(request->arg("wifiSsid"));
-            if (request->hasArg("mdnsName"))
-                settings->setMdnsName(request->arg("mdnsName"));
-            if (request->hasArg("wifiPassword") && request->arg("wifiPassword") != "---unchanged---")
-                settings->setWifiPassword(request->arg("wifiPassword"));
-            settings->setHomekit(request->hasArg("homekit"));
-            settings->setBoilerFillActive(request->hasArg("boilerFillActive"));
-            if (request->hasArg("startupFillTime"))
-                settings->setStartupFillTime(request->arg("startupFillTime").toInt() * 1000);
-            if (request->hasArg("steamFillTime"))
-                settings->setSteamFillTime(request->arg("steamFillTime").toInt() * 1000);
-            settings->setSmartGrindActive(request->hasArg("smartGrindActive"));
-            if (request->hasArg("smartGrindIp"))
-                settings->setSmartGrindIp(request->arg("smartGrindIp"));
-            if (request->hasArg("smartGrindMode"))
-                settings->setSmartGrindMode(request->arg("smartGrindMode").toInt());
-            settings->setHomeAssistant(request->hasArg("homeAssistant"));
-            if (request->hasArg("haUser"))
-                settings->setHomeAssistantUser(request->arg("haUser"));
-            if (request->hasArg("haPassword"))
-                settings->setHomeAssistantPassword(request->arg("haPassword"));
-            if (request->hasArg("haIP"))
-                settings->setHomeAssistantIP(request->arg("haIP"));
-            if (request->hasArg("haPort"))
-                settings->setHomeAssistantPort(request->arg("haPort").toInt());
-            if (request->hasArg("haTopic"))
-                settings->setHomeAssistantTopic(request->arg("haTopic"));
-            settings->setMomentaryButtons(request->hasArg("momentaryButtons"));
-            settings->setDelayAdjust(request->hasArg("delayAdjust"));
-            if (request->hasArg("brewDelay"))
-                settings->setBrewDelay(request->arg("brewDelay").toDouble());
-            if (request->hasArg("grindDelay"))
-                settings->setGrindDelay(request->arg("grindDelay").toDouble());
-            if (request->hasArg("timezone"))
-                settings->setTimezone(request->arg("timezone"));
-            settings->setClockFormat(request->hasArg("clock24hFormat"));
-            if (request->hasArg("standbyTimeout"))
-                settings->setStandbyTimeout(request->arg("standbyTimeout").toInt() * 1000);
-            if (request->hasArg("mainBrightness"))
-                settings->setMainBrightness(request->arg("mainBrightness").toInt());
-            if (request->hasArg("standbyBrightness"))
-                settings->setStandbyBrightness(request->arg("standbyBrightness").toInt());
-            if (request->hasArg("standbyBrightnessTimeout"))
-                settings->setStandbyBrightnessTimeout(request->arg("standbyBrightnessTimeout").toInt() * 1000);
-            if (request->hasArg("steamPumpPercentage"))
-                settings->setSteamPumpPercentage(request->arg("steamPumpPercentage").toFloat());
-            if (request->hasArg("steamPumpCutoff"))
-                settings->setSteamPumpCutoff(request->arg("steamPumpCutoff").toFloat());
-            if (request->hasArg("themeMode"))
-                settings->setThemeMode(request->arg("themeMode").toInt());
-            if (request->hasArg("sunriseR"))
-                settings->setSunriseR(request->arg("sunriseR").toInt());
-            if (request->hasArg("sunriseG"))
-                settings->setSunriseG(request->arg("sunriseG").toInt());
-            if (request->hasArg("sunriseB"))
-                settings->setSunriseB(request->arg("sunriseB").toInt());
-            if (request->hasArg("sunriseW"))
-                settings->setSunriseW(request->arg("sunriseW").toInt());
-            if (request->hasArg("sunriseExtBrightness"))
-                settings->setSunriseExtBrightness(request->arg("sunriseExtBrightness").toInt());
-            if (request->hasArg("emptyTankDistance"))
-                settings->setEmptyTankDistance(request->arg("emptyTankDistance").toInt());
-            if (request->hasArg("fullTankDistance"))
-                settings->setFullTankDistance(request->arg("fullTankDistance").toInt());
+        std::vector<const char *> events;
+        controller->getSettings().batchUpdate([request, &events](Settings *settings) {
+            uint64_t posted = 0;
+            for (size_t i = 0; i < request->args(); i++) {
+                const SettingDescriptor *setting = Settings::findSetting(request->argName(i).c_str());
+                if (setting == nullptr) {
+                    continue;
+                }
+                posted |= 1ULL << setting->key;
+                if (settings->update(*setting, request->arg(i)) && setting->event != nullptr) {
+                    events.push_back(setting->event);
+                }
+            }
+            // Unchecked checkboxes are left out of the form
+            for (const SettingDescriptor &setting : Settings::SCHEMA) {
+                if (setting.name != nullptr && setting.type == SettingType::BOOL && !(posted & (1ULL << setting.key)) &&
+                    settings->update(setting, "false") && setting.event != nullptr) {
+                    events.push_back(setting.event);
+                }
+            }
             settings->save(true);
         });
-        controller->setTargetTemp(controller->getTargetTemp());
-        controller->setPumpModelCoeffs();
+        triggerSettingsEvents(events);
     }
 
     AsyncResponseStream *response = request->beginResponseStream("application/json");
-    JsonDocument doc;
-    Settings const &settings = controller->getSettings();
-    doc["startupMode"] = settings.getStartupMode() == MODE_BREW ? "brew" : "standby";
-    doc["targetSteamTemp"] = settings.getTargetSteamTemp();
-    doc["targetWaterTemp"] = settings.getTargetWaterTemp();
-    doc["homekit"] = settings.isHomekit();
-    doc["homeAssistant"] = settings.isHomeAssistant();
-    doc["haUser"] = settings.getHomeAssistantUser();
-    doc["haPassword"] = settings.getHomeAssistantPassword();
-    doc["haIP"] = settings.getHomeAssistantIP();
-    doc["haPort"] = settings.getHomeAssistantPort();
-    doc["haTopic"] = settings.getHomeAssistantTopic();
-    doc["pid"] = settings.getPid();
-    doc["pumpModelCoeffs"] = settings.getPumpModelCoeffs();
-    doc["wifiSsid"] = settings.getWifiSsid();
-    doc["wifiPassword"] = apMode ? "---unchanged---" : settings.getWifiPassword();
-    doc["mdnsName"] = settings.getMdnsName();
-    doc["temperatureOffset"] = String(settings.getTemperatureOffset());
-    doc["pressureScaling"] = String(settings.getPressureScaling());
-    doc["boilerFillActive"] = settings.isBoilerFillActive();
-    doc["startupFillTime"] = settings.getStartupFillTime() / 1000;
-    doc["steamFillTime"] = settings.getSteamFillTime() / 1000;
-    doc["smartGrindActive"] = settings.isSmartGrindActive();
-    doc["smartGrindIp"] = settings.getSmartGrindIp();
-    doc["smartGrindMode"] = settings.getSmartGrindMode();
-    doc["momentaryButtons"] = settings.isMomentaryButtons();
-    doc["brewDelay"] = settings.getBrewDelay();
-    doc["grindDelay"] = settings.getGrindDelay();
-    doc["delayAdjust"] = settings.isDelayAdjust();
-    doc["timezone"] = settings.getTimezone();
-    doc["clock24hFormat"] = settings.isClock24hFormat();
-    doc["standbyTimeout"] = settings.getStandbyTimeout() / 1000;
-    doc["mainBrightness"] = settings.getMainBrightness();
-    doc["standbyBrightness"] = settings.getStandbyBrightness();
-    doc["standbyBrightnessTimeout"] = settings.getStandbyBrightnessTimeout() / 1000;
-    doc["steamPumpPercentage"] = settings.getSteamPumpPercentage();
-    doc["steamPumpCutoff"] = settings.getSteamPumpCutoff();
-    doc["themeMode"] = settings.getThemeMode();
-    doc["sunriseR"] = settings.getSunriseR();
-    doc["sunriseG"] = settings.getSunriseG();
-    doc["sunriseB"] = settings.getSunriseB();
-    doc["sunriseW"] = settings.getSunriseW();
-    doc["sunriseExtBrightness"] = settings.getSunriseExtBrightness();
-    doc["emptyTankDistance"] = settings.getEmptyTankDistance();
-    doc["fullTankDistance"] = settings.getFullTankDistance();
-    serializeJson(doc, *response);
+    controller->getSettings().writeJson(*response, apMode);
     request->send(response);
 
     if (request->method() == HTTP_POST && request->hasArg("restart"))
         ESP.restart();
 }
 
+void WebUIPlugin::handleSettingsRequest(uint32_t clientId, JsonDocument &request) {
+    // Only the settings in the request change, a checkbox missing here is left alone
+    Settings &settings = controller->getSettings();
+    std::vector<const char *> events;
+    for (JsonPair pair : request["settings"].as<JsonObject>()) {
+        const SettingDescriptor *setting = Settings::findSetting(pair.key().c_str());
+        if (setting == nullptr) {
+            continue;
+        }
+        String value;
+        if (pair.value().is<const char *>()) {
+            value = pair.value().as<const char *>();
+        } else {
+            serializeJson(pair.value(), value);
+        }
+        if (settings.update(*setting, value) && setting->event != nullptr) {
+            events.push_back(setting->event);
+        }
+    }
+    triggerSettingsEvents(events);
+
+    StreamString msg;
+    msg.print("{\"tp\":\"res:settings\",\"rid\":");
+    serializeJson(request["rid"], msg);
+    msg.print(",\"settings\":");
+    settings.writeJson(msg, apMode);
+    msg.print('}');
+    ws.text(clientId, msg);
+}
+
+void WebUIPlugin::triggerSettingsEvents(std::vector<const char *> &events) const {
+    std::sort(events.begin(), events.end(), [](const char *a, const char *b) { return strcmp(a, b) < 0; });
+    events.erase(std::unique(events.begin(), events.end(), [](const char *a, const char *b) { return strcmp(a, b) == 0; }),
+                 events.end());
+    for (const char *event : events) {
+        pluginManager->trigger(event);
+    }
+}
+
 void WebUIPlugin::handleBLEScaleList(AsyncWebServerRequest *request) {
     JsonDocument doc;
     JsonArray scalesArray = doc.to<JsonArray>();
@@ -580,6 +555,29 @@ void WebUIPlugin::sendAutotuneResult() {
     ws.textAll(message);
 }
 
+void WebUIPlugin::sendAutotuneProgress(int progress) {
+    JsonDocument doc;
+    doc["tp"] = "evt:autotune-progress";
+    doc["progress"] = progress;
+    String message = doc.as<String>();
+    ws.textAll(message);
+}
+
+void WebUIPlugin::sendAutotuneAbort() {
+    JsonDocument doc;
+    doc["tp"] = "evt:autotune-abort";
+    String message = doc.as<String>();
+    ws.textAll(message);
+}
+
+void WebUIPlugin::sendPumpCalibration(int confidence) {
+    JsonDocument doc;
+    doc["tp"] = "evt:pump-calibration";
+    doc["confidence"] = confidence;
+    String message = doc.as<String>();
+    ws.textAll(message);
+}
+
 void WebUIPlugin::handleFlushStart(uint32_t clientId, JsonDocument &request) {
     controller->onFlush();
 
@@ -11,9 +11,13 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <atomic>
 #include <vector>
 
 constexpr size_t UPDATE_CHECK_INTERVAL = 5 * 60 * 1000;
+constexpr size_t UPDATE_CHECK_RETRY_INTERVAL = 30 * 1000; // doubles after every failed check
+constexpr size_t UPDATE_CHECK_MAX_INTERVAL = 60 * 60 * 1000;
+constexpr uint32_t UPDATE_CHECK_STACK_SIZE = 8192;       // TLS handshakes need more than the other tasks
 constexpr size_t CLEANUP_PERIOD = 5 * 1000;
 constexpr size_t STATUS_PERIOD = 500;
 constexpr size_t DNS_PERIOD = 10;
@@ -33,6 +37,8 @@ class WebUIPlugin : public Plugin {
     void setupServer();
     void start();
     void stop();
+    void checkForUpdates();
+    static void updateCheckTask(void *arg);
 
     // Websocket handlers
     void handleWebSocketData(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data,
@@ -42,9 +48,11 @@ class WebUIPlugin : public Plugin {
     void handleAutotuneStart(uint32_t clientId, JsonDocument &request);
     void handleProfileRequest(uint32_t clientId, JsonDocument &request);
     void handleFlushStart(uint32_t clientId, JsonDocument &request);
+    void handleSettingsRequest(uint32_t clientId, JsonDocument &request);
 
     // HTTP handlers
     void handleSettings(AsyncWebServerRequest *request) const;
+    void triggerSettingsEvents(std::vector<const char *> &events) const;
     void handleBLEScaleList(AsyncWebServerRequest *request);
     void handleBLEScaleScan(AsyncWebServerRequest *request);
     void handleBLEScaleConnect(AsyncWebServerRequest *request);
@@ -52,6 +60,9 @@ class WebUIPlugin : public Plugin {
     void updateOTAStatus(const String &version);
     void updateOTAProgress(uint8_t phase, int progress);
     void sendAutotuneResult();
+    void sendAutotuneProgress(int progress);
+    void sendAutotuneAbort();
+    void sendPumpCalibration(int confidence);
 
     GitHubOTA *ota = nullptr;
     AsyncWebServer server;
@@ -61,7 +72,13 @@ class WebUIPlugin : public Plugin {
     DNSServer *dnsServer = nullptr;
     ProfileManager *profileManager = nullptr;
 
-    long lastUpdateCheck = 0;
+    // The update check runs on its own task, GitHub requests take seconds and would stall the status and DNS
+    xTaskHandle updateCheckTaskHandle = nullptr;
+    unsigned long lastUpdateCheck = 0;
+    unsigned long updateCheckInterval = UPDATE_CHECK_INTERVAL;
+    int updateCheckFailures = 0;
+    std::atomic<bool> updateCheckRequested{false};
+    std::atomic<bool> updateCheckFinished{false};
     long lastStatus = 0;
     long lastCleanup = 0;
     long lastDns = 0;
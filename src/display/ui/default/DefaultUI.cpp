@@ -181,6 +181,8 @@ void DefaultUI::init() {
                       [this](Event const &) { changeScreen(&ui_InitScreen, &ui_InitScreen_screen_init); });
     pluginManager->on("controller:autotune:result",
                       [this](Event const &) { changeScreen(&ui_StandbyScreen, &ui_StandbyScreen_screen_init); });
+    pluginManager->on("controller:autotune:abort",
+                      [this](Event const &) { changeScreen(&ui_StandbyScreen, &ui_StandbyScreen_screen_init); });
 
     pluginManager->on("profiles:profile:select", [this](Event const &event) {
         selectedProfileId = event.getString("id");
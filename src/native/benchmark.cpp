@@ -0,0 +1,155 @@
+// Host microbenchmarks for the NayrodPID control library, built by the native environment:
+//   pio run -e native -t exec
+// Every component runs against a small plant model so the measured path is the one taken on the controller.
+// Reports the mean time and heap allocations per update.
+
+#include <Autotune/Autotune.h>
+#include <Clock/Clock.h>
+#include <HydraulicParameterEstimator/HydraulicParameterEstimator.h>
+#include <PressureController/PressureController.h>
+#include <SavGolFilter/SavGolFilter.h>
+#include <SimpleKalmanFilter/SimpleKalmanFilter.h>
+#include <SimplePID/SimplePID.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static size_t allocationCount = 0;
+
+void *operator new(size_t size) {
+    allocationCount++;
+    if (void *ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+constexpr int WARMUP_ITERATIONS = 1000;
+constexpr int ITERATIONS = 200000;
+
+// Prevents the compiler from optimizing away results that are otherwise unused
+static volatile float sink = 0.0f;
+
+template <typename Step> void runBenchmark(const char *name, Step step) {
+    for (int i = 0; i < WARMUP_ITERATIONS; i++)
+        step(i);
+    size_t allocations = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        step(i);
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    allocations = allocationCount - allocations;
+    printf("%-28s %10.1f ns/update %8.3f allocs/update\n", name, elapsed / ITERATIONS,
+           static_cast<double>(allocations) / ITERATIONS);
+}
+
+// Pump, boiler compliance and puck, close enough to real shots to keep the controllers in their working range
+struct HydraulicPlant {
+    static constexpr float COMPLIANCE = 0.66f; // ml/bar
+    float pressure = 0.0f;
+    float pumpFlow = 0.0f;
+
+    float step(float power, float dt) {
+        pumpFlow = power / 100.0f * std::max(10.8f - 0.59f * pressure, 0.0f);
+        float puckFlow = 0.7f * sqrtf(std::max(pressure, 0.0f));
+        pressure = std::max(pressure + (pumpFlow - puckFlow) * dt / COMPLIANCE, 0.0f);
+        return pressure;
+    }
+};
+
+// Boiler as a first order lag, one step per heater update
+struct ThermalPlant {
+    float temperature = 25.0f;
+
+    float step(float power, float dt) {
+        temperature += (25.0f + 1.0f * power - temperature) * dt / 120.0f;
+        return temperature;
+    }
+};
+
+// The unit tests link the same sources and bring their own main
+#ifndef PIO_UNIT_TESTING
+int main() {
+    VirtualClock clock;
+    Clock::set(&clock);
+    printf("NayrodPID host benchmark, %d updates per component\n", ITERATIONS);
+
+    {
+        SimpleKalmanFilter filter(0.1f, 10.0f, 0.01f);
+        runBenchmark("SimpleKalmanFilter", [&](int i) { sink = filter.updateEstimate(9.0f + 0.01f * (i % 7)); });
+    }
+
+    {
+        SavGolFilter<PRESSURE_DERIVATIVE_FILTER_WINDOW> filter;
+        runBenchmark("SavGolFilter", [&](int i) {
+            filter.push(9.0f + 0.01f * (i % 7));
+            sink = filter.getValue() + filter.getEndDerivative(0.03f);
+        });
+    }
+
+    {
+        float output = 0.0f, temperature = 90.0f, setpoint = 93.0f;
+        ThermalPlant plant;
+        plant.temperature = temperature;
+        SimplePID pid(&output, &temperature, &setpoint);
+        pid.setControllerPIDGains(58.397f, 1.027f, 249.055f, 0.0f);
+        pid.setSamplingFrequency(1.0f);
+        pid.setCtrlOutputLimits(0.0f, 1000.0f);
+        pid.activateSetPointFilter(false);
+        pid.setMode(SimplePID::Control::automatic);
+        runBenchmark("SimplePID", [&](int) {
+            clock.advanceMillis(1000);
+            pid.update();
+            temperature = plant.step(output / 10.0f, 1.0f);
+        });
+    }
+
+    {
+        float power = 0.0f, pressure = 0.0f;
+        HydraulicPlant plant;
+        HydraulicParameterEstimator estimator(0.03f);
+        estimator.reset();
+        runBenchmark("HydraulicParameterEstimator", [&](int i) {
+            power = (i % 2000) < 1000 ? 60.0f : 80.0f;
+            pressure = plant.step(power, 0.03f);
+            estimator.update(plant.pumpFlow * 1e-6f, pressure);
+            sink = estimator.getResistance();
+        });
+    }
+
+    {
+        float pressureSetpoint = 9.0f, flowSetpoint = 0.0f, pressure = 0.0f, output = 0.0f;
+        int valve = 1;
+        HydraulicPlant plant;
+        PressureController controller(0.03f, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+        runBenchmark("PressureController", [&](int i) {
+            pressureSetpoint = (i % 2000) < 1000 ? 9.0f : 6.0f;
+            controller.update(PressureController::ControlMode::PRESSURE);
+            pressure = plant.step(output, 0.03f);
+        });
+    }
+
+    {
+        Autotune autotune;
+        ThermalPlant plant;
+        float time = 0.0f;
+        autotune.setMethod(Autotune::Method::RELAY);
+        autotune.setRelay(93.0f, 0.5f, 4);
+        runBenchmark("Autotune (relay)", [&](int) {
+            if (autotune.isFinished()) {
+                autotune.reset();
+                plant = ThermalPlant();
+                time = 0.0f;
+            }
+            autotune.update(plant.temperature, time);
+            plant.step(autotune.getOutput() * 100.0f, 1.0f);
+            time += 1.0f;
+        });
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,292 @@
+// Loopback of the controller firmware transfer over a modelled BLE link, built by the native-ota environment:
+//   pio run -e native-ota -t exec
+//   .pio/build/native-ota/program [--size bytes] [--interval ms] [--packets n] [--buffer n] [--loss p] [--flash kB/s]
+//                                 [--download kB/s] [--image file --expect file [--base file]]
+// Runs WindowedTransferSender (display) against WindowedTransferReceiver (controller) and checks the received image.
+// The controller decodes it with image_decoder, --image sends a file built by scripts/ota/compress_image.py instead of
+// random data and --expect is the firmware it has to decode to, --base the running firmware a delta applies to.
+// The display streams the image through WindowedStreamBuffer at the download rate and both sides hash it, the
+// controller only accepts the update if the digests match. Then it times the slow mode of ControllerOTA on the same
+// link, which stages the download in SPIFFS first and writes every packet with response followed by delay(50).
+// The link delivers a limited number of packets per connection event, the controller drops packets while its buffers
+// are full, e.g. during the flash write of a part.
+
+#include <WindowedTransfer.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <image_decoder.hpp>
+#include <iterator>
+#include <random>
+#include <vector>
+#include <windowed_transfer.hpp>
+
+#include "Sha256.h"
+
+constexpr uint16_t PART_SIZE = 19000;   // ControllerOTA.h
+constexpr uint32_t UPDATER_SIZE = 20000; // ble_ota_dfu.hpp
+constexpr uint16_t SLOW_MTU = 120;      // ControllerOTA.h, payload of a slow mode packet
+constexpr uint16_t LINK_MTU = 128;      // NimBLEDevice::setMTU of both boards
+constexpr double SLOW_DELAY_MS = 50.0;  // delay() after every slow mode write and in the wait loop
+constexpr double WRITE_HANDLER_MS = 1.0; // delay(1) at the end of the controller write handler
+constexpr size_t CLIENT_TX_BUFFERS = 12;
+constexpr double STEP_MS = 0.25;
+
+struct LinkConfig {
+    uint32_t size = 1100000;
+    double interval = 10.0; // ms, the display requests 7.5-10 ms
+    int packetsPerEvent = 4;
+    size_t serverBuffers = 12;
+    double loss = 0.0;
+    double flashRate = 80.0;     // kB/s of flash writes on the controller
+    double downloadRate = 200.0; // kB/s of the firmware download on the display
+};
+
+struct WindowedResult {
+    double duration;
+    bool intact;
+    uint32_t retransmissions;
+    uint32_t dropped;
+    bool digestAccepted;
+};
+
+static WindowedResult runWindowed(const LinkConfig &config, const std::vector<uint8_t> &image,
+                                  const std::vector<uint8_t> &expected, const std::vector<uint8_t> &base) {
+    using Packet = std::vector<uint8_t>;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    std::deque<Packet> clientTx, serverRx, notifications;
+    std::vector<uint8_t> received;
+    static uint8_t buffers[2][UPDATER_SIZE];
+    double flashPending = 0.0;
+    uint32_t dropped = 0;
+    Sha256 displayHash, controllerHash;
+    bool digestAccepted = false;
+    std::vector<uint8_t> decoded;
+    image_decoder decoder(
+        [&](const image_header &header) {
+            if (header.format != IMAGE_FORMAT_DELTA) {
+                return true;
+            }
+            uint8_t digest[IMAGE_SHA256_SIZE];
+            Sha256 baseHash;
+            baseHash.update(base.data(), std::min<size_t>(header.base_size, base.size()));
+            baseHash.finish(digest);
+            return header.base_size <= base.size() && memcmp(digest, header.base_sha256, sizeof(digest)) == 0;
+        },
+        [&](const uint8_t *data, size_t length) {
+            decoded.insert(decoded.end(), data, data + length);
+            flashPending += length / config.flashRate; // bytes / (kB/s) = ms
+            return true;
+        },
+        [&](uint32_t offset, uint8_t *buffer, size_t length) {
+            memcpy(buffer, base.data() + offset, length);
+            return true;
+        });
+    decoder.reset(config.size);
+
+    const uint16_t payload = LINK_MTU - 3 - DFU_WINDOWED_DATA_HEADER;
+    WindowedTransferReceiver<UPDATER_SIZE> receiver(
+        buffers[0], buffers[1],
+        [&](const uint8_t *data, uint16_t length) {
+            received.insert(received.end(), data, data + length);
+            controllerHash.update(data, length);
+            return decoder.feed(data, length);
+        },
+        [&](const uint8_t *data, size_t length) { notifications.emplace_back(data, data + length); },
+        [&](const uint8_t *digest) {
+            uint8_t written[DFU_WINDOWED_DIGEST_SIZE];
+            controllerHash.finish(written);
+            digestAccepted = received.size() == config.size && memcmp(digest, written, sizeof(written)) == 0 &&
+                             decoder.finish();
+            return digestAccepted;
+        });
+    receiver.begin((config.size + PART_SIZE - 1) / PART_SIZE, payload);
+
+    // The download delivers what arrived since the last call, like WiFiClient::available()
+    double now = 0.0;
+    uint32_t downloaded = 0;
+    WindowedStreamBuffer firmware(config.size, PART_SIZE, OTA_STREAM_BUFFERED_PARTS, [&](uint8_t *buffer, size_t length) {
+        const uint32_t arrived = std::min<uint32_t>(config.size, static_cast<uint32_t>(now * config.downloadRate));
+        const size_t count = std::min<size_t>(length, arrived - downloaded);
+        memcpy(buffer, image.data() + downloaded, count);
+        displayHash.update(buffer, count);
+        downloaded += count;
+        return count;
+    });
+
+    WindowedTransferSender sender(
+        config.size, PART_SIZE, payload,
+        [&](uint32_t offset, uint8_t *buffer, uint16_t length) {
+            // ControllerOTA waits for the download here, the loop below stands in for the time that passes
+            while (!firmware.read(offset, buffer, length)) {
+                if (firmware.load() == 0) {
+                    now += STEP_MS;
+                }
+            }
+            return true;
+        },
+        [&](const uint8_t *data, uint16_t length) {
+            if (clientTx.size() >= CLIENT_TX_BUFFERS)
+                return false;
+            clientTx.emplace_back(data, data + length);
+            return true;
+        },
+        [&](uint8_t *digest) { displayHash.finish(digest); });
+
+    double nextEvent = 0.0;
+    double serverBusyUntil = 0.0;
+    double nextPoll = 0.0;
+    WindowedTransferSender::State state = WindowedTransferSender::State::RUNNING;
+    while (state == WindowedTransferSender::State::RUNNING && now < 3600000.0) {
+        if (now >= nextEvent) {
+            nextEvent += config.interval;
+            for (int i = 0; i < config.packetsPerEvent && !clientTx.empty(); i++) {
+                if (serverRx.size() >= config.serverBuffers || chance(rng) < config.loss) {
+                    dropped++;
+                } else {
+                    serverRx.push_back(clientTx.front());
+                }
+                clientTx.pop_front();
+            }
+            while (!notifications.empty()) {
+                sender.onMessage(notifications.front().data(), notifications.front().size(), static_cast<unsigned long>(now));
+                notifications.pop_front();
+            }
+        }
+        if (now >= serverBusyUntil && !serverRx.empty()) {
+            const Packet packet = serverRx.front();
+            serverRx.pop_front();
+            if (packet[0] == DFU_WINDOWED_DATA) {
+                receiver.on_data(packet.data(), packet.size());
+            } else if (packet[0] == DFU_WINDOWED_END) {
+                receiver.on_end(packet.data(), packet.size());
+            } else if (packet[0] == DFU_WINDOWED_DIGEST) {
+                receiver.on_digest(packet.data(), packet.size());
+            }
+            serverBusyUntil = now + WRITE_HANDLER_MS + flashPending;
+            flashPending = 0.0;
+        }
+        if (now >= nextPoll) {
+            firmware.release(sender.getAcknowledgedParts());
+            firmware.load();
+            state = sender.poll(static_cast<unsigned long>(now));
+            nextPoll = now + 1.0; // delay(1) in ControllerOTA::runWindowedUpdate
+        }
+        now += STEP_MS;
+    }
+    const bool intact = state == WindowedTransferSender::State::FINISHED && received == image && decoded == expected;
+    return {now / 1000.0, intact, sender.getRetransmissions(), dropped, digestAccepted};
+}
+
+static double runSlow(const LinkConfig &config, uint32_t size) {
+    // A write with response is sent at the next connection event and answered at the one after
+    auto write = [&config](double now) {
+        const double event = (static_cast<int>(now / config.interval) + 1) * config.interval;
+        return event + config.interval + SLOW_DELAY_MS;
+    };
+    const uint32_t parts = (size + PART_SIZE - 1) / PART_SIZE;
+    double now = size / config.downloadRate;
+    for (uint32_t part = 0; part < parts; part++) {
+        const uint32_t length = std::min<uint32_t>(PART_SIZE, size - part * PART_SIZE);
+        const uint32_t packets = (length + SLOW_MTU - 1) / SLOW_MTU + 1; // data and footer
+        for (uint32_t i = 0; i < packets; i++) {
+            now = write(now);
+        }
+        // The controller writes the part before requesting the next one, the display polls every 50 ms
+        const double requested = now + length / config.flashRate + config.interval;
+        now = (static_cast<int>(requested / SLOW_DELAY_MS) + 1) * SLOW_DELAY_MS;
+    }
+    return now / 1000.0;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return file.good() || file.eof();
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [--size bytes] [--interval ms] [--packets n] [--buffer n] [--loss p] [--flash kB/s] "
+            "[--download kB/s] [--image file --expect file [--base file]]\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    LinkConfig config;
+    const char *imagePath = nullptr;
+    const char *expectPath = nullptr;
+    const char *basePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (strcmp(argv[i - 1], "--size") == 0) {
+            config.size = static_cast<uint32_t>(atol(value));
+        } else if (strcmp(argv[i - 1], "--interval") == 0) {
+            config.interval = atof(value);
+        } else if (strcmp(argv[i - 1], "--packets") == 0) {
+            config.packetsPerEvent = atoi(value);
+        } else if (strcmp(argv[i - 1], "--buffer") == 0) {
+            config.serverBuffers = static_cast<size_t>(atoi(value));
+        } else if (strcmp(argv[i - 1], "--loss") == 0) {
+            config.loss = atof(value);
+        } else if (strcmp(argv[i - 1], "--flash") == 0) {
+            config.flashRate = atof(value);
+        } else if (strcmp(argv[i - 1], "--download") == 0) {
+            config.downloadRate = atof(value);
+        } else if (strcmp(argv[i - 1], "--image") == 0) {
+            imagePath = value;
+        } else if (strcmp(argv[i - 1], "--expect") == 0) {
+            expectPath = value;
+        } else if (strcmp(argv[i - 1], "--base") == 0) {
+            basePath = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.size == 0 || config.interval <= 0.0 || config.packetsPerEvent <= 0 || config.flashRate <= 0.0 ||
+        config.downloadRate <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> image, expected, base;
+    if (imagePath != nullptr) {
+        if (expectPath == nullptr || !readFile(imagePath, image) || !readFile(expectPath, expected) ||
+            (basePath != nullptr && !readFile(basePath, base)) || image.empty()) {
+            usage(argv[0]);
+            return 1;
+        }
+        config.size = image.size();
+    } else {
+        // Random data behind the magic byte of a plain ESP image
+        image.resize(config.size);
+        std::mt19937 rng(2);
+        for (auto &byte : image) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        image[0] = IMAGE_PLAIN_MAGIC;
+        expected = image;
+    }
+
+    printf("Firmware %zu bytes sent as %u, %.1f ms interval, %d packets per event, %zu controller buffers, %.1f%% loss\n",
+           expected.size(), config.size, config.interval, config.packetsPerEvent, config.serverBuffers, config.loss * 100.0);
+    // The slow mode always sends the plain image
+    const double slow = runSlow(config, expected.size());
+    printf("slow       %8.1f s  %6.1f kB/s\n", slow, expected.size() / slow / 1000.0);
+    const WindowedResult windowed = runWindowed(config, image, expected, base);
+    printf("windowed   %8.1f s  %6.1f kB/s  %u packets sent again, %u dropped, image %s, digest %s\n",
+           windowed.duration, expected.size() / windowed.duration / 1000.0, windowed.retransmissions, windowed.dropped,
+           windowed.intact ? "intact" : "CORRUPTED", windowed.digestAccepted ? "accepted" : "REJECTED");
+    printf("speedup    %8.1fx\n", slow / windowed.duration);
+    return windowed.intact && windowed.digestAccepted ? 0 : 1;
+}
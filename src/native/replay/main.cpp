@@ -0,0 +1,285 @@
+// Offline replay of recorded shots (/h/*.dat) through BrewProcess, WeightEstimator, VolumetricRateCalculator and the
+// phase targets of profile.h, built by the native-replay environment:
+//   pio run -e native-replay
+//   .pio/build/native-replay/program --profile profile.json [--delay ms] [--time] [--adapt] shot.dat|directory...
+// The recorded pressure, pump flow and scale weight are fed on a VirtualClock in place of millis(), the same way
+// Controller::loop and Controller::onVolumetricMeasurement feed them on the display. Reports when every phase would end,
+// the predicted weight at the cutoff against the weight the cup actually reached, and the delay the auto adjustment
+// would store afterwards.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Clock/Clock.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <display/core/WeightEstimator.h>
+#include <display/core/process/BrewProcess.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+// Columns written by ShotHistoryPlugin::ShotSample::serialize
+struct ShotSample {
+    unsigned long t;
+    float targetTemperature;
+    float temperature;
+    float targetPressure;
+    float pressure;
+    float pumpFlow;
+    float targetFlow;
+    float puckFlow;
+    float weightFlow;
+    float weight;
+    float estimatedWeight;
+};
+
+struct ShotRecord {
+    std::string path;
+    std::string profileName;
+    std::vector<ShotSample> samples;
+};
+
+struct ReplayResult {
+    std::vector<float> phaseEnds; // s
+    bool finished = false;
+    float cutoff = 0.0f;          // s
+    float recordedStop = 0.0f;    // s, last sample with pump flow
+    double predictedWeight = 0.0; // at the cutoff
+    double finalWeight = 0.0;     // once the cup settled, PREDICTIVE_TIME after the cutoff
+    bool settled = false;         // the recording covers the settling time after the cutoff
+    double newDelay = 0.0;
+};
+
+constexpr float RECORDED_STOP_FLOW = 0.1f; // ml/s
+constexpr float STOP_MISMATCH_S = 0.3f;
+
+static bool loadProfile(const std::string &path, Profile &profile) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Cannot open profile %s\n", path.c_str());
+        return false;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    JsonDocument doc;
+    if (DeserializationError error = deserializeJson(doc, content.str())) {
+        fprintf(stderr, "Invalid profile %s: %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    if (!parseProfile(doc.as<JsonObject>(), profile) || profile.phases.empty()) {
+        fprintf(stderr, "Profile %s has no phases\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool loadShot(const std::string &path, ShotRecord &shot) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Cannot open shot %s\n", path.c_str());
+        return false;
+    }
+    shot.path = path;
+    std::string line;
+    // Header: version,profile name,start time
+    if (!std::getline(file, line) || line.rfind("1,", 0) != 0) {
+        fprintf(stderr, "Unsupported shot file %s\n", path.c_str());
+        return false;
+    }
+    shot.profileName = line.substr(2, line.rfind(',') - 2);
+    while (std::getline(file, line)) {
+        ShotSample s{};
+        if (sscanf(line.c_str(), "%lu,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", &s.t, &s.targetTemperature, &s.temperature,
+                   &s.targetPressure, &s.pressure, &s.pumpFlow, &s.targetFlow, &s.puckFlow, &s.weightFlow, &s.weight,
+                   &s.estimatedWeight) == 11) {
+            shot.samples.push_back(s);
+        }
+    }
+    if (shot.samples.empty()) {
+        fprintf(stderr, "Shot %s has no samples\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static double weightAt(const ShotRecord &shot, unsigned long t) {
+    double weight = 0.0;
+    for (const auto &sample : shot.samples) {
+        if (sample.t > t)
+            break;
+        weight = sample.weight;
+    }
+    return weight;
+}
+
+static VirtualClock replayClock;
+
+static ReplayResult replayShot(const Profile &profile, const ShotRecord &shot, ProcessTarget target, double brewDelay) {
+    ReplayResult result;
+    const unsigned long start = replayClock.millis();
+    auto setClock = [start](unsigned long t) { replayClock.setMillis(start + t); };
+
+    for (const auto &sample : shot.samples) {
+        if (sample.pumpFlow > RECORDED_STOP_FLOW)
+            result.recordedStop = static_cast<float>(sample.t) / 1000.0f;
+    }
+
+    BrewProcess process(profile, target, brewDelay);
+    WeightEstimator estimator;
+    const unsigned long end = shot.samples.back().t;
+    size_t next = 0;
+    const ShotSample *latest = &shot.samples.front();
+    for (unsigned long t = PROGRESS_INTERVAL; t <= end; t += PROGRESS_INTERVAL) {
+        // Scale notifications arrive between two progress ticks
+        for (; next < shot.samples.size() && shot.samples[next].t <= t; next++) {
+            latest = &shot.samples[next];
+            setClock(latest->t);
+            if (target == ProcessTarget::VOLUMETRIC) {
+                estimator.addMeasurement(latest->weight);
+                process.setWeightEstimator(&estimator);
+                process.updateVolume(estimator.getWeight());
+            }
+        }
+        setClock(t);
+        if (process.isComplete())
+            break;
+        process.updatePressure(latest->pressure);
+        process.updateFlow(latest->pumpFlow);
+        const unsigned int previousPhase = process.phaseIndex;
+        const bool wasActive = process.isActive();
+        process.progress();
+        for (unsigned int i = previousPhase; i < process.phaseIndex; i++) {
+            result.phaseEnds.push_back(static_cast<float>(t) / 1000.0f);
+        }
+        if (wasActive && !process.isActive()) {
+            result.phaseEnds.push_back(static_cast<float>(t) / 1000.0f);
+            result.finished = true;
+            result.cutoff = static_cast<float>(t) / 1000.0f;
+            result.predictedWeight = process.getPredictedVolume();
+        }
+    }
+    if (result.finished) {
+        const auto settledAt = static_cast<unsigned long>(result.cutoff * 1000.0f + PREDICTIVE_TIME);
+        result.settled = settledAt <= end;
+        result.finalWeight = weightAt(shot, settledAt);
+        result.newDelay = process.getNewDelayTime();
+    }
+    return result;
+}
+
+static void collectShots(const char *argument, std::vector<std::string> &paths) {
+    if (fs::is_directory(argument)) {
+        std::vector<std::string> found;
+        for (const auto &entry : fs::directory_iterator(argument)) {
+            if (entry.path().extension() == ".dat")
+                found.push_back(entry.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    } else {
+        paths.emplace_back(argument);
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s --profile profile.json [--delay ms] [--time] [--adapt] shot.dat|directory...\n", program);
+}
+
+int main(int argc, char **argv) {
+    Clock::set(&replayClock);
+    const char *profilePath = nullptr;
+    double brewDelay = 1000.0; // Settings default
+    bool adapt = false;
+    ProcessTarget target = ProcessTarget::VOLUMETRIC;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--profile") == 0 && hasValue) {
+            profilePath = argv[++i];
+        } else if (strcmp(argv[i], "--delay") == 0 && hasValue) {
+            brewDelay = strtod(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--time") == 0) {
+            target = ProcessTarget::TIME;
+        } else if (strcmp(argv[i], "--adapt") == 0) {
+            adapt = true;
+        } else if (argv[i][0] != '-') {
+            collectShots(argv[i], paths);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (profilePath == nullptr || paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Profile profile;
+    if (!loadProfile(profilePath, profile)) {
+        return 1;
+    }
+    const bool hasVolumetricTarget = std::any_of(profile.phases.begin(), profile.phases.end(),
+                                                 [](const Phase &phase) { return phase.hasVolumetricTarget(); });
+    if (target == ProcessTarget::VOLUMETRIC && !hasVolumetricTarget) {
+        fprintf(stderr, "Profile %s has no volumetric target, replaying with time targets\n", profile.label.c_str());
+        target = ProcessTarget::TIME;
+    }
+
+    printf("%-24s %-32s %15s %10s %8s %8s %9s\n", "shot", "phase ends (s)", "stop replay/rec", "predicted", "final", "error",
+           "new delay");
+    int replayed = 0;
+    int compared = 0;
+    double errorSum = 0.0;
+    double absErrorSum = 0.0;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (const auto &path : paths) {
+        ShotRecord shot;
+        if (!loadShot(path, shot)) {
+            continue;
+        }
+        if (shot.profileName != profile.label.c_str()) {
+            fprintf(stderr, "%s was brewed with %s, replaying with %s\n", path.c_str(), shot.profileName.c_str(),
+                    profile.label.c_str());
+        }
+        const ReplayResult result = replayShot(profile, shot, target, brewDelay);
+        replayed++;
+
+        std::string phaseEnds;
+        for (float phaseEnd : result.phaseEnds) {
+            char value[16];
+            snprintf(value, sizeof(value), "%s%.1f", phaseEnds.empty() ? "" : " ", phaseEnd);
+            phaseEnds += value;
+        }
+        const std::string name = fs::path(path).filename().string();
+        if (!result.finished) {
+            printf("%-24s %-32s %6s / %6.1f   not reached\n", name.c_str(), phaseEnds.c_str(), "-", result.recordedStop);
+            continue;
+        }
+        // The final weight only shows the prediction error if the recorded shot stopped at the same moment
+        const bool comparable = result.settled && fabsf(result.cutoff - result.recordedStop) <= STOP_MISMATCH_S;
+        const double error = result.finalWeight - result.predictedWeight;
+        printf("%-24s %-32s %6.1f / %6.1f %8.1f g %6.1f g %+6.1f g%s %6.0f ms\n", name.c_str(), phaseEnds.c_str(),
+               result.cutoff, result.recordedStop, result.predictedWeight, result.finalWeight, error, comparable ? " " : "*",
+               result.newDelay);
+        if (target == ProcessTarget::VOLUMETRIC && comparable) {
+            compared++;
+            errorSum += error;
+            absErrorSum += fabs(error);
+        }
+        if (adapt && target == ProcessTarget::VOLUMETRIC) {
+            brewDelay = std::clamp(result.newDelay, 0.0, PREDICTIVE_TIME);
+        }
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    printf("\n%d shots replayed in %.3f s (%.0f shots/s)", replayed, elapsed, elapsed > 0.0 ? replayed / elapsed : 0.0);
+    if (compared > 0) {
+        printf(", cutoff error over %d comparable shots: mean %+.2f g, mean absolute %.2f g", compared, errorSum / compared,
+               absErrorSum / compared);
+    }
+    printf("\n* the recorded shot stopped at a different time or ended before the cup settled, error not comparable\n");
+    return replayed > 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#ifndef REPLAY_ARDUINO_H
+#define REPLAY_ARDUINO_H
+
+// Host replacement of the Arduino core for the shot replay, only what the display process and profile code use.
+// Time comes from the simulated clock in ArduinoStub.h so the replay controls it.
+
+#include <ArduinoStub.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class String {
+  public:
+    String() = default;
+    String(const char *str) : value(str != nullptr ? str : "") {}
+    String(const std::string &str) : value(str) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned int number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    explicit String(float number, unsigned int decimals = 2) : String(static_cast<double>(number), decimals) {}
+    explicit String(double number, unsigned int decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+        value = buffer;
+    }
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+
+    bool concat(const char *str) {
+        if (str != nullptr)
+            value += str;
+        return true;
+    }
+    bool concat(const String &str) { return concat(str.c_str()); }
+    bool concat(char c) {
+        value += c;
+        return true;
+    }
+    String &operator+=(const String &str) {
+        concat(str);
+        return *this;
+    }
+    String &operator+=(const char *str) {
+        concat(str);
+        return *this;
+    }
+    String &operator+=(char c) {
+        concat(c);
+        return *this;
+    }
+
+    bool operator==(const String &other) const { return value == other.value; }
+    bool operator==(const char *other) const { return value == (other != nullptr ? other : ""); }
+    bool operator!=(const String &other) const { return !(*this == other); }
+    bool operator!=(const char *other) const { return !(*this == other); }
+    bool operator<(const String &other) const { return value < other.value; }
+    char operator[](unsigned int index) const { return index < value.length() ? value[index] : 0; }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t index = value.find(c, from);
+        return index == std::string::npos ? -1 : static_cast<int>(index);
+    }
+    int lastIndexOf(char c) const {
+        size_t index = value.rfind(c);
+        return index == std::string::npos ? -1 : static_cast<int>(index);
+    }
+    String substring(unsigned int from) const { return from < value.length() ? String(value.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to)
+            std::swap(from, to);
+        return from < value.length() ? String(value.substr(from, to - from)) : String();
+    }
+    bool startsWith(const String &prefix) const { return value.rfind(prefix.value, 0) == 0; }
+    bool endsWith(const String &suffix) const {
+        return value.length() >= suffix.value.length() &&
+               value.compare(value.length() - suffix.value.length(), suffix.value.length(), suffix.value) == 0;
+    }
+    long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(value.c_str(), nullptr); }
+
+  private:
+    std::string value;
+};
+
+// Result type of concatenations on the Arduino core, referenced by the ArduinoJson string adapters
+class StringSumHelper : public String {
+  public:
+    using String::String;
+    StringSumHelper(const String &str) : String(str) {}
+};
+
+inline StringSumHelper operator+(const String &lhs, const String &rhs) {
+    StringSumHelper result(lhs);
+    result += rhs;
+    return result;
+}
+
+inline StringSumHelper operator+(const String &lhs, const char *rhs) { return lhs + String(rhs); }
+inline StringSumHelper operator+(const char *lhs, const String &rhs) { return String(lhs) + rhs; }
+
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+#endif // REPLAY_ARDUINO_H
@@ -0,0 +1,6 @@
+#ifndef REPLAY_NIMBLEDEVICE_H
+#define REPLAY_NIMBLEDEVICE_H
+
+// NimBLEComm.h is only needed for the shared protocol types on the host, the bluetooth stack itself is never used
+
+#endif // REPLAY_NIMBLEDEVICE_H
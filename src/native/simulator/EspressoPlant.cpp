@@ -0,0 +1,62 @@
+#include "EspressoPlant.h"
+#include <algorithm>
+#include <cmath>
+
+EspressoPlant::EspressoPlant(const EspressoPlantConfig &config, unsigned int seed)
+    : config(config), rng(seed), noise(0.0f, config.pressureNoise) {
+    reset(config.ambientTemp);
+}
+
+void EspressoPlant::reset(float temperature) {
+    waterTemp = temperature;
+    sensorTemp = temperature;
+    elementPowerW = 0.0f;
+    pressure = 0.0f;
+    pumpFlow = 0.0f;
+    puckFlow = 0.0f;
+    absorbedVolume = 0.0f;
+    extractionTime = 0.0f;
+    cupVolume = 0.0f;
+}
+
+float EspressoPlant::getPuckConductance() const {
+    if (absorbedVolume < config.headspaceVolume) {
+        return config.headspaceConductance;
+    }
+    return config.puckConductance * (1.0f + config.puckErosionPerSecond * extractionTime);
+}
+
+void EspressoPlant::step(float dt, float heaterDuty, float pumpPower, bool valveOpen) {
+    const float power = std::clamp(pumpPower, 0.0f, 100.0f) / 100.0f;
+    const float *curve = config.pumpCurve;
+    pumpFlow = power * std::max(curve[0] * pressure * pressure + curve[1] * pressure + curve[2], 0.0f);
+
+    // Hydraulics
+    float outflow = std::max(pressure - config.opvPressure, 0.0f) * config.opvConductance;
+    puckFlow = 0.0f;
+    if (valveOpen) {
+        puckFlow = getPuckConductance() * sqrtf(std::max(pressure, 0.0f));
+        outflow += puckFlow;
+        if (absorbedVolume < config.headspaceVolume) {
+            absorbedVolume += puckFlow * dt;
+        } else {
+            extractionTime += dt;
+            cupVolume += puckFlow * dt;
+        }
+        pressure += (pumpFlow - outflow) * dt / config.compliance;
+    } else if (pumpFlow > 0.0f) {
+        pressure += (pumpFlow - outflow) * dt / config.compliance;
+    } else {
+        pressure -= config.valveReleaseRate * dt;
+    }
+    pressure = std::max(pressure, 0.0f);
+
+    // Boiler, the pumped water enters at the inlet temperature
+    elementPowerW += (std::clamp(heaterDuty, 0.0f, 1.0f) * config.heaterPowerW - elementPowerW) * dt / config.elementTimeConstantS;
+    const float loadW = pumpFlow * 4.186f * (waterTemp - config.inletTemp);
+    const float lossW = config.lossWK * (waterTemp - config.ambientTemp);
+    waterTemp += (elementPowerW - loadW - lossW) * dt / config.boilerHeatCapacityJK;
+    sensorTemp += (waterTemp - sensorTemp) * dt / config.sensorTimeConstantS;
+}
+
+float EspressoPlant::getMeasuredPressure() { return std::max(pressure + noise(rng), 0.0f); }
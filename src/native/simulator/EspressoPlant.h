@@ -0,0 +1,67 @@
+#ifndef ESPRESSOPLANT_H
+#define ESPRESSOPLANT_H
+
+#include <random>
+
+// Lumped model of a single boiler machine with a vibratory pump, used to run the controllers in closed loop on the host.
+// Units follow the firmware: bar, ml/s, °C and actuator commands in percent.
+struct EspressoPlantConfig {
+    // Boiler and heating element
+    float heaterPowerW = 1200.0f;
+    float boilerHeatCapacityJK = 900.0f; // water and boiler body
+    float elementTimeConstantS = 8.0f;
+    float sensorTimeConstantS = 4.0f;
+    float lossWK = 1.2f;
+    float ambientTemp = 25.0f;
+    float inletTemp = 25.0f;
+
+    // Pump flow at full power: a * P^2 + b * P + c
+    float pumpCurve[3] = {-0.01f, -0.5f, 10.6f};
+    float compliance = 0.66f;       // ml/bar, boiler and hoses
+    float opvPressure = 12.0f;      // over pressure valve
+    float opvConductance = 4.0f;    // ml/s/bar above the OPV pressure
+    float valveReleaseRate = 20.0f; // bar/s while the three way valve vents the boiler
+
+    // Puck, flow = conductance * sqrt(P)
+    float headspaceVolume = 12.0f;      // ml absorbed before the puck restricts the flow
+    float headspaceConductance = 3.0f;  // ml/s/sqrt(bar)
+    float puckConductance = 0.6f;       // ml/s/sqrt(bar) once saturated
+    float puckErosionPerSecond = 0.01f; // relative conductance increase per second of extraction
+
+    float pressureNoise = 0.02f; // bar, sensor standard deviation
+};
+
+class EspressoPlant {
+  public:
+    explicit EspressoPlant(const EspressoPlantConfig &config = EspressoPlantConfig(), unsigned int seed = 1);
+
+    void reset(float temperature);
+    // heaterDuty 0-1, pumpPower 0-100, valveOpen routes the water through the puck
+    void step(float dt, float heaterDuty, float pumpPower, bool valveOpen);
+
+    float getMeasuredPressure();
+    float getMeasuredTemperature() const { return sensorTemp; }
+    float getPressure() const { return pressure; }
+    float getWaterTemperature() const { return waterTemp; }
+    float getPumpFlow() const { return pumpFlow; }
+    float getPuckFlow() const { return puckFlow; }
+    float getPuckConductance() const;
+    float getCupVolume() const { return cupVolume; }
+
+  private:
+    EspressoPlantConfig config;
+    std::mt19937 rng;
+    std::normal_distribution<float> noise;
+
+    float waterTemp = 25.0f;
+    float elementPowerW = 0.0f;
+    float sensorTemp = 25.0f;
+    float pressure = 0.0f;
+    float pumpFlow = 0.0f;
+    float puckFlow = 0.0f;
+    float absorbedVolume = 0.0f;
+    float extractionTime = 0.0f;
+    float cupVolume = 0.0f;
+};
+
+#endif // ESPRESSOPLANT_H
@@ -0,0 +1,193 @@
+#include "Simulation.h"
+#include <Clock/Clock.h>
+#include <algorithm>
+#include <cmath>
+
+constexpr float HYDRAULIC_SETTLING_RATIO = 0.05f; // of the target
+constexpr float PRESSURE_SETTLING_BAND = 0.2f;    // bar, minimum band
+constexpr float FLOW_SETTLING_BAND = 0.2f;        // ml/s, minimum band
+constexpr float TEMPERATURE_SETTLING_BAND = 0.5f; // °C
+
+SimulatedHeater::SimulatedHeater(float Kp, float Ki, float Kd, float flowFeedForwardGain)
+    : flowFeedForward(flowFeedForwardGain), pid(&output, &temperature, &setpoint) {
+    pid.setSamplingFrequency(TUNER_OUTPUT_SPAN / 1000.0f);
+    pid.setCtrlOutputLimits(0.0f, TUNER_OUTPUT_SPAN);
+    pid.activateSetPointFilter(false);
+    pid.activateFeedForward(false);
+    pid.reset();
+    pid.setControllerPIDGains(Kp, Ki, Kd, 0.0f);
+    pid.reset();
+}
+
+void SimulatedHeater::loop(float measuredTemperature) {
+    temperature = measuredTemperature;
+    if (setpoint <= 0.0f) {
+        pid.setMode(SimplePID::Control::manual);
+        duty = 0.0f;
+        return;
+    }
+    pid.setMode(SimplePID::Control::automatic);
+    pid.setDisturbanceFeedForward(flowFeedForward.getOutput(pumpFlow, setpoint) * TUNER_OUTPUT_SPAN);
+    flowFeedForward.learn(pumpFlow, setpoint, temperature, Clock::get().millis());
+    if (pid.update()) {
+        duty = std::clamp(output / TUNER_OUTPUT_SPAN, 0.0f, 1.0f);
+    }
+}
+
+SimulatedPump::SimulatedPump()
+    : controller(DIMMED_PUMP_UPDATE_INTERVAL_MS / 1000.0f, &ctrlPressure, &ctrlFlow, &currentPressure, &controllerPower,
+                 &valveStatus) {}
+
+void SimulatedPump::setPower(float setpoint) {
+    ctrlPressure = setpoint > 0 ? 20.0f : 0.0f;
+    mode = PressureController::ControlMode::POWER;
+    power = std::clamp(setpoint, 0.0f, 100.0f);
+    controllerPower = power;
+    if (power == 0.0f) {
+        currentFlow = 0.0f;
+    }
+}
+
+void SimulatedPump::setPressureTarget(float targetPressure, float flowLimit) {
+    mode = PressureController::ControlMode::PRESSURE;
+    ctrlFlow = flowLimit;
+    ctrlPressure = targetPressure;
+    controller.setFlowLimit(flowLimit);
+}
+
+void SimulatedPump::setFlowTarget(float targetFlow, float pressureLimit) {
+    mode = PressureController::ControlMode::FLOW;
+    ctrlFlow = targetFlow;
+    ctrlPressure = pressureLimit;
+    controller.setPressureLimit(pressureLimit);
+}
+
+void SimulatedPump::loop(float measuredPressure) {
+    currentPressure = measuredPressure;
+    controller.update(mode);
+    if (mode != PressureController::ControlMode::POWER) {
+        power = controllerPower;
+    }
+    currentFlow = 0.1f * (controller.getPumFlowRate() * 1000000.0f) + 0.9f * currentFlow;
+}
+
+namespace {
+
+class MetricAccumulator {
+  public:
+    void begin(float target, float initial, float band) {
+        metrics = LoopMetrics();
+        metrics.target = target;
+        rising = target >= initial;
+        this->band = band;
+        lastOutside = 0.0f;
+        effortSum = 0.0f;
+        elapsed = 0.0f;
+    }
+
+    void add(float value, float actuator, float dt) {
+        elapsed += dt;
+        const float error = value - metrics.target;
+        metrics.overshoot = std::max(metrics.overshoot, rising ? error : -error);
+        metrics.iae += fabsf(error) * dt;
+        effortSum += actuator * dt;
+        if (fabsf(error) > band) {
+            lastOutside = elapsed;
+        }
+    }
+
+    LoopMetrics result() const {
+        LoopMetrics result = metrics;
+        result.settlingTime = lastOutside >= elapsed ? -1.0f : lastOutside;
+        result.effort = elapsed > 0.0f ? effortSum / elapsed : 0.0f;
+        return result;
+    }
+
+  private:
+    LoopMetrics metrics;
+    bool rising = true;
+    float band = 0.0f;
+    float lastOutside = 0.0f;
+    float effortSum = 0.0f;
+    float elapsed = 0.0f;
+};
+
+} // namespace
+
+// Shared by all scenarios so time keeps moving forward between runs, like on the machine
+static VirtualClock simulationClock;
+
+ScenarioResult runScenario(const Scenario &scenario, const SimulationConfig &config) {
+    Clock::set(&simulationClock);
+    EspressoPlant plant(config.plant);
+    SimulatedHeater heater(config.Kp, config.Ki, config.Kd, config.flowFeedForwardGain);
+    SimulatedPump pump;
+    pump.setPumpFlowCoeff(config.pumpOneBarFlow, config.pumpNineBarFlow);
+
+    constexpr float dt = SIMULATION_TICK_MS / 1000.0f;
+    int tick = 0;
+    auto step = [&](bool valve) {
+        if (tick % (DIMMED_PUMP_UPDATE_INTERVAL_MS / SIMULATION_TICK_MS) == 0) {
+            pump.loop(plant.getMeasuredPressure());
+        }
+        if (tick % (HEATER_UPDATE_INTERVAL_MS / SIMULATION_TICK_MS) == 0) {
+            heater.setPumpFlow(pump.getPumpFlow());
+            heater.loop(plant.getMeasuredTemperature());
+        }
+        plant.step(dt, heater.getDuty(), pump.getPower(), valve);
+        simulationClock.advanceMillis(SIMULATION_TICK_MS);
+        tick++;
+    };
+
+    // Let the boiler settle at the starting temperature with the machine idle
+    plant.reset(scenario.startTemperature);
+    heater.setSetpoint(scenario.startTemperature);
+    pump.setPower(0.0f);
+    for (int i = 0; i < static_cast<int>(SIMULATION_SETTLE_S / dt); i++) {
+        step(false);
+    }
+
+    std::vector<PhaseResult> results;
+    float temperatureSag = 0.0f;
+    for (const auto &phase : scenario.phases) {
+        pump.setValveState(phase.valve);
+        heater.setSetpoint(phase.temperature);
+        float hydraulicValue = 0.0f;
+        float band = 0.0f;
+        switch (phase.target) {
+        case PumpTarget::PRESSURE:
+            pump.setPressureTarget(phase.value, phase.limit);
+            hydraulicValue = plant.getPressure();
+            band = std::max(PRESSURE_SETTLING_BAND, HYDRAULIC_SETTLING_RATIO * phase.value);
+            break;
+        case PumpTarget::FLOW:
+            pump.setFlowTarget(phase.value, phase.limit);
+            hydraulicValue = plant.getPumpFlow();
+            band = std::max(FLOW_SETTLING_BAND, HYDRAULIC_SETTLING_RATIO * phase.value);
+            break;
+        case PumpTarget::POWER:
+            pump.setPower(phase.value);
+            break;
+        }
+
+        MetricAccumulator hydraulic, thermal;
+        hydraulic.begin(phase.value, hydraulicValue, band);
+        thermal.begin(phase.temperature, plant.getWaterTemperature(), TEMPERATURE_SETTLING_BAND);
+        for (int i = 0; i < static_cast<int>(phase.duration / dt); i++) {
+            step(phase.valve);
+            const float value = phase.target == PumpTarget::FLOW ? plant.getPumpFlow() : plant.getPressure();
+            hydraulic.add(value, pump.getPower(), dt);
+            thermal.add(plant.getWaterTemperature(), heater.getDuty() * 100.0f, dt);
+            if (plant.getPumpFlow() > FLOW_FF_FLOW_THRESHOLD) {
+                temperatureSag = std::max(temperatureSag, phase.temperature - plant.getWaterTemperature());
+            }
+        }
+        results.push_back({phase.name, phase.target, hydraulic.result(), thermal.result()});
+    }
+
+    pump.setPower(0.0f);
+    for (int i = 0; i < static_cast<int>(SIMULATION_IDLE_S / dt); i++) {
+        step(false);
+    }
+    return {results, temperatureSag, heater.getFlowFeedForwardGain()};
+}
@@ -0,0 +1,117 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "EspressoPlant.h"
+#include <FlowFeedForward/FlowFeedForward.h>
+#include <PressureController/PressureController.h>
+#include <SimplePID/SimplePID.h>
+#include <vector>
+
+// Keep in sync with Heater.h and DimmedPump.h
+constexpr float TUNER_OUTPUT_SPAN = 1000.0f;
+constexpr int HEATER_UPDATE_INTERVAL_MS = 250;
+constexpr int DIMMED_PUMP_UPDATE_INTERVAL_MS = 30;
+
+constexpr int SIMULATION_TICK_MS = 10; // ControlScheduler tick
+constexpr float SIMULATION_SETTLE_S = 300.0f;
+constexpr float SIMULATION_IDLE_S = 5.0f; // pump off after the last phase, ends the shot for the feedforward learning
+
+// Runs SimplePID and the flow feedforward the way Heater::setupPid and Heater::loopPid do, without the hardware
+class SimulatedHeater {
+  public:
+    SimulatedHeater(float Kp, float Ki, float Kd, float flowFeedForwardGain);
+
+    void setSetpoint(float setpoint) { this->setpoint = setpoint; }
+    void setPumpFlow(float pumpFlow) { this->pumpFlow = pumpFlow; }
+    void loop(float measuredTemperature);
+    float getDuty() const { return duty; }
+    float getFlowFeedForwardGain() const { return flowFeedForward.getGain(); }
+
+  private:
+    float output = 0.0f;
+    float temperature = 0.0f;
+    float setpoint = 0.0f;
+    float pumpFlow = 0.0f;
+    float duty = 0.0f;
+    FlowFeedForward flowFeedForward;
+    SimplePID pid;
+};
+
+// Runs PressureController the way DimmedPump does, without the phase control
+class SimulatedPump {
+  public:
+    SimulatedPump();
+
+    void setPower(float setpoint);
+    void setPressureTarget(float targetPressure, float flowLimit);
+    void setFlowTarget(float targetFlow, float pressureLimit);
+    void setValveState(bool open) { valveStatus = open; }
+    void setPumpFlowCoeff(float oneBarFlow, float nineBarFlow) { controller.setPumpFlowCoeff(oneBarFlow, nineBarFlow); }
+    void loop(float measuredPressure);
+    float getPower() const { return power; }
+    float getPumpFlow() const { return currentFlow; }
+
+  private:
+    PressureController::ControlMode mode = PressureController::ControlMode::POWER;
+    float power = 0.0f;
+    float controllerPower = 0.0f;
+    float ctrlPressure = 0.0f;
+    float ctrlFlow = 0.0f;
+    float currentPressure = 0.0f;
+    float currentFlow = 0.0f;
+    int valveStatus = 0;
+    PressureController controller;
+};
+
+enum class PumpTarget { POWER, PRESSURE, FLOW };
+
+struct ScenarioPhase {
+    const char *name;
+    float duration; // s
+    bool valve;
+    PumpTarget target;
+    float value; // power in percent, pressure in bar or flow in ml/s depending on the target
+    float limit; // flow limit for pressure targets, pressure limit for flow targets, 0 = none
+    float temperature;
+};
+
+struct Scenario {
+    const char *name;
+    float startTemperature; // the boiler settles there before the first phase
+    std::vector<ScenarioPhase> phases;
+};
+
+struct LoopMetrics {
+    float target = 0.0f;
+    float overshoot = 0.0f;    // beyond the target in the direction of the step
+    float settlingTime = 0.0f; // until the error stays within the band, negative if it never does
+    float iae = 0.0f;          // integrated absolute error
+    float effort = 0.0f;       // mean actuator command in percent
+};
+
+struct PhaseResult {
+    const char *name;
+    PumpTarget target;
+    LoopMetrics hydraulic; // only meaningful for pressure and flow targets
+    LoopMetrics thermal;
+};
+
+struct ScenarioResult {
+    std::vector<PhaseResult> phases;
+    float temperatureSag;      // deepest drop of the boiler water below the phase temperature while pumping
+    float flowFeedForwardGain; // learned from the shot, the next run starts from it
+};
+
+struct SimulationConfig {
+    float Kp = 58.397f;
+    float Ki = 1.027f;
+    float Kd = 249.055f;
+    float flowFeedForwardGain = 1.0f;
+    float pumpOneBarFlow = 10.205f; // pump model the controller is configured with
+    float pumpNineBarFlow = 5.521f;
+    EspressoPlantConfig plant;
+};
+
+ScenarioResult runScenario(const Scenario &scenario, const SimulationConfig &config);
+
+#endif // SIMULATION_H
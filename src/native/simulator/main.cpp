@@ -0,0 +1,129 @@
+// Closed loop regression benchmark of the heater and pump controllers against EspressoPlant, built by the
+// native-sim environment:
+//   pio run -e native-sim -t exec
+//   .pio/build/native-sim/program [scenario] [--pid Kp,Ki,Kd] [--ff gain] [--pump oneBar,nineBar] [--learn shots]
+// Prints overshoot, settling time, integrated absolute error and actuator effort for every phase of the
+// standard scenarios, and the deepest temperature sag of every shot. Temperatures are the boiler water temperature, not
+// the lagging sensor reading. --ff 0 turns the flow feedforward off to compare the sag without it.
+// --learn repeats every scenario as a series of shots, each starting from the feedforward gain the previous one learned.
+
+#include "Simulation.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const std::vector<Scenario> SCENARIOS = {
+    {"flat9",
+     93.0f,
+     {
+         {"preinfusion", 8.0f, true, PumpTarget::PRESSURE, 3.0f, 0.0f, 93.0f},
+         {"extraction", 27.0f, true, PumpTarget::PRESSURE, 9.0f, 0.0f, 93.0f},
+     }},
+    {"flow",
+     93.0f,
+     {
+         {"fill", 6.0f, true, PumpTarget::FLOW, 4.0f, 3.0f, 93.0f},
+         {"extraction", 30.0f, true, PumpTarget::FLOW, 2.0f, 9.0f, 93.0f},
+     }},
+    {"blooming",
+     93.0f,
+     {
+         {"fill", 8.0f, true, PumpTarget::PRESSURE, 3.0f, 0.0f, 93.0f},
+         {"bloom", 10.0f, true, PumpTarget::POWER, 0.0f, 0.0f, 93.0f},
+         {"extraction", 20.0f, true, PumpTarget::PRESSURE, 9.0f, 0.0f, 93.0f},
+     }},
+    {"steam",
+     93.0f,
+     {
+         {"heat-up", 120.0f, false, PumpTarget::POWER, 0.0f, 0.0f, 145.0f},
+     }},
+};
+
+static const char *targetUnit(PumpTarget target) {
+    switch (target) {
+    case PumpTarget::PRESSURE:
+        return "bar";
+    case PumpTarget::FLOW:
+        return "ml/s";
+    default:
+        return "";
+    }
+}
+
+static void printMetrics(const char *scenario, const char *phase, const char *variable, const char *unit,
+                         const LoopMetrics &metrics) {
+    char settling[16];
+    if (metrics.settlingTime < 0.0f) {
+        snprintf(settling, sizeof(settling), "%10s", "-");
+    } else {
+        snprintf(settling, sizeof(settling), "%8.2f s", metrics.settlingTime);
+    }
+    printf("%-10s %-12s %-12s %7.2f %-5s %9.2f %s %10.2f %7.1f %%\n", scenario, phase, variable, metrics.target, unit,
+           metrics.overshoot, settling, metrics.iae, metrics.effort);
+}
+
+static bool parsePair(const char *value, float &a, float &b) { return sscanf(value, "%f,%f", &a, &b) == 2; }
+
+int main(int argc, char **argv) {
+    SimulationConfig config;
+    const char *selected = nullptr;
+    int shots = 1;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--pid") == 0 && hasValue) {
+            if (sscanf(argv[++i], "%f,%f,%f", &config.Kp, &config.Ki, &config.Kd) != 3) {
+                fprintf(stderr, "--pid expects Kp,Ki,Kd\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ff") == 0 && hasValue) {
+            config.flowFeedForwardGain = strtof(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--pump") == 0 && hasValue) {
+            if (!parsePair(argv[++i], config.pumpOneBarFlow, config.pumpNineBarFlow)) {
+                fprintf(stderr, "--pump expects the flow at 1 and 9 bar\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--learn") == 0 && hasValue) {
+            shots = std::max(atoi(argv[++i]), 1);
+        } else if (argv[i][0] != '-') {
+            selected = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [scenario] [--pid Kp,Ki,Kd] [--ff gain] [--pump oneBar,nineBar] [--learn shots]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (selected != nullptr && std::none_of(SCENARIOS.begin(), SCENARIOS.end(),
+                                            [&](const Scenario &scenario) { return strcmp(selected, scenario.name) == 0; })) {
+        fprintf(stderr, "Unknown scenario %s\n", selected);
+        return 1;
+    }
+
+    printf("%-10s %-12s %-12s %13s %11s %10s %10s %9s\n", "scenario", "phase", "variable", "target", "overshoot",
+           "settling", "IAE", "effort");
+    for (const auto &scenario : SCENARIOS) {
+        if (selected != nullptr && strcmp(selected, scenario.name) != 0) {
+            continue;
+        }
+        SimulationConfig shotConfig = config;
+        for (int shot = 1; shot <= shots; shot++) {
+            const ScenarioResult result = runScenario(scenario, shotConfig);
+            for (const auto &phase : result.phases) {
+                if (phase.target != PumpTarget::POWER) {
+                    const char *variable = phase.target == PumpTarget::FLOW ? "pump flow" : "pressure";
+                    printMetrics(scenario.name, phase.name, variable, targetUnit(phase.target), phase.hydraulic);
+                }
+                printMetrics(scenario.name, phase.name, "temperature", "°C", phase.thermal);
+            }
+            printf("%-10s temperature sag %.2f °C, flow feedforward gain %.3f", scenario.name, result.temperatureSag,
+                   shotConfig.flowFeedForwardGain);
+            if (shots > 1) {
+                printf(", learned %.3f after shot %d", result.flowFeedForwardGain, shot);
+            }
+            printf("\n");
+            shotConfig.flowFeedForwardGain = result.flowFeedForwardGain;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Autotune relay experiment on a first order plus dead time boiler, run with: pio test -e native -f test_autotune
+
+#include <Autotune/Autotune.h>
+#include <cmath>
+#include <deque>
+#include <unity.h>
+
+constexpr float DT = 0.25f;
+constexpr float AMBIENT = 25.0f;
+constexpr float TARGET = 93.0f;
+// Static gain chosen so that the target is held at half power and the relay oscillation is symmetric
+constexpr float GAIN = 2.0f * (TARGET - AMBIENT);
+constexpr float TIME_CONSTANT = 120.0f;
+constexpr float DELAY = 10.0f;
+
+void setUp() {}
+void tearDown() {}
+
+// Boiler as a first order lag behind a transport delay, power from 0 to 1
+struct Boiler {
+    float temperature = AMBIENT;
+    std::deque<float> delayed = std::deque<float>(static_cast<size_t>(DELAY / DT), 0.0f);
+
+    float step(float power) {
+        delayed.push_back(power);
+        const float heating = delayed.front();
+        delayed.pop_front();
+        temperature += (AMBIENT + GAIN * heating - temperature) * DT / TIME_CONSTANT;
+        return temperature;
+    }
+};
+
+// Phase crossover of K e^(-Ls) / (1 + tau s), atan(w tau) + w L = pi, solved by bisection
+static float crossoverFrequency() {
+    float low = 0.0f, high = static_cast<float>(M_PI) / DELAY;
+    for (int i = 0; i < 60; i++) {
+        const float w = (low + high) / 2.0f;
+        if (atanf(w * TIME_CONSTANT) + w * DELAY < static_cast<float>(M_PI)) {
+            low = w;
+        } else {
+            high = w;
+        }
+    }
+    return (low + high) / 2.0f;
+}
+
+// Runs the experiment until it ends or the time runs out, returns the elapsed time
+static float run(Autotune &autotune, Boiler &boiler, float seconds) {
+    float time = 0.0f;
+    while (!autotune.isFinished() && time < seconds) {
+        autotune.update(boiler.temperature, time);
+        boiler.step(autotune.getOutput());
+        time += DT;
+    }
+    return time;
+}
+
+static void setupRelay(Autotune &autotune) {
+    autotune.reset();
+    autotune.setMethod(Autotune::Method::RELAY);
+    autotune.setRelay(TARGET, 0.2f, 4);
+}
+
+void test_heats_below_the_target() {
+    Autotune autotune;
+    setupRelay(autotune);
+    autotune.update(AMBIENT, 0.0f);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, autotune.getOutput());
+    TEST_ASSERT_EQUAL_INT(0, autotune.getProgress());
+    TEST_ASSERT_FALSE(autotune.isFinished());
+}
+
+void test_relay_finds_the_ultimate_gain_and_period() {
+    Autotune autotune;
+    Boiler boiler;
+    setupRelay(autotune);
+    run(autotune, boiler, 3600.0f);
+    TEST_ASSERT_TRUE(autotune.isFinished());
+    TEST_ASSERT_FALSE(autotune.hasFailed());
+    TEST_ASSERT_EQUAL_INT(100, autotune.getProgress());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, autotune.getOutput());
+
+    // The describing function is an approximation, a quarter off is still a usable starting point
+    const float w = crossoverFrequency();
+    const float ultimateGain = sqrtf(1.0f + powf(w * TIME_CONSTANT, 2)) / GAIN;
+    const float ultimatePeriod = 2.0f * static_cast<float>(M_PI) / w;
+    TEST_ASSERT_FLOAT_WITHIN(0.25f * ultimateGain, ultimateGain, autotune.getSystemGain());
+    TEST_ASSERT_FLOAT_WITHIN(0.25f / ultimatePeriod, 1.0f / ultimatePeriod, autotune.getCrossoverFreq());
+
+    // Ziegler-Nichols with the default tuning goal
+    const float ku = autotune.getSystemGain();
+    const float tu = 1.0f / autotune.getCrossoverFreq();
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.4f * ku, autotune.getKp());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.4f * ku / (tu / 2.0f), autotune.getKi());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.4f * ku * tu / 8.0f * 0.35f, autotune.getKd());
+}
+
+void test_aggressive_goal_raises_the_gain() {
+    Autotune conservative, aggressive;
+    Boiler conservativeBoiler, aggressiveBoiler;
+    setupRelay(conservative);
+    setupRelay(aggressive);
+    conservative.setTuningGoal(0.0f);
+    aggressive.setTuningGoal(100.0f);
+    run(conservative, conservativeBoiler, 3600.0f);
+    run(aggressive, aggressiveBoiler, 3600.0f);
+    TEST_ASSERT_TRUE(aggressive.getKp() > conservative.getKp());
+}
+
+void test_fails_when_the_target_is_unreachable() {
+    Autotune autotune;
+    Boiler boiler;
+    setupRelay(autotune);
+    autotune.setRelay(AMBIENT + GAIN + 10.0f, 0.2f, 4);
+    autotune.setRelayTimeOut(600.0f);
+    const float elapsed = run(autotune, boiler, 3600.0f);
+    TEST_ASSERT_TRUE(autotune.isFinished());
+    TEST_ASSERT_TRUE(autotune.hasFailed());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 600.0f, elapsed);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, autotune.getOutput());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_heats_below_the_target);
+    RUN_TEST(test_relay_finds_the_ultimate_gain_and_period);
+    RUN_TEST(test_aggressive_goal_raises_the_gain);
+    RUN_TEST(test_fails_when_the_target_is_unreachable);
+    return UNITY_END();
+}
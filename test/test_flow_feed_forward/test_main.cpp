@@ -0,0 +1,103 @@
+// FlowFeedForward heat load and gain learning, run with: pio test -e native -f test_flow_feed_forward
+
+#include <FlowFeedForward/FlowFeedForward.h>
+#include <unity.h>
+
+constexpr unsigned long HEATER_INTERVAL_MS = 250;
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds one shot at a constant flow, the sag is setpoint minus temperature, then one idle sample to end it.
+// Returns whether the gain was learned and advances the time.
+static bool runShot(FlowFeedForward &feedForward, unsigned long &now, unsigned long durationMs, float sag,
+                    float setpoint = 93.0f) {
+    bool learned = false;
+    for (unsigned long t = 0; t < durationMs; t += HEATER_INTERVAL_MS) {
+        learned = feedForward.learn(2.0f, setpoint, setpoint - sag, now) || learned;
+        now += HEATER_INTERVAL_MS;
+    }
+    TEST_ASSERT_FALSE_MESSAGE(learned, "learned while the pump was running");
+    return feedForward.learn(0.0f, setpoint, setpoint, now);
+}
+
+void test_output_is_the_heat_load() {
+    FlowFeedForward feedForward;
+    // 2 ml/s heated from 25 °C to 93 °C takes 569 W of the 1200 W element
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f * 4.186f * 68.0f / 1200.0f, feedForward.getOutput(2.0f, 93.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, feedForward.getOutput(0.0f, 93.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, feedForward.getOutput(2.0f, 20.0f));
+    feedForward.setGain(0.5f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.5f * 2.0f * 4.186f * 68.0f / 1200.0f, feedForward.getOutput(2.0f, 93.0f));
+}
+
+void test_sag_raises_the_gain() {
+    FlowFeedForward feedForward;
+    unsigned long now = 1000;
+    TEST_ASSERT_TRUE(runShot(feedForward, now, 25000, 2.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 2.0f, feedForward.getLastShotError());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, FLOW_FF_DEFAULT_GAIN + FLOW_FF_LEARNING_RATE * 2.0f, feedForward.getGain());
+}
+
+void test_overshoot_lowers_the_gain() {
+    FlowFeedForward feedForward;
+    unsigned long now = 1000;
+    TEST_ASSERT_TRUE(runShot(feedForward, now, 25000, -1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, FLOW_FF_DEFAULT_GAIN - FLOW_FF_LEARNING_RATE, feedForward.getGain());
+}
+
+void test_short_shot_is_ignored() {
+    FlowFeedForward feedForward;
+    unsigned long now = 1000;
+    TEST_ASSERT_FALSE(runShot(feedForward, now, FLOW_FF_MIN_SHOT_MS - 1000, 5.0f));
+    TEST_ASSERT_EQUAL_FLOAT(FLOW_FF_DEFAULT_GAIN, feedForward.getGain());
+}
+
+void test_setpoint_change_during_the_shot_is_ignored() {
+    FlowFeedForward feedForward;
+    unsigned long now = 1000;
+    for (int i = 0; i < 100; i++) {
+        feedForward.learn(2.0f, i < 50 ? 93.0f : 90.0f, 91.0f, now);
+        now += HEATER_INTERVAL_MS;
+    }
+    TEST_ASSERT_FALSE(feedForward.learn(0.0f, 90.0f, 90.0f, now));
+    TEST_ASSERT_EQUAL_FLOAT(FLOW_FF_DEFAULT_GAIN, feedForward.getGain());
+    // The next shot starts clean
+    TEST_ASSERT_TRUE(runShot(feedForward, now, 25000, 1.0f, 90.0f));
+}
+
+void test_gain_is_clamped() {
+    FlowFeedForward feedForward(5.0f);
+    TEST_ASSERT_EQUAL_FLOAT(FLOW_FF_MAX_GAIN, feedForward.getGain());
+    unsigned long now = 1000;
+    runShot(feedForward, now, 25000, 10.0f);
+    TEST_ASSERT_EQUAL_FLOAT(FLOW_FF_MAX_GAIN, feedForward.getGain());
+    feedForward.setGain(0.1f);
+    runShot(feedForward, now, 25000, -10.0f);
+    TEST_ASSERT_EQUAL_FLOAT(FLOW_FF_MIN_GAIN, feedForward.getGain());
+}
+
+void test_gain_converges_over_shots() {
+    // The mean sag of a shot is proportional to the heat load that is not compensated, a boiler needing 1.3 times
+    // the theoretical load settles there
+    constexpr float REQUIRED_GAIN = 1.3f;
+    constexpr float SAG_PER_GAIN = 4.0f; // °C
+    FlowFeedForward feedForward(0.0f);
+    unsigned long now = 1000;
+    for (int shot = 0; shot < 40; shot++) {
+        TEST_ASSERT_TRUE(runShot(feedForward, now, 30000, SAG_PER_GAIN * (REQUIRED_GAIN - feedForward.getGain())));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, REQUIRED_GAIN, feedForward.getGain());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_output_is_the_heat_load);
+    RUN_TEST(test_sag_raises_the_gain);
+    RUN_TEST(test_overshoot_lowers_the_gain);
+    RUN_TEST(test_short_shot_is_ignored);
+    RUN_TEST(test_setpoint_change_during_the_shot_is_ignored);
+    RUN_TEST(test_gain_is_clamped);
+    RUN_TEST(test_gain_converges_over_shots);
+    return UNITY_END();
+}
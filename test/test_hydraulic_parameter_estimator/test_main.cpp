@@ -0,0 +1,82 @@
+// HydraulicParameterEstimator puck conductance convergence, run with: pio test -e native -f test_hydraulic_parameter_estimator
+
+#include <HydraulicParameterEstimator/HydraulicParameterEstimator.h>
+#include <cmath>
+#include <random>
+#include <unity.h>
+
+constexpr float DT = 0.03f;
+// Puck flow of 0.7 ml/s per sqrt(bar), about 2 ml/s at 9 bar
+constexpr float PUCK_CONDUCTANCE = 0.7e-6f;
+
+void setUp() {}
+void tearDown() {}
+
+// Compliance of the estimator model, the flows are in m^3/s
+struct Puck {
+    float pressure = 0.0f;
+
+    void step(float pumpFlow) {
+        const float puckFlow = PUCK_CONDUCTANCE * sqrtf(fmax(pressure, 0.0f));
+        pressure = fmax(pressure + (pumpFlow - puckFlow) * DT / 1e-6f, 0.0f);
+    }
+};
+
+// Pump flow swinging around the puck flow at 9 bar so the pressure is excited
+static float pumpFlow(int k) { return 2.1e-6f + 0.5e-6f * sinf(2.0f * static_cast<float>(M_PI) * 0.5f * k * DT); }
+
+void test_not_pressurized_is_ignored() {
+    HydraulicParameterEstimator estimator(DT);
+    estimator.reset();
+    TEST_ASSERT_FALSE(estimator.update(5e-6f, 0.1f));
+    TEST_ASSERT_FALSE(estimator.hasConverged());
+}
+
+void test_conductance_converges() {
+    HydraulicParameterEstimator estimator(DT);
+    estimator.reset();
+    Puck puck;
+    bool converged = false;
+    for (int k = 0; k < 2000; k++) {
+        puck.step(pumpFlow(k));
+        estimator.update(pumpFlow(k), puck.pressure);
+        converged = converged || estimator.hasConverged();
+    }
+    TEST_ASSERT_TRUE(converged);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f * PUCK_CONDUCTANCE, PUCK_CONDUCTANCE, estimator.getResistance());
+}
+
+void test_conductance_converges_with_sensor_noise() {
+    HydraulicParameterEstimator estimator(DT);
+    estimator.reset();
+    Puck puck;
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    for (int k = 0; k < 2000; k++) {
+        puck.step(pumpFlow(k));
+        estimator.update(pumpFlow(k), puck.pressure + noise(rng));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.1f * PUCK_CONDUCTANCE, PUCK_CONDUCTANCE, estimator.getResistance());
+}
+
+void test_reset_restarts_the_estimation() {
+    HydraulicParameterEstimator estimator(DT);
+    estimator.reset();
+    Puck puck;
+    for (int k = 0; k < 2000; k++) {
+        puck.step(pumpFlow(k));
+        estimator.update(pumpFlow(k), puck.pressure);
+    }
+    estimator.reset();
+    TEST_ASSERT_FALSE(estimator.hasConverged());
+    TEST_ASSERT_EQUAL_FLOAT(estimator.K_est_init, estimator.getResistance());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_not_pressurized_is_ignored);
+    RUN_TEST(test_conductance_converges);
+    RUN_TEST(test_conductance_converges_with_sensor_noise);
+    RUN_TEST(test_reset_restarts_the_estimation);
+    return UNITY_END();
+}
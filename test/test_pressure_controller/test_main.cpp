@@ -0,0 +1,101 @@
+// PressureController convergence on a fixed hydraulic plant, run with: pio test -e native -f test_pressure_controller
+
+#include <PressureController/PressureController.h>
+#include <algorithm>
+#include <cmath>
+#include <unity.h>
+
+constexpr float DT = 0.03f;
+
+static float pressureSetpoint, flowSetpoint, pressure, output;
+static int valve;
+
+void setUp() {
+    pressureSetpoint = 9.0f;
+    flowSetpoint = 0.0f;
+    pressure = 0.0f;
+    output = 0.0f;
+    valve = 1;
+}
+
+void tearDown() {}
+
+// Pump matching the default flow model into a compliant group head and a puck, flows in ml/s
+struct HydraulicPlant {
+    static constexpr float COMPLIANCE = 0.66f; // ml/bar
+    float pressure = 0.0f;
+
+    float step(float power) {
+        const float pumpFlow = power / 100.0f * std::max(10.8f - 0.59f * pressure, 0.0f);
+        const float puckFlow = 0.7f * sqrtf(std::max(pressure, 0.0f));
+        pressure = std::max(pressure + (pumpFlow - puckFlow) * DT / COMPLIANCE, 0.0f);
+        return pressure;
+    }
+};
+
+// Runs the loop for a number of seconds and returns the peak pressure, the output has to stay within the pump power range
+static float run(PressureController &controller, HydraulicPlant &plant, float seconds) {
+    float peak = 0.0f;
+    for (int k = 0; k < static_cast<int>(seconds / DT); k++) {
+        controller.update(PressureController::ControlMode::PRESSURE);
+        TEST_ASSERT_TRUE_MESSAGE(output >= 0.0f && output <= 100.0f, "output out of the pump range");
+        pressure = plant.step(output);
+        peak = std::max(peak, pressure);
+    }
+    return peak;
+}
+
+void test_full_power_until_pressurized() {
+    PressureController controller(DT, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+    controller.update(PressureController::ControlMode::PRESSURE);
+    TEST_ASSERT_EQUAL_FLOAT(100.0f, output);
+}
+
+void test_zero_setpoint_stops_the_pump() {
+    PressureController controller(DT, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+    HydraulicPlant plant;
+    run(controller, plant, 5.0f);
+    pressureSetpoint = 0.0f;
+    controller.update(PressureController::ControlMode::PRESSURE);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, output);
+}
+
+void test_converges_to_the_setpoint() {
+    PressureController controller(DT, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+    HydraulicPlant plant;
+    const float peak = run(controller, plant, 10.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 9.0f, controller.getFilteredPressure());
+    TEST_ASSERT_TRUE_MESSAGE(peak < 9.5f, "overshoot while pressurizing");
+    // And stays there
+    run(controller, plant, 5.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 9.0f, controller.getFilteredPressure());
+}
+
+void test_follows_a_setpoint_step() {
+    PressureController controller(DT, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+    HydraulicPlant plant;
+    run(controller, plant, 10.0f);
+    pressureSetpoint = 6.0f;
+    run(controller, plant, 10.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 6.0f, controller.getFilteredPressure());
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 6.0f, controller.getFilteredSetpoint());
+}
+
+void test_puck_flow_is_estimated() {
+    PressureController controller(DT, &pressureSetpoint, &flowSetpoint, &pressure, &output, &valve);
+    HydraulicPlant plant;
+    run(controller, plant, 15.0f);
+    // 0.7 ml/s per sqrt(bar) at 9 bar
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 0.7f * 3.0f, controller.getCoffeeFlowRate());
+    TEST_ASSERT_TRUE(controller.getcoffeeOutputEstimate() > 0.0f);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_power_until_pressurized);
+    RUN_TEST(test_zero_setpoint_stops_the_pump);
+    RUN_TEST(test_converges_to_the_setpoint);
+    RUN_TEST(test_follows_a_setpoint_step);
+    RUN_TEST(test_puck_flow_is_estimated);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+// PumpFlowCalibrator fit of a synthetic pump curve, run with: pio test -e native -f test_pump_flow_calibrator
+
+#include <cmath>
+#include <display/core/PumpFlowCalibrator.h>
+#include <random>
+#include <unity.h>
+
+// Synthetic pump, the cubic and quadratic terms are known to the calibrator, the affine part is fitted
+constexpr float PUMP_A = 0.0004f;
+constexpr float PUMP_B = -0.012f;
+constexpr float PUMP_C = -0.42f;
+constexpr float PUMP_D = 9.4f;
+
+void setUp() {}
+void tearDown() {}
+
+static float pumpFlow(float pressure, float duty) {
+    return duty * (PUMP_A * pressure * pressure * pressure + PUMP_B * pressure * pressure + PUMP_C * pressure + PUMP_D);
+}
+
+// Steady windows of an extraction, pressure between 6 and 9.5 bar at 30 to 90 % power, flow with scale noise
+struct ShotSamples {
+    std::mt19937 rng{1};
+    std::uniform_real_distribution<float> pressure{6.0f, 9.5f};
+    std::uniform_real_distribution<float> duty{0.3f, 0.9f};
+    std::normal_distribution<float> noise{0.0f, 0.1f};
+
+    void feed(PumpFlowCalibrator &calibrator, int count) {
+        for (int i = 0; i < count; i++) {
+            const float p = pressure(rng);
+            const float u = duty(rng);
+            calibrator.update(p, u, pumpFlow(p, u) + noise(rng));
+        }
+    }
+};
+
+// Starts from the default two point model (10.205 ml/s at 1 bar, 5.521 ml/s at 9 bar)
+static void resetToDefault(PumpFlowCalibrator &calibrator) {
+    const float c = (5.521f - 10.205f) / 8.0f;
+    calibrator.reset(PUMP_A, PUMP_B, c, 10.205f - c);
+}
+
+void test_coefficients_converge() {
+    PumpFlowCalibrator calibrator;
+    resetToDefault(calibrator);
+    ShotSamples shots;
+    shots.feed(calibrator, 400);
+    TEST_ASSERT_FLOAT_WITHIN(0.03f, PUMP_C, calibrator.getC());
+    TEST_ASSERT_FLOAT_WITHIN(0.25f, PUMP_D, calibrator.getD());
+    for (float p = 6.0f; p <= 9.5f; p += 0.5f) {
+        TEST_ASSERT_FLOAT_WITHIN(0.05f, pumpFlow(p, 1.0f), calibrator.getFlow(p));
+    }
+    TEST_ASSERT_EQUAL_INT(400, calibrator.getSampleCount());
+}
+
+void test_confidence_rises_with_samples() {
+    PumpFlowCalibrator calibrator;
+    resetToDefault(calibrator);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, calibrator.getConfidence());
+    ShotSamples shots;
+    float previous = 0.0f;
+    for (int i = 0; i < 8; i++) {
+        shots.feed(calibrator, 25);
+        TEST_ASSERT_TRUE_MESSAGE(calibrator.getConfidence() >= previous, "confidence dropped while learning");
+        previous = calibrator.getConfidence();
+    }
+    TEST_ASSERT_TRUE(previous > 0.8f);
+    TEST_ASSERT_TRUE(calibrator.getFlowStdDev(PUMP_CALIBRATION_REFERENCE_PRESSURE) < PUMP_CALIBRATION_TARGET_STDDEV / 0.8f);
+}
+
+void test_confidence_gate() {
+    PumpFlowCalibrator calibrator;
+    resetToDefault(calibrator);
+    TEST_ASSERT_FALSE(calibrator.isConfident());
+    // A few samples from one shot are not enough to replace the configured model
+    ShotSamples shots;
+    shots.feed(calibrator, 5);
+    TEST_ASSERT_TRUE(calibrator.getConfidence() < PUMP_CALIBRATION_APPLY_CONFIDENCE);
+    TEST_ASSERT_FALSE(calibrator.isConfident());
+    int samples = 5;
+    while (!calibrator.isConfident() && samples < 1000) {
+        shots.feed(calibrator, 1);
+        samples++;
+    }
+    TEST_ASSERT_TRUE(calibrator.isConfident());
+    TEST_ASSERT_TRUE(calibrator.getConfidence() >= PUMP_CALIBRATION_APPLY_CONFIDENCE);
+    // The reported uncertainty has to hold for the model it lets through
+    const float stdDev = calibrator.getFlowStdDev(PUMP_CALIBRATION_REFERENCE_PRESSURE);
+    TEST_ASSERT_FLOAT_WITHIN(2.0f * stdDev, pumpFlow(9.0f, 1.0f), calibrator.getFlow(9.0f));
+}
+
+void test_noisy_scale_is_not_trusted() {
+    // Twenty times the flow noise has to keep the calibration below the gate
+    PumpFlowCalibrator calibrator;
+    resetToDefault(calibrator);
+    ShotSamples shots;
+    shots.noise = std::normal_distribution<float>(0.0f, 2.0f);
+    shots.feed(calibrator, 400);
+    TEST_ASSERT_FALSE(calibrator.isConfident());
+}
+
+void test_state_round_trip() {
+    PumpFlowCalibrator calibrator;
+    resetToDefault(calibrator);
+    ShotSamples shots;
+    shots.feed(calibrator, 100);
+    PumpFlowCalibrator restored;
+    restored.setState(PUMP_A, PUMP_B, calibrator.getState());
+    TEST_ASSERT_EQUAL_FLOAT(calibrator.getC(), restored.getC());
+    TEST_ASSERT_EQUAL_FLOAT(calibrator.getD(), restored.getD());
+    TEST_ASSERT_EQUAL_FLOAT(calibrator.getConfidence(), restored.getConfidence());
+    TEST_ASSERT_EQUAL_INT(calibrator.getSampleCount(), restored.getSampleCount());
+    // Both continue the same way
+    calibrator.update(9.0f, 0.5f, 2.0f);
+    restored.update(9.0f, 0.5f, 2.0f);
+    TEST_ASSERT_EQUAL_FLOAT(calibrator.getD(), restored.getD());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_coefficients_converge);
+    RUN_TEST(test_confidence_rises_with_samples);
+    RUN_TEST(test_confidence_gate);
+    RUN_TEST(test_noisy_scale_is_not_trusted);
+    RUN_TEST(test_state_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,114 @@
+// SavGolFilter against known polynomials and a noisy ramp, run with: pio test -e native -f test_savgol_filter
+
+#include <SavGolFilter/SavGolFilter.h>
+#include <cmath>
+#include <random>
+#include <unity.h>
+
+constexpr float DT = 0.03f;
+
+void setUp() {}
+void tearDown() {}
+
+// y = a + b t + c t^2, a quadratic is fitted exactly by every window size
+static float quadratic(float t) { return 2.0f + 1.5f * t - 4.0f * t * t; }
+static float quadraticSlope(float t) { return 1.5f - 8.0f * t; }
+
+template <size_t N> static void checkQuadratic() {
+    SavGolFilter<N> filter;
+    constexpr int HALF = SavGolFilter<N>::HALF_WINDOW;
+    for (int k = 0; k < 40; k++) {
+        const bool ready = filter.push(quadratic(k * DT));
+        TEST_ASSERT_EQUAL(k + 1 >= static_cast<int>(N), ready);
+        if (!ready) {
+            continue;
+        }
+        const float centre = (k - HALF) * DT;
+        const float newest = k * DT;
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, quadratic(centre), filter.getValue());
+        TEST_ASSERT_FLOAT_WITHIN(1e-2f, quadraticSlope(centre), filter.getDerivative(DT));
+        TEST_ASSERT_FLOAT_WITHIN(1e-2f, quadraticSlope(newest), filter.getEndDerivative(DT));
+    }
+}
+
+void test_quadratic_is_reproduced_window_5() { checkQuadratic<5>(); }
+void test_quadratic_is_reproduced_window_9() { checkQuadratic<9>(); }
+
+void test_coefficient_sums() {
+    // Weights of a constant signal: 1 for the value, 0 for both slopes
+    float smoothing = 0.0f, derivative = 0.0f, endDerivative = 0.0f;
+    for (int i = -3; i <= 3; i++) {
+        smoothing += SavGolFilter<7>::smoothingCoefficient(i);
+        derivative += SavGolFilter<7>::derivativeCoefficient(i);
+        endDerivative += SavGolFilter<7>::endDerivativeCoefficient(i);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, smoothing);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, derivative);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, endDerivative);
+    // Published 5 point quadratic weights
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, -3.0f / 35.0f, SavGolFilter<5>::smoothingCoefficient(-2));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 17.0f / 35.0f, SavGolFilter<5>::smoothingCoefficient(0));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 27.0f / 35.0f, SavGolFilter<5>::endDerivativeCoefficient(2));
+}
+
+void test_reset_empties_the_window() {
+    SavGolFilter<5> filter;
+    for (int k = 0; k < 5; k++) {
+        filter.push(100.0f);
+    }
+    TEST_ASSERT_TRUE(filter.isReady());
+    filter.reset();
+    TEST_ASSERT_FALSE(filter.isReady());
+    for (int k = 0; k < 5; k++) {
+        filter.push(1.0f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, filter.getValue());
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, filter.getDerivative(DT));
+}
+
+void test_noise_is_attenuated() {
+    // Pressure ramp of 3 bar/s with 0.05 bar sensor noise, the outputs must stay within the white noise gain of the
+    // coefficients (sqrt of the summed squares) plus a margin for the finite sample
+    constexpr float SIGMA = 0.05f;
+    constexpr float RAMP = 3.0f;
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, SIGMA);
+    SavGolFilter<5> filter;
+    float valueGain = 0.0f, slopeGain = 0.0f, endSlopeGain = 0.0f;
+    for (int i = -2; i <= 2; i++) {
+        valueGain += powf(SavGolFilter<5>::smoothingCoefficient(i), 2);
+        slopeGain += powf(SavGolFilter<5>::derivativeCoefficient(i), 2);
+        endSlopeGain += powf(SavGolFilter<5>::endDerivativeCoefficient(i), 2);
+    }
+    double valueError = 0.0, slopeError = 0.0, endSlopeError = 0.0;
+    int samples = 0;
+    for (int k = 0; k < 2000; k++) {
+        if (!filter.push(RAMP * k * DT + noise(rng))) {
+            continue;
+        }
+        valueError += pow(filter.getValue() - RAMP * (k - 2) * DT, 2);
+        slopeError += pow(filter.getDerivative(DT) - RAMP, 2);
+        endSlopeError += pow(filter.getEndDerivative(DT) - RAMP, 2);
+        samples++;
+    }
+    const float valueRms = sqrtf(static_cast<float>(valueError / samples));
+    const float slopeRms = sqrtf(static_cast<float>(slopeError / samples));
+    const float endSlopeRms = sqrtf(static_cast<float>(endSlopeError / samples));
+    TEST_ASSERT_TRUE_MESSAGE(valueRms < SIGMA, "smoothing must reduce the noise");
+    TEST_ASSERT_TRUE(valueRms < 1.1f * SIGMA * sqrtf(valueGain));
+    TEST_ASSERT_TRUE(slopeRms < 1.1f * SIGMA * sqrtf(slopeGain) / DT);
+    TEST_ASSERT_TRUE(endSlopeRms < 1.1f * SIGMA * sqrtf(endSlopeGain) / DT);
+    // A first difference has a noise gain of sqrt(2) / DT
+    TEST_ASSERT_TRUE(slopeRms < SIGMA * sqrtf(2.0f) / DT);
+    TEST_ASSERT_TRUE(endSlopeRms < SIGMA * sqrtf(2.0f) / DT);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_quadratic_is_reproduced_window_5);
+    RUN_TEST(test_quadratic_is_reproduced_window_9);
+    RUN_TEST(test_coefficient_sums);
+    RUN_TEST(test_reset_empties_the_window);
+    RUN_TEST(test_noise_is_attenuated);
+    return UNITY_END();
+}
@@ -0,0 +1,81 @@
+// SimpleKalmanFilter steady state gain and noise reduction, run with: pio test -e native -f test_simple_kalman_filter
+
+#include <SimpleKalmanFilter/SimpleKalmanFilter.h>
+#include <cmath>
+#include <random>
+#include <unity.h>
+
+// Same tuning as the pressure controller at its 30 ms step
+constexpr float MEASUREMENT_ERROR = 0.1f;
+constexpr float PROCESS_NOISE = (4 * 0.03f) * (4 * 0.03f);
+
+void setUp() {}
+void tearDown() {}
+
+// Fixed point of the covariance recursion: P = (P + q) * R / (P + q + R), solved for P + q
+static float steadyStateGain(float r, float q) {
+    const float predicted = (q + sqrtf(q * q + 4.0f * q * r)) / 2.0f;
+    return predicted / (predicted + r);
+}
+
+void test_gain_converges_to_the_steady_state() {
+    SimpleKalmanFilter filter(MEASUREMENT_ERROR, 10.0f, PROCESS_NOISE);
+    for (int i = 0; i < 200; i++) {
+        filter.updateEstimate(9.0f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, steadyStateGain(MEASUREMENT_ERROR, PROCESS_NOISE), filter.getKalmanGain());
+}
+
+void test_estimate_converges_to_a_constant_measurement() {
+    SimpleKalmanFilter filter(MEASUREMENT_ERROR, 10.0f, PROCESS_NOISE);
+    // A large initial covariance trusts the first measurement almost completely
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 9.0f, filter.updateEstimate(9.0f));
+    filter.updateEstimate(6.0f);
+    for (int i = 0; i < 100; i++) {
+        filter.updateEstimate(6.0f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 6.0f, filter.getCurrentEstimate());
+}
+
+void test_noise_is_reduced_as_predicted() {
+    // At steady state the filter is a first order low pass, white noise variance is scaled by K / (2 - K)
+    constexpr float SIGMA = 0.1f;
+    SimpleKalmanFilter filter(MEASUREMENT_ERROR, 10.0f, PROCESS_NOISE);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, SIGMA);
+    for (int i = 0; i < 200; i++) {
+        filter.updateEstimate(9.0f + noise(rng));
+    }
+    double sum = 0.0;
+    constexpr int SAMPLES = 20000;
+    for (int i = 0; i < SAMPLES; i++) {
+        sum += pow(filter.updateEstimate(9.0f + noise(rng)) - 9.0f, 2);
+    }
+    const float gain = steadyStateGain(MEASUREMENT_ERROR, PROCESS_NOISE);
+    const float expected = SIGMA * sqrtf(gain / (2.0f - gain));
+    TEST_ASSERT_FLOAT_WITHIN(0.1f * expected, expected, sqrtf(static_cast<float>(sum / SAMPLES)));
+}
+
+void test_setters_change_the_gain() {
+    SimpleKalmanFilter filter(MEASUREMENT_ERROR, 10.0f, PROCESS_NOISE);
+    for (int i = 0; i < 200; i++) {
+        filter.updateEstimate(9.0f);
+    }
+    const float gain = filter.getKalmanGain();
+    // Trusting the measurement more makes the filter faster
+    filter.setMeasurementError(MEASUREMENT_ERROR / 10.0f);
+    for (int i = 0; i < 200; i++) {
+        filter.updateEstimate(9.0f);
+    }
+    TEST_ASSERT_TRUE(filter.getKalmanGain() > gain);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, steadyStateGain(MEASUREMENT_ERROR / 10.0f, PROCESS_NOISE), filter.getKalmanGain());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_gain_converges_to_the_steady_state);
+    RUN_TEST(test_estimate_converges_to_a_constant_measurement);
+    RUN_TEST(test_noise_is_reduced_as_predicted);
+    RUN_TEST(test_setters_change_the_gain);
+    return UNITY_END();
+}
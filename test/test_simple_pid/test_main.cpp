@@ -0,0 +1,126 @@
+// SimplePID output sign, saturation, anti-windup and closed loop behaviour, run with: pio test -e native -f test_simple_pid
+
+#include <Clock/Clock.h>
+#include <SimplePID/SimplePID.h>
+#include <unity.h>
+
+static VirtualClock virtualClock;
+static float output, temperature, setpoint;
+
+void setUp() {
+    virtualClock.setMillis(0);
+    Clock::set(&virtualClock);
+    output = 0.0f;
+    temperature = 90.0f;
+    setpoint = 93.0f;
+}
+
+void tearDown() { Clock::set(nullptr); }
+
+static void configure(SimplePID &pid, float Kp, float Ki, float Kd, float minOutput, float maxOutput) {
+    pid.setControllerPIDGains(Kp, Ki, Kd, 0.0f);
+    pid.setSamplingFrequency(1.0f);
+    pid.setCtrlOutputLimits(minOutput, maxOutput);
+    pid.activateSetPointFilter(false);
+    pid.setMode(SimplePID::Control::automatic);
+}
+
+// Updates once per sampling period (1 s)
+static bool step(SimplePID &pid) {
+    virtualClock.advanceMillis(1000);
+    return pid.update();
+}
+
+void test_output_follows_the_error_sign() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 10.0f, 0.0f, 0.0f, -1000.0f, 1000.0f);
+    TEST_ASSERT_TRUE(step(pid));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 30.0f, output);
+
+    temperature = 95.0f;
+    TEST_ASSERT_TRUE(step(pid));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, -20.0f, output);
+}
+
+void test_output_is_saturated() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 1000.0f, 0.0f, 0.0f, 0.0f, 1000.0f);
+    temperature = 20.0f;
+    step(pid);
+    TEST_ASSERT_EQUAL_FLOAT(1000.0f, output);
+
+    temperature = 120.0f;
+    step(pid);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, output);
+}
+
+void test_integral_does_not_wind_up_while_saturated() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 10.0f, 1.0f, 0.0f, 0.0f, 100.0f);
+    // Far below the setpoint for a long time, the output is pinned at the upper limit
+    temperature = 20.0f;
+    for (int i = 0; i < 600; i++) {
+        step(pid);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(100.0f, output);
+    // Once the setpoint is overshot the heater has to switch off right away instead of unwinding the integral
+    temperature = 94.0f;
+    step(pid);
+    TEST_ASSERT_TRUE_MESSAGE(output < 100.0f, "integral wound up during saturation");
+    temperature = 96.0f;
+    step(pid);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, output);
+}
+
+void test_updates_only_once_per_sampling_period() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 10.0f, 0.0f, 0.0f, -1000.0f, 1000.0f);
+    TEST_ASSERT_TRUE(step(pid));
+    virtualClock.advanceMillis(500);
+    TEST_ASSERT_FALSE(pid.update());
+    virtualClock.advanceMillis(500);
+    TEST_ASSERT_TRUE(pid.update());
+}
+
+void test_manual_mode_does_not_update() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 10.0f, 0.0f, 0.0f, -1000.0f, 1000.0f);
+    pid.setManualOutput(0.0f);
+    output = 42.0f;
+    TEST_ASSERT_FALSE(step(pid));
+    TEST_ASSERT_EQUAL_FLOAT(42.0f, output);
+}
+
+void test_disturbance_feedforward_is_added() {
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 10.0f, 0.0f, 0.0f, -1000.0f, 1000.0f);
+    pid.setDisturbanceFeedForward(50.0f);
+    step(pid);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 80.0f, output);
+}
+
+void test_closed_loop_reaches_the_setpoint() {
+    // Boiler as a first order lag, 1 °C per percent of power above ambient and a 120 s time constant
+    SimplePID pid(&output, &temperature, &setpoint);
+    configure(pid, 20.0f, 0.5f, 0.0f, 0.0f, 1000.0f);
+    temperature = 25.0f;
+    for (int i = 0; i < 1800; i++) {
+        step(pid);
+        temperature += (25.0f + output / 10.0f - temperature) / 120.0f;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, setpoint, temperature);
+    // Holding 93 °C needs 68 % in this plant
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, 680.0f, output);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_output_follows_the_error_sign);
+    RUN_TEST(test_output_is_saturated);
+    RUN_TEST(test_integral_does_not_wind_up_while_saturated);
+    RUN_TEST(test_updates_only_once_per_sampling_period);
+    RUN_TEST(test_manual_mode_does_not_update);
+    RUN_TEST(test_disturbance_feedforward_is_added);
+    RUN_TEST(test_closed_loop_reaches_the_setpoint);
+    return UNITY_END();
+}
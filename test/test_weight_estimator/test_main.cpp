@@ -0,0 +1,169 @@
+// WeightEstimator tracking of scale readings and latency estimation, run with: pio test -e native -f test_weight_estimator
+
+#include <Clock/Clock.h>
+#include <algorithm>
+#include <cmath>
+#include <display/core/WeightEstimator.h>
+#include <unity.h>
+
+constexpr unsigned long SCALE_INTERVAL_MS = 100;
+constexpr unsigned long START_MS = 10000;
+
+static VirtualClock virtualClock;
+
+void setUp() {
+    virtualClock.setMillis(START_MS);
+    Clock::set(&virtualClock);
+}
+
+void tearDown() { Clock::set(nullptr); }
+
+static float elapsedSeconds() { return static_cast<float>(virtualClock.millis() - START_MS) / 1000.0f; }
+
+// Scale readings at 10 Hz of a cup filling at a constant flow, each reading is lagMs old when it arrives
+static void feedRamp(WeightEstimator &estimator, float flow, unsigned long durationMs, float lagMs) {
+    for (unsigned long t = 0; t < durationMs; t += SCALE_INTERVAL_MS) {
+        virtualClock.advanceMillis(SCALE_INTERVAL_MS);
+        estimator.addMeasurement(flow * std::max(elapsedSeconds() - lagMs / 1000.0f, 0.0f));
+    }
+}
+
+// Puck flow of a shot starting at START_MS, ramps up, holds and declines so the lag is observable
+static float shotFlow(float t) {
+    if (t < 5.0f) {
+        return 0.5f * t;
+    }
+    if (t < 15.0f) {
+        return 2.5f;
+    }
+    return std::max(2.5f - 0.25f * (t - 15.0f), 0.5f);
+}
+
+static float shotVolume(float t, float (*flow)(float)) {
+    float volume = 0.0f;
+    for (float s = 0.0f; s < t; s += 0.001f) {
+        volume += flow(s) * 0.001f;
+    }
+    return volume;
+}
+
+// Records a 30 s shot, the scale reports the volume lagMs late with its 0.1 g resolution
+static void recordShot(WeightEstimator &estimator, float (*flow)(float), float lagMs) {
+    estimator.startShot();
+    for (unsigned long t = 0; t < 30000; t += SCALE_INTERVAL_MS) {
+        virtualClock.advanceMillis(SCALE_INTERVAL_MS);
+        const float now = elapsedSeconds();
+        estimator.addReferenceFlow(flow(now));
+        const float weight = shotVolume(std::max(now - lagMs / 1000.0f, 0.0f), flow);
+        estimator.addMeasurement(std::round(weight * 10.0f) / 10.0f);
+    }
+    estimator.endShot();
+}
+
+void test_flow_converges_on_ramp() {
+    WeightEstimator estimator;
+    estimator.setLatency(0.0f);
+    TEST_ASSERT_FALSE(estimator.hasEstimate());
+    feedRamp(estimator, 2.0f, 5000, 0.0f);
+    TEST_ASSERT_TRUE(estimator.hasEstimate());
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f, estimator.getFlow());
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f * elapsedSeconds(), estimator.getWeight());
+    // Between readings the weight keeps moving with the flow
+    virtualClock.advanceMillis(50);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f * elapsedSeconds(), estimator.getWeight());
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2.0f * elapsedSeconds() + 2.0f, estimator.predictWeight(1000.0));
+}
+
+void test_latency_is_compensated() {
+    // Readings 300 ms old put the last one 0.6 g behind the cup
+    WeightEstimator estimator;
+    estimator.setLatency(300.0f);
+    feedRamp(estimator, 2.0f, 5000, 300.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f * elapsedSeconds(), estimator.getWeight());
+
+    WeightEstimator uncompensated;
+    uncompensated.setLatency(0.0f);
+    virtualClock.setMillis(START_MS);
+    feedRamp(uncompensated, 2.0f, 5000, 300.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f * elapsedSeconds() - 0.6f, uncompensated.getWeight());
+}
+
+void test_latency_is_clamped() {
+    WeightEstimator estimator;
+    TEST_ASSERT_EQUAL_FLOAT(WEIGHT_DEFAULT_LATENCY_MS, estimator.getLatency());
+    estimator.setLatency(5000.0f);
+    TEST_ASSERT_EQUAL_FLOAT(WEIGHT_MAX_LATENCY_MS, estimator.getLatency());
+    estimator.setLatency(-10.0f);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.getLatency());
+}
+
+void test_tare_jump_resets() {
+    WeightEstimator estimator;
+    estimator.setLatency(0.0f);
+    feedRamp(estimator, 2.0f, 10000, 0.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2.0f, estimator.getFlow());
+    // Tared to zero, the filter must not treat the step as flow
+    virtualClock.advanceMillis(SCALE_INTERVAL_MS);
+    estimator.addMeasurement(0.0f);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.getWeight());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.getFlow());
+}
+
+void test_stale_readings_restart() {
+    WeightEstimator estimator;
+    estimator.setLatency(0.0f);
+    feedRamp(estimator, 2.0f, 5000, 0.0f);
+    TEST_ASSERT_TRUE(estimator.hasEstimate());
+    virtualClock.advanceMillis(WEIGHT_STALE_MS + 1);
+    TEST_ASSERT_FALSE(estimator.hasEstimate());
+    // The extrapolation stops after WEIGHT_MAX_EXTRAPOLATION_S instead of running on with the flow
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2.0f * (5.0f + WEIGHT_MAX_EXTRAPOLATION_S), estimator.getWeight());
+    // Even a reading matching the extrapolation starts over without the old flow after the gap
+    estimator.addMeasurement(12.0f);
+    TEST_ASSERT_TRUE(estimator.hasEstimate());
+    TEST_ASSERT_EQUAL_FLOAT(12.0f, estimator.getWeight());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.getFlow());
+
+    estimator.reset();
+    TEST_ASSERT_FALSE(estimator.hasEstimate());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.getWeight());
+}
+
+void test_estimate_latency_recovers_lag() {
+    WeightEstimator estimator;
+    recordShot(estimator, shotFlow, 400.0f);
+    float latency = 0.0f;
+    TEST_ASSERT_TRUE(estimator.estimateLatency(latency));
+    TEST_ASSERT_FLOAT_WITHIN(WEIGHT_LATENCY_STEP_MS, 400.0f, latency);
+}
+
+void test_estimate_latency_rejects_constant_flow() {
+    // A constant flow fits every lag equally well
+    WeightEstimator estimator;
+    recordShot(estimator, [](float) { return 2.0f; }, 400.0f);
+    float latency = -1.0f;
+    TEST_ASSERT_FALSE(estimator.estimateLatency(latency));
+    TEST_ASSERT_EQUAL_FLOAT(-1.0f, latency);
+}
+
+void test_estimate_latency_needs_a_shot() {
+    WeightEstimator estimator;
+    float latency = 0.0f;
+    TEST_ASSERT_FALSE(estimator.estimateLatency(latency));
+    // Readings outside startShot and endShot are not recorded
+    feedRamp(estimator, 2.0f, 10000, 0.0f);
+    TEST_ASSERT_FALSE(estimator.estimateLatency(latency));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_flow_converges_on_ramp);
+    RUN_TEST(test_latency_is_compensated);
+    RUN_TEST(test_latency_is_clamped);
+    RUN_TEST(test_tare_jump_resets);
+    RUN_TEST(test_stale_readings_restart);
+    RUN_TEST(test_estimate_latency_recovers_lag);
+    RUN_TEST(test_estimate_latency_rejects_constant_flow);
+    RUN_TEST(test_estimate_latency_needs_a_shot);
+    return UNITY_END();
+}
@@ -10,23 +10,44 @@ export function Autotune() {
   const [result, setResult] = useState(null);
   const [time, setTime] = useState(60);
   const [samples, setSamples] = useState(4);
+  const [method, setMethod] = useState(0);
+  const [progress, setProgress] = useState(0);
+  const [aborted, setAborted] = useState(false);
 
   const onStart = useCallback(() => {
     apiService.send({
       tp: 'req:autotune-start',
       time,
       samples,
+      method,
     });
+    setProgress(0);
+    setAborted(false);
     setActive(true);
-  }, [time, samples, apiService]);
+  }, [time, samples, method, apiService]);
+
+  const onAbort = useCallback(() => {
+    apiService.send({
+      tp: 'req:autotune-abort',
+    });
+  }, [apiService]);
 
   useEffect(() => {
-    const listenerId = apiService.on('evt:autotune-result', msg => {
+    const resultListenerId = apiService.on('evt:autotune-result', msg => {
       setActive(false);
       setResult(msg.pid);
     });
+    const progressListenerId = apiService.on('evt:autotune-progress', msg => {
+      setProgress(msg.progress);
+    });
+    const abortListenerId = apiService.on('evt:autotune-abort', () => {
+      setActive(false);
+      setAborted(true);
+    });
     return () => {
-      apiService.off('evt:autotune-result', listenerId);
+      apiService.off('evt:autotune-result', resultListenerId);
+      apiService.off('evt:autotune-progress', progressListenerId);
+      apiService.off('evt:autotune-abort', abortListenerId);
     };
   }, [apiService]);
 
@@ -48,10 +69,12 @@ export function Autotune() {
                   <Spinner size={8} />
                   <span className='text-lg font-medium'>Autotune in Progress</span>
                 </div>
+                <progress className='progress progress-primary w-56' value={progress} max='100' />
                 <div className='alert alert-warning max-w-md'>
                   <span>
-                    Please wait while the system optimizes your PID settings. This may take up to 30
-                    seconds.
+                    {method === 1
+                      ? 'Please wait while the boiler is cycled around brew temperature. This may take up to 30 minutes.'
+                      : 'Please wait while the system optimizes your PID settings. This may take a few minutes.'}
                   </span>
                 </div>
               </div>
@@ -76,6 +99,11 @@ export function Autotune() {
 
           {!active && !result && (
             <div className='space-y-4'>
+              {aborted && (
+                <div className='alert alert-error'>
+                  <span>The autotune was aborted, your PID values have not been changed.</span>
+                </div>
+              )}
               <div className='alert alert-warning'>
                 <span>
                   Please ensure the boiler temperature is below 50°C before starting the autotune
@@ -84,6 +112,25 @@ export function Autotune() {
               </div>
 
               <div className='grid grid-cols-1 gap-4 sm:grid-cols-2'>
+                <div className='form-control sm:col-span-2'>
+                  <label htmlFor='method' className='mb-2 block text-sm font-medium'>
+                    Method
+                  </label>
+                  <select
+                    id='method'
+                    className='select select-bordered w-full'
+                    value={method}
+                    onChange={e => setMethod(parseInt(e.target.value, 10))}
+                  >
+                    <option value={0}>Step response</option>
+                    <option value={1}>Relay feedback</option>
+                  </select>
+                  <div className='mb-2 text-xs opacity-70'>
+                    Relay feedback oscillates the boiler around brew temperature. It takes longer but
+                    measures the system where it is actually used.
+                  </div>
+                </div>
+
                 <div className='form-control'>
                   <label htmlFor='tuningGoal' className='mb-2 block text-sm font-medium'>
                     Tuning Goal
@@ -140,6 +187,12 @@ export function Autotune() {
             </button>
           )}
 
+          {active && (
+            <button className='btn btn-error' onClick={onAbort}>
+              Abort Autotune
+            </button>
+          )}
+
           {result && (
             <button className='btn btn-outline' onClick={() => setResult(null)}>
               Back to Settings
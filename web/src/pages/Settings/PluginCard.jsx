@@ -227,6 +227,21 @@ export function PluginCard({ formData, onChange }) {
                 onChange={onChange('haTopic')}
               />
             </div>
+            <div className='form-control'>
+              <label htmlFor='haTelemetryInterval' className='mb-2 block text-sm font-medium'>
+                Telemetry Interval (ms, 0 to disable)
+              </label>
+              <input
+                id='haTelemetryInterval'
+                name='haTelemetryInterval'
+                type='number'
+                className='input input-bordered w-full'
+                min='0'
+                max='60000'
+                value={formData.haTelemetryInterval}
+                onChange={onChange('haTelemetryInterval')}
+              />
+            </div>
           </div>
         )}
       </div>